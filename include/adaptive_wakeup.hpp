@@ -0,0 +1,49 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ddprof {
+
+// Computes how long the worker can sleep before one of the ring buffers risks
+// overflowing, based on the fill rate observed between wakeups.
+// Idle rings let the worker sleep up to k_max_timeout, while busy rings bring
+// the timeout down to k_min_timeout. The kernel additionally wakes the worker
+// up when a perf ring buffer is half full.
+class AdaptiveWakeup {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::chrono::milliseconds k_min_timeout{10};
+  static constexpr std::chrono::milliseconds k_max_timeout{1000};
+  // Part of a ring buffer that is allowed to fill up while the worker sleeps
+  static constexpr double k_target_fill_ratio = 0.25;
+
+  explicit AdaptiveWakeup(size_t nb_rings) : _rings(nb_rings) {}
+
+  // Record the writer position of a ring buffer (cumulative bytes written)
+  // Returns true if data was written since the previous observation
+  bool observe(size_t ring_idx, uint64_t writer_pos, size_t ring_size,
+               Clock::time_point now);
+
+  [[nodiscard]] std::chrono::milliseconds timeout() const;
+
+private:
+  struct RingRate {
+    uint64_t writer_pos{};
+    Clock::time_point time{};
+    size_t ring_size{};
+    double bytes_per_ms{}; // smoothed over wakeups
+    bool initialized{false};
+  };
+  std::vector<RingRate> _rings;
+};
+
+} // namespace ddprof
@@ -8,6 +8,7 @@
 #include "dso_hdr.hpp"
 #include "dso_symbol_lookup.hpp"
 #include "symbol_table.hpp"
+#include "table_compaction.hpp"
 
 namespace ddprof {
 class BaseFrameSymbolLookup {
@@ -16,12 +17,19 @@ public:
                             DsoSymbolLookup &dso_symbol_lookup,
                             DsoHdr &dso_hdr);
 
-  // Erase symbol lookup for this pid (warning symbols still exist)
+  // Erase symbol lookup for this pid (symbols are reclaimed by compaction)
   void erase(pid_t pid) {
     _bin_map.erase(pid);
     _pid_map.erase(pid);
   }
 
+  void remap(const TableRemap &symbol_remap) {
+    remap_map_values(_bin_map, symbol_remap);
+    remap_map_values(
+        _pid_map, symbol_remap,
+        [](PidSymbol &el) -> SymbolIdx_t & { return el._symb_idx; });
+  }
+
   std::string_view get_exe_name(pid_t pid) const;
 
 private:
@@ -0,0 +1,57 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace ddprof {
+
+// Bump allocator for short-lived buffers (e.g. per sample temporaries).
+// Allocations are carved out of chunks and deallocation is a no-op.
+// rewind() makes all the memory available again while keeping the chunks, so
+// that a steady state workload does not call malloc. release() frees the
+// chunks beyond the first one.
+class BumpArena : public std::pmr::memory_resource {
+public:
+  static constexpr size_t k_default_chunk_size = 16 * 1024;
+
+  explicit BumpArena(size_t chunk_size = k_default_chunk_size)
+      : _chunk_size(chunk_size) {}
+
+  void rewind() {
+    _current = 0;
+    _offset = 0;
+  }
+  void release();
+
+  [[nodiscard]] size_t nb_chunks() const { return _chunks.size(); }
+
+private:
+  struct Chunk {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void * /*p*/, size_t /*bytes*/,
+                     size_t /*alignment*/) override {}
+  [[nodiscard]] bool
+  do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+  void *carve(size_t bytes, size_t alignment);
+
+  size_t _chunk_size;
+  std::vector<Chunk> _chunks;
+  size_t _current{0}; // chunk allocations are carved from
+  size_t _offset{0};  // first free byte of the current chunk
+};
+
+} // namespace ddprof
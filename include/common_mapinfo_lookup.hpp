@@ -8,6 +8,7 @@
 #include "ddprof_defs.hpp"
 #include "hash_helper.hpp"
 #include "mapinfo_table.hpp"
+#include "table_compaction.hpp"
 
 #include <string>
 #include <unordered_map>
@@ -23,6 +24,10 @@ public:
   SymbolIdx_t get_or_insert(MappingErrors lookup_case,
                             MapInfoTable &mapinfo_table);
 
+  void remap(const TableRemap &mapinfo_remap) {
+    remap_map_values(_map, mapinfo_remap);
+  }
+
 private:
   std::unordered_map<MappingErrors, MapInfoIdx_t> _map;
 };
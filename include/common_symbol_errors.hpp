@@ -14,10 +14,11 @@ using namespace std::string_view_literals;
 
 namespace ddprof {
 
-inline constexpr std::array<std::string_view, 6> k_common_frame_names = {
+inline constexpr std::array<std::string_view, 8> k_common_frame_names = {
     "[truncated]"sv,      "[unknown mapping]"sv,
     "[unwind failure]"sv, "[incomplete]"sv,
-    "[lost]"sv,           "[maximum pids]"sv};
+    "[lost]"sv,           "[maximum pids]"sv,
+    "[overload]"sv,       "[stack scan]"sv};
 
 enum SymbolErrors : std::uint8_t {
   truncated_stack = 0,
@@ -26,6 +27,8 @@ enum SymbolErrors : std::uint8_t {
   incomplete_stack,
   lost_event,
   max_pids,
+  overload,
+  stack_scan, // frames below were found by scanning the stack
 };
 
 } // namespace ddprof
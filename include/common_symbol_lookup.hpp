@@ -8,6 +8,7 @@
 #include "common_symbol_errors.hpp"
 #include "hash_helper.hpp"
 #include "symbol_table.hpp"
+#include "table_compaction.hpp"
 
 #include <unordered_map>
 
@@ -18,6 +19,10 @@ public:
   SymbolIdx_t get_or_insert(SymbolErrors lookup_case,
                             SymbolTable &symbol_table);
 
+  void remap(const TableRemap &symbol_remap) {
+    remap_map_values(_map, symbol_remap);
+  }
+
 private:
   std::unordered_map<SymbolErrors, SymbolIdx_t> _map;
 };
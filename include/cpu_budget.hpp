@@ -0,0 +1,27 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cstdint>
+
+namespace ddprof {
+
+// Sampling periods are expressed as a percentage of the configured periods
+inline constexpr uint32_t k_nominal_period_scale_pct{100};
+// Sample at least 1/64th of the configured rate
+inline constexpr uint32_t k_max_period_scale_pct{64 * 100};
+
+// Compute the sampling period scale that brings the CPU usage of the profiler
+// within max_cpu_percent (of one core), assuming the CPU usage is
+// proportional to the sampling rate.
+// The period is increased when the usage is above the budget, and decreased
+// when the usage falls below 3/4 of the budget, so that small variations do
+// not change the sampling rate every cycle.
+// A max_cpu_percent of 0 disables the budget.
+uint32_t cpu_budget_period_scale(uint32_t scale_pct, int64_t cpu_millicores,
+                                 uint32_t max_cpu_percent);
+
+} // namespace ddprof
@@ -6,7 +6,7 @@
 #pragma once
 
 #include "ddres_def.hpp"
-#include "map_utils.hpp"
+#include "demangler/demangle_cache.hpp"
 #include "mapinfo_table.hpp"
 #include "symbol.hpp"
 #include "unwind_output.hpp"
@@ -38,9 +38,9 @@ void write_location(ProcessAddress_t ip_or_elf_addr,
                     uint32_t lineno, const MapInfo &mapinfo,
                     ddog_prof_Location *ffi_location);
 
-DDRes write_location_blaze(
-    ProcessAddress_t ip_or_elf_addr,
-    ddprof::HeterogeneousLookupStringMap<std::string> &demangled_names,
-    const MapInfo &mapinfo, const blaze_sym &blaze_sym, unsigned &cur_loc,
-    std::span<ddog_prof_Location> locations_buff);
+DDRes write_location_blaze(ProcessAddress_t ip_or_elf_addr,
+                           DemangleCache &demangle_cache,
+                           const MapInfo &mapinfo, const blaze_sym &blaze_sym,
+                           unsigned &cur_loc,
+                           std::span<ddog_prof_Location> locations_buff);
 } // namespace ddprof
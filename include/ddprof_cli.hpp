@@ -72,6 +72,14 @@ public:
   bool disable_symbolization{false};
   bool reorder_events{false}; // reorder events by timestamp
   int maximum_pids{-1};
+  uint32_t unwinding_threads{0};
+  std::vector<uint32_t> overload_thresholds; // ring buffer occupancy (%)
+  uint32_t max_cpu_percent{0};
+  uint32_t export_queue_depth{2};
+  std::string symbol_cache_dir;
+  uint32_t symbol_cache_max_mb{128};
+  bool stack_scan{false};
+  bool adaptive_stack_sample_size{false};
 
   std::string socket_path;
   int pipefd_to_library{-1};
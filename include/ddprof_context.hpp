@@ -16,6 +16,7 @@
 
 #include <sched.h>
 #include <unistd.h>
+#include <vector>
 
 namespace ddprof {
 struct DDProfContext {
@@ -37,6 +38,16 @@ struct DDProfContext {
     bool disable_symbolization{false};
     bool reorder_events{false}; // reorder events by timestamp
     int maximum_pids{0};
+    uint32_t unwinding_threads{0}; // 0: unwind on the worker thread
+    // ring buffer occupancy (%) entering each overload tier
+    std::vector<uint32_t> overload_thresholds;
+    uint32_t max_cpu_percent{0}; // CPU budget of the profiler (0: unbounded)
+    uint32_t export_queue_depth{2}; // serialized profiles waiting for upload
+    std::string symbol_cache_dir;   // empty: no persistent symbol cache
+    uint32_t symbol_cache_max_mb{128};
+    bool stack_scan{false}; // scan the stack when unwinding stops early
+    // size of the user stack copies follows the stack usage
+    bool adaptive_stack_sample_size{false};
 
     cpu_set_t cpu_affinity{};
     std::string switch_user;
@@ -36,6 +36,9 @@ inline constexpr int k_size_api_key = 32;
 inline constexpr int k_default_max_profiled_pids{100};
 inline constexpr int k_unlimited_max_profiled_pids{-1};
 
+// Upper bound of the number of threads unwinding samples
+inline constexpr uint32_t k_max_unwinding_threads{64};
+
 // Linux Inode type
 using inode_t = uint64_t;
 
@@ -9,9 +9,13 @@
 
 #include "build_id.hpp"
 
+#include <memory>
+
 using Dwfl_Module = struct Dwfl_Module;
 
 namespace ddprof {
+struct SharedModule;
+
 struct DDProfModRange {
   ProcessAddress_t _low_addr = 0;
   ProcessAddress_t _high_addr = 0;
@@ -37,6 +41,8 @@ struct DDProfMod {
   ProcessAddress_t _high_addr{};
   // The symbol bias (0 for position dependant)
   Offset_t _sym_bias{static_cast<Offset_t>(-1)};
+  // Elf data shared with other processes mapping the same file
+  std::shared_ptr<const SharedModule> _shared_module;
   Status _status{kUnknown};
 };
 
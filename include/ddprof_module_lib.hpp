@@ -11,6 +11,7 @@
 #include "dso.hpp"
 #include "dso_hdr.hpp"
 #include "dwfl_internals.hpp"
+#include "dwfl_module_cache.hpp"
 
 #include <optional>
 
@@ -22,17 +23,16 @@ inline uint32_t elf_flags_to_prot(Elf64_Word flags) {
       ((flags & PF_W) ? PROT_WRITE : 0);
 }
 
-// Structure to represent both a mapping and a loadable elf segment
-struct Segment {
-  ElfAddress_t addr;
-  Offset_t offset;
-  uint32_t prot;
-};
-
 // From a dso object (and the matching file), attach the module to the dwfl
 // object, return the associated Dwfl_Module
 DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
-                    const FileInfoValue &fileInfoValue, DDProfMod &ddprof_mod);
+                    const FileInfoValue &fileInfoValue,
+                    DwflModuleCache &module_cache, DDProfMod &ddprof_mod);
+
+// Parse the process independent information of an elf file (loadable
+// segments and build id)
+DDRes load_shared_module(Elf *elf, const std::string &filepath,
+                         SharedModule &module);
 
 std::optional<std::string> find_build_id(const char *filepath);
 
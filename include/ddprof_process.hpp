@@ -10,12 +10,14 @@
 #include "ddres_def.hpp"
 #include "dwfl_wrapper.hpp"
 #include "logger.hpp"
+#include "stack_usage.hpp"
 
 #include <limits>
 #include <memory>
 #include <sys/types.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace ddprof {
 
@@ -38,25 +40,75 @@ public:
 
   uint64_t increment_counter() { return ++_sample_counter; }
 
-  [[nodiscard]] std::string_view get_or_insert_thread_name(pid_t tid);
+  // Number of samples over a sliding window of cycles: samples of previous
+  // cycles are given a decreasing weight.
+  [[nodiscard]] uint64_t sample_score() const {
+    return _sample_score + _sample_counter;
+  }
+
+  // Start a new window of samples
+  void cycle();
+
+  [[nodiscard]] pid_t pid() const { return _pid; }
+
+  // Admitted processes are the ones we unwind
+  [[nodiscard]] bool admitted() const { return _admitted; }
+
+  // Names are reported by perf events (thread creation / comm changes).
+  // /proc is only read once for threads that existed before.
+  [[nodiscard]] std::string_view
+  get_or_insert_thread_name(pid_t tid, std::string_view path_to_proc = "");
+  void set_thread_name(pid_t tid, std::string_view name);
+  void inherit_thread_name(pid_t parent_tid, pid_t tid);
+  // Samples of other CPUs can be processed after the exit of the thread: the
+  // name is kept until the next cycle
+  void erase_thread_name(pid_t tid);
+
+  // Callchains of this process were found truncated (missing frame pointers):
+  // with hybrid unwinding, its samples are unwound with DWARF
+  [[nodiscard]] bool callchain_truncated() const {
+    return _callchain_truncated;
+  }
+  void set_callchain_truncated() { _callchain_truncated = true; }
+
+  // Stack bytes read by the unwinding of the samples (adaptive stack sample
+  // size)
+  void add_stack_usage(uint64_t stack_bytes) { _stack_usage.add(stack_bytes); }
+  [[nodiscard]] const StackUsageHistogram &stack_usage() const {
+    return _stack_usage;
+  }
 
   [[nodiscard]] DwflWrapper *get_or_insert_dwfl();
   [[nodiscard]] DwflWrapper *get_dwfl();
   [[nodiscard]] const DwflWrapper *get_dwfl() const;
 
 private:
+  friend class ProcessHdr;
+
   static std::string format_cgroup_file(pid_t pid,
                                         std::string_view path_to_proc);
 
   static DDRes read_cgroup_ns(pid_t pid, std::string_view path_to_proc,
                               CGroupId_t &cgroup);
 
+  void scan_thread_names(std::string_view path_to_proc);
+
   std::unordered_map<pid_t, std::string> _thread_name_map;
+  std::vector<pid_t> _exited_tids;
   std::unique_ptr<DwflWrapper> _dwfl_wrapper;
   ContainerId _container_id;
   pid_t _pid;
   CGroupId_t _cgroup_ns;
   uint64_t _sample_counter{};
+  uint64_t _sample_score{};
+  StackUsageHistogram _stack_usage;
+  // cycle in which the process was admitted
+  uint32_t _admission_cycle{};
+  bool _admitted{false};
+  bool _thread_names_scanned{false};
+  // Thread events are received for this process
+  bool _thread_events{false};
+  bool _callchain_truncated{false};
 };
 
 class ProcessHdr {
@@ -65,23 +117,56 @@ public:
       : _path_to_proc(path_to_proc) {}
   void flag_visited(pid_t pid);
   Process &get(pid_t pid);
+  // Does not create the process (and does not flag it as visited)
+  Process *find(pid_t pid);
   const ContainerId &get_container_id(pid_t pid);
-  void clear(pid_t pid) { _process_map.erase(pid); }
+  std::string_view get_thread_name(Process &process, pid_t tid);
+  void clear(pid_t pid);
+
+  // Decide if the process can be unwound given the maximum number of
+  // processes. When the limit is reached, the coldest admitted process is
+  // evicted if the candidate is significantly hotter (evicted_pid is set).
+  // The unwinding state of the evicted process should then be freed.
+  bool admit(Process &process, unsigned max_pids, pid_t &evicted_pid);
+  void cycle();
 
   std::vector<pid_t> get_unvisited() const;
   const std::unordered_set<pid_t> &get_visited() const { return _visited_pid; }
   void reset_unvisited();
 
   unsigned process_count() const { return _process_map.size(); }
+  template <typename Func> void for_each_process(Func &&func) const {
+    for (const auto &[pid, process] : _process_map) {
+      func(process);
+    }
+  }
+  unsigned admitted_count() const { return _nb_admitted; }
+  unsigned nb_evictions() const { return _nb_evictions; }
   void display_stats() const;
 
+  // Candidate needs k_admission_ratio times more samples than the process it
+  // replaces (hysteresis to avoid evicting processes back and forth)
+  static constexpr uint64_t k_admission_ratio = 2;
+  static constexpr uint64_t k_admission_min_samples = 8;
+  // Recently admitted processes are not evicted
+  static constexpr uint32_t k_min_admitted_cycles = 1;
+  static constexpr unsigned k_max_evictions_per_cycle = 16;
+
 private:
   int get_nb_mod() const;
+  void do_admit(Process &process);
+  Process *find_coldest();
 
   std::unordered_set<pid_t> _visited_pid;
   using ProcessMap = std::unordered_map<pid_t, Process>;
   ProcessMap _process_map;
   std::string _path_to_proc;
+  unsigned _nb_admitted{};
+  unsigned _nb_evictions{};
+  uint32_t _cycle{};
+  // Coldest process is only looked up once per cycle (or after an eviction)
+  pid_t _coldest_pid{-1};
+  bool _coldest_valid{false};
 };
 
 }; // namespace ddprof
@@ -17,28 +17,57 @@ namespace ddprof {
   X(EVENT_LOST, "event.lost", STAT_GAUGE)                                      \
   X(EVENT_OUT_OF_ORDER, "event.out_of_order", STAT_GAUGE)                      \
   X(SAMPLE_COUNT, "sample.count", STAT_GAUGE)                                  \
+  X(WORKER_WAKEUPS, "worker.wakeups", STAT_GAUGE)                              \
+  X(WORKER_IDLE_WAKEUPS, "worker.idle_wakeups", STAT_GAUGE)                    \
+  X(RING_BUFFER_OCCUPANCY_MAX, "ring_buffer.occupancy_max_pct", STAT_GAUGE)    \
+  X(OVERLOAD_DEGRADED_SAMPLES, "overload.degraded_samples", STAT_GAUGE)        \
   X(UNMATCHED_DEALLOCATION_COUNT, "unmatched_deallocation.count", STAT_GAUGE)  \
   X(TARGET_CPU_USAGE, "target_process.cpu_usage.millicores", STAT_GAUGE)       \
   X(UNWIND_AVG_TIME, "unwind.avg_time_ns", STAT_GAUGE)                         \
   X(UNWIND_FRAMES, "unwind.frames", STAT_GAUGE)                                \
+  X(UNWIND_SCANNED_FRAMES, "unwind.scanned_frames", STAT_GAUGE)                \
+  X(UNWIND_CALLCHAIN_SAMPLES, "unwind.callchain.samples", STAT_GAUGE)          \
+  X(UNWIND_CALLCHAIN_FALLBACKS, "unwind.callchain.fallbacks", STAT_GAUGE)      \
   X(UNWIND_ERRORS, "unwind.errors", STAT_GAUGE)                                \
   X(UNWIND_TRUNCATED_INPUT, "unwind.stack.truncated_input", STAT_GAUGE)        \
   X(UNWIND_TRUNCATED_OUTPUT, "unwind.stack.truncated_output", STAT_GAUGE)      \
   X(UNWIND_INCOMPLETE_STACK, "unwind.stack.incomplete", STAT_GAUGE)            \
   X(UNWIND_AVG_STACK_SIZE, "unwind.stack.avg_size", STAT_GAUGE)                \
   X(UNWIND_AVG_STACK_DEPTH, "unwind.stack.avg_depth", STAT_GAUGE)              \
+  X(UNWIND_STACK_SAMPLE_SIZE, "unwind.stack.sample_size", STAT_GAUGE)          \
   X(UNUSED_SYMBOLS_BINARIES_COUNT, "symbols.binaries.unused.count",            \
     STAT_GAUGE)                                                                \
+  X(SYMBOLS_BINARIES_EVICTED, "symbols.binaries.evicted", STAT_GAUGE)          \
+  X(SYMBOLS_CACHE_HITS, "symbols.cache.hits", STAT_GAUGE)                      \
+  X(SYMBOLS_CACHE_MISSES, "symbols.cache.misses", STAT_GAUGE)                  \
+  X(SYMBOLS_DEMANGLE_HITS, "symbols.demangle.hits", STAT_GAUGE)                \
+  X(SYMBOLS_DEMANGLE_MISSES, "symbols.demangle.misses", STAT_GAUGE)            \
+  X(SYMBOLS_DEMANGLE_BYTES, "symbols.demangle.bytes", STAT_GAUGE)              \
+  X(SYMBOLS_DEMANGLE_SAVED_BYTES, "symbols.demangle.saved_bytes", STAT_GAUGE)  \
   X(SYMBOLS_JIT_READS, "symbols.jit.reads", STAT_GAUGE)                        \
   X(SYMBOLS_JIT_FAILED_LOOKUPS, "symbols.jit.failed_lookups", STAT_GAUGE)      \
   X(SYMBOLS_JIT_SYMBOL_COUNT, "symbols.jit.symbol_count", STAT_GAUGE)          \
+  X(SYMBOLS_TABLE_SIZE, "symbols.table.size", STAT_GAUGE)                      \
+  X(SYMBOLS_TABLE_RECLAIMED, "symbols.table.reclaimed", STAT_GAUGE)            \
+  X(MAPINFO_TABLE_SIZE, "mapinfo.table.size", STAT_GAUGE)                      \
   X(PROFILER_RSS, "profiler.rss", STAT_GAUGE)                                  \
   X(PROFILER_CPU_USAGE, "profiler.cpu_usage.millicores", STAT_GAUGE)           \
+  X(SAMPLING_PERIOD_SCALE, "sampling.period_scale_pct", STAT_GAUGE)            \
+  X(PROCESS_ADMITTED, "process.admitted", STAT_GAUGE)                          \
+  X(PROCESS_EVICTIONS, "process.evictions", STAT_GAUGE)                        \
   X(DSO_NEW_DSO, "dso.new", STAT_GAUGE)                                        \
   X(DSO_SIZE, "dso.size", STAT_GAUGE)                                          \
+  X(DWFL_MODULE_FILES, "dwfl.module.files", STAT_GAUGE)                        \
+  X(DWFL_MODULE_SHARED, "dwfl.module.shared", STAT_GAUGE)                      \
+  X(ELF_CACHE_SIZE, "elf_cache.size", STAT_GAUGE)                              \
+  X(ELF_CACHE_HITS, "elf_cache.hits", STAT_GAUGE)                              \
+  X(ELF_CACHE_EVICTIONS, "elf_cache.evictions", STAT_GAUGE)                    \
   X(PPROF_SIZE, "pprof.size", STAT_GAUGE)                                      \
+  X(EXPORT_DROPPED, "export.dropped", STAT_GAUGE)                              \
+  X(EXPORT_QUEUE_SIZE, "export.queue.size", STAT_GAUGE)                        \
   X(PROFILE_DURATION, "profile.duration_ms", STAT_GAUGE)                       \
   X(AGGREGATION_AVG_TIME, "aggregation.avg_time_ns", STAT_GAUGE)               \
+  X(AGGREGATION_STACKS, "aggregation.stacks", STAT_GAUGE)                      \
   X(BACKPOPULATE_COUNT, "backpopulate.count", STAT_GAUGE)
 
 // Expand the enum/index for the individual stats
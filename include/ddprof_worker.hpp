@@ -14,6 +14,7 @@
 
 namespace ddprof {
 struct DDProfContext;
+struct WorkerShard;
 
 DDRes ddprof_worker_init(DDProfContext &ctx,
                          PersistentWorkerState *persistent_worker_state);
@@ -25,6 +26,10 @@ DDRes ddprof_worker_cycle(DDProfContext &ctx,
                           bool synchronous_export);
 DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
                                   DDProfContext &ctx);
+// Called from the threads of the unwinding pool
+DDRes ddprof_worker_process_shard_event(WorkerShard &shard,
+                                        const perf_event_header *hdr,
+                                        int watcher_pos, DDProfContext &ctx);
 
 // Only init unwinding elements
 DDRes worker_library_init(DDProfContext &ctx,
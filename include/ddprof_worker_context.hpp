@@ -8,6 +8,7 @@
 #include "live_allocation.hpp"
 #include "pevent.hpp"
 #include "proc_status.hpp"
+#include "unwind_output.hpp"
 
 #include <array>
 #include <chrono>
@@ -16,23 +17,30 @@ namespace ddprof {
 
 struct DDProfExporter;
 struct DDProfPProf;
+struct ExportJob;
 struct PersistentWorkerState;
 struct UnwindState;
 struct UserTags;
+class StackAccumulator;
 class Symbolizer;
+class UnwindingPool;
+template <typename Job> class ExportQueue;
 
 // Mutable states within a worker
 struct DDProfWorkerContext {
   // Persistent reference to the state shared accross workers
   PersistentWorkerState *persistent_worker_state{nullptr};
   PEventHdr pevent_hdr;     // perf_event buffer holder
-  DDProfExporter *exp[2]{}; // wrapper around rust exporter
-  DDProfPProf *pprof[2]{};  // wrapper around rust exporter
+  DDProfExporter *exp{}; // wrapper around rust exporter
+  DDProfPProf *pprof{};  // wrapper around rust exporter
+  // Serialized profiles waiting to be sent by the export thread
+  ExportQueue<ExportJob> *export_queue{};
   Symbolizer *symbolizer{};
-  int i_current_pprof{0};
-  volatile bool exp_error{false};
-  pthread_t exp_tid{0};
   UnwindState *us{};
+  // Stacks unwound by the worker, added to the profile at the end of the cycle
+  StackAccumulator *stack_accumulator{};
+  // Optional threads unwinding samples (sharded by pid)
+  UnwindingPool *unwinding_pool{};
   UserTags *user_tags{};
   ProcStatus proc_status{};
   std::chrono::steady_clock::time_point
@@ -42,6 +50,9 @@ struct DDProfWorkerContext {
   uint32_t count_worker{0}; // exports since last cache clear
   std::array<uint64_t, kMaxTypeWatcher> lost_events_per_watcher{};
   LiveAllocation live_allocation;
+  // Work shed on samples when the worker falls behind.
+  // Read by the unwinding threads: access through std::atomic_ref.
+  OverloadTier overload_tier{OverloadTier::kNone};
   int64_t perfclock_offset;
   PerfClock::time_point last_processed_event_timestamp;
 };
@@ -62,7 +62,10 @@ enum : uint16_t { DD_COMMON_START_RANGE = 1000, DD_NATIVE_START_RANGE = 2000 };
   X(INVALID_ELF, "invalid elf file")                                           \
   X(AMBIGUOUS_LOAD_SEGMENT, "ambiguous executable LOAD segment")               \
   X(SYMBOLIZER, "symbolizer error")                                            \
-  X(NO_MATCHING_LOAD_SEGMENT, "unable to find a LOAD segment matching mapping")
+  X(NO_MATCHING_LOAD_SEGMENT, "unable to find a LOAD segment matching mapping") \
+  X(EXPORT_SPOOL, "error while spooling profiles to disk")                    \
+  X(SYMBOL_CACHE, "error in the on-disk symbol cache")                         \
+  X(KERNEL_SYMBOLS, "error reading kernel symbols")
 
 // generic erno errors available from /usr/include/asm-generic/errno.h
 
@@ -0,0 +1,74 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "map_utils.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace ddprof {
+
+// Demangled names shared by all the symbolizers of the process: the same
+// libraries (and the same template instances) are found in many binaries and
+// container copies.
+// Entries are keyed by the hash of the mangled name, which is not kept.
+// Demangled names are stored once, even when several mangled names give the
+// same result (e.g. Rust symbols that only differ by their hash).
+class DemangleCache {
+public:
+  struct Stats {
+    uint64_t _nb_hits{};
+    uint64_t _nb_misses{};
+    uint64_t _nb_evictions{};
+    // Bytes of the stored demangled names
+    uint64_t _bytes{};
+    // Bytes that are not stored, compared to a map of mangled to demangled
+    // names: mangled names and demangled names shared by several entries
+    uint64_t _bytes_saved{};
+  };
+
+  explicit DemangleCache(size_t max_entries = k_default_max_entries)
+      : _max_entries(max_entries) {}
+
+  // Shared by the symbolizers
+  static DemangleCache &global();
+
+  // C++ and Rust names. The view remains valid until the next call to cycle.
+  std::string_view demangle(const char *mangled);
+
+  // Enforce the size limit, evicting first the names that were not used
+  // during the cycle. Names returned before are no longer referenced.
+  void cycle();
+
+  [[nodiscard]] size_t size() const;
+  // Stats of the last cycle
+  [[nodiscard]] Stats cycle_stats() const;
+
+  static constexpr size_t k_default_max_entries = 128 * 1024;
+
+private:
+  struct Entry {
+    std::string_view demangled; // key of _names
+    uint32_t mangled_size;
+    bool visited;
+  };
+
+  void release(const Entry &entry);
+
+  size_t _max_entries;
+  mutable std::mutex _mutex;
+  std::unordered_map<uint64_t, Entry> _entries;
+  // Demangled names and the number of entries that reference them
+  HeterogeneousLookupStringMap<uint32_t> _names;
+  Stats _stats;
+  Stats _cycle_stats;
+};
+
+} // namespace ddprof
@@ -8,6 +8,7 @@
 #include "dso.hpp"
 #include "hash_helper.hpp"
 #include "symbol_table.hpp"
+#include "table_compaction.hpp"
 
 #include <unordered_map>
 
@@ -24,6 +25,8 @@ public:
 
   void stats_display() const;
 
+  void remap(const TableRemap &symbol_remap);
+
 private:
   size_t get_size() const;
 
@@ -31,7 +34,6 @@ private:
                                            SymbolTable &symbol_table);
   // map of maps --> the aim is to monitor usage of some maps and clear them
   // together
-  // TODO : find efficient clear on symbol table before we do this
   using AddressMap = std::unordered_map<FileAddress_t, SymbolIdx_t>;
   using DsoPathMap = std::unordered_map<std::string, AddressMap>;
   DsoPathMap _map_dso_path;
@@ -0,0 +1,92 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "build_id.hpp"
+#include "ddprof_defs.hpp"
+#include "ddprof_file_info.hpp"
+#include "ddres_def.hpp"
+#include "elf_handle_cache.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ddprof {
+
+// Structure to represent both a mapping and a loadable elf segment
+struct Segment {
+  ElfAddress_t addr;
+  Offset_t offset;
+  Offset_t filesz;
+  uint32_t prot;
+};
+
+// Process independent data of an elf file.
+// Every process mapping the same file reports a module backed by the same
+// parsed elf: only the load address (bias) is specific to a process.
+struct SharedModule {
+  std::string _path;
+  FileInfoId_t _file_info_id{k_file_info_undef};
+  // Elf object is opened on demand
+  ElfHandleCache *_elf_handles{nullptr};
+  BuildIdStr _build_id;
+  std::vector<Segment> _load_segments;
+  // Range covered by the loadable segments (before bias is applied)
+  ElfAddress_t _load_start{};
+  ElfAddress_t _load_end{};
+
+  // Find the loadable segment matching a file offset
+  [[nodiscard]] const Segment *find_segment(Offset_t file_offset) const;
+
+  // The elf object is only guaranteed to be valid until the next call
+  DDRes get_elf(Elf **elf) const;
+};
+
+// Cache of the elf files reported to the dwfl objects of all processes.
+// Entries are keyed by file (inode) and deduplicated by build id, so that a
+// library mapped from different paths (containers) is only parsed once.
+class DwflModuleCache {
+public:
+  using SharedModulePtr = std::shared_ptr<const SharedModule>;
+
+  struct Stats {
+    uint64_t _nb_hits{};
+    uint64_t _nb_loads{};
+  };
+
+  explicit DwflModuleCache(
+      size_t max_open_elfs = ElfHandleCache::k_default_capacity)
+      : _elf_handles(std::make_unique<ElfHandleCache>(max_open_elfs)) {}
+
+  DDRes get_or_insert(const FileInfoValue &file_info_value,
+                      SharedModulePtr &module);
+
+  // Release files that are no longer referenced by any process
+  // Returns the number of released files
+  size_t remove_unused();
+
+  [[nodiscard]] size_t size() const { return _modules.size(); }
+  [[nodiscard]] const Stats &stats() const { return _stats; }
+  [[nodiscard]] const ElfHandleCache &elf_handles() const {
+    return *_elf_handles;
+  }
+  void reset_stats() {
+    _stats = {};
+    _elf_handles->reset_stats();
+  }
+
+private:
+  // Stable address: referenced by the shared modules
+  std::unique_ptr<ElfHandleCache> _elf_handles;
+  std::unordered_map<FileInfoId_t, SharedModulePtr> _modules;
+  std::unordered_map<BuildIdStr, std::weak_ptr<const SharedModule>>
+      _build_id_map;
+  Stats _stats;
+};
+
+} // namespace ddprof
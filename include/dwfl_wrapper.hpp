@@ -12,8 +12,12 @@
 #include "ddres.hpp"
 #include "dso.hpp"
 #include "dso_hdr.hpp"
+#include "dwfl_module_cache.hpp"
 
+#include <memory>
 #include <sys/types.h>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
 struct Dwfl;
@@ -42,13 +46,17 @@ struct DwflWrapper {
 
   // safe get
   DDRes register_mod(ProcessAddress_t pc, const Dso &dso,
-                     const FileInfoValue &fileInfoValue, DDProfMod **mod);
+                     const FileInfoValue &fileInfoValue,
+                     DwflModuleCache &module_cache, DDProfMod **mod);
 
   ~DwflWrapper();
 
   static void swap(DwflWrapper &first, DwflWrapper &second) noexcept {
     std::swap(first._dwfl, second._dwfl);
     std::swap(first._attached, second._attached);
+    std::swap(first._inconsistent, second._inconsistent);
+    std::swap(first._ddprof_mods, second._ddprof_mods);
+    std::swap(first._reported_modules, second._reported_modules);
   }
 
   Dwfl *_dwfl{nullptr};
@@ -57,6 +65,9 @@ struct DwflWrapper {
 
   // Keep track of the files we added to the dwfl object
   std::unordered_map<FileInfoId_t, DDProfMod> _ddprof_mods;
+  // Modules stay reported until dwfl_end and reference their shared module
+  // (find_elf callback): entries of _ddprof_mods can be replaced before that
+  std::vector<std::shared_ptr<const SharedModule>> _reported_modules;
 };
 
 } // namespace ddprof
@@ -0,0 +1,43 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "create_elf.hpp"
+#include "ddprof_file_info-i.hpp"
+#include "ddres_def.hpp"
+#include "lru_cache.hpp"
+
+#include <string>
+
+namespace ddprof {
+
+// Bounded set of opened elf files, least recently used files are closed and
+// reopened on demand.
+// Files are memory mapped: file descriptors are released once the elf object
+// is created.
+class ElfHandleCache {
+public:
+  using Stats = LRUCache<FileInfoId_t, UniqueElf>::Stats;
+  static constexpr size_t k_default_capacity = 512;
+
+  explicit ElfHandleCache(size_t capacity = k_default_capacity)
+      : _handles(capacity) {}
+
+  // The elf object is only guaranteed to be valid until the next call
+  DDRes get(FileInfoId_t file_info_id, const std::string &filepath,
+            Elf **elf);
+
+  void erase(FileInfoId_t file_info_id) { _handles.erase(file_info_id); }
+
+  [[nodiscard]] size_t size() const { return _handles.size(); }
+  [[nodiscard]] const Stats &stats() const { return _handles.stats(); }
+  void reset_stats() { _handles.reset_stats(); }
+
+private:
+  LRUCache<FileInfoId_t, UniqueElf> _handles;
+};
+
+} // namespace ddprof
@@ -46,6 +46,13 @@ enum class EventConfCadenceType : uint8_t {
   kFrequency = 2,
 };
 
+// Defines how the stacks of the samples are captured
+enum class EventConfUnwindMode : uint8_t {
+  kDwarf = 0,     // Copy of the user stack, unwound with DWARF information
+  kCallchain = 1, // Callchain of the kernel (requires frame pointers)
+  kHybrid = 2,    // Callchain, DWARF for processes with truncated callchains
+};
+
 // Used by the parser to return which key was detected
 enum class EventConfField : uint8_t {
   kNone = 0,
@@ -132,6 +139,13 @@ enum class EventConfField : uint8_t {
    * are copied from the user application. This will define how far we can
    * unwind.
    */
+  kUnwindMode,
+  /*
+   *  How stacks are captured: 'dwarf' (default) copies the user stack and
+   *  unwinds it with DWARF information, 'fp' uses the callchain built by the
+   *  kernel from frame pointers, 'hybrid' uses the callchain and falls back
+   *  to DWARF for the processes whose callchains look truncated.
+   */
 };
 
 struct EventConf {
@@ -148,6 +162,7 @@ struct EventConf {
   uint8_t raw_size{};
   uint64_t raw_offset{};
   uint32_t stack_sample_size{k_default_perf_stack_sample_size};
+  EventConfUnwindMode unwind_mode{};
   double value_scale{};
 
   EventConfCadenceType cad_type{};
@@ -7,10 +7,14 @@
 
 #include "ddprof_defs.hpp"
 #include "ddres_def.hpp"
+#include "exporter/export_spool.hpp"
 #include "exporter_input.hpp"
 #include "perf_watcher.hpp"
 #include "tags.hpp"
 
+#include <memory>
+
+struct ddog_prof_EncodedProfile;
 struct ddog_prof_Exporter;
 struct ddog_prof_Profile;
 
@@ -26,6 +30,18 @@ struct DDProfExporter {
   bool _agent{false};
   bool _export{false}; // debug mode : should we send profiles ?
   int32_t _nb_consecutive_errors{0};
+  std::unique_ptr<ExportSpool> _spool; // profiles waiting for the agent
+};
+
+// Profile serialized by the worker, waiting to be sent
+struct ExportJob {
+  struct EncodedProfileDeleter {
+    void operator()(ddog_prof_EncodedProfile *encoded_profile) const;
+  };
+  std::unique_ptr<ddog_prof_EncodedProfile, EncodedProfileDeleter>
+      encoded_profile;
+  Tags additional_tags;
+  uint32_t profile_seq{0};
 };
 
 DDRes ddprof_exporter_init(const ExporterInput &exporter_input,
@@ -33,6 +49,15 @@ DDRes ddprof_exporter_init(const ExporterInput &exporter_input,
 
 DDRes ddprof_exporter_new(const UserTags *user_tags, DDProfExporter *exporter);
 
+/// Serialize the profile (it can then be reset) so that it is sent later
+DDRes ddprof_exporter_serialize(ddog_prof_Profile *profile,
+                                const Tags &additional_tags,
+                                uint32_t profile_seq, ExportJob &job);
+
+/// Send a serialized profile (and write it to the debug folder)
+DDRes ddprof_exporter_send(const ExportJob &job, DDProfExporter *exporter);
+
+/// Serialize and send the profile
 DDRes ddprof_exporter_export(ddog_prof_Profile *profile,
                              const Tags &additional_tags, uint32_t profile_seq,
                              DDProfExporter *exporter);
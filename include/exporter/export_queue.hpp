@@ -0,0 +1,141 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace ddprof {
+
+// Hands jobs over to a persistent thread, so that slow exports never stall the
+// producer. The queue is bounded: when it is full, the oldest job is dropped
+// to make room for the new one.
+template <typename Job> class ExportQueue {
+public:
+  // Fatal errors returned by send are reported through error()
+  using SendFunc = std::function<DDRes(Job &)>;
+
+  ExportQueue(size_t depth, SendFunc send)
+      : _depth(std::max<size_t>(depth, 1)), _send(std::move(send)),
+        _thread([this] { run(); }) {}
+
+  ~ExportQueue() { stop(); }
+
+  ExportQueue(const ExportQueue &) = delete;
+  ExportQueue &operator=(const ExportQueue &) = delete;
+
+  // Never waits for the export thread. Returns false if a job was dropped.
+  bool push(Job job) {
+    bool dropped = false;
+    {
+      std::lock_guard const lock(_mutex);
+      if (_jobs.size() >= _depth) {
+        _jobs.pop_front();
+        ++_nb_dropped;
+        dropped = true;
+      }
+      _jobs.push_back(std::move(job));
+    }
+    _cv.notify_one();
+    return !dropped;
+  }
+
+  // Wait for the queued jobs to be sent. Returns false on timeout.
+  bool drain(std::chrono::milliseconds timeout) {
+    std::unique_lock lock(_mutex);
+    return _idle_cv.wait_for(lock, timeout,
+                             [this] { return _jobs.empty() && !_busy; });
+  }
+
+  // Stop the thread once the current job is sent: queued jobs are dropped
+  void stop() {
+    {
+      std::lock_guard const lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    if (_thread.joinable()) {
+      _thread.join();
+    }
+  }
+
+  [[nodiscard]] bool error() const {
+    std::lock_guard const lock(_mutex);
+    return _error;
+  }
+  [[nodiscard]] size_t size() const {
+    std::lock_guard const lock(_mutex);
+    return _jobs.size();
+  }
+  [[nodiscard]] uint64_t nb_sent() const {
+    std::lock_guard const lock(_mutex);
+    return _nb_sent;
+  }
+  [[nodiscard]] uint64_t nb_failed() const {
+    std::lock_guard const lock(_mutex);
+    return _nb_failed;
+  }
+  [[nodiscard]] uint64_t nb_dropped() const {
+    std::lock_guard const lock(_mutex);
+    return _nb_dropped;
+  }
+
+private:
+  void run() {
+    std::unique_lock lock(_mutex);
+    while (true) {
+      _cv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+      if (_stop) {
+        break;
+      }
+      _busy = true;
+      DDRes res;
+      {
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        lock.unlock();
+        res = _send(job);
+      }
+      lock.lock();
+      _busy = false;
+      if (IsDDResOK(res)) {
+        ++_nb_sent;
+      } else {
+        ++_nb_failed;
+        _error |= IsDDResFatal(res);
+      }
+      if (_jobs.empty()) {
+        _idle_cv.notify_all();
+      }
+    }
+    _idle_cv.notify_all();
+  }
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;      // jobs were pushed or stop was requested
+  std::condition_variable _idle_cv; // all jobs were sent
+  std::deque<Job> _jobs;
+  size_t _depth;
+  bool _busy{false};
+  bool _stop{false};
+  bool _error{false};
+  uint64_t _nb_sent{0};
+  uint64_t _nb_failed{0};
+  uint64_t _nb_dropped{0};
+  SendFunc _send;
+  std::thread _thread; // last: started once the other members are ready
+};
+
+} // namespace ddprof
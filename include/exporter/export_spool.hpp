@@ -0,0 +1,78 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres_def.hpp"
+#include "ratelimiter.hpp"
+#include "tags.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ddprof {
+
+struct ExportSpoolLimits {
+  uint64_t max_bytes{64ULL * 1024 * 1024};
+  std::chrono::seconds max_age{std::chrono::hours{1}};
+  // Replays are spread out not to flood the agent once it is back
+  uint64_t max_replays_per_interval{4};
+  std::chrono::seconds replay_interval{10};
+};
+
+// Profile that could not be exported, stored in the spool
+struct SpooledProfile {
+  std::chrono::nanoseconds start{}; // since epoch
+  std::chrono::nanoseconds end{};
+  uint32_t profile_seq{0};
+  uint64_t size{0};
+  std::string path; // set by the spool
+};
+
+// On-disk store for profiles that failed to export, replayed oldest first.
+// Profiles are written to a temporary file, synced then renamed: a crash never
+// leaves partial profiles behind. Timestamps and sequence numbers are encoded
+// in the file name, tags are stored in a sidecar file written beforehand.
+// Oldest profiles are evicted once the size or age limits are reached.
+class ExportSpool {
+public:
+  using WriteFunc = std::function<DDRes(int fd)>;
+
+  ExportSpool(std::string dir, const ExportSpoolLimits &limits);
+
+  // Create the directory and pick up the profiles left by previous runs
+  DDRes init();
+
+  DDRes store(const SpooledProfile &profile, const Tags &tags,
+              const WriteFunc &write);
+
+  // Oldest profile, if the replay rate allows it
+  std::optional<SpooledProfile> next_replay();
+  DDRes load(const SpooledProfile &profile, std::vector<std::byte> &payload,
+             Tags &tags) const;
+  void remove(const SpooledProfile &profile);
+
+  void enforce_limits(std::chrono::system_clock::time_point now);
+
+  [[nodiscard]] size_t size() const { return _profiles.size(); }
+  [[nodiscard]] uint64_t nb_bytes() const { return _nb_bytes; }
+  [[nodiscard]] uint64_t nb_evicted() const { return _nb_evicted; }
+
+private:
+  std::string _dir;
+  ExportSpoolLimits _limits;
+  std::deque<SpooledProfile> _profiles; // oldest first
+  uint64_t _nb_bytes{0};
+  uint64_t _nb_evicted{0};
+  IntervalRateLimiter _replay_limiter;
+};
+
+} // namespace ddprof
@@ -7,6 +7,7 @@
 
 #include "ddres_def.hpp"
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 
@@ -29,6 +30,9 @@ struct ExporterInput {
   std::string_view family{"native"};
   std::string_view profiler_version;
   bool agentless{false}; // Whether or not to actually use API key/intake
+  std::string spool_dir; // store profiles that failed to export (if set)
+  uint32_t spool_max_mb{64};
+  uint32_t spool_max_age_s{3600};
 };
 
 } // namespace ddprof
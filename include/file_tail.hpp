@@ -0,0 +1,57 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres_def.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <span>
+#include <sys/types.h>
+
+namespace ddprof {
+
+// Read position in a file that is only appended to (perf-map, jitdump)
+struct FileTailState {
+  dev_t dev{0};
+  ino_t inode{0};
+  timespec mtime{};
+  uint64_t offset{0}; // bytes already parsed
+};
+
+// Read-only mapping of the bytes appended to a file since the last read.
+// The file was replaced when its inode changed, when it shrank below the
+// parsed offset (truncation) or when it was rewritten without growing: its
+// content should then be parsed again from the start.
+class FileTail {
+public:
+  FileTail() = default;
+  ~FileTail() { unmap(); }
+
+  FileTail(const FileTail &) = delete;
+  FileTail &operator=(const FileTail &) = delete;
+
+  // Update state and map the bytes that follow state.offset
+  DDRes map(int fd, FileTailState &state);
+
+  // Appended bytes (empty if the file did not change)
+  [[nodiscard]] std::span<const std::byte> data() const {
+    return {static_cast<const std::byte *>(_addr) + _skip, _size - _skip};
+  }
+  // Content that was previously parsed is stale
+  [[nodiscard]] bool replaced() const { return _replaced; }
+
+private:
+  void unmap();
+
+  void *_addr{nullptr};
+  size_t _size{0}; // mapped size
+  size_t _skip{0}; // bytes mapped before the offset (page alignment)
+  bool _replaced{false};
+};
+
+} // namespace ddprof
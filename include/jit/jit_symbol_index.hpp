@@ -0,0 +1,71 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace ddprof {
+
+// Address ranges of JIT code and their symbols, stored in sorted arrays of
+// non overlapping intervals.
+// JIT runtimes reuse code regions: every insertion gets a generation and
+// newer intervals overwrite the parts of older ones they overlap.
+// Insertions are buffered and sorted on the next lookup into a small array of
+// recent intervals, checked first. It is merged into the main array once it
+// grows, so that refreshing a large index does not copy it every time.
+class JITSymbolIndex {
+public:
+  void insert(ProcessAddress_t start, Offset_t size, SymbolIdx_t symbol_idx);
+
+  // Returns -1 if no interval contains the address
+  SymbolIdx_t find(ProcessAddress_t pc);
+
+  // func(SymbolIdx_t symbol_idx) is called for every stored interval
+  template <typename Func> void for_each_symbol(Func &&func) const {
+    for (const auto *intervals : {&_intervals, &_recent, &_pending}) {
+      for (const Interval &interval : *intervals) {
+        func(interval.symbol_idx);
+      }
+    }
+  }
+
+  void clear() {
+    _intervals.clear();
+    _recent.clear();
+    _pending.clear();
+    _generation = 0;
+  }
+
+  // Number of stored intervals
+  [[nodiscard]] size_t size() const {
+    return _intervals.size() + _recent.size() + _pending.size();
+  }
+
+private:
+  struct Interval {
+    ProcessAddress_t start;
+    ProcessAddress_t end; // excluded
+    SymbolIdx_t symbol_idx;
+    uint32_t generation;
+  };
+
+  static constexpr size_t k_min_merge_size = 4096;
+  static constexpr size_t k_merge_ratio = 16;
+
+  void flush();
+  static SymbolIdx_t find(const std::vector<Interval> &intervals,
+                          ProcessAddress_t pc);
+
+  std::vector<Interval> _intervals; // sorted by start
+  std::vector<Interval> _recent;    // sorted, newer than _intervals
+  std::vector<Interval> _pending;   // insertion order
+  uint32_t _generation{0};
+};
+
+} // namespace ddprof
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "ddres.hpp"
+#include "file_tail.hpp"
 
 #include <ctime>
 #include <stdint.h>
@@ -126,4 +127,10 @@ struct JITDump {
 
 DDRes jitdump_read(std::string_view file, JITDump &jit_dump);
 
+// Only parse the records appended since the previous read (tracked by state).
+// replaced is set if the file was truncated or rotated: it is then parsed from
+// the start.
+DDRes jitdump_read_tail(std::string_view file, FileTailState &state,
+                        JITDump &jit_dump, bool &replaced);
+
 } // namespace ddprof
@@ -0,0 +1,64 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+#include "kernel_symbols.hpp"
+#include "map_utils.hpp"
+#include "mapinfo_table.hpp"
+#include "symbol_table.hpp"
+#include "table_compaction.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ddprof {
+
+// Symbols of the kernel frames found in callchains
+class KernelSymbolLookup {
+public:
+  explicit KernelSymbolLookup(std::string_view path_to_proc = "/proc",
+                              std::string_view path_to_sys = "/sys")
+      : _path_to_proc(path_to_proc), _path_to_sys(path_to_sys) {}
+
+  // Kernel symbols are read on first use, they are persisted in this
+  // directory if set
+  void set_cache_dir(std::string cache_dir) {
+    _cache_dir = std::move(cache_dir);
+  }
+
+  // Returns k_symbol_idx_null if the address is not a known kernel symbol
+  SymbolIdx_t get_or_insert(ProcessAddress_t addr, SymbolTable &symbol_table,
+                            MapInfoTable &mapinfo_table,
+                            MapInfoIdx_t &map_info_idx);
+
+  // Follow the loaded and unloaded modules
+  void cycle();
+
+  void remap(const TableRemap &symbol_remap) {
+    remap_map_values(_symbol_map, symbol_remap);
+  }
+  void remap_mapinfo(const TableRemap &mapinfo_remap) {
+    remap_map_values(_mapinfo_map, mapinfo_remap);
+  }
+
+private:
+  void refresh();
+
+  std::string _path_to_proc;
+  std::string _path_to_sys;
+  std::string _cache_dir;
+  std::unique_ptr<KernelSymbols> _symbols;
+  uint64_t _modules_signature{0};
+  // start address of the symbol to its index in the symbol table
+  std::unordered_map<ProcessAddress_t, SymbolIdx_t> _symbol_map;
+  // module name (empty for the kernel) to its mapping
+  HeterogeneousLookupStringMap<MapInfoIdx_t> _mapinfo_map;
+};
+
+} // namespace ddprof
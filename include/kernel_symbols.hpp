@@ -0,0 +1,111 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+#include "ddres_def.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ddprof {
+
+struct KernelSymbol {
+  std::string_view name;
+  std::string_view module; // empty for the kernel image
+  ProcessAddress_t start;
+};
+
+// Text symbols of the running kernel and of its modules, read from kallsyms.
+// Each image (the kernel or a module) stores its symbols in a sorted array of
+// offsets, with the names in a single buffer.
+//
+// Kernel symbols are parsed once. Their addresses are randomized at boot
+// (KASLR), so they are stored relative to _text and persisted in the cache
+// directory under the kernel build id: later runs only read the first lines
+// of kallsyms to find _text.
+// Modules are checked on every refresh through /proc/modules (a few lines).
+// When the list changed, the symbols of the unloaded modules are dropped and
+// only the lines of the new modules are parsed.
+//
+// Without CAP_SYSLOG, kptr_restrict makes kallsyms report null addresses: the
+// index then stays empty.
+class KernelSymbols {
+public:
+  explicit KernelSymbols(std::string cache_dir,
+                         std::string_view path_to_proc = "/proc",
+                         std::string_view path_to_sys = "/sys");
+
+  // Build the index on the first call, then update the modules if needed
+  DDRes refresh();
+
+  [[nodiscard]] std::optional<KernelSymbol> find(ProcessAddress_t addr) const;
+
+  // False if kernel addresses are hidden or could not be read
+  [[nodiscard]] bool available() const { return _kernel.start != 0; }
+
+  // Empty if unknown (no on-disk cache)
+  [[nodiscard]] const std::string &build_id() const { return _build_id; }
+  // Changes whenever modules are loaded or unloaded
+  [[nodiscard]] uint64_t modules_signature() const {
+    return _modules_signature;
+  }
+
+  // Number of symbols
+  [[nodiscard]] size_t size() const;
+  [[nodiscard]] size_t nb_modules() const { return _modules.size(); }
+  // Kernel symbols were read from the cache directory
+  [[nodiscard]] bool loaded_from_cache() const { return _loaded_from_cache; }
+
+private:
+  struct Entry {
+    uint32_t offset;      // from the start of the image
+    uint32_t name_offset; // in names (NUL separated)
+  };
+
+  struct Image {
+    std::string name; // empty for the kernel
+    ProcessAddress_t start{0};
+    ProcessAddress_t end{0}; // excluded
+    std::vector<Entry> entries;
+    std::string names;
+
+    [[nodiscard]] std::optional<KernelSymbol> find(ProcessAddress_t addr) const;
+  };
+
+  struct ModuleInfo {
+    std::string name;
+    ProcessAddress_t start;
+    uint64_t size;
+  };
+
+  DDRes read_modules(std::vector<ModuleInfo> &modules,
+                     uint64_t &signature) const;
+  // Parse the kernel symbols and the symbols of the added modules
+  DDRes parse_kallsyms(bool parse_kernel, const std::vector<ModuleInfo> &added,
+                       std::vector<Image> &images);
+
+  // _text address, without parsing the kernel symbols
+  DDRes read_text_address(ProcessAddress_t &text) const;
+  std::string cache_path() const;
+  DDRes load_cache(ProcessAddress_t text);
+  DDRes write_cache() const;
+
+  std::string _cache_dir;
+  std::string _path_to_proc;
+  std::string _path_to_sys;
+  std::string _build_id;
+  Image _kernel;
+  std::vector<Image> _modules; // sorted by start
+  uint64_t _modules_signature{0};
+  bool _initialized{false};
+  bool _loaded_from_cache{false};
+};
+
+} // namespace ddprof
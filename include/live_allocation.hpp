@@ -6,6 +6,7 @@
 #pragma once
 
 #include "ddprof_defs.hpp"
+#include "table_compaction.hpp"
 #include "unlikely.hpp"
 #include "unwind_output_hash.hpp"
 
@@ -89,6 +90,20 @@ public:
 
   void cycle() { _stats = {}; }
 
+  template <typename Func> void for_each_stack(Func &&func) const {
+    for (const auto &pid_map : _watcher_vector) {
+      for (const auto &pid_vt : pid_map) {
+        for (const auto &stack_vt : pid_vt.second._unique_stacks) {
+          func(stack_vt.first);
+        }
+      }
+    }
+  }
+
+  // Update symbol and mapping indexes after a compaction of the tables.
+  // Stacks are expected to only reference elements that were kept.
+  void remap(const TableRemap &symbol_remap, const TableRemap &mapinfo_remap);
+
 private:
   // returns true if the deallocation was registered
   static bool register_deallocation(uintptr_t address, PprofStacks &stacks,
@@ -0,0 +1,94 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace ddprof {
+
+// Tournament tree used to merge k ordered sources.
+// Each source exposes the key of its next element. Internal nodes store the
+// loser of the match played at that node, so that replacing the key of the
+// winning source only replays the matches on its path to the root
+// (log2(k) comparisons, no sibling lookups).
+// Ties are broken by source index, which keeps the merge deterministic.
+template <typename Key, typename Compare = std::less<Key>> class LoserTree {
+public:
+  LoserTree(size_t nb_sources, const Key &initial_key)
+      : _keys(nb_sources, initial_key), _tree(nb_sources),
+        _winners(2 * nb_sources) {
+    rebuild();
+  }
+
+  [[nodiscard]] size_t size() const { return _keys.size(); }
+
+  // Source with the smallest key
+  [[nodiscard]] size_t top() const {
+    assert(size() > 0);
+    return _tree[0];
+  }
+  [[nodiscard]] const Key &top_key() const { return _keys[top()]; }
+  [[nodiscard]] const Key &key(size_t source) const { return _keys[source]; }
+
+  // Change the key of any source: the tree must be rebuilt before top() is
+  // used again
+  void set_key(size_t source, Key key) { _keys[source] = std::move(key); }
+
+  // Replay all matches (k comparisons)
+  void rebuild() {
+    size_t const k = _keys.size();
+    if (k == 0) {
+      return;
+    }
+    // Leaves are at positions [k, 2k) of an implicit binary tree
+    for (size_t i = 0; i < k; ++i) {
+      _winners[k + i] = i;
+    }
+    for (size_t node = k - 1; node > 0; --node) {
+      size_t const left = _winners[2 * node];
+      size_t const right = _winners[(2 * node) + 1];
+      bool const left_wins = beats(left, right);
+      _winners[node] = left_wins ? left : right;
+      _tree[node] = left_wins ? right : left;
+    }
+    _tree[0] = k == 1 ? 0 : _winners[1];
+  }
+
+  // Change the key of the winning source and replay its matches
+  void replace_top(Key key) {
+    size_t winner = top();
+    _keys[winner] = std::move(key);
+    for (size_t node = (winner + _keys.size()) / 2; node > 0; node /= 2) {
+      if (beats(_tree[node], winner)) {
+        std::swap(_tree[node], winner);
+      }
+    }
+    _tree[0] = winner;
+  }
+
+private:
+  [[nodiscard]] bool beats(size_t lhs, size_t rhs) const {
+    if (_compare(_keys[lhs], _keys[rhs])) {
+      return true;
+    }
+    if (_compare(_keys[rhs], _keys[lhs])) {
+      return false;
+    }
+    return lhs < rhs;
+  }
+
+  std::vector<Key> _keys;
+  // _tree[0] is the overall winner, other nodes hold the loser of their match
+  std::vector<size_t> _tree;
+  std::vector<size_t> _winners; // scratch space for rebuild
+  [[no_unique_address]] Compare _compare;
+};
+
+} // namespace ddprof
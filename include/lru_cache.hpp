@@ -0,0 +1,123 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+namespace ddprof {
+
+// Associative container keeping track of the order in which elements are used.
+// When the capacity is reached, inserting an element evicts the least recently
+// used one. Pointers to elements are stable until they are evicted / erased.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache {
+public:
+  static constexpr size_t k_unbounded = std::numeric_limits<size_t>::max();
+
+  struct Stats {
+    uint64_t _nb_hits{};
+    uint64_t _nb_misses{};
+    uint64_t _nb_evictions{};
+  };
+
+  explicit LRUCache(size_t capacity = k_unbounded) : _capacity(capacity) {}
+
+  // Returns nullptr if the element is absent. Otherwise the element becomes the
+  // most recently used one.
+  Value *find(const Key &key) {
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+      ++_stats._nb_misses;
+      return nullptr;
+    }
+    ++_stats._nb_hits;
+    _elements.splice(_elements.begin(), _elements, it->second);
+    return &it->second->second;
+  }
+
+  // Insert (or replace) an element as the most recently used one
+  template <typename... Args> Value &emplace(const Key &key, Args &&...args) {
+    erase(key);
+    _elements.emplace_front(std::piecewise_construct,
+                            std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    _index.emplace(key, _elements.begin());
+    shrink(_capacity);
+    return _elements.front().second;
+  }
+
+  bool erase(const Key &key) {
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+      return false;
+    }
+    _elements.erase(it->second);
+    _index.erase(it);
+    return true;
+  }
+
+  // Predicate receives the key and the value
+  template <typename Pred> size_t erase_if(Pred pred) {
+    size_t count = 0;
+    for (auto it = _elements.begin(); it != _elements.end();) {
+      if (pred(std::as_const(it->first), it->second)) {
+        _index.erase(it->first);
+        it = _elements.erase(it);
+        ++count;
+      } else {
+        ++it;
+      }
+    }
+    return count;
+  }
+
+  // Evict the least recently used elements until size is at most max_size
+  // Returns the number of evicted elements
+  size_t shrink(size_t max_size) {
+    size_t count = 0;
+    while (_elements.size() > max_size) {
+      _index.erase(_elements.back().first);
+      _elements.pop_back();
+      ++count;
+    }
+    _stats._nb_evictions += count;
+    return count;
+  }
+
+  // Iterate from the most recently used to the least recently used element
+  template <typename Func> void for_each(Func func) {
+    for (auto &[key, value] : _elements) {
+      func(std::as_const(key), value);
+    }
+  }
+
+  void clear() {
+    _elements.clear();
+    _index.clear();
+  }
+
+  [[nodiscard]] size_t size() const { return _elements.size(); }
+  [[nodiscard]] bool empty() const { return _elements.empty(); }
+  [[nodiscard]] size_t capacity() const { return _capacity; }
+  [[nodiscard]] const Stats &stats() const { return _stats; }
+  void reset_stats() { _stats = {}; }
+
+private:
+  using ElementList = std::list<std::pair<Key, Value>>;
+  ElementList _elements;
+  std::unordered_map<Key, typename ElementList::iterator, Hash> _index;
+  size_t _capacity;
+  Stats _stats;
+};
+
+} // namespace ddprof
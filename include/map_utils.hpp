@@ -8,6 +8,7 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace ddprof {
 
@@ -24,4 +25,7 @@ template <typename T>
 using HeterogeneousLookupStringMap =
     std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
 
+using HeterogeneousLookupStringSet =
+    std::unordered_set<std::string, StringHash, std::equal_to<>>;
+
 } // namespace ddprof
@@ -7,6 +7,7 @@
 
 #include "ddprof_defs.hpp"
 #include "mapinfo_table.hpp"
+#include "table_compaction.hpp"
 
 #include "dso.hpp"
 
@@ -24,10 +25,16 @@ public:
                              const Dso &dso,
                              std::optional<BuildIdStr> build_id);
   void erase(pid_t pid) {
-    // table elements are not removed (TODO to gain memory usage)
+    // table elements are reclaimed by the compaction of the mapinfo table
     _mapinfo_pidmap.erase(pid);
   }
 
+  void remap(const TableRemap &mapinfo_remap) {
+    for (auto &el : _mapinfo_pidmap) {
+      remap_map_values(el.second, mapinfo_remap);
+    }
+  }
+
 private:
   using MapInfoAddrMap = std::unordered_map<ElfAddress_t, MapInfoIdx_t>;
   using MapInfoPidMap = std::unordered_map<pid_t, MapInfoAddrMap>;
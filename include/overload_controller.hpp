@@ -0,0 +1,42 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "unwind_output.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace ddprof {
+
+// Maximum number of frames unwound in OverloadTier::kTruncatedStack
+inline constexpr size_t k_overload_max_stack_depth{16};
+
+inline constexpr size_t k_nb_overload_thresholds{3};
+
+std::string_view overload_tier_name(OverloadTier tier);
+
+// Chooses how much work to shed on samples, depending on the backlog of the
+// worker (ring buffer occupancy in percent).
+// Tier N is entered when the occupancy reaches the Nth threshold, and left
+// once the occupancy drops below half of that threshold, so that the tier
+// does not flap around a threshold.
+class OverloadController {
+public:
+  // Thresholds are sorted. No thresholds disables shedding.
+  explicit OverloadController(std::span<const uint32_t> thresholds_pct);
+
+  OverloadTier update(uint64_t occupancy_pct);
+  [[nodiscard]] OverloadTier tier() const { return _tier; }
+
+private:
+  std::vector<uint32_t> _thresholds_pct;
+  OverloadTier _tier{OverloadTier::kNone};
+};
+
+} // namespace ddprof
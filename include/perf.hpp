@@ -13,6 +13,7 @@
 #include <chrono>
 #include <csignal>
 #include <linux/perf_event.h>
+#include <span>
 #include <stdint.h>
 #include <vector>
 
@@ -138,6 +139,16 @@ struct perf_samplestacku {
   // uint64_t    dyn_size;   // Don't forget!
 };
 
+// Parts of a PERF_SAMPLE_CALLCHAIN callchain (leaf first), without the context
+// markers. The first user address is the user PC when the sample was taken,
+// the next ones are return addresses.
+struct PerfCallchain {
+  std::span<const uint64_t> kernel;
+  std::span<const uint64_t> user;
+};
+
+PerfCallchain perf_callchain_split(std::span<const uint64_t> ips);
+
 int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int gfd,
                     unsigned long flags);
 size_t perf_mmap_size(int buf_size_shift);
@@ -7,6 +7,8 @@
 
 #include "perf.hpp"
 
+#include <cstddef>
+
 namespace ddprof {
 
 enum class RingBufferType : uint8_t { kPerfRingBuffer, kMPSCRingBuffer };
@@ -44,6 +46,23 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
 
 perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask);
 
+// Reentrant version: fields of the sample point into the event
+// Returns false if the sample can not be decoded
+bool hdr2samp(const perf_event_header *hdr, uint64_t mask,
+              perf_event_sample &sample);
+
+// Decoder of the samples of the given sample type: sample types of the
+// watchers have decoders without tests on the fields of the sample, other
+// sample types use hdr2samp
+SampleDecoder sample_decoder_from_mask(uint64_t mask);
+
 uint64_t hdr_time(const perf_event_header *hdr, uint64_t mask);
 
+// Copy an event to `dst` (which must hold at least hdr->size bytes).
+// For samples, only the captured part (dyn_size) of the user stack is copied
+// and fields following the user stack are dropped.
+// Returns the size of the copy.
+size_t hdr_compact_copy(const perf_event_header *hdr, uint64_t mask,
+                        std::byte *dst);
+
 } // namespace ddprof
@@ -20,6 +20,22 @@ enum class PerfWatcherUseKernel : uint8_t {
   kTry,      // On if possible, default to OFF on failure
 };
 
+// Sample type of the watchers of EVENT_CONFIG_TABLE and of tracepoints
+inline constexpr uint64_t k_default_sample_type = PERF_SAMPLE_STACK_USER |
+    PERF_SAMPLE_REGS_USER | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+    PERF_SAMPLE_PERIOD;
+
+struct perf_event_sample;
+
+// Decodes a perf sample with the given sample type (returns false if the
+// sample can not be decoded)
+using SampleDecoder = bool (*)(const perf_event_header *hdr, uint64_t mask,
+                               perf_event_sample &sample);
+
+// Decoder of any sample type (defined in perf_ringbuffer.cc)
+bool hdr2samp(const perf_event_header *hdr, uint64_t mask,
+              perf_event_sample &sample);
+
 struct PerfWatcherOptions {
   PerfWatcherUseKernel use_kernel;
   bool is_freq;
@@ -28,6 +44,7 @@ struct PerfWatcherOptions {
                              // frames belonging to libdd_profiling.so)
   uint32_t stack_sample_size{
       k_default_perf_stack_sample_size}; // size of the user stack to capture
+  EventConfUnwindMode unwind_mode{EventConfUnwindMode::kDwarf};
 };
 
 struct PProfIndices {
@@ -74,6 +91,9 @@ struct PerfWatcher {
   bool suppress_tid;
 
   bool instrument_self; // do my own perf_event_open, etc
+
+  // Specialized for the sample type once it is final
+  SampleDecoder sample_decoder{hdr2samp};
 };
 
 // The Datadog backend only understands pre-configured event types.  Those
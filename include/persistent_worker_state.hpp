@@ -5,6 +5,10 @@
 
 #pragma once
 
+#include "ddprof_defs.hpp"
+
+#include <cstdint>
+
 namespace ddprof {
 // Workers are reset by creating new forks. This structure is shared accross
 // processes
@@ -15,6 +19,12 @@ struct PersistentWorkerState {
   // Why not volatile ? Although several threads can update the number of
   // cycles, by design Only a single thread reads and writes to this variable.
   uint32_t profile_seq;
+  // Scale applied to the sampling periods to respect the CPU budget, in
+  // percent (0 until the budget is first enforced)
+  uint32_t period_scale_pct;
+  // Size of the user stack copies of each watcher (adaptive stack sample
+  // size), 0 until it is first adapted
+  uint32_t stack_sample_size[kMaxTypeWatcher];
 };
 
 } // namespace ddprof
@@ -9,12 +9,19 @@
 #include "perf_ringbuffer.hpp"
 
 #include <sys/types.h>
+#include <vector>
 
 namespace ddprof {
 
 // Takes into account number of watchers * number of CPUs
 inline constexpr size_t k_max_nb_perf_event_open{450};
 
+// Copy of a perf event capturing another size of user stack
+struct PEventStackTier {
+  uint32_t stack_sample_size;
+  std::vector<int> fds; // one per thread in PID mode
+};
+
 struct PEvent {
   int watcher_pos; // Index to the watcher (containing perf event config)
   int fd; // Underlying perf event FD for perf_events, otherwise an eventfd that
@@ -29,6 +36,10 @@ struct PEvent {
   std::vector<int>
       sub_fds; // perf FDs of other events outputting to the same ring buffer
                // (eg. perf events for other process threads in PID mode)
+  std::vector<PEventStackTier>
+      stack_tiers; // disabled copies of the event with other stack sample
+                   // sizes, outputting to the same ring buffer (adaptive
+                   // stack sample size)
 };
 
 struct PEventHdr {
@@ -36,6 +36,26 @@ DDRes pevent_setup(DDProfContext &ctx, std::span<pid_t> pids, int num_cpu,
 /// Call ioctl PERF_EVENT_IOC_ENABLE on available file descriptors
 DDRes pevent_enable(PEventHdr *pevent_hdr);
 
+/// Call ioctl PERF_EVENT_IOC_PERIOD to scale the sampling period of perf
+/// events whose value is the sample period (frequencies are divided by the
+/// same factor). k_nominal_period_scale_pct restores the configured periods.
+/// Events already inherited by child threads keep their period.
+DDRes pevent_set_period_scale(PEventHdr *pevent_hdr,
+                              std::span<const PerfWatcher> watchers,
+                              uint32_t scale_pct);
+
+/// true if the perf events of the watcher switch between stack tiers
+/// (adaptive stack sample size)
+bool pevent_has_stack_tiers(const DDProfContext &ctx,
+                            const PerfWatcher &watcher);
+
+/// Call ioctl PERF_EVENT_IOC_ENABLE on the perf events of the watcher
+/// capturing stack_sample_size bytes of user stack, and PERF_EVENT_IOC_DISABLE
+/// on the ones capturing other sizes
+DDRes pevent_set_stack_sample_size(PEventHdr *pevent_hdr,
+                                   const PerfWatcher &watcher, int watcher_pos,
+                                   uint32_t stack_sample_size);
+
 /// Clean the buffers allocated by mmap
 DDRes pevent_munmap(PEventHdr *pevent_hdr);
 
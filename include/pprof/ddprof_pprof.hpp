@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "bump_arena.hpp"
 #include "ddog_profiling_utils.hpp"
 #include "ddprof_context.hpp"
 #include "ddprof_defs.hpp"
@@ -14,6 +15,7 @@
 #include "tags.hpp"
 #include "unwind_output.hpp"
 
+#include <mutex>
 #include <unordered_map>
 
 namespace ddprof {
@@ -27,8 +29,13 @@ struct DDProfPProf {
   unsigned _nb_values = 0;
   Tags _tags;
   bool use_process_adresses{true};
-  // avoid re-creating strings for all pid numbers
+  // avoid re-creating strings for all pid numbers (kept across cycles)
   std::unordered_map<pid_t, std::string> _pid_str;
+  // per sample temporaries: rewound for every sample, released every cycle
+  BumpArena _arena;
+  // Unwinding threads add their stacks while the worker is sampling when they
+  // accumulate too many of them
+  std::mutex _mutex;
 };
 
 struct DDProfValuePack {
@@ -53,6 +60,14 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
                       EventAggregationModePos value_pos, Symbolizer *symbolizer,
                       DDProfPProf *pprof);
 
+/**
+ * Add the frames of a stack that pprof_aggregate would symbolize to the
+ * symbolizer's batch (cf. Symbolizer::symbolize_batch).
+ */
+void pprof_prepare_symbolization(const UnwindOutput *uw_output,
+                                 const PerfWatcher *watcher,
+                                 Symbolizer *symbolizer);
+
 DDRes pprof_reset(DDProfPProf *pprof);
 
 DDRes pprof_write_profile(const DDProfPProf *pprof, int fd);
@@ -7,13 +7,17 @@
 
 #include "ddprof_defs.hpp"
 #include "ddres_def.hpp"
+#include "file_tail.hpp"
+#include "jit/jit_symbol_index.hpp"
 #include "map_utils.hpp"
-#include "symbol_map.hpp"
 #include "symbol_table.hpp"
+#include "table_compaction.hpp"
 #include "unique_fd.hpp"
 
 #include <array>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace ddprof {
 
@@ -37,6 +41,10 @@ public:
 
   void erase(pid_t pid) { _pid_map.erase(pid); }
 
+  // Update the indexes of the symbols. Code regions of removed symbols are
+  // kept: their symbol is added again to the table on the next lookup.
+  void remap(const TableRemap &symbol_remap);
+
   void cycle() {
     ++_cycle_counter;
     _stats = {};
@@ -46,7 +54,7 @@ public:
     Stats ret = _stats;
     ret._symbol_count = 0;
     for (const auto &map : _pid_map) {
-      ret._symbol_count += map.second._map.size();
+      ret._symbol_count += map.second._index.size();
     }
     return ret;
   }
@@ -55,8 +63,12 @@ private:
   using FailedCycle = HeterogeneousLookupStringMap<uint32_t>;
 
   struct SymbolInfo {
-    SymbolMap _map;
+    // Code regions to the id of their name
+    JITSymbolIndex _index;
     FailedCycle _failed_cycle;
+    // Only the records appended since the previous read are parsed
+    FileTailState _jitdump_tail;
+    FileTailState _perfmap_tail;
   };
   using PidUnorderedMap = std::unordered_map<pid_t, SymbolInfo>;
 
@@ -75,14 +87,23 @@ private:
   // If none are found, we parse the JITDump file if available.
   // If not, we look for a perf-map file.
   // Symbols are cached with the process's address.
+  // Names are interned: code regions that are emitted again for the same
+  // function share its symbol. Regions reference the name rather than the
+  // symbol, so that compacting the symbol table does not require parsing the
+  // files again.
+  //
+  // 3) Refresh
+  // Both files are append only: we keep the offset of the last complete
+  // record and only parse what was appended since. A file that was truncated
+  // or rotated is parsed again from the start.
   //
   DDRes fill_from_jitdump(std::string_view jitdump_path, pid_t pid,
-                          SymbolMap &symbol_map, SymbolTable &symbol_table);
+                          SymbolInfo &symbol_info, SymbolTable &symbol_table);
 
-  DDRes fill_from_perfmap(int pid, SymbolMap &symbol_map,
+  DDRes fill_from_perfmap(int pid, SymbolInfo &symbol_info,
                           SymbolTable &symbol_table);
 
-  UniqueFile perfmaps_open(int pid, const char *path_to_perfmap);
+  UniqueFd perfmaps_open(int pid, const char *path_to_perfmap);
 
   bool has_lookup_failure(const SymbolInfo &symbol_info,
                           std::string_view path) const {
@@ -108,10 +129,12 @@ private:
 
   static bool should_skip_symbol(std::string_view symbol);
 
-  static bool insert_or_replace(std::string_view symbol,
-                                ProcessAddress_t address, Offset_t code_size,
-                                SymbolMap &symbol_map,
-                                SymbolTable &symbol_table);
+  bool insert(std::string_view symbol, ProcessAddress_t address,
+              Offset_t code_size, JITSymbolIndex &index,
+              SymbolTable &symbol_table);
+
+  // Symbol of an interned name, added to the symbol table if needed
+  SymbolIdx_t symbol_of(SymbolIdx_t name_id, SymbolTable &symbol_table);
 
   static constexpr std::array<const std::string_view, 1>
       _ignored_symbols_start = {{
@@ -119,7 +142,16 @@ private:
           "stub<",
       }};
 
+  struct JITName {
+    const std::string *name{}; // key of _name_ids, null if the id is free
+    SymbolIdx_t symbol_idx{-1}; // -1 if not in the symbol table
+  };
+
   PidUnorderedMap _pid_map;
+  // symbol name to its id
+  HeterogeneousLookupStringMap<SymbolIdx_t> _name_ids;
+  std::vector<JITName> _names;
+  std::vector<SymbolIdx_t> _free_name_ids;
   std::string _path_to_proc;
   Stats _stats;
   uint32_t _cycle_counter{1};
@@ -0,0 +1,85 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres_def.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <linux/perf_event.h>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+namespace ddprof {
+
+// Hands perf events over to a fixed set of threads.
+// Events are sharded by pid: all the events of a pid are handled by the same
+// thread, in the order in which they were pushed. Events are copied, so ring
+// buffer slots can be released as soon as the events are pushed.
+// push / flush / drain are expected to be called from a single thread.
+class ShardedEventQueue {
+public:
+  // Called from the thread of the shard
+  using Handler = std::function<DDRes(
+      unsigned shard_idx, const perf_event_header *hdr, int watcher_pos)>;
+
+  // Events are handed over to the threads by batches of this size
+  static constexpr size_t k_flush_bytes = 64 * 1024;
+  // Producer blocks when a thread lags behind by this amount of events
+  static constexpr size_t k_default_max_pending_bytes = 8 * 1024 * 1024;
+
+  ShardedEventQueue(unsigned nb_shards, Handler handler,
+                    size_t max_pending_bytes = k_default_max_pending_bytes);
+  ~ShardedEventQueue();
+
+  ShardedEventQueue(const ShardedEventQueue &) = delete;
+  ShardedEventQueue &operator=(const ShardedEventQueue &) = delete;
+
+  // Returns the first error reported by the handler of the shard
+  DDRes push(pid_t pid, const perf_event_header *hdr, int watcher_pos);
+
+  // Hand pending events over to the threads
+  DDRes flush();
+
+  // Wait until all the pushed events are handled
+  // Returns the first error reported by a handler
+  DDRes drain();
+
+  [[nodiscard]] unsigned shard_of(pid_t pid) const {
+    return static_cast<uint32_t>(pid) % _shards.size();
+  }
+  [[nodiscard]] unsigned nb_shards() const { return _shards.size(); }
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    // signaled when events are available (or on stop)
+    std::condition_variable events_cv;
+    // signaled when events were taken over by the thread
+    std::condition_variable progress_cv;
+    std::vector<std::byte> pending;
+    bool busy{false};
+    bool stop{false};
+    DDRes error{};
+    // only accessed by the producer
+    std::vector<std::byte> staging;
+    std::thread thread;
+  };
+
+  void run(Shard &shard, unsigned shard_idx);
+  DDRes handle_batch(unsigned shard_idx, const std::vector<std::byte> &batch);
+  DDRes flush(Shard &shard);
+
+  std::vector<std::unique_ptr<Shard>> _shards;
+  Handler _handler;
+  size_t _max_pending_bytes;
+};
+
+} // namespace ddprof
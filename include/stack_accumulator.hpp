@@ -0,0 +1,86 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres.hpp"
+#include "map_utils.hpp"
+#include "pprof/ddprof_pprof.hpp"
+#include "unwind_output.hpp"
+#include "unwind_output_hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ddprof {
+
+// Keeps the values of unwound stacks until they are aggregated into a profile.
+// Identical stacks are only stored once: values of samples without timestamp
+// are summed, timestamped samples are kept individually.
+// Labels are copied, so stacks outlive the processes they were unwound from.
+class StackAccumulator {
+public:
+  void add(int watcher_pos, const UnwindOutput &output,
+           const DDProfValuePack &pack);
+
+  // func(int watcher_pos, const UnwindOutput &output,
+  //      const DDProfValuePack &pack) is called for every summed stack then for
+  // every timestamped sample. Iteration stops on the first error.
+  template <typename Func> DDRes for_each(Func &&func) const {
+    for (const Stack &stack : _stacks) {
+      if (stack._total.count != 0) {
+        DDRES_CHECK_FWD(func(stack._watcher_pos, *stack._output, stack._total));
+      }
+    }
+    for (const TimedSample &sample : _timed_samples) {
+      const Stack &stack = _stacks[sample._stack_idx];
+      DDRES_CHECK_FWD(func(stack._watcher_pos, *stack._output, sample._pack));
+    }
+    return {};
+  }
+
+  // func(int watcher_pos, const UnwindOutput &output) is called once for
+  // every distinct stack
+  template <typename Func> void for_each_stack(Func &&func) const {
+    for (const Stack &stack : _stacks) {
+      func(stack._watcher_pos, *stack._output);
+    }
+  }
+
+  void clear();
+
+  [[nodiscard]] size_t nb_stacks() const { return _stacks.size(); }
+  [[nodiscard]] size_t nb_timed_samples() const {
+    return _timed_samples.size();
+  }
+  [[nodiscard]] bool empty() const { return _stacks.empty(); }
+
+private:
+  struct Stack {
+    const UnwindOutput *_output;
+    int _watcher_pos;
+    DDProfValuePack _total;
+  };
+
+  struct TimedSample {
+    uint32_t _stack_idx;
+    DDProfValuePack _pack;
+  };
+
+  using StackMap = std::unordered_map<UnwindOutput, uint32_t, UnwindOutputHash>;
+
+  std::string_view intern(std::string_view str);
+
+  // One map per watcher (node based: stacks reference the keys)
+  std::vector<StackMap> _stack_maps;
+  std::vector<Stack> _stacks;
+  std::vector<TimedSample> _timed_samples;
+  HeterogeneousLookupStringSet _strings;
+};
+
+} // namespace ddprof
@@ -0,0 +1,58 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+#include "ddprof_file_info-i.hpp"
+#include "lru_cache.hpp"
+#include "unique_fd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ddprof {
+
+// Executable mapping of the sampled process
+struct CodeRange {
+  ProcessAddress_t start;
+  ProcessAddress_t end; // excluded
+};
+
+// Append the positions of the words that fall in one of the ranges.
+// Ranges are sorted and do not overlap. Most words of a stack are not code
+// addresses: they are first checked against the bounds of all the ranges,
+// several words at a time.
+void find_code_addresses(std::span<const uint64_t> words,
+                         std::span<const CodeRange> ranges,
+                         std::vector<uint32_t> &positions);
+
+// Bytes read before a return address to recognize a call instruction
+inline constexpr size_t k_max_call_size = 7;
+
+// Whether the code ends with a call instruction (code precedes a return
+// address)
+bool ends_with_call(std::span<const std::byte> code);
+
+// Code of the scanned mappings, read from their files
+class CodeReader {
+public:
+  // Read the bytes that precede a file offset
+  bool read_before(FileInfoId_t file_info_id, const std::string &path,
+                   Offset_t offset, std::span<std::byte> code);
+
+  void clear() { _files.clear(); }
+
+  // Files kept open between samples
+  static constexpr size_t k_max_open_files = 16;
+
+private:
+  LRUCache<FileInfoId_t, UniqueFd> _files{k_max_open_files};
+};
+
+} // namespace ddprof
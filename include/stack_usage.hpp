@@ -0,0 +1,91 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace ddprof {
+
+// Sizes of the user stack copies a watcher switches between when the stack
+// sample size is adaptive: a quarter of the configured size, the configured
+// size and the largest size. Sorted, sizes can repeat.
+inline constexpr size_t k_nb_stack_tiers{3};
+using StackSizeTiers = std::array<uint32_t, k_nb_stack_tiers>;
+
+// Leaves room for the registers and the callchain within the 64 KiB of a
+// perf sample (bigger copies are silently reduced by the kernel)
+inline constexpr uint32_t k_max_stack_tier_size{60000};
+inline constexpr uint32_t k_min_stack_tier_size{1024};
+
+constexpr StackSizeTiers stack_size_tiers(uint32_t stack_sample_size) {
+  // Stack sizes are 8 bytes aligned
+  uint32_t const small_size = (stack_sample_size / 4) & ~7U;
+  return {small_size >= k_min_stack_tier_size ? small_size : stack_sample_size,
+          stack_sample_size,
+          std::max(stack_sample_size, k_max_stack_tier_size)};
+}
+
+// Stack bytes needed by the samples of a process
+class StackUsageHistogram {
+public:
+  static constexpr uint32_t k_bucket_size{1024};
+  static constexpr size_t k_nb_buckets{64};
+
+  void add(uint64_t stack_bytes) {
+    size_t const bucket =
+        std::min<uint64_t>(stack_bytes / k_bucket_size, k_nb_buckets - 1);
+    ++_buckets[bucket];
+    ++_count;
+  }
+
+  [[nodiscard]] uint64_t count() const { return _count; }
+
+  // Stack bytes enough for pct % of the samples (rounded up to the bucket)
+  [[nodiscard]] uint32_t percentile(uint32_t pct) const {
+    uint64_t const target = (_count * pct + 99) / 100;
+    uint64_t cumulated = 0;
+    for (size_t i = 0; i < k_nb_buckets; ++i) {
+      cumulated += _buckets[i];
+      if (cumulated >= target) {
+        return static_cast<uint32_t>(i + 1) * k_bucket_size;
+      }
+    }
+    return static_cast<uint32_t>(k_nb_buckets) * k_bucket_size;
+  }
+
+  // Samples of previous cycles are given a decreasing weight
+  void decay() {
+    _count = 0;
+    for (auto &bucket : _buckets) {
+      bucket /= 2;
+      _count += bucket;
+    }
+  }
+
+private:
+  std::array<uint32_t, k_nb_buckets> _buckets{};
+  uint64_t _count{};
+};
+
+struct ProcessStackUsage {
+  uint32_t stack_bytes; // percentile of the stack usage of the process
+  uint64_t nb_samples;
+};
+
+inline constexpr uint32_t k_stack_usage_pct{95};
+
+// Smallest tier holding the stacks of k_stack_usage_pct % of the samples,
+// a sample needing the stack bytes of its process.
+// Without samples, the current size is kept.
+uint32_t stack_tier_from_usage(const StackSizeTiers &tiers,
+                               std::span<const ProcessStackUsage> usages,
+                               uint32_t current_size);
+
+} // namespace ddprof
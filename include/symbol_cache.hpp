@@ -0,0 +1,112 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+#include "ddres_def.hpp"
+#include "lru_cache.hpp"
+#include "map_utils.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ddprof {
+
+// Symbolization result of an address, the outermost function comes last
+struct CachedFrame {
+  std::string_view name; // demangled
+  std::string_view file; // empty if unknown
+  uint32_t line{0};
+};
+
+// Symbols of a binary, persisted in an append-only file.
+// Records written by previous runs are mapped and referenced in place.
+// Results added during the run are written on flush.
+class SymbolCacheFile {
+public:
+  explicit SymbolCacheFile(std::string path) : _path(std::move(path)) {}
+  ~SymbolCacheFile();
+
+  SymbolCacheFile(const SymbolCacheFile &) = delete;
+  SymbolCacheFile &operator=(const SymbolCacheFile &) = delete;
+
+  // Map the file (if it exists) and index its records
+  DDRes load();
+
+  // Empty if the address is unknown
+  [[nodiscard]] std::span<const CachedFrame> find(ElfAddress_t addr) const;
+  void add(ElfAddress_t addr, std::span<const CachedFrame> frames);
+
+  // Append the records added since the last flush
+  DDRes flush();
+
+  [[nodiscard]] size_t size() const { return _entries.size(); }
+
+  bool visited{true};
+
+private:
+  struct Entry {
+    uint32_t first_frame;
+    uint32_t nb_frames;
+  };
+
+  void index(ElfAddress_t addr, std::span<const CachedFrame> frames);
+
+  std::string _path;
+  void *_addr{nullptr};
+  size_t _mapped_size{0};
+  size_t _valid_size{0}; // end of the last complete record
+  std::unordered_map<ElfAddress_t, Entry> _entries;
+  std::vector<CachedFrame> _frames;
+  // Strings of the records added since the file was mapped
+  HeterogeneousLookupStringSet _strings;
+  std::string _pending; // serialized records
+};
+
+// Symbolization results keyed by build id, kept across restarts in a
+// directory. Files are evicted least recently used first once the directory
+// exceeds its size limit.
+class SymbolCache {
+public:
+  struct Stats {
+    uint64_t _nb_hits{};
+    uint64_t _nb_misses{};
+  };
+
+  // Files differ depending on the inlined functions setting
+  SymbolCache(std::string dir, uint64_t max_bytes, bool inlined_functions);
+
+  // Create the directory
+  DDRes init();
+
+  // nullptr if the file can not be used
+  SymbolCacheFile *get(std::string_view build_id);
+
+  // Write new results, release the files that were not used during the cycle
+  // and enforce the size limit
+  void cycle();
+
+  Stats &stats() { return _stats; }
+  // Stats accumulated until the last call to cycle
+  [[nodiscard]] const Stats &cycle_stats() const { return _cycle_stats; }
+
+  // Keep the files that are mapped
+  static constexpr size_t k_max_files = 512;
+
+private:
+  std::string _dir;
+  uint64_t _max_bytes;
+  std::string_view _suffix;
+  LRUCache<std::string, SymbolCacheFile> _files;
+  Stats _stats;
+  Stats _cycle_stats;
+};
+
+} // namespace ddprof
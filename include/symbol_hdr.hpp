@@ -10,18 +10,50 @@
 #include "common_symbol_lookup.hpp"
 #include "ddres_def.hpp"
 #include "dso_symbol_lookup.hpp"
+#include "kernel_symbol_lookup.hpp"
 #include "logger.hpp"
 #include "mapinfo_lookup.hpp"
 #include "runtime_symbol_lookup.hpp"
+#include "table_compaction.hpp"
+#include "unwind_output.hpp"
 
 #include <cstdlib>
 
 namespace ddprof {
 struct SymbolHdr {
+  // Number of cycles without references before an element can be reclaimed
+  static constexpr uint32_t k_default_max_age_cycles = 4;
+
   explicit SymbolHdr(std::string_view path_to_proc = "")
       : _runtime_symbol_lookup(path_to_proc) {}
   void display_stats() const { _dso_symbol_lookup.stats_display(); }
-  void cycle() { _runtime_symbol_lookup.cycle(); }
+  void cycle() {
+    _runtime_symbol_lookup.cycle();
+    _kernel_symbol_lookup.cycle();
+    _symbol_epochs.cycle(_symbol_table.size());
+    _mapinfo_epochs.cycle(_mapinfo_table.size());
+  }
+
+  // Flag table elements as referenced during this cycle
+  void mark_used(SymbolIdx_t symbol_idx, MapInfoIdx_t map_info_idx) {
+    _symbol_epochs.touch(symbol_idx);
+    _mapinfo_epochs.touch(map_info_idx);
+  }
+
+  void mark_used(const UnwindOutput &output) {
+    for (const FunLoc &loc : output.locs) {
+      mark_used(loc.symbol_idx, loc.map_info_idx);
+    }
+  }
+
+  // Remove the symbols and mappings that were not referenced during the last
+  // max_age cycles. Caches are updated accordingly.
+  // Compaction only happens when enough elements can be reclaimed. Returns
+  // true (and fills the remap tables) if the tables were compacted. Indexes
+  // that are stored outside of the symbol header should be updated with the
+  // remap tables.
+  bool compact(uint32_t max_age, TableRemap &symbol_remap,
+               TableRemap &mapinfo_remap);
 
   void clear(pid_t pid) {
     _base_frame_symbol_lookup.erase(pid);
@@ -35,6 +67,7 @@ struct SymbolHdr {
   CommonSymbolLookup _common_symbol_lookup;
   DsoSymbolLookup _dso_symbol_lookup;
   RuntimeSymbolLookup _runtime_symbol_lookup;
+  KernelSymbolLookup _kernel_symbol_lookup;
   // Symbol table (contains the references to strings)
   SymbolTable _symbol_table;
 
@@ -44,6 +77,10 @@ struct SymbolHdr {
 
   // The mapping table
   MapInfoTable _mapinfo_table;
+
+  // Last cycle in which table elements were used
+  EpochTracker _symbol_epochs;
+  EpochTracker _mapinfo_epochs;
 };
 
 } // namespace ddprof
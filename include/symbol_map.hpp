@@ -25,6 +25,8 @@ public:
 
   [[nodiscard]] SymbolIdx_t get_symbol_idx() const { return _symbol_idx; }
 
+  void set_symbol_idx(SymbolIdx_t symbol_idx) { _symbol_idx = symbol_idx; }
+
 private:
   // symbol end within the segment (considering file offset)
   Offset_t _end;
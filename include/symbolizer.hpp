@@ -6,15 +6,20 @@
 
 #include "datadog/blazesym.h"
 #include "ddprof_defs.hpp"
-#include "ddprof_file_info-i.hpp"
+#include "ddprof_file_info.hpp"
 #include "ddres_def.hpp"
+#include "demangler/demangle_cache.hpp"
+#include "lru_cache.hpp"
 #include "map_utils.hpp"
 #include "mapinfo_table.hpp"
+#include "symbol_cache.hpp"
 
 #include <memory>
+#include <memory_resource>
 #include <span>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 struct ddog_prof_Location;
@@ -36,6 +41,8 @@ public:
 
   struct BlazeResultsWrapper {
     BlazeResultsWrapper() = default;
+    explicit BlazeResultsWrapper(std::pmr::memory_resource *resource)
+        : blaze_results(resource) {}
     ~BlazeResultsWrapper() {
       for (auto &result : blaze_results) {
         blaze_result_free(result);
@@ -63,7 +70,7 @@ public:
       return *this;
     }
 
-    std::vector<const blaze_result *> blaze_results;
+    std::pmr::vector<const blaze_result *> blaze_results;
   };
 
   /// Fills the locations at the write index using address and elf source.
@@ -78,14 +85,46 @@ public:
   /// write_index - input / output parameter updated based on what is written
   /// results - A handle object for lifetime of strings.
   ///          Should be kept until interned strings are no longer needed.
+  /// skip_symbolization - only write addresses (e.g. when shedding work)
   DDRes symbolize_pprof(std::span<ElfAddress_t> addrs,
                         std::span<ProcessAddress_t> process_addrs,
                         FileInfoId_t file_id, const std::string &elf_src,
                         const MapInfo &map_info,
                         std::span<ddog_prof_Location> locations,
-                        unsigned &write_index, BlazeResultsWrapper &results);
+                        unsigned &write_index, BlazeResultsWrapper &results,
+                        bool skip_symbolization = false);
+
+  /// Batched symbolization: the addresses of the stacks about to be
+  /// aggregated are added, then symbolized with a single call per file
+  /// (sorted and deduplicated). symbolize_pprof uses these results until
+  /// end_batch.
+  void add_to_batch(FileInfoId_t file_id, ElfAddress_t elf_addr,
+                    MapInfoIdx_t map_info_idx) {
+    _batch_addrs.push_back({file_id, elf_addr, map_info_idx});
+  }
+  DDRes symbolize_batch(const FileInfoVector &file_infos,
+                        const MapInfoTable &mapinfo_table);
+  void end_batch();
+
+  // Keep symbolization results on disk, keyed by build id, so that they are
+  // not computed again after a restart
+  DDRes init_symbol_cache(std::string dir, uint64_t max_bytes);
+
+  // Release the symbolizers that were not used during the cycle, and the
+  // least recently used ones when above k_max_symbolizers
   int remove_unvisited();
   void reset_unvisited_flag();
+  [[nodiscard]] uint64_t nb_evicted() const {
+    return _symbolizer_map.stats()._nb_evictions;
+  }
+  // Stats of the last cycle
+  [[nodiscard]] SymbolCache::Stats symbol_cache_stats() const {
+    return _symbol_cache ? _symbol_cache->cycle_stats() : SymbolCache::Stats{};
+  }
+  void reset_stats() { _symbolizer_map.reset_stats(); }
+
+  // Each symbolizer keeps the file (and its debug info) opened
+  static constexpr size_t k_max_symbolizers = 512;
 
 private:
   struct BlazeSymbolizerDeleter {
@@ -112,7 +151,6 @@ private:
 
     blaze_symbolizer_opts opts;
     std::unique_ptr<blaze_symbolizer, BlazeSymbolizerDeleter> symbolizer;
-    ddprof::HeterogeneousLookupStringMap<std::string> demangled_names;
     std::string elf_src;
     bool visited{true};
     bool use_debug;
@@ -121,7 +159,55 @@ private:
   BlazeSymbolizerWrapper &get_symbolizer(FileInfoId_t file_id,
                                          const std::string &elf_src);
 
-  std::unordered_map<FileInfoId_t, BlazeSymbolizerWrapper> _symbolizer_map;
+  // nullptr on failure
+  static const blaze_result *
+  symbolize_elf(BlazeSymbolizerWrapper &symbolizer_wrapper,
+                std::span<const ElfAddress_t> elf_addrs);
+
+  struct BatchAddress {
+    FileInfoId_t file_id;
+    ElfAddress_t elf_addr;
+    MapInfoIdx_t map_info_idx;
+  };
+
+  // Addresses of a file in _batch_elf_addrs, and their symbols
+  struct FileBatch {
+    size_t first_addr;
+    size_t nb_addrs;
+    const blaze_result *blaze_res; // nullptr on failure
+  };
+
+  // Symbolize the addresses that are not in the cache yet and add them
+  void update_cache(SymbolCacheFile &cache,
+                    std::span<const ElfAddress_t> elf_addrs,
+                    FileInfoId_t file_id, const std::string &elf_src,
+                    std::pmr::memory_resource *resource, bool count_stats);
+
+  // Only the addresses that are not in the cache are symbolized
+  DDRes symbolize_cached(SymbolCacheFile &cache,
+                         std::span<ElfAddress_t> elf_addrs,
+                         std::span<ProcessAddress_t> process_addrs,
+                         FileInfoId_t file_id, const std::string &elf_src,
+                         const MapInfo &map_info,
+                         std::span<ddog_prof_Location> locations,
+                         unsigned &write_index, BlazeResultsWrapper &results);
+
+  DDRes symbolize_batched(const FileBatch &file_batch,
+                          std::span<ElfAddress_t> elf_addrs,
+                          std::span<ProcessAddress_t> process_addrs,
+                          const MapInfo &map_info,
+                          std::span<ddog_prof_Location> locations,
+                          unsigned &write_index);
+
+  // Not bounded while symbolizing: only shrunk by remove_unvisited
+  LRUCache<FileInfoId_t, BlazeSymbolizerWrapper> _symbolizer_map;
+  std::unique_ptr<SymbolCache> _symbol_cache; // null if disabled
+  DemangleCache &_demangle_cache{DemangleCache::global()};
+  std::vector<BatchAddress> _batch_addrs;
+  std::vector<ElfAddress_t> _batch_elf_addrs; // sorted for each file
+  std::unordered_map<FileInfoId_t, FileBatch> _batch;
+  BlazeResultsWrapper _batch_results;
+  bool _in_batch{false};
   bool inlined_functions;
   bool _disable_symbolization;
   AddrFormat _reported_addr_format;
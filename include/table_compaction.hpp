@@ -0,0 +1,131 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ddprof {
+
+// Maps an index of a table before compaction to its index after compaction
+using TableRemap = std::vector<int32_t>;
+inline constexpr int32_t k_table_idx_removed = -1;
+
+// Returns false if the element was removed, otherwise updates the index
+inline bool remap_index(const TableRemap &remap, int32_t &idx) {
+  if (idx < 0 || static_cast<size_t>(idx) >= remap.size()) {
+    // negative indexes are null values, an empty remap means the table was
+    // left untouched
+    return true;
+  }
+  idx = remap[idx];
+  return idx != k_table_idx_removed;
+}
+
+// Update indexes stored as values of an associative container.
+// Entries pointing to removed elements are erased.
+template <typename Map, typename GetIdx>
+void remap_map_values(Map &map, const TableRemap &remap, GetIdx get_idx) {
+  for (auto it = map.begin(); it != map.end();) {
+    if (!remap_index(remap, get_idx(it->second))) {
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+template <typename Map>
+void remap_map_values(Map &map, const TableRemap &remap) {
+  remap_map_values(map, remap, [](auto &idx) -> int32_t & { return idx; });
+}
+
+// Keeps track of the last cycle (epoch) in which elements of a table were
+// referenced. Elements that were never referenced are tagged with the epoch in
+// which they were first seen.
+class EpochTracker {
+public:
+  void touch(int32_t idx) {
+    if (idx < 0) {
+      return;
+    }
+    if (static_cast<size_t>(idx) >= _epochs.size()) {
+      _epochs.resize(idx + 1, _epoch);
+    }
+    _epochs[idx] = _epoch;
+  }
+
+  // Start a new epoch, elements added to the table since the last cycle are
+  // tagged with the current epoch
+  void cycle(size_t table_size) {
+    if (table_size > _epochs.size()) {
+      _epochs.resize(table_size, _epoch);
+    }
+    ++_epoch;
+  }
+
+  [[nodiscard]] bool is_stale(size_t idx, uint32_t max_age) const {
+    const uint32_t last_epoch = idx < _epochs.size() ? _epochs[idx] : _epoch;
+    return _epoch - last_epoch > max_age;
+  }
+
+  [[nodiscard]] size_t count_stale(size_t table_size, uint32_t max_age) const {
+    size_t count = 0;
+    for (size_t i = 0; i < table_size; ++i) {
+      count += is_stale(i, max_age) ? 1 : 0;
+    }
+    return count;
+  }
+
+  [[nodiscard]] uint32_t epoch() const { return _epoch; }
+
+  // Move the epoch of the element at position "from" to position "to"
+  void move(size_t from, size_t to) {
+    if (from < _epochs.size()) {
+      assert(to < _epochs.size());
+      _epochs[to] = _epochs[from];
+    }
+  }
+
+  void resize(size_t size) {
+    if (size < _epochs.size()) {
+      _epochs.resize(size);
+    }
+  }
+
+private:
+  std::vector<uint32_t> _epochs;
+  uint32_t _epoch{0};
+};
+
+// Remove elements that were not referenced during the last max_age cycles.
+// Surviving elements keep their relative order.
+// Returns the remap table that should be applied to every stored index.
+template <typename T>
+TableRemap compact_table(std::vector<T> &table, EpochTracker &tracker,
+                         uint32_t max_age) {
+  TableRemap remap(table.size(), k_table_idx_removed);
+  size_t new_size = 0;
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (tracker.is_stale(i, max_age)) {
+      continue;
+    }
+    if (new_size != i) {
+      table[new_size] = std::move(table[i]);
+      tracker.move(i, new_size);
+    }
+    remap[i] = static_cast<int32_t>(new_size);
+    ++new_size;
+  }
+  table.resize(new_size);
+  table.shrink_to_fit();
+  tracker.resize(new_size);
+  return remap;
+}
+
+} // namespace ddprof
@@ -29,4 +29,7 @@ void unwind_cycle(UnwindState *us);
 // Clear unwinding structures of this pid
 void unwind_pid_free(UnwindState *us, pid_t pid);
 
+// Clear unwinding structures of a live pid that is no longer unwound
+void unwind_pid_evict(UnwindState *us, pid_t pid);
+
 } // namespace ddprof
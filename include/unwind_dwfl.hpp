@@ -8,6 +8,9 @@
 #include "ddprof_process.hpp"
 #include "ddres_def.hpp"
 
+#include <cstdint>
+#include <span>
+
 namespace ddprof {
 
 struct UnwindState;
@@ -16,4 +19,8 @@ DDRes unwind_init_dwfl(Process &process, UnwindState *us);
 
 DDRes unwind_dwfl(Process &process, bool avoid_new_attach, UnwindState *us);
 
+// Add the frames of a user callchain captured by the kernel (leaf first)
+DDRes unwind_callchain(Process &process, bool avoid_new_attach,
+                       std::span<const uint64_t> ips, UnwindState *us);
+
 } // namespace ddprof
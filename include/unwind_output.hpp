@@ -18,6 +18,14 @@
 
 namespace ddprof {
 
+// Work shed on a sample when the worker falls behind (increasing levels)
+enum class OverloadTier : uint8_t {
+  kNone = 0,
+  kNoSymbolization, // addresses only
+  kTruncatedStack,  // top frames only
+  kCountOnly,       // sample is counted with a synthetic frame
+};
+
 struct FunLoc {
   ProcessAddress_t ip;
   ElfAddress_t elf_addr;
@@ -34,11 +42,13 @@ struct UnwindOutput {
     container_id = k_container_id_unknown;
     exe_name = {};
     thread_name = {};
+    overload_tier = OverloadTier::kNone;
   }
   std::vector<FunLoc> locs;
   std::string_view container_id;
   std::string_view exe_name;
   std::string_view thread_name;
+  OverloadTier overload_tier{OverloadTier::kNone};
   int pid;
   int tid;
   friend auto operator<=>(const UnwindOutput &, const UnwindOutput &) = default;
@@ -3,6 +3,8 @@
 // developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
 // Datadog, Inc.
 
+#pragma once
+
 #include "unwind_output.hpp"
 
 #include "hash_helper.hpp"
@@ -14,6 +16,7 @@ struct UnwindOutputHash {
     std::size_t seed = 0;
     hash_combine(seed, uo.pid);
     hash_combine(seed, uo.tid);
+    hash_combine(seed, static_cast<uint8_t>(uo.overload_tier));
     for (const auto &fl : uo.locs) {
       hash_combine(seed, fl.ip);
       // no need to hash fl.elf_addr since it's derived from fl.ip
@@ -14,10 +14,12 @@
 #include "dwfl_wrapper.hpp"
 #include "perf.hpp"
 #include "perf_archmap.hpp"
+#include "stack_scan.hpp"
 #include "symbol_hdr.hpp"
 #include "unwind_output.hpp"
 
 #include <optional>
+#include <span>
 #include <sys/types.h>
 
 using Dwfl = struct Dwfl;
@@ -52,6 +54,7 @@ struct UnwindState {
   DwflWrapper *_dwfl_wrapper{nullptr}; // pointer to current dwfl element
   DsoHdr dso_hdr;
   SymbolHdr symbol_hdr;
+  DwflModuleCache module_cache;
   ProcessHdr process_hdr;
 
   pid_t pid{-1};
@@ -60,8 +63,20 @@ struct UnwindState {
 
   UnwindRegisters initial_regs;
   ProcessAddress_t current_ip{0};
+  ProcessAddress_t max_stack_read{0}; // highest stack slot read by unwinding
+  bool dwarf_unwound{false}; // the stack copy was unwound with DWARF
+
+  // Callchain of the sample, used instead of the stack copy depending on
+  // the unwinding mode of the watcher
+  std::span<const uint64_t> callchain;
+  EventConfUnwindMode unwind_mode{EventConfUnwindMode::kDwarf};
+
+  // Scan the stack for return addresses when unwinding stops early
+  bool stack_scan{false};
+  CodeReader code_reader;
 
   UnwindOutput output;
+  size_t max_stack_depth{kMaxStackDepth}; // lowered when shedding work
   UniqueElf ref_elf; // reference elf object used to initialize dwfl
   int maximum_pids;
   bool is_timeline;
@@ -0,0 +1,75 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddres_def.hpp"
+#include "sharded_event_queue.hpp"
+#include "stack_accumulator.hpp"
+#include "symbolizer.hpp"
+#include "unwind_state.hpp"
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace ddprof {
+
+// State owned by one thread of the unwinding pool
+struct WorkerShard {
+  WorkerShard(UnwindState unwind_state, bool inlined_functions,
+              bool disable_symbolization,
+              Symbolizer::AddrFormat reported_addr_format)
+      : us(std::move(unwind_state)),
+        symbolizer(inlined_functions, disable_symbolization,
+                   reported_addr_format) {}
+
+  UnwindState us;
+  // File ids are specific to the dso header of the shard
+  Symbolizer symbolizer;
+  // Stacks unwound during the current cycle, aggregated into the profile by
+  // the thread of the shard when they grow too many, and by the worker at the
+  // end of the cycle (only then is the shard guaranteed to be idle)
+  StackAccumulator stacks;
+};
+
+// Threads unwinding samples in parallel.
+// Processes are sharded by pid: a process (and its dwfl / dso state) is only
+// ever accessed by the thread of the shard owning the pid.
+class UnwindingPool {
+public:
+  using EventHandler = std::function<DDRes(
+      WorkerShard &shard, const perf_event_header *hdr, int watcher_pos)>;
+
+  UnwindingPool(std::vector<std::unique_ptr<WorkerShard>> shards,
+                EventHandler handler)
+      : _shards(std::move(shards)), _handler(std::move(handler)),
+        _queue(_shards.size(),
+               [this](unsigned shard_idx, const perf_event_header *hdr,
+                      int watcher_pos) {
+                 return _handler(*_shards[shard_idx], hdr, watcher_pos);
+               }) {}
+
+  DDRes push(pid_t pid, const perf_event_header *hdr, int watcher_pos) {
+    return _queue.push(pid, hdr, watcher_pos);
+  }
+  DDRes flush() { return _queue.flush(); }
+  // Shards can only be accessed from other threads once drained
+  DDRes drain() { return _queue.drain(); }
+
+  WorkerShard &shard_of(pid_t pid) { return *_shards[_queue.shard_of(pid)]; }
+  [[nodiscard]] std::span<const std::unique_ptr<WorkerShard>> shards() const {
+    return _shards;
+  }
+
+private:
+  std::vector<std::unique_ptr<WorkerShard>> _shards;
+  EventHandler _handler;
+  // Declared last: threads are stopped before the shards are destroyed
+  ShardedEventQueue _queue;
+};
+
+} // namespace ddprof
@@ -0,0 +1,54 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "adaptive_wakeup.hpp"
+
+#include <algorithm>
+
+namespace ddprof {
+
+namespace {
+// Weight of the latest observation in the smoothed fill rate
+constexpr double k_rate_smoothing = 0.5;
+} // namespace
+
+bool AdaptiveWakeup::observe(size_t ring_idx, uint64_t writer_pos,
+                             size_t ring_size, Clock::time_point now) {
+  RingRate &ring = _rings[ring_idx];
+  bool const new_data = writer_pos != ring.writer_pos;
+  ring.ring_size = ring_size;
+  if (ring.initialized) {
+    auto const elapsed =
+        std::chrono::duration<double, std::milli>(now - ring.time).count();
+    if (elapsed <= 0) {
+      return new_data;
+    }
+    double const rate =
+        static_cast<double>(writer_pos - ring.writer_pos) / elapsed;
+    // React immediately to bursts, decay progressively when activity drops
+    double const smoothed_rate =
+        k_rate_smoothing * rate + (1 - k_rate_smoothing) * ring.bytes_per_ms;
+    ring.bytes_per_ms = std::max(rate, smoothed_rate);
+  }
+  ring.writer_pos = writer_pos;
+  ring.time = now;
+  ring.initialized = true;
+  return new_data;
+}
+
+std::chrono::milliseconds AdaptiveWakeup::timeout() const {
+  double timeout_ms = k_max_timeout.count();
+  for (const RingRate &ring : _rings) {
+    if (ring.bytes_per_ms > 0) {
+      double const fill_ms = k_target_fill_ratio *
+          static_cast<double>(ring.ring_size) / ring.bytes_per_ms;
+      timeout_ms = std::min(timeout_ms, fill_ms);
+    }
+  }
+  return std::max(k_min_timeout,
+                  std::chrono::milliseconds{static_cast<int64_t>(timeout_ms)});
+}
+
+} // namespace ddprof
@@ -0,0 +1,47 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "bump_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace ddprof {
+
+void BumpArena::release() {
+  if (_chunks.size() > 1) {
+    _chunks.resize(1);
+  }
+  rewind();
+}
+
+void *BumpArena::carve(size_t bytes, size_t alignment) {
+  Chunk &chunk = _chunks[_current];
+  auto const base = reinterpret_cast<uintptr_t>(chunk.data.get());
+  uintptr_t const aligned =
+      ((base + _offset + alignment - 1) & ~(alignment - 1)) - base;
+  if (aligned + bytes > chunk.size) {
+    return nullptr;
+  }
+  _offset = aligned + bytes;
+  return chunk.data.get() + aligned;
+}
+
+void *BumpArena::do_allocate(size_t bytes, size_t alignment) {
+  for (; _current < _chunks.size(); ++_current) {
+    if (void *ptr = carve(bytes, alignment)) {
+      return ptr;
+    }
+    _offset = 0;
+  }
+  size_t const size = std::max(_chunk_size, bytes + alignment);
+  _chunks.push_back(
+      {std::make_unique_for_overwrite<std::byte[]>(size), size});
+  _current = _chunks.size() - 1;
+  _offset = 0;
+  return carve(bytes, alignment);
+}
+
+} // namespace ddprof
@@ -0,0 +1,34 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "cpu_budget.hpp"
+
+#include <algorithm>
+
+namespace ddprof {
+
+uint32_t cpu_budget_period_scale(uint32_t scale_pct, int64_t cpu_millicores,
+                                 uint32_t max_cpu_percent) {
+  if (max_cpu_percent == 0) {
+    return k_nominal_period_scale_pct;
+  }
+  scale_pct = std::clamp(scale_pct, k_nominal_period_scale_pct,
+                         k_max_period_scale_pct);
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  int64_t const budget_millicores = static_cast<int64_t>(max_cpu_percent) * 10;
+  if (cpu_millicores <= budget_millicores &&
+      cpu_millicores * 4 >= budget_millicores * 3) {
+    return scale_pct;
+  }
+  // Aim for the budget: CPU usage scales with the inverse of the period
+  int64_t const target = (static_cast<int64_t>(scale_pct) *
+                          std::max<int64_t>(cpu_millicores, 0)) /
+      budget_millicores;
+  return static_cast<uint32_t>(
+      std::clamp<int64_t>(target, k_nominal_period_scale_pct,
+                          k_max_period_scale_pct));
+}
+
+} // namespace ddprof
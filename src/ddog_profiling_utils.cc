@@ -6,7 +6,6 @@
 #include "ddog_profiling_utils.hpp"
 
 #include "ddres.hpp"
-#include "demangler/demangler.hpp"
 
 namespace ddprof {
 void write_function(const Symbol &symbol, ddog_prof_Function *ffi_func) {
@@ -54,23 +53,11 @@ void write_location(ProcessAddress_t ip_or_elf_addr,
 
 // demangling caching based on stability of unordered map
 // This will be moved to the backend
-std::string_view get_or_insert_demangled_sym(
-    const char *sym,
-    ddprof::HeterogeneousLookupStringMap<std::string> &demangled_names) {
-  auto it = demangled_names.find(sym);
-  if (it == demangled_names.end()) {
-    std::string demangled_name = ddprof::Demangler::non_microsoft_demangle(sym);
-    it = demangled_names.insert({std::string(sym), std::move(demangled_name)})
-             .first;
-  }
-  return it->second;
-}
-
-DDRes write_location_blaze(
-    ProcessAddress_t ip_or_elf_addr,
-    ddprof::HeterogeneousLookupStringMap<std::string> &demangled_names,
-    const MapInfo &mapinfo, const blaze_sym &blaze_sym, unsigned &cur_loc,
-    std::span<ddog_prof_Location> locations_buff) {
+DDRes write_location_blaze(ProcessAddress_t ip_or_elf_addr,
+                           DemangleCache &demangle_cache,
+                           const MapInfo &mapinfo, const blaze_sym &blaze_sym,
+                           unsigned &cur_loc,
+                           std::span<ddog_prof_Location> locations_buff) {
   if (cur_loc >= locations_buff.size()) {
     return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
   }
@@ -81,7 +68,7 @@ DDRes write_location_blaze(
     const blaze_symbolize_inlined_fn *inlined_fn = blaze_sym.inlined + i;
     ddog_prof_Location &ffi_location = locations_buff[cur_loc];
     const std::string_view demangled_name = inlined_fn->name
-        ? get_or_insert_demangled_sym(inlined_fn->name, demangled_names)
+        ? demangle_cache.demangle(inlined_fn->name)
         : undef_inlined;
     write_location(ip_or_elf_addr, demangled_name,
                    inlined_fn->code_info.file
@@ -96,9 +83,8 @@ DDRes write_location_blaze(
   }
   ddog_prof_Location &ffi_location = locations_buff[cur_loc];
 
-  const std::string_view demangled_name = blaze_sym.name
-      ? get_or_insert_demangled_sym(blaze_sym.name, demangled_names)
-      : undef;
+  const std::string_view demangled_name =
+      blaze_sym.name ? demangle_cache.demangle(blaze_sym.name) : undef;
   write_location(ip_or_elf_addr, demangled_name,
                  blaze_sym.code_info.file
                      ? std::string_view{blaze_sym.code_info.file}
@@ -328,6 +328,29 @@ int DDProfCLI::parse(int argc, const char *argv[]) {
                      "Prefix path to capture pprof files locally")
           ->group("")
           ->envname("DD_PROFILING_PPROF_PREFIX"));
+  extended_options.push_back(
+      app.add_option("--export_spool_dir,--export-spool-dir",
+                     exporter_input.spool_dir,
+                     "Directory storing profiles that failed to export, "
+                     "replayed once the agent is reachable again")
+          ->group("")
+          ->envname("DD_PROFILING_EXPORT_SPOOL_DIR"));
+  extended_options.push_back(
+      app.add_option("--export_spool_max_mb,--export-spool-max-mb",
+                     exporter_input.spool_max_mb,
+                     "Maximum size of the export spool (MiB)")
+          ->default_val(64)
+          ->check(CLI::PositiveNumber)
+          ->group("")
+          ->envname("DD_PROFILING_EXPORT_SPOOL_MAX_MB"));
+  extended_options.push_back(
+      app.add_option("--export_spool_max_age,--export-spool-max-age",
+                     exporter_input.spool_max_age_s,
+                     "Maximum age of spooled profiles (seconds)")
+          ->default_val(3600)
+          ->check(CLI::PositiveNumber)
+          ->group("")
+          ->envname("DD_PROFILING_EXPORT_SPOOL_MAX_AGE"));
   extended_options.push_back(
       app.add_option("--agentless", exporter_input.agentless,
                      "Allow sending profiles directly to Datadog intake")
@@ -415,6 +438,81 @@ int DDProfCLI::parse(int argc, const char *argv[]) {
                                  ->default_val(k_default_max_profiled_pids)
                                  ->envname("DD_PROFILING_MAXIMUM_PIDS")
                                  ->group(""));
+
+  extended_options.push_back(
+      app.add_option("--unwinding-threads,--unwinding_threads",
+                     unwinding_threads,
+                     "Number of threads unwinding samples, processes are "
+                     "split between threads. 0 unwinds on the worker thread.")
+          ->default_val(0)
+          ->check(CLI::Range(0U, k_max_unwinding_threads))
+          ->envname("DD_PROFILING_UNWINDING_THREADS")
+          ->group(""));
+
+  extended_options.push_back(
+      app.add_option("--overload-thresholds,--overload_thresholds",
+                     overload_thresholds,
+                     "Ring buffer occupancy percentages (up to 3, comma "
+                     "separated) above which samples are degraded: "
+                     "no symbolization, truncated stacks, then count only. "
+                     "Empty disables overload shedding.")
+          ->delimiter(',')
+          ->check(CLI::Range(1U, 100U))
+          ->envname("DD_PROFILING_OVERLOAD_THRESHOLDS")
+          ->group(""));
+
+  extended_options.push_back(
+      app.add_option("--max-cpu-percent,--max_cpu_percent", max_cpu_percent,
+                     "CPU budget of the profiler, in percent of a core. "
+                     "Sampling periods are increased when it is exceeded "
+                     "(global mode only). 0 disables the budget.")
+          ->default_val(0)
+          ->check(CLI::NonNegativeNumber)
+          ->envname("DD_PROFILING_MAX_CPU_PERCENT")
+          ->group(""));
+
+  extended_options.push_back(
+      app.add_option("--export-queue-depth,--export_queue_depth",
+                     export_queue_depth,
+                     "Number of serialized profiles waiting to be sent. "
+                     "The oldest profile is dropped when the queue is full.")
+          ->default_val(2)
+          ->check(CLI::Range(1U, 64U))
+          ->envname("DD_PROFILING_EXPORT_QUEUE_DEPTH")
+          ->group(""));
+
+  extended_options.push_back(
+      app.add_option("--symbol-cache-dir,--symbol_cache_dir", symbol_cache_dir,
+                     "Directory keeping symbolization results across "
+                     "restarts, keyed by build id. Empty disables the cache.")
+          ->envname("DD_PROFILING_SYMBOL_CACHE_DIR")
+          ->group(""));
+  extended_options.push_back(
+      app.add_option("--symbol-cache-max-mb,--symbol_cache_max_mb",
+                     symbol_cache_max_mb,
+                     "Maximum size of the symbol cache directory (MiB)")
+          ->default_val(128)
+          ->check(CLI::PositiveNumber)
+          ->envname("DD_PROFILING_SYMBOL_CACHE_MAX_MB")
+          ->group(""));
+  extended_options.push_back(
+      app.add_flag("--stack-scan,--stack_scan", stack_scan,
+                   "When unwinding stops on a frame without unwinding "
+                   "information, recover its callers by scanning the stack "
+                   "for return addresses (heuristic).")
+          ->default_val(false)
+          ->envname("DD_PROFILING_STACK_SCAN")
+          ->group(""));
+  extended_options.push_back(
+      app.add_flag("--adaptive-stack-sample-size,--adaptive_stack_sample_size",
+                   adaptive_stack_sample_size,
+                   "Switch the size of the user stack copies between a "
+                   "quarter of the stack sample size, the stack sample size "
+                   "and the maximum size, following the stack usage of the "
+                   "profiled processes.")
+          ->default_val(false)
+          ->envname("DD_PROFILING_ADAPTIVE_STACK_SAMPLE_SIZE")
+          ->group(""));
   // Parse
   CLI11_PARSE(app, argc, argv);
 
@@ -491,6 +589,11 @@ void DDProfCLI::print() const {
   PRINT_NFO("  - port: %s", exporter_input.port.c_str());
   PRINT_NFO("  - do_export: %s", exporter_input.do_export ? "true" : "false");
   PRINT_NFO("  - runtime_id: %s", exporter_input.runtime_id.c_str());
+  if (!exporter_input.spool_dir.empty()) {
+    PRINT_NFO("  - export_spool_dir: %s (max %u MiB, %u s)",
+              exporter_input.spool_dir.c_str(), exporter_input.spool_max_mb,
+              exporter_input.spool_max_age_s);
+  }
 
   if (!tags.empty()) {
     PRINT_NFO("Tags: %s", tags.c_str());
@@ -533,6 +636,9 @@ void DDProfCLI::print() const {
   if (nice != -1) {
     PRINT_NFO("  - nice: %d", nice);
   }
+  if (unwinding_threads) {
+    PRINT_NFO("  - unwinding_threads: %u", unwinding_threads);
+  }
   PRINT_NFO("Debug:");
   PRINT_NFO("  - log_level: %s", log_level.c_str());
   PRINT_NFO("  - log_mode: %s", log_mode.c_str());
@@ -559,6 +665,30 @@ void DDProfCLI::print() const {
     PRINT_NFO("Extended:");
     PRINT_NFO("  - stack_sample_size: %u", default_stack_sample_size);
   }
+  if (!overload_thresholds.empty()) {
+    std::string thresholds;
+    for (uint32_t const threshold : overload_thresholds) {
+      if (!thresholds.empty()) {
+        thresholds += ',';
+      }
+      thresholds += std::to_string(threshold);
+    }
+    PRINT_NFO("  - overload_thresholds: %s", thresholds.c_str());
+  }
+  if (max_cpu_percent != 0) {
+    PRINT_NFO("  - max_cpu_percent: %u", max_cpu_percent);
+  }
+  PRINT_NFO("  - export_queue_depth: %u", export_queue_depth);
+  if (!symbol_cache_dir.empty()) {
+    PRINT_NFO("  - symbol_cache_dir: %s (max %u MiB)", symbol_cache_dir.c_str(),
+              symbol_cache_max_mb);
+  }
+  if (stack_scan) {
+    PRINT_NFO("  - stack_scan: true");
+  }
+  if (adaptive_stack_sample_size) {
+    PRINT_NFO("  - adaptive_stack_sample_size: true");
+  }
 }
 
 CommandLineWrapper DDProfCLI::get_user_command_line() const {
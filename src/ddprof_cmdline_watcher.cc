@@ -94,6 +94,22 @@ bool watcher_from_config(EventConf *conf, PerfWatcher *watcher) {
   watcher->tracepoint_group = conf->groupname;
   watcher->tracepoint_label = conf->label;
   watcher->options.stack_sample_size = conf->stack_sample_size;
+
+  // Configure how stacks are captured
+  if (conf->unwind_mode != EventConfUnwindMode::kDwarf) {
+    // Custom events are not sampled by the kernel: there is no callchain
+    if (watcher->type == kDDPROF_TYPE_CUSTOM) {
+      return false;
+    }
+    watcher->options.unwind_mode = conf->unwind_mode;
+    watcher->sample_type |= PERF_SAMPLE_CALLCHAIN;
+    if (conf->unwind_mode == EventConfUnwindMode::kCallchain) {
+      // No copy of the user stack (registers are kept, they can hold the
+      // sample value)
+      watcher->sample_type &= ~PERF_SAMPLE_STACK_USER;
+    }
+  }
+
   // Allocation watcher, has an extra field to ensure we capture address
 
   if (watcher->config == kDDPROF_COUNT_ALLOCATIONS) {
@@ -13,6 +13,7 @@
 #include "ipc.hpp"
 #include "logger.hpp"
 #include "logger_setup.hpp"
+#include "perf_ringbuffer.hpp"
 #include "presets.hpp"
 #include "prng.hpp"
 
@@ -94,6 +95,21 @@ void copy_cli_values(const DDProfCLI &ddprof_cli, DDProfContext &ctx) {
   ctx.params.disable_symbolization = ddprof_cli.disable_symbolization;
   ctx.params.reorder_events = ddprof_cli.reorder_events;
   ctx.params.maximum_pids = ddprof_cli.maximum_pids;
+  ctx.params.unwinding_threads = ddprof_cli.unwinding_threads;
+  ctx.params.overload_thresholds = ddprof_cli.overload_thresholds;
+  // Sampling periods are changed with PERF_EVENT_IOC_PERIOD, which does not
+  // reach the events inherited by the threads of a profiled pid: only the
+  // per-CPU events of global mode follow the budget
+  if (ddprof_cli.max_cpu_percent != 0 && !ddprof_cli.global) {
+    LG_WRN("CPU budget (max_cpu_percent) is only enforced in global mode");
+  } else {
+    ctx.params.max_cpu_percent = ddprof_cli.max_cpu_percent;
+  }
+  ctx.params.export_queue_depth = ddprof_cli.export_queue_depth;
+  ctx.params.symbol_cache_dir = ddprof_cli.symbol_cache_dir;
+  ctx.params.symbol_cache_max_mb = ddprof_cli.symbol_cache_max_mb;
+  ctx.params.stack_scan = ddprof_cli.stack_scan;
+  ctx.params.adaptive_stack_sample_size = ddprof_cli.adaptive_stack_sample_size;
 
   ctx.params.initial_loaded_libs_check_delay =
       ddprof_cli.initial_loaded_libs_check_delay;
@@ -136,6 +152,11 @@ DDRes context_add_watchers(const DDProfCLI &ddprof_cli, DDProfContext &ctx) {
 
   order_watchers(watchers);
 
+  // Sample types are final
+  for (auto &watcher : watchers) {
+    watcher.sample_decoder = sample_decoder_from_mask(watcher.sample_type);
+  }
+
   ctx.watchers = std::move(watchers);
   return {};
 }
@@ -150,8 +150,8 @@ std::optional<std::string> find_build_id(Elf *elf) {
   return std::nullopt;
 }
 
-DDRes find_elf_segment(Elf *elf, const std::string &filepath,
-                       Offset_t file_offset, Segment &segment) {
+DDRes read_load_segments(Elf *elf, const std::string &filepath,
+                         SharedModule &module) {
   GElf_Ehdr ehdr_mem;
   GElf_Ehdr *ehdr = gelf_getehdr(elf, &ehdr_mem);
   if (ehdr == nullptr) {
@@ -175,12 +175,19 @@ DDRes find_elf_segment(Elf *elf, const std::string &filepath,
         LG_WRN("Invalid elf %s", filepath.c_str());
         return ddres_error(DD_WHAT_INVALID_ELF);
       }
-      if (ph->p_type == PT_LOAD && file_offset >= ph->p_offset &&
-          file_offset < ph->p_offset + ph->p_filesz) {
-        segment =
-            Segment{ph->p_vaddr, ph->p_offset, elf_flags_to_prot(ph->p_flags)};
-        return {};
+      if (ph->p_type != PT_LOAD) {
+        continue;
       }
+      // Mirror the module range computed by dwfl from the elf file
+      if (module._load_segments.empty()) {
+        module._load_start = ph->p_vaddr & -ph->p_align;
+      }
+      if (ph->p_vaddr + ph->p_memsz > 0) {
+        module._load_end = ph->p_vaddr + ph->p_memsz;
+      }
+      module._load_segments.push_back(Segment{ph->p_vaddr, ph->p_offset,
+                                              ph->p_filesz,
+                                              elf_flags_to_prot(ph->p_flags)});
     }
     break;
   }
@@ -188,31 +195,30 @@ DDRes find_elf_segment(Elf *elf, const std::string &filepath,
     LG_WRN("Unsupported elf type (%d) %s", ehdr->e_type, filepath.c_str());
     return ddres_error(DD_WHAT_INVALID_ELF);
   }
-
-  LG_WRN("No LOAD segment found for offset %lx in %s", file_offset,
-         filepath.c_str());
-  return ddres_error(DD_WHAT_NO_MATCHING_LOAD_SEGMENT);
+  return {};
 }
 
-DDRes compute_elf_bias(Elf *elf, const std::string &filepath, const Dso &dso,
+DDRes compute_elf_bias(const SharedModule &module, const Dso &dso,
                        ProcessAddress_t pc, Offset_t &bias) {
   // Compute file offset from pc
   Offset_t const file_offset = pc - dso.start() + dso.offset();
 
-  Segment segment;
-  auto res = find_elf_segment(elf, filepath, file_offset, segment);
-  if (!IsDDResOK(res)) {
-    return res;
+  const Segment *segment = module.find_segment(file_offset);
+  if (!segment) {
+    LG_WRN("No LOAD segment found for offset %lx in %s", file_offset,
+           module._path.c_str());
+    return ddres_error(DD_WHAT_NO_MATCHING_LOAD_SEGMENT);
   }
 
-  bias = dso.start() - dso.offset() - (segment.addr - segment.offset);
+  bias = dso.start() - dso.offset() - (segment->addr - segment->offset);
 
   return {};
 }
 } // namespace
 
 DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
-                    const FileInfoValue &fileInfoValue, DDProfMod &ddprof_mod) {
+                    const FileInfoValue &fileInfoValue,
+                    DwflModuleCache &module_cache, DDProfMod &ddprof_mod) {
   const std::string &filepath = fileInfoValue.get_path();
   const char *module_name = strrchr(filepath.c_str(), '/') + 1;
   if (fileInfoValue.errored()) { // avoid bouncing on errors
@@ -237,24 +243,15 @@ DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
     return ddres_warn(DD_WHAT_MODULE);
   }
 
-  UniqueFd fd_holder{::open(filepath.c_str(), O_RDONLY)};
-  if (!fd_holder) {
-    LG_WRN("[Mod] Couldn't open fd to module (%s)", filepath.c_str());
-    return ddres_warn(DD_WHAT_MODULE);
-  }
-  LG_DBG("[Mod] Success opening %s, ", filepath.c_str());
-
-  // Load the file at a matching DSO address
-  dwfl_errno(); // erase previous error
-  Elf *elf = elf_begin(fd_holder.get(), ELF_C_READ_MMAP, nullptr);
-  if (elf == nullptr) {
-    LG_WRN("Invalid elf %s", filepath.c_str());
-    return ddres_error(DD_WHAT_INVALID_ELF);
+  // Elf file is parsed once for all processes
+  DwflModuleCache::SharedModulePtr shared_module;
+  auto res = module_cache.get_or_insert(fileInfoValue, shared_module);
+  if (!IsDDResOK(res)) {
+    return res;
   }
-  defer { elf_end(elf); };
 
   Offset_t bias = 0;
-  auto res = compute_elf_bias(elf, filepath, dso, pc, bias);
+  res = compute_elf_bias(*shared_module, dso, pc, bias);
   if (!IsDDResOK(res)) {
     fileInfoValue.set_errored();
     LG_WRN("Couldn't retrieve offsets from %s(%s)", module_name,
@@ -264,16 +261,12 @@ DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
 
   LG_NFO("Loading module %s for pid %d", fileInfoValue.get_path().c_str(),
          dso._pid);
-  ddprof_mod._mod = dwfl_report_elf(dwfl, module_name, filepath.c_str(),
-                                    fd_holder.get(), bias, true);
-
-  auto maybe_build_id = find_build_id(elf);
-
-  // Retrieve build id
-  if (maybe_build_id) {
-    ddprof_mod.set_build_id(std::move(maybe_build_id.value()));
-  }
-
+  dwfl_errno(); // erase previous error
+  // Only the address range is reported: the elf is handed over to dwfl by the
+  // find_elf callback when the module is first used (see dwfl_wrapper.cc)
+  ddprof_mod._mod =
+      dwfl_report_module(dwfl, module_name, shared_module->_load_start + bias,
+                         shared_module->_load_end + bias);
   if (!ddprof_mod._mod) {
     // Ideally we would differentiate pid errors from file errors.
     // For perf reasons we will just flag the file as errored
@@ -282,10 +275,12 @@ DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
            module_name, fileInfoValue.get_path().c_str());
     return ddres_warn(DD_WHAT_MODULE);
   }
-  // dwfl now has ownership of the file descriptor
-  (void)fd_holder.release(); // NOLINT
-  dwfl_module_info(ddprof_mod._mod, nullptr, &ddprof_mod._low_addr,
+  void **userdata = nullptr;
+  dwfl_module_info(ddprof_mod._mod, &userdata, &ddprof_mod._low_addr,
                    &ddprof_mod._high_addr, nullptr, nullptr, nullptr, nullptr);
+  // dwfl does not modify the elf object
+  *userdata = const_cast<SharedModule *>(shared_module.get());
+  ddprof_mod.set_build_id(shared_module->_build_id);
   LG_DBG("Loaded mod from file (%s[ID#%d]), (%s) mod[%lx-%lx] bias[%lx], "
          "build-id: %s",
          fileInfoValue.get_path().c_str(), fileInfoValue.get_id(),
@@ -293,6 +288,22 @@ DDRes report_module(Dwfl *dwfl, ProcessAddress_t pc, const Dso &dso,
          ddprof_mod._build_id.c_str());
 
   ddprof_mod._sym_bias = bias;
+  ddprof_mod._shared_module = std::move(shared_module);
+  return {};
+}
+
+DDRes load_shared_module(Elf *elf, const std::string &filepath,
+                         SharedModule &module) {
+  auto res = read_load_segments(elf, filepath, module);
+  if (!IsDDResOK(res)) {
+    return res;
+  }
+
+  auto maybe_build_id = find_build_id(elf);
+  if (maybe_build_id) {
+    module._build_id = std::move(maybe_build_id.value());
+  }
+  module._path = filepath;
   return {};
 }
 
@@ -11,8 +11,8 @@
 
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
-#include <absl/strings/str_format.h>
 
+#include <filesystem>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
@@ -85,9 +85,9 @@ DDRes Process::read_cgroup_ns(pid_t pid, std::string_view path_to_proc,
   return {};
 }
 
-UniqueFile open_proc_comm(pid_t pid, pid_t tid, const char *path_to_proc = "") {
+UniqueFile open_proc_comm(pid_t pid, pid_t tid, std::string_view path_to_proc) {
   const std::string proc_comm_filename =
-      absl::StrFormat("%s/proc/%d/task/%d/comm", path_to_proc, pid, tid);
+      absl::StrCat(path_to_proc, "/proc/", pid, "/task/", tid, "/comm");
   UniqueFile file{fopen(proc_comm_filename.c_str(), "r"), fclose};
   if (!file) {
     // Check if the file exists
@@ -104,26 +104,19 @@ UniqueFile open_proc_comm(pid_t pid, pid_t tid, const char *path_to_proc = "") {
   return file;
 }
 
-std::string_view Process::get_or_insert_thread_name(pid_t tid) {
-  // Try to insert an empty string first, to ensure only one lookup happens
-  auto [it, inserted] = _thread_name_map.emplace(tid, "");
-
-  // If the thread name is already cached (not inserted), return the cached name
-  if (!inserted) {
-    return it->second;
-  }
-
+namespace {
+bool read_thread_name(pid_t pid, pid_t tid, std::string_view path_to_proc,
+                      std::string &name) {
   // Attempt to open the comm file for the thread
-  const UniqueFile comm_file = open_proc_comm(_pid, tid);
+  const UniqueFile comm_file = open_proc_comm(pid, tid, path_to_proc);
   if (!comm_file) {
-    // Leave the empty string we just inserted
-    return it->second; // This will return the empty string
+    return false;
   }
 
   // Thread names in Linux are limited to 16 bytes, though 256 is fine
   char thread_name[256];
   if (fgets(thread_name, sizeof(thread_name), comm_file.get()) == nullptr) {
-    return it->second; // This will return the empty string
+    return false;
   }
 
   // Remove the trailing newline character if present
@@ -131,10 +124,81 @@ std::string_view Process::get_or_insert_thread_name(pid_t tid) {
   if (len > 0 && thread_name[len - 1] == '\n') {
     thread_name[len - 1] = '\0';
   }
+  name = thread_name;
+  return true;
+}
+} // namespace
+
+void Process::scan_thread_names(std::string_view path_to_proc) {
+  const std::string task_dir =
+      absl::StrCat(path_to_proc, "/proc/", _pid, "/task");
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(task_dir, ec)) {
+    pid_t tid;
+    if (!absl::SimpleAtoi(entry.path().filename().string(), &tid)) {
+      continue;
+    }
+    std::string name;
+    if (read_thread_name(_pid, tid, path_to_proc, name)) {
+      // names reported by events are more recent
+      _thread_name_map.emplace(tid, std::move(name));
+    }
+  }
+}
 
-  // Update the value with the actual thread name
-  it->second = thread_name;
-  return it->second;
+std::string_view
+Process::get_or_insert_thread_name(pid_t tid, std::string_view path_to_proc) {
+  auto it = _thread_name_map.find(tid);
+  if (it != _thread_name_map.end()) {
+    return it->second;
+  }
+
+  if (!_thread_names_scanned) {
+    // Threads that existed before we started following the process
+    _thread_names_scanned = true;
+    scan_thread_names(path_to_proc);
+    it = _thread_name_map.find(tid);
+    if (it != _thread_name_map.end()) {
+      return it->second;
+    }
+  }
+
+  std::string name;
+  if (!_thread_events) {
+    // Thread creations are not reported (e.g. allocation profiling)
+    read_thread_name(_pid, tid, path_to_proc, name);
+  }
+  // An empty name is kept to ensure only one lookup happens
+  return _thread_name_map.emplace(tid, std::move(name)).first->second;
+}
+
+void Process::set_thread_name(pid_t tid, std::string_view name) {
+  _thread_events = true;
+  _thread_name_map.insert_or_assign(tid, std::string(name));
+}
+
+void Process::inherit_thread_name(pid_t parent_tid, pid_t tid) {
+  _thread_events = true;
+  // the tid of an exited thread can be reused
+  std::erase(_exited_tids, tid);
+  auto it = _thread_name_map.find(parent_tid);
+  if (it != _thread_name_map.end()) {
+    // copy as the insertion can invalidate the iterator
+    std::string name = it->second;
+    _thread_name_map.insert_or_assign(tid, std::move(name));
+  }
+}
+
+void Process::erase_thread_name(pid_t tid) { _exited_tids.push_back(tid); }
+
+void Process::cycle() {
+  _sample_score = (_sample_score + _sample_counter) / 2;
+  _sample_counter = 0;
+  _stack_usage.decay();
+  for (pid_t const tid : _exited_tids) {
+    _thread_name_map.erase(tid);
+  }
+  _exited_tids.clear();
 }
 
 const ContainerId &ProcessHdr::get_container_id(pid_t pid) {
@@ -142,8 +206,17 @@ const ContainerId &ProcessHdr::get_container_id(pid_t pid) {
   return p.get_container_id(_path_to_proc);
 }
 
+std::string_view ProcessHdr::get_thread_name(Process &process, pid_t tid) {
+  return process.get_or_insert_thread_name(tid, _path_to_proc);
+}
+
 void ProcessHdr::flag_visited(pid_t pid) { _visited_pid.insert(pid); }
 
+Process *ProcessHdr::find(pid_t pid) {
+  auto it = _process_map.find(pid);
+  return it != _process_map.end() ? &it->second : nullptr;
+}
+
 Process &ProcessHdr::get(pid_t pid) {
   _visited_pid.insert(pid);
   auto it = _process_map.find(pid);
@@ -154,6 +227,87 @@ Process &ProcessHdr::get(pid_t pid) {
   return it->second;
 }
 
+void ProcessHdr::clear(pid_t pid) {
+  auto it = _process_map.find(pid);
+  if (it == _process_map.end()) {
+    return;
+  }
+  if (it->second._admitted) {
+    --_nb_admitted;
+  }
+  if (pid == _coldest_pid) {
+    _coldest_valid = false;
+  }
+  _process_map.erase(it);
+}
+
+void ProcessHdr::do_admit(Process &process) {
+  process._admitted = true;
+  process._admission_cycle = _cycle;
+  ++_nb_admitted;
+}
+
+Process *ProcessHdr::find_coldest() {
+  if (_coldest_valid) {
+    auto it = _process_map.find(_coldest_pid);
+    return it != _process_map.end() ? &it->second : nullptr;
+  }
+  Process *coldest = nullptr;
+  for (auto &[pid, process] : _process_map) {
+    if (!process._admitted ||
+        _cycle - process._admission_cycle < k_min_admitted_cycles) {
+      continue;
+    }
+    if (!coldest || process.sample_score() < coldest->sample_score()) {
+      coldest = &process;
+    }
+  }
+  _coldest_pid = coldest ? coldest->_pid : -1;
+  _coldest_valid = true;
+  return coldest;
+}
+
+bool ProcessHdr::admit(Process &process, unsigned max_pids,
+                       pid_t &evicted_pid) {
+  evicted_pid = -1;
+  if (process._admitted) {
+    return true;
+  }
+  if (_nb_admitted < max_pids) {
+    do_admit(process);
+    return true;
+  }
+  if (_nb_evictions >= k_max_evictions_per_cycle ||
+      process.sample_score() < k_admission_min_samples) {
+    return false;
+  }
+  Process *coldest = find_coldest();
+  if (!coldest ||
+      process.sample_score() <= k_admission_ratio * coldest->sample_score()) {
+    return false;
+  }
+  LG_NTC("[PROC] Evicting PID%d (score=%lu) in favor of PID%d (score=%lu)",
+         coldest->_pid, coldest->sample_score(), process._pid,
+         process.sample_score());
+  evicted_pid = coldest->_pid;
+  coldest->_admitted = false;
+  coldest->_dwfl_wrapper.reset();
+  --_nb_admitted;
+  ++_nb_evictions;
+  _coldest_valid = false;
+  do_admit(process);
+  return true;
+}
+
+void ProcessHdr::cycle() {
+  for (auto &[pid, process] : _process_map) {
+    process.cycle();
+  }
+  ++_cycle;
+  _nb_evictions = 0;
+  _coldest_valid = false;
+}
+
 void ProcessHdr::reset_unvisited() {
   // clear the list of visited for next cycle
   _visited_pid.clear();
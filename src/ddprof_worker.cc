@@ -5,25 +5,38 @@
 
 #include "ddprof_worker.hpp"
 
+#include "cpu_budget.hpp"
 #include "ddprof_context.hpp"
 #include "ddprof_perf_event.hpp"
 #include "ddprof_stats.hpp"
+#include "defer.hpp"
+#include "demangler/demangle_cache.hpp"
 #include "dso_hdr.hpp"
 #include "exporter/ddprof_exporter.hpp"
+#include "exporter/export_queue.hpp"
 #include "logger.hpp"
+#include "overload_controller.hpp"
 #include "perf.hpp"
 #include "pevent_lib.hpp"
 #include "pprof/ddprof_pprof.hpp"
 #include "procutils.hpp"
+#include "stack_accumulator.hpp"
+#include "stack_usage.hpp"
 #include "symbolizer.hpp"
 #include "tags.hpp"
 #include "tsc_clock.hpp"
 #include "unwind.hpp"
 #include "unwind_helper.hpp"
 #include "unwind_state.hpp"
+#include "unwinding_pool.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <ctime>
+#include <mutex>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -36,20 +49,45 @@ namespace {
 const DDPROF_STATS s_cycled_stats[] = {
     STATS_UNWIND_AVG_TIME, STATS_AGGREGATION_AVG_TIME, STATS_EVENT_COUNT,
     STATS_EVENT_LOST,      STATS_EVENT_OUT_OF_ORDER,   STATS_SAMPLE_COUNT,
-    STATS_TARGET_CPU_USAGE};
+    STATS_WORKER_WAKEUPS,  STATS_WORKER_IDLE_WAKEUPS,  STATS_TARGET_CPU_USAGE,
+    STATS_RING_BUFFER_OCCUPANCY_MAX, STATS_OVERLOAD_DEGRADED_SAMPLES,
+    STATS_AGGREGATION_STACKS, STATS_EXPORT_DROPPED,
+    STATS_UNWIND_SCANNED_FRAMES, STATS_UNWIND_CALLCHAIN_SAMPLES,
+    STATS_UNWIND_CALLCHAIN_FALLBACKS};
+
+// Unwinding that reads the end of a full stack copy is assumed to need more
+// stack
+constexpr uint64_t k_stack_tail_bytes{1024};
 
 const long k_clock_ticks_per_sec = sysconf(_SC_CLK_TCK);
 
-/// Remove all structures related to
-DDRes worker_pid_free(DDProfContext &ctx, pid_t el);
+// Bound the memory of the stacks waiting to be added to the profile
+constexpr size_t k_max_accumulated_stacks{65536};
 
-DDRes clear_unvisited_pids(DDProfContext &ctx);
+/// Remove all structures related to
+DDRes worker_pid_free(DDProfContext &ctx, UnwindState &us, pid_t el);
+
+DDRes clear_unvisited_pids(DDProfContext &ctx, UnwindState &us);
+
+/// Call func(UnwindState &, Symbolizer &) for the worker and for every thread
+/// of the unwinding pool (threads should be idle)
+template <typename Func>
+void for_each_unwind_state(DDProfWorkerContext &worker_ctx, Func &&func) {
+  func(*worker_ctx.us, *worker_ctx.symbolizer);
+  if (worker_ctx.unwinding_pool) {
+    for (const auto &shard : worker_ctx.unwinding_pool->shards()) {
+      func(shard->us, shard->symbolizer);
+    }
+  }
+}
 
 /// Human readable runtime information
-void print_diagnostics(const DsoHdr &dso_hdr) {
+void print_diagnostics(DDProfWorkerContext &worker_ctx) {
   LG_NFO("Printing internal diagnostics");
   ddprof_stats_print();
-  dso_hdr.stats().log();
+  for_each_unwind_state(worker_ctx, [](const UnwindState &us, const auto &) {
+    us.dso_hdr.stats().log();
+  });
 }
 
 DDRes report_lost_events(DDProfContext &ctx) {
@@ -68,15 +106,19 @@ DDRes report_lost_events(DDProfContext &ctx) {
               watcher->sample_frequency
           : watcher->sample_period;
 
-      const int64_t value = period * nb_lost;
+      // Lost samples were taken with the effective (scaled) period
+      uint32_t const scale_pct =
+          std::max(ctx.worker_ctx.persistent_worker_state->period_scale_pct,
+                   k_nominal_period_scale_pct);
+      const int64_t value = period * nb_lost * scale_pct /
+          k_nominal_period_scale_pct;
       LG_NTC("Reporting %lu lost samples (cumulated lost value: %lu) for "
              "watcher #%d",
              nb_lost, value, watcher_idx);
       DDRES_CHECK_FWD(pprof_aggregate(
           &us->output, us->symbol_hdr, {value, nb_lost, 0}, watcher,
           ctx.worker_ctx.us->dso_hdr.get_file_info_vector(), false, kSumPos,
-          ctx.worker_ctx.symbolizer,
-          ctx.worker_ctx.pprof[ctx.worker_ctx.i_current_pprof]));
+          ctx.worker_ctx.symbolizer, ctx.worker_ctx.pprof));
       ctx.worker_ctx.lost_events_per_watcher[watcher_idx] = 0;
     }
   }
@@ -98,15 +140,93 @@ inline void export_time_set(DDProfContext &ctx) {
           .count();
 }
 
-DDRes symbols_update_stats(const SymbolHdr &symbol_hdr) {
+// Stats summed over the unwinding states of the worker and of the pool
+const DDPROF_STATS s_unwind_state_stats[] = {
+    STATS_PROCESS_ADMITTED,           STATS_PROCESS_EVICTIONS,
+    STATS_DSO_NEW_DSO,                STATS_DSO_SIZE,
+    STATS_DWFL_MODULE_FILES,          STATS_DWFL_MODULE_SHARED,
+    STATS_ELF_CACHE_SIZE,             STATS_ELF_CACHE_HITS,
+    STATS_ELF_CACHE_EVICTIONS,        STATS_BACKPOPULATE_COUNT,
+    STATS_SYMBOLS_BINARIES_EVICTED,   STATS_SYMBOLS_CACHE_HITS,
+    STATS_SYMBOLS_CACHE_MISSES,       STATS_SYMBOLS_JIT_READS,
+    STATS_SYMBOLS_JIT_FAILED_LOOKUPS, STATS_SYMBOLS_JIT_SYMBOL_COUNT,
+    STATS_SYMBOLS_TABLE_SIZE,         STATS_MAPINFO_TABLE_SIZE};
+
+void symbols_update_stats(const SymbolHdr &symbol_hdr) {
   const auto &stats = symbol_hdr._runtime_symbol_lookup.get_stats();
-  DDRES_CHECK_FWD(
-      ddprof_stats_set(STATS_SYMBOLS_JIT_READS, stats._nb_jit_reads));
-  DDRES_CHECK_FWD(ddprof_stats_set(STATS_SYMBOLS_JIT_FAILED_LOOKUPS,
-                                   stats._nb_failed_lookups));
-  DDRES_CHECK_FWD(
-      ddprof_stats_set(STATS_SYMBOLS_JIT_SYMBOL_COUNT, stats._symbol_count));
-  return {};
+  ddprof_stats_add(STATS_SYMBOLS_JIT_READS, stats._nb_jit_reads, nullptr);
+  ddprof_stats_add(STATS_SYMBOLS_JIT_FAILED_LOOKUPS, stats._nb_failed_lookups,
+                   nullptr);
+  ddprof_stats_add(STATS_SYMBOLS_JIT_SYMBOL_COUNT, stats._symbol_count,
+                   nullptr);
+  ddprof_stats_add(STATS_SYMBOLS_TABLE_SIZE, symbol_hdr._symbol_table.size(),
+                   nullptr);
+  ddprof_stats_add(STATS_MAPINFO_TABLE_SIZE, symbol_hdr._mapinfo_table.size(),
+                   nullptr);
+}
+
+void unwind_state_update_stats(const UnwindState &us,
+                               const Symbolizer &symbolizer) {
+  const DsoHdr &dso_hdr = us.dso_hdr;
+  ddprof_stats_add(STATS_PROCESS_ADMITTED, us.process_hdr.admitted_count(),
+                   nullptr);
+  ddprof_stats_add(STATS_PROCESS_EVICTIONS, us.process_hdr.nb_evictions(),
+                   nullptr);
+  ddprof_stats_add(STATS_DSO_NEW_DSO,
+                   dso_hdr.stats().sum_event_metric(DsoStats::kNewDso),
+                   nullptr);
+  ddprof_stats_add(STATS_DSO_SIZE, dso_hdr.get_nb_dso(), nullptr);
+  ddprof_stats_add(STATS_DWFL_MODULE_FILES, us.module_cache.size(), nullptr);
+  ddprof_stats_add(STATS_DWFL_MODULE_SHARED, us.module_cache.stats()._nb_hits,
+                   nullptr);
+  const ElfHandleCache &elf_handles = us.module_cache.elf_handles();
+  ddprof_stats_add(STATS_ELF_CACHE_SIZE, elf_handles.size(), nullptr);
+  ddprof_stats_add(STATS_ELF_CACHE_HITS, elf_handles.stats()._nb_hits,
+                   nullptr);
+  ddprof_stats_add(STATS_ELF_CACHE_EVICTIONS,
+                   elf_handles.stats()._nb_evictions, nullptr);
+  ddprof_stats_add(STATS_BACKPOPULATE_COUNT,
+                   dso_hdr.stats().backpopulate_count(), nullptr);
+  ddprof_stats_add(STATS_SYMBOLS_BINARIES_EVICTED, symbolizer.nb_evicted(),
+                   nullptr);
+  const SymbolCache::Stats symbol_cache_stats = symbolizer.symbol_cache_stats();
+  ddprof_stats_add(STATS_SYMBOLS_CACHE_HITS, symbol_cache_stats._nb_hits,
+                   nullptr);
+  ddprof_stats_add(STATS_SYMBOLS_CACHE_MISSES, symbol_cache_stats._nb_misses,
+                   nullptr);
+  symbols_update_stats(us.symbol_hdr);
+}
+
+/// Reclaim symbols and mappings that were not used during the last cycles
+/// Returns the number of reclaimed symbols
+size_t compact_symbol_tables(SymbolHdr &symbol_hdr,
+                             LiveAllocation *live_allocation) {
+  // Live allocations keep stacks across cycles
+  if (live_allocation) {
+    live_allocation->for_each_stack(
+        [&symbol_hdr](const UnwindOutput &uo) { symbol_hdr.mark_used(uo); });
+  }
+  const size_t previous_size = symbol_hdr._symbol_table.size();
+  TableRemap symbol_remap;
+  TableRemap mapinfo_remap;
+  if (symbol_hdr.compact(SymbolHdr::k_default_max_age_cycles, symbol_remap,
+                         mapinfo_remap) &&
+      live_allocation) {
+    live_allocation->remap(symbol_remap, mapinfo_remap);
+  }
+  return previous_size - symbol_hdr._symbol_table.size();
+}
+
+void compact_symbol_tables(DDProfWorkerContext &worker_context) {
+  size_t nb_reclaimed = compact_symbol_tables(worker_context.us->symbol_hdr,
+                                              &worker_context.live_allocation);
+  if (worker_context.unwinding_pool) {
+    // Stacks of the pool were aggregated at the start of the cycle
+    for (const auto &shard : worker_context.unwinding_pool->shards()) {
+      nb_reclaimed += compact_symbol_tables(shard->us.symbol_hdr, nullptr);
+    }
+  }
+  ddprof_stats_set(STATS_SYMBOLS_TABLE_RECLAIMED, nb_reclaimed);
 }
 
 /// Retrieve cpu / memory info
@@ -114,8 +234,6 @@ DDRes worker_update_stats(DDProfWorkerContext &worker_context,
                           std::chrono::nanoseconds cycle_duration,
                           int count_symbolizer_cleared) {
   ProcStatus *procstat = &worker_context.proc_status;
-  const UnwindState &us = *worker_context.us;
-  const DsoHdr &dso_hdr = us.dso_hdr;
   // Update the procstats, but first snapshot the utime so we can compute the
   // diff for the utime metric
   int64_t const cpu_time_old = procstat->utime + procstat->stime;
@@ -127,18 +245,24 @@ DDRes worker_update_stats(DDProfWorkerContext &worker_context,
       (k_clock_ticks_per_sec * elapsed_nsec);
   ddprof_stats_set(STATS_PROFILER_RSS, get_page_size() * procstat->rss);
   ddprof_stats_set(STATS_PROFILER_CPU_USAGE, millicores);
-  ddprof_stats_set(STATS_DSO_NEW_DSO,
-                   dso_hdr.stats().sum_event_metric(DsoStats::kNewDso));
-  ddprof_stats_set(STATS_DSO_SIZE, dso_hdr.get_nb_dso());
-  ddprof_stats_set(STATS_BACKPOPULATE_COUNT,
-                   dso_hdr.stats().backpopulate_count());
+  for (auto stat : s_unwind_state_stats) {
+    ddprof_stats_set(stat, 0);
+  }
+  for_each_unwind_state(worker_context, unwind_state_update_stats);
   ddprof_stats_set(
       STATS_UNMATCHED_DEALLOCATION_COUNT,
       worker_context.live_allocation.get_nb_unmatched_deallocations());
   // Symbol stats
   ddprof_stats_set(STATS_UNUSED_SYMBOLS_BINARIES_COUNT,
                    count_symbolizer_cleared);
-  DDRES_CHECK_FWD(symbols_update_stats(us.symbol_hdr));
+  // Shared by the symbolizers
+  const DemangleCache::Stats demangle_stats =
+      DemangleCache::global().cycle_stats();
+  ddprof_stats_set(STATS_SYMBOLS_DEMANGLE_HITS, demangle_stats._nb_hits);
+  ddprof_stats_set(STATS_SYMBOLS_DEMANGLE_MISSES, demangle_stats._nb_misses);
+  ddprof_stats_set(STATS_SYMBOLS_DEMANGLE_BYTES, demangle_stats._bytes);
+  ddprof_stats_set(STATS_SYMBOLS_DEMANGLE_SAVED_BYTES,
+                   demangle_stats._bytes_saved);
 
   long target_cpu_nsec;
   ddprof_stats_get(STATS_TARGET_CPU_USAGE, &target_cpu_nsec);
@@ -178,18 +302,115 @@ DDRes worker_update_stats(DDProfWorkerContext &worker_context,
   return {};
 }
 
-DDRes ddprof_unwind_sample(DDProfContext &ctx, perf_event_sample *sample,
-                           int watcher_pos, bool &inconsistent_pid_state) {
+// Scale the sampling periods to keep the profiler within its CPU budget.
+// The scale is persisted as perf events outlive the worker.
+DDRes worker_enforce_cpu_budget(DDProfContext &ctx) {
+  PersistentWorkerState *state = ctx.worker_ctx.persistent_worker_state;
+  uint32_t const scale_pct =
+      std::max(state->period_scale_pct, k_nominal_period_scale_pct);
+  long cpu_millicores = 0;
+  ddprof_stats_get(STATS_PROFILER_CPU_USAGE, &cpu_millicores);
+  uint32_t const new_scale_pct = cpu_budget_period_scale(
+      scale_pct, cpu_millicores, ctx.params.max_cpu_percent);
+  if (new_scale_pct != scale_pct) {
+    LG_NTC("Profiler CPU usage %ld millicores (budget %u%%), scaling sampling "
+           "periods to %u%%",
+           cpu_millicores, ctx.params.max_cpu_percent, new_scale_pct);
+    DDRES_CHECK_FWD(pevent_set_period_scale(&ctx.worker_ctx.pevent_hdr,
+                                            ctx.watchers, new_scale_pct));
+  }
+  state->period_scale_pct = new_scale_pct;
+  ddprof_stats_set(STATS_SAMPLING_PERIOD_SCALE, new_scale_pct);
+  return {};
+}
+
+// Move the watchers to the size of user stack copies needed by the profiled
+// processes. Sizes are persisted as perf events outlive the worker.
+DDRes worker_adapt_stack_sample_size(DDProfContext &ctx) {
+  if (!ctx.params.adaptive_stack_sample_size) {
+    return {};
+  }
+  std::vector<ProcessStackUsage> usages;
+  for_each_unwind_state(ctx.worker_ctx, [&](UnwindState &us, Symbolizer &) {
+    us.process_hdr.for_each_process([&](const Process &process) {
+      const StackUsageHistogram &stack_usage = process.stack_usage();
+      if (stack_usage.count()) {
+        usages.push_back({stack_usage.percentile(k_stack_usage_pct),
+                          stack_usage.count()});
+      }
+    });
+  });
+  PersistentWorkerState *state = ctx.worker_ctx.persistent_worker_state;
+  uint32_t max_stack_sample_size = 0;
+  for (size_t i = 0; i < ctx.watchers.size(); ++i) {
+    const PerfWatcher &watcher = ctx.watchers[i];
+    if (!pevent_has_stack_tiers(ctx, watcher)) {
+      continue;
+    }
+    uint32_t const current_size = state->stack_sample_size[i]
+        ? state->stack_sample_size[i]
+        : watcher.options.stack_sample_size;
+    uint32_t const new_size = stack_tier_from_usage(
+        stack_size_tiers(watcher.options.stack_sample_size), usages,
+        current_size);
+    if (new_size != current_size) {
+      LG_NTC("Switching stack sample size of watcher #%zu (%s) from %u to %u",
+             i, watcher.desc.c_str(), current_size, new_size);
+      DDRES_CHECK_FWD(pevent_set_stack_sample_size(
+          &ctx.worker_ctx.pevent_hdr, watcher, static_cast<int>(i),
+          new_size));
+    }
+    state->stack_sample_size[i] = new_size;
+    max_stack_sample_size = std::max(max_stack_sample_size, new_size);
+  }
+  ddprof_stats_set(STATS_UNWIND_STACK_SAMPLE_SIZE, max_stack_sample_size);
+  return {};
+}
+
+// The kernel copied as much stack as requested (the stack can be bigger)
+bool is_full_stack_copy(const DDProfContext &ctx, const PerfWatcher &watcher,
+                        uint64_t size_stack) {
+  if (!pevent_has_stack_tiers(ctx, watcher)) {
+    return size_stack == watcher.options.stack_sample_size;
+  }
+  StackSizeTiers const tiers =
+      stack_size_tiers(watcher.options.stack_sample_size);
+  return std::ranges::find(tiers, size_stack) != tiers.end();
+}
+
+// Stack bytes read by the unwinding. A stack that did not fit in the copy
+// needs one more byte than the copy.
+uint64_t sample_stack_usage(const UnwindState &us, bool full_copy) {
+  uint64_t const sp = us.initial_regs.regs[REGNAME(SP)];
+  uint64_t const stack_usage = us.max_stack_read >= sp
+      ? us.max_stack_read + sizeof(uint64_t) - sp
+      : 0;
+  if (full_copy && stack_usage + k_stack_tail_bytes >= us.stack_sz) {
+    return us.stack_sz + 1;
+  }
+  return stack_usage;
+}
+
+DDRes ddprof_unwind_sample(DDProfContext &ctx, UnwindState *us,
+                           perf_event_sample *sample, int watcher_pos,
+                           bool &inconsistent_pid_state) {
   inconsistent_pid_state = false;
-  struct UnwindState *us = ctx.worker_ctx.us;
   PerfWatcher *watcher = &ctx.watchers[watcher_pos];
 
+  // Callchain only watchers do not copy the user stack
+  bool const has_stack = watcher->sample_type & PERF_SAMPLE_STACK_USER;
+  uint64_t const size_stack = has_stack ? sample->size_stack : 0;
+
   ddprof_stats_add(STATS_SAMPLE_COUNT, 1, nullptr);
-  ddprof_stats_add(STATS_UNWIND_AVG_STACK_SIZE, sample->size_stack, nullptr);
+  ddprof_stats_add(STATS_UNWIND_AVG_STACK_SIZE, size_stack, nullptr);
 
   // copy the sample context into the unwind structure
-  unwind_init_sample(us, sample->regs, sample->pid, sample->size_stack,
-                     sample->data_stack);
+  unwind_init_sample(us, sample->regs, sample->pid, size_stack,
+                     has_stack ? sample->data_stack : nullptr);
+  if (watcher->options.unwind_mode != EventConfUnwindMode::kDwarf) {
+    us->unwind_mode = watcher->options.unwind_mode;
+    us->callchain = {sample->ips, sample->nr};
+  }
 
   // If a sample has a PID, it has a TID.  Include it for downstream labels
   us->output.pid = sample->pid;
@@ -200,8 +421,29 @@ DDRes ddprof_unwind_sample(DDProfContext &ctx, perf_event_sample *sample,
     ddprof_stats_add(STATS_TARGET_CPU_USAGE, sample->period, nullptr);
   }
 
+  OverloadTier const overload_tier =
+      std::atomic_ref(ctx.worker_ctx.overload_tier)
+          .load(std::memory_order_relaxed);
+  if (overload_tier != OverloadTier::kNone) {
+    ddprof_stats_add(STATS_OVERLOAD_DEGRADED_SAMPLES, 1, nullptr);
+  }
+  if (overload_tier == OverloadTier::kCountOnly) {
+    // Only attribute the sample to its binary
+    add_common_frame(us, SymbolErrors::overload);
+    add_virtual_base_frame(us);
+    us->output.overload_tier = overload_tier;
+    return {};
+  }
+  if (overload_tier >= OverloadTier::kTruncatedStack) {
+    us->max_stack_depth = k_overload_max_stack_depth;
+  }
+
   // Attempt to fully unwind if the watcher has a callgraph type
   DDRes res = unwindstate_unwind(us);
+  // Unwinding stopped before reading the whole stack in use
+  bool const depth_limited = is_max_stack_depth_reached(*us);
+  us->max_stack_depth = kMaxStackDepth;
+  us->output.overload_tier = overload_tier;
 
   /* This test is not 100% accurate:
    * Linux kernel does not take into account stack start (ie. end address since
@@ -222,10 +464,19 @@ DDRes ddprof_unwind_sample(DDProfContext &ctx, perf_event_sample *sample,
    * That's why we consider the stack as truncated in input only if it is also
    * detected as incomplete during unwinding.
    */
-  if (sample->size_stack ==
-      ctx.watchers[watcher_pos].options.stack_sample_size) {
+  bool const full_copy =
+      has_stack && is_full_stack_copy(ctx, *watcher, sample->size_stack);
+  if (full_copy) {
     ddprof_stats_add(STATS_UNWIND_TRUNCATED_INPUT, 1, nullptr);
   }
+  // Truncated unwinding under-reports the stack usage, and samples unwound
+  // from their callchain do not read the stack copy
+  if (us->dwarf_unwound && ctx.params.adaptive_stack_sample_size &&
+      overload_tier == OverloadTier::kNone && !depth_limited) {
+    if (Process *process = us->process_hdr.find(us->pid)) {
+      process->add_stack_usage(sample_stack_usage(*us, full_copy));
+    }
+  }
 
   if (us->_dwfl_wrapper && us->_dwfl_wrapper->_inconsistent) {
     // Loaded modules were inconsistent, assume we should flush everything.
@@ -258,8 +509,7 @@ DDRes aggregate_livealloc_stack(
 
 DDRes aggregate_live_allocations_for_pid(DDProfContext &ctx, pid_t pid) {
   struct UnwindState *us = ctx.worker_ctx.us;
-  int const i_export = ctx.worker_ctx.i_current_pprof;
-  DDProfPProf *pprof = ctx.worker_ctx.pprof[i_export];
+  DDProfPProf *pprof = ctx.worker_ctx.pprof;
   const SymbolHdr &symbol_hdr = us->symbol_hdr;
   LiveAllocation &live_allocations = ctx.worker_ctx.live_allocation;
   for (unsigned watcher_pos = 0;
@@ -279,8 +529,7 @@ DDRes aggregate_live_allocations(DDProfContext &ctx) {
   // this would be more efficient if we could reuse the same stacks in
   // libdatadog
   UnwindState *us = ctx.worker_ctx.us;
-  int const i_export = ctx.worker_ctx.i_current_pprof;
-  DDProfPProf *pprof = ctx.worker_ctx.pprof[i_export];
+  DDProfPProf *pprof = ctx.worker_ctx.pprof;
   const SymbolHdr &symbol_hdr = us->symbol_hdr;
   const LiveAllocation &live_allocations = ctx.worker_ctx.live_allocation;
   for (unsigned watcher_pos = 0;
@@ -300,30 +549,142 @@ DDRes aggregate_live_allocations(DDProfContext &ctx) {
   return {};
 }
 
-DDRes worker_pid_free(DDProfContext &ctx, pid_t el) {
+DDRes worker_pid_free(DDProfContext &ctx, UnwindState &us, pid_t el) {
   DDRES_CHECK_FWD(aggregate_live_allocations_for_pid(ctx, el));
-  UnwindState *us = ctx.worker_ctx.us;
-  unwind_pid_free(us, el);
+  unwind_pid_free(&us, el);
   ctx.worker_ctx.live_allocation.clear_pid(el);
   return {};
 }
 
-DDRes clear_unvisited_pids(DDProfContext &ctx) {
-  UnwindState *us = ctx.worker_ctx.us;
-  const std::vector<pid_t> pids_remove = us->process_hdr.get_unvisited();
+DDRes clear_unvisited_pids(DDProfContext &ctx, UnwindState &us) {
+  const std::vector<pid_t> pids_remove = us.process_hdr.get_unvisited();
   for (pid_t const el : pids_remove) {
-    DDRES_CHECK_FWD(worker_pid_free(ctx, el));
+    DDRES_CHECK_FWD(worker_pid_free(ctx, us, el));
   }
-  const auto &visited_pids = us->process_hdr.get_visited();
+  const auto &visited_pids = us.process_hdr.get_visited();
   // some pids might have been visited but not unwound
-  const int nb_cleared = us->dso_hdr.clear_unvisited(visited_pids);
+  const int nb_cleared = us.dso_hdr.clear_unvisited(visited_pids);
   if (nb_cleared) {
     LG_NTC("Clearing %d unvisited PIDs from DSO header", nb_cleared);
   }
-  us->process_hdr.reset_unvisited();
+  us.process_hdr.reset_unvisited();
+  return {};
+}
+
+DDRes clear_unvisited_pids(DDProfContext &ctx) {
+  DDRES_CHECK_FWD(clear_unvisited_pids(ctx, *ctx.worker_ctx.us));
+  if (ctx.worker_ctx.unwinding_pool) {
+    for (const auto &shard : ctx.worker_ctx.unwinding_pool->shards()) {
+      DDRES_CHECK_FWD(clear_unvisited_pids(ctx, shard->us));
+    }
+  }
   return {};
 }
 
+/// Add accumulated stacks to the profile (one call per distinct stack)
+DDRes aggregate_stacks(DDProfContext &ctx, StackAccumulator &stacks,
+                       const UnwindState &us, Symbolizer *symbolizer) {
+  DDProfPProf *pprof = ctx.worker_ctx.pprof;
+  ddprof_stats_add(STATS_AGGREGATION_STACKS,
+                   static_cast<long>(stacks.nb_stacks()), nullptr);
+  std::lock_guard const lock{pprof->_mutex};
+  // Symbolize the frames of all the stacks with one call per file
+  stacks.for_each_stack([&](int watcher_pos, const UnwindOutput &output) {
+    pprof_prepare_symbolization(&output, &ctx.watchers[watcher_pos],
+                                symbolizer);
+  });
+  defer { symbolizer->end_batch(); };
+  DDRES_CHECK_FWD(symbolizer->symbolize_batch(
+      us.dso_hdr.get_file_info_vector(), us.symbol_hdr._mapinfo_table));
+  DDRes const res = stacks.for_each([&](int watcher_pos,
+                                        const UnwindOutput &output,
+                                        const DDProfValuePack &pack) {
+    return pprof_aggregate(&output, us.symbol_hdr, pack,
+                           &ctx.watchers[watcher_pos],
+                           us.dso_hdr.get_file_info_vector(),
+                           ctx.params.show_samples, kSumPos, symbolizer, pprof);
+  });
+  stacks.clear();
+  return res;
+}
+
+/// Aggregate the stacks unwound by the threads of the pool into the profile
+DDRes aggregate_unwinding_pool(DDProfContext &ctx) {
+  for (const auto &shard : ctx.worker_ctx.unwinding_pool->shards()) {
+    DDRES_CHECK_FWD(
+        aggregate_stacks(ctx, shard->stacks, shard->us, &shard->symbolizer));
+  }
+  return {};
+}
+
+DDRes create_unwinding_pool(DDProfContext &ctx) {
+  const uint32_t nb_threads = ctx.params.unwinding_threads;
+  if (nb_threads == 0) {
+    return {};
+  }
+  for (const PerfWatcher &watcher : ctx.watchers) {
+    if (Any(EventAggregationMode::kLiveSum & watcher.aggregation_mode)) {
+      // Live allocations are tracked across cycles by the worker
+      LG_WRN("Live allocation profiling is not compatible with unwinding "
+             "threads. Unwinding on the worker thread.");
+      return {};
+    }
+  }
+  // Processes are split between the threads
+  int maximum_pids = ctx.params.maximum_pids;
+  if (maximum_pids > 0) {
+    maximum_pids = std::max(1, maximum_pids / static_cast<int>(nb_threads));
+  }
+  std::vector<std::unique_ptr<WorkerShard>> shards;
+  shards.reserve(nb_threads);
+  for (uint32_t i = 0; i < nb_threads; ++i) {
+    auto unwind_state = create_unwind_state(ctx.params.dd_profiling_fd,
+                                            maximum_pids, ctx.params.timeline);
+    if (!unwind_state) {
+      LG_ERR("Failed to create unwind state");
+      return ddres_error(DD_WHAT_UW_ERROR);
+    }
+    unwind_state->stack_scan = ctx.params.stack_scan;
+    shards.push_back(std::make_unique<WorkerShard>(
+        *std::move(unwind_state), ctx.params.inlined_functions,
+        ctx.params.disable_symbolization,
+        ctx.params.remote_symbolization ? Symbolizer::k_elf
+                                        : Symbolizer::k_process));
+  }
+  ctx.worker_ctx.unwinding_pool = new UnwindingPool(
+      std::move(shards),
+      [&ctx](WorkerShard &shard, const perf_event_header *hdr,
+             int watcher_pos) {
+        return ddprof_worker_process_shard_event(shard, hdr, watcher_pos, ctx);
+      });
+  LG_NTC("Unwinding samples on %u threads", nb_threads);
+  return {};
+}
+
+// Symbolization results of the previous workers are reused
+void init_symbol_cache(DDProfContext &ctx) {
+  if (ctx.params.symbol_cache_dir.empty()) {
+    return;
+  }
+  constexpr uint64_t k_mebibyte = 1024 * 1024;
+  // Each symbolizer accounts for the whole directory
+  uint64_t const max_bytes =
+      static_cast<uint64_t>(ctx.params.symbol_cache_max_mb) * k_mebibyte;
+  bool failed = false;
+  // Kernel symbols are kept aside: they are not evicted with the files
+  std::string const kernel_cache_dir = ctx.params.symbol_cache_dir + "/kernel";
+  for_each_unwind_state(
+      ctx.worker_ctx, [&](UnwindState &us, Symbolizer &symbolizer) {
+        failed |= IsDDResNotOK(symbolizer.init_symbol_cache(
+            ctx.params.symbol_cache_dir, max_bytes));
+        us.symbol_hdr._kernel_symbol_lookup.set_cache_dir(kernel_cache_dir);
+      });
+  if (failed) {
+    LG_WRN("Unable to use symbol cache directory %s",
+           ctx.params.symbol_cache_dir.c_str());
+  }
+}
+
 [[maybe_unused]] DDRes worker_init_stats(DDProfWorkerContext *worker_ctx) {
   DDRES_CHECK_FWD(proc_read(&worker_ctx->proc_status));
   worker_ctx->cycle_start_time = std::chrono::steady_clock::now();
@@ -340,8 +701,6 @@ DDRes worker_library_init(DDProfContext &ctx,
     // Make sure worker-related counters are reset
     ctx.worker_ctx.count_worker = 0;
     // Make sure worker index is initialized correctly
-    ctx.worker_ctx.i_current_pprof = 0;
-    ctx.worker_ctx.exp_tid = {0};
     auto unwind_state =
         create_unwind_state(ctx.params.dd_profiling_fd, ctx.params.maximum_pids,
                             ctx.params.timeline);
@@ -350,6 +709,8 @@ DDRes worker_library_init(DDProfContext &ctx,
       return ddres_error(DD_WHAT_UW_ERROR);
     }
     ctx.worker_ctx.us = new UnwindState{*std::move(unwind_state)};
+    ctx.worker_ctx.us->stack_scan = ctx.params.stack_scan;
+    ctx.worker_ctx.stack_accumulator = new StackAccumulator();
 
     std::fill(ctx.worker_ctx.lost_events_per_watcher.begin(),
               ctx.worker_ctx.lost_events_per_watcher.end(), 0UL);
@@ -376,10 +737,9 @@ DDRes worker_library_init(DDProfContext &ctx,
                                         : Symbolizer::k_process);
 
     // Zero out pointers to dynamically allocated memory
-    ctx.worker_ctx.exp[0] = nullptr;
-    ctx.worker_ctx.exp[1] = nullptr;
-    ctx.worker_ctx.pprof[0] = nullptr;
-    ctx.worker_ctx.pprof[1] = nullptr;
+    ctx.worker_ctx.exp = nullptr;
+    ctx.worker_ctx.pprof = nullptr;
+    ctx.worker_ctx.export_queue = nullptr;
   }
   CatchExcept2DDRes();
   return {};
@@ -393,6 +753,8 @@ DDRes worker_library_free(DDProfContext &ctx) {
     PEventHdr *pevent_hdr = &ctx.worker_ctx.pevent_hdr;
     DDRES_CHECK_FWD(pevent_munmap(pevent_hdr));
 
+    delete ctx.worker_ctx.stack_accumulator;
+    ctx.worker_ctx.stack_accumulator = nullptr;
     delete ctx.worker_ctx.us;
     ctx.worker_ctx.us = nullptr;
   }
@@ -415,8 +777,8 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
 
   auto ticks0 = TscClock::cycles_now();
   bool inconsistent_pid_state = false;
-  DDRes const res =
-      ddprof_unwind_sample(ctx, sample, watcher_pos, inconsistent_pid_state);
+  DDRes const res = ddprof_unwind_sample(ctx, ctx.worker_ctx.us, sample,
+                                         watcher_pos, inconsistent_pid_state);
   auto unwind_ticks = TscClock::cycles_now();
   ddprof_stats_add(STATS_UNWIND_AVG_TIME, unwind_ticks - ticks0, nullptr);
 
@@ -437,10 +799,6 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
       // Depending on the type of watcher, compute a value for sample
       uint64_t const sample_val = perf_value_from_sample(watcher, sample);
 
-      // in lib mode we don't aggregate (protect to avoid link failures)
-      int const i_export = ctx.worker_ctx.i_current_pprof;
-      DDProfPProf *pprof = ctx.worker_ctx.pprof[i_export];
-
       // We want to emit 0 for the time unless timeline is specified, and if
       // it is, we also want to adjust the source to be in the system_time
       // frame
@@ -451,15 +809,21 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
       const DDProfValuePack pack{static_cast<int64_t>(sample_val), 1,
                                  timestamp};
 
-      DDRES_CHECK_FWD(pprof_aggregate(
-          &us->output, us->symbol_hdr, pack, watcher,
-          us->dso_hdr.get_file_info_vector(), ctx.params.show_samples, kSumPos,
-          ctx.worker_ctx.symbolizer, pprof));
+      // Identical stacks are added to the profile once, at the end of the
+      // cycle (or earlier if too many stacks are pending)
+      StackAccumulator &stacks = *ctx.worker_ctx.stack_accumulator;
+      stacks.add(watcher_pos, us->output, pack);
+      if (stacks.nb_stacks() + stacks.nb_timed_samples() >=
+          k_max_accumulated_stacks) {
+        DDRES_CHECK_FWD(
+            aggregate_stacks(ctx, stacks, *us, ctx.worker_ctx.symbolizer));
+      }
     }
   }
   // We need to free the PID only after any aggregation operations
   if (inconsistent_pid_state) {
-    DDRES_CHECK_FWD(worker_pid_free(ctx, ctx.worker_ctx.us->pid));
+    DDRES_CHECK_FWD(
+        worker_pid_free(ctx, *ctx.worker_ctx.us, ctx.worker_ctx.us->pid));
   }
   ddprof_stats_add(STATS_AGGREGATION_AVG_TIME,
                    TscClock::cycles_now() - unwind_ticks, nullptr);
@@ -467,98 +831,86 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
   return {};
 }
 
-void *ddprof_worker_export_thread(void *arg) {
-  auto *worker = static_cast<DDProfWorkerContext *>(arg);
-  // export the one we are not writing to
-  int const i = 1 - worker->i_current_pprof;
-  // Increase number of sequences in persistent storage
-  // This should start at 0, and if exporter thread
-  // gets joined forcefully, we should not resume on same value
-  uint32_t const profile_seq = (worker->persistent_worker_state->profile_seq)++;
-
-  if (IsDDResFatal(ddprof_exporter_export(&worker->pprof[i]->_profile,
-                                          worker->pprof[i]->_tags, profile_seq,
-                                          worker->exp[i]))) {
-    LG_NFO("Failed to export from worker");
-    worker->exp_error = true;
-  }
-
-  return nullptr;
-}
-
 /// Cycle operations : export, sync metrics, update counters
 DDRes ddprof_worker_cycle(DDProfContext &ctx,
                           std::chrono::steady_clock::time_point now,
-                          [[maybe_unused]] bool synchronous_export) {
+                          bool synchronous_export) {
+
+  DDRES_CHECK_FWD(aggregate_stacks(ctx, *ctx.worker_ctx.stack_accumulator,
+                                   *ctx.worker_ctx.us,
+                                   ctx.worker_ctx.symbolizer));
+  if (ctx.worker_ctx.unwinding_pool) {
+    // Wait for the threads to be idle before accessing their states
+    DDRES_CHECK_FWD(ctx.worker_ctx.unwinding_pool->drain());
+    DDRES_CHECK_FWD(aggregate_unwinding_pool(ctx));
+  }
 
   // Clearing unused PIDs will ensure we don't report them at next cycle
   DDRES_CHECK_FWD(clear_unvisited_pids(ctx));
   DDRES_CHECK_FWD(aggregate_live_allocations(ctx));
 
-  // Take the current pprof contents and ship them to the backend.  This also
-  // clears the pprof for reuse
-  // Dispatch happens in a thread, with the underlying data structure for
-  // aggregation rotating between exports.  If we return to this point before
-  // the previous thread has finished,  we wait for up to five seconds before
-  // failing
-
-  // If something is pending, return error
-  if (ctx.worker_ctx.exp_tid) {
-    struct timespec waittime;
-    clock_gettime(CLOCK_REALTIME, &waittime);
-    auto wait_sec =
-        std::chrono::seconds{k_export_timeout - ctx.params.upload_period}
-            .count();
-    wait_sec = wait_sec > 1 ? wait_sec : 1;
-    waittime.tv_sec += wait_sec;
-    if (pthread_timedjoin_np(ctx.worker_ctx.exp_tid, nullptr, &waittime)) {
-      LG_WRN("Exporter took too long");
-      return ddres_create(DD_SEV_ERROR, DD_WHAT_EXPORT_TIMEOUT);
-    }
-    ctx.worker_ctx.exp_tid = 0;
-  }
-  if (ctx.worker_ctx.exp_error) {
+  // Fatal errors of previous exports (e.g. invalid API key) stop profiling
+  if (ctx.worker_ctx.export_queue->error()) {
     return ddres_create(DD_SEV_ERROR, DD_WHAT_EXPORTER);
   }
 
   DDRES_CHECK_FWD(report_lost_events(ctx));
 
-  // Dispatch to thread
-  ctx.worker_ctx.exp_error = false;
-
-  // switch before we async export to avoid any possible race conditions (then
-  // take into account the switch)
-  ctx.worker_ctx.i_current_pprof = 1 - ctx.worker_ctx.i_current_pprof;
-
-  // Reset the current, ensuring the timestamp starts when we are about to write
-  // to it
-  DDRES_CHECK_FWD(
-      pprof_reset(ctx.worker_ctx.pprof[ctx.worker_ctx.i_current_pprof]));
-
-  if (!synchronous_export) {
-    pthread_create(&ctx.worker_ctx.exp_tid, nullptr,
-                   ddprof_worker_export_thread, &ctx.worker_ctx);
-  } else {
-    ddprof_worker_export_thread(reinterpret_cast<void *>(&ctx.worker_ctx));
-    if (ctx.worker_ctx.exp_error) {
+  // Serialize the profile and hand it over to the export thread. Slow uploads
+  // fill the queue, then the oldest profiles are dropped: sampling is never
+  // blocked by the backend.
+  DDProfPProf *pprof = ctx.worker_ctx.pprof;
+  ExportJob job;
+  // Increase number of sequences in persistent storage
+  uint32_t const profile_seq =
+      (ctx.worker_ctx.persistent_worker_state->profile_seq)++;
+  DDRES_CHECK_FWD(ddprof_exporter_serialize(&pprof->_profile, pprof->_tags,
+                                            profile_seq, job));
+  // Reset the profile, ensuring the timestamp starts when we are about to
+  // write to it
+  DDRES_CHECK_FWD(pprof_reset(pprof));
+  ExportQueue<ExportJob> &export_queue = *ctx.worker_ctx.export_queue;
+  if (!export_queue.push(std::move(job))) {
+    LG_WRN("Export queue is full, dropping the oldest profile");
+    ddprof_stats_add(STATS_EXPORT_DROPPED, 1, nullptr);
+  }
+  if (synchronous_export) {
+    if (!export_queue.drain(k_export_timeout)) {
+      LG_WRN("Exporter took too long");
+      return ddres_create(DD_SEV_ERROR, DD_WHAT_EXPORT_TIMEOUT);
+    }
+    if (export_queue.error()) {
       return ddres_create(DD_SEV_ERROR, DD_WHAT_EXPORTER);
     }
   }
+  ddprof_stats_set(STATS_EXPORT_QUEUE_SIZE,
+                   static_cast<long>(export_queue.size()));
+
   auto cycle_now = std::chrono::steady_clock::now();
   auto cycle_duration = cycle_now - ctx.worker_ctx.cycle_start_time;
   ctx.worker_ctx.cycle_start_time = cycle_now;
 
   // Check if we can clear symbol objects
-  const int count_symbolizers_cleared =
-      ctx.worker_ctx.symbolizer->remove_unvisited();
-  ctx.worker_ctx.symbolizer->reset_unvisited_flag();
+  int count_symbolizers_cleared = 0;
+  for_each_unwind_state(ctx.worker_ctx,
+                        [&](UnwindState &, Symbolizer &symbolizer) {
+                          symbolizer.reset_stats();
+                          count_symbolizers_cleared +=
+                              symbolizer.remove_unvisited();
+                          symbolizer.reset_unvisited_flag();
+                        });
+  // Shared by the symbolizers of the worker and of the unwinding threads
+  DemangleCache::global().cycle();
+  compact_symbol_tables(ctx.worker_ctx);
 
   // Scrape procfs for process usage statistics
   DDRES_CHECK_FWD(worker_update_stats(ctx.worker_ctx, cycle_duration,
                                       count_symbolizers_cleared));
+  DDRES_CHECK_FWD(worker_enforce_cpu_budget(ctx));
+  DDRES_CHECK_FWD(worker_adapt_stack_sample_size(ctx));
 
   // And emit diagnostic output (if it's enabled)
-  print_diagnostics(ctx.worker_ctx.us->dso_hdr);
+  print_diagnostics(ctx.worker_ctx);
   if (IsDDResNotOK(ddprof_stats_send(ctx.params.internal_stats))) {
     LG_WRN("Unable to utilize to statsd socket.  Suppressing future stats.");
     ctx.params.internal_stats = {};
@@ -567,12 +919,14 @@ DDRes ddprof_worker_cycle(DDProfContext &ctx,
   // Increase the counts of exports
   ctx.worker_ctx.count_worker += 1;
 
-  // In debug mode, check for possible issues in loaded segments
-  DDPROF_DCHECK_FATAL(ctx.worker_ctx.us->dso_hdr.check_invariants(),
-                      "DsoHdr invariant violation");
+  for_each_unwind_state(ctx.worker_ctx, [](UnwindState &us, Symbolizer &) {
+    // In debug mode, check for possible issues in loaded segments
+    DDPROF_DCHECK_FATAL(us.dso_hdr.check_invariants(),
+                        "DsoHdr invariant violation");
 
-  // allow new backpopulates
-  ctx.worker_ctx.us->dso_hdr.reset_backpopulate_state();
+    // allow new backpopulates
+    us.dso_hdr.reset_backpopulate_state();
+  });
 
   // Update the time last sent
   ctx.worker_ctx.send_time += ctx.params.upload_period;
@@ -585,7 +939,9 @@ DDRes ddprof_worker_cycle(DDProfContext &ctx,
     LG_WRN("Timer skew detected; frequent warnings may suggest system issue");
     export_time_set(ctx);
   }
-  unwind_cycle(ctx.worker_ctx.us);
+  for_each_unwind_state(ctx.worker_ctx, [](UnwindState &us, Symbolizer &) {
+    unwind_cycle(&us);
+  });
   ctx.worker_ctx.live_allocation.cycle();
   // Reset stats relevant to a single cycle
   ddprof_reset_worker_stats();
@@ -593,7 +949,7 @@ DDRes ddprof_worker_cycle(DDProfContext &ctx,
   return {};
 }
 
-void ddprof_pr_mmap(DDProfContext &ctx, const perf_event_mmap2 *map,
+void ddprof_pr_mmap(UnwindState &us, const perf_event_mmap2 *map,
                     int watcher_pos, PerfClock::time_point timestamp) {
   LG_DBG("<%d>(MAP)%d: %s (%lx/%lx/%lx) %c%c%c %02u:%02u %lu", watcher_pos,
          map->pid, map->filename, map->addr, map->len, map->pgoff,
@@ -601,10 +957,9 @@ void ddprof_pr_mmap(DDProfContext &ctx, const perf_event_mmap2 *map,
          map->prot & PROT_EXEC ? 'x' : '-', map->maj, map->min, map->ino);
   Dso new_dso(map->pid, map->addr, map->addr + map->len - 1, map->pgoff,
               std::string(map->filename), map->ino, map->prot);
-  ctx.worker_ctx.us->dso_hdr.maybe_insert_erase_overlap(std::move(new_dso),
-                                                        timestamp);
+  us.dso_hdr.maybe_insert_erase_overlap(std::move(new_dso), timestamp);
   // ensure we access the process (to avoid a premature clear)
-  ctx.worker_ctx.us->process_hdr.flag_visited(map->pid);
+  us.process_hdr.flag_visited(map->pid);
 }
 
 void ddprof_pr_lost(DDProfContext &ctx, const perf_event_lost *lost,
@@ -613,41 +968,76 @@ void ddprof_pr_lost(DDProfContext &ctx, const perf_event_lost *lost,
   ctx.worker_ctx.lost_events_per_watcher[watcher_pos] += lost->lost;
 }
 
+// Change in process name (assuming exec) : associated dso should be cleared
+bool is_exec(const perf_event_comm *comm) {
+  return comm->header.misc & PERF_RECORD_MISC_COMM_EXEC;
+}
+
+// Thread was renamed (prctl(PR_SET_NAME))
+void ddprof_pr_thread_rename(UnwindState &us, const perf_event_comm *comm) {
+  Process *process = us.process_hdr.find(comm->pid);
+  if (process) {
+    const size_t max_len =
+        comm->header.size - offsetof(perf_event_comm, comm);
+    process->set_thread_name(
+        comm->tid, std::string_view(comm->comm, strnlen(comm->comm, max_len)));
+  }
+}
+
 DDRes ddprof_pr_comm(DDProfContext &ctx, const perf_event_comm *comm,
                      int watcher_pos) {
-  // Change in process name (assuming exec) : clear all associated dso
-  if (comm->header.misc & PERF_RECORD_MISC_COMM_EXEC) {
+  if (is_exec(comm)) {
     LG_DBG("<%d>(COMM)%d -> %s", watcher_pos, comm->pid, comm->comm);
-    DDRES_CHECK_FWD(worker_pid_free(ctx, comm->pid));
+    DDRES_CHECK_FWD(worker_pid_free(ctx, *ctx.worker_ctx.us, comm->pid));
+    return {};
   }
+  ddprof_pr_thread_rename(*ctx.worker_ctx.us, comm);
   return {};
 }
 
+// Expects the state of the child process to be cleared
+void ddprof_pr_process_fork(UnwindState &us, const perf_event_fork *frk) {
+  // The parent might be owned by another unwinding thread: mappings are then
+  // populated with coming samples
+  us.dso_hdr.pid_fork(frk->pid, frk->ppid);
+  // ensure we access the process (to avoid a premature clear)
+  us.process_hdr.flag_visited(frk->pid);
+}
+
+void ddprof_pr_thread_fork(UnwindState &us, const perf_event_fork *frk) {
+  if (Process *process = us.process_hdr.find(frk->pid)) {
+    // New thread: name is inherited from the thread that created it
+    process->inherit_thread_name(frk->ptid, frk->tid);
+  }
+}
+
 DDRes ddprof_pr_fork(DDProfContext &ctx, const perf_event_fork *frk,
                      int watcher_pos) {
   LG_DBG("<%d>(FORK)%d -> %d/%d", watcher_pos, frk->ppid, frk->pid, frk->tid);
   if (frk->ppid != frk->pid) {
     // Clear everything and populate at next error or with coming samples
-    DDRES_CHECK_FWD(worker_pid_free(ctx, frk->pid));
-    ctx.worker_ctx.us->dso_hdr.pid_fork(frk->pid, frk->ppid);
-    // ensure we access the process (to avoid a premature clear)
-    ctx.worker_ctx.us->process_hdr.flag_visited(frk->pid);
+    DDRES_CHECK_FWD(worker_pid_free(ctx, *ctx.worker_ctx.us, frk->pid));
+    ddprof_pr_process_fork(*ctx.worker_ctx.us, frk);
+  } else {
+    ddprof_pr_thread_fork(*ctx.worker_ctx.us, frk);
   }
   return {};
 }
 
-void ddprof_pr_exit(DDProfContext &ctx, const perf_event_exit *ext,
+void ddprof_pr_exit(UnwindState &us, const perf_event_exit *ext,
                     int watcher_pos) {
   // On Linux, it seems that the thread group leader is the one whose task ID
   // matches the process ID of the group.  Moreover, it seems that it is the
   // overwhelming convention that this thread is closed after the other threads
   // (upheld by both pthreads and runtimes).
   // We do not clear the PID at this time because we currently cleanup anyway.
-  (void)ctx;
   if (ext->pid == ext->tid) {
     LG_DBG("<%d>(EXIT)%d", watcher_pos, ext->pid);
   } else {
     LG_DBG("<%d>(EXIT)%d/%d", watcher_pos, ext->pid, ext->tid);
+    if (Process *process = us.process_hdr.find(ext->pid)) {
+      process->erase_thread_name(ext->tid);
+    }
   }
 }
 
@@ -686,21 +1076,26 @@ DDRes ddprof_worker_init(DDProfContext &ctx,
                          PersistentWorkerState *persistent_worker_state) {
   try {
     DDRES_CHECK_FWD(worker_library_init(ctx, persistent_worker_state));
-    ctx.worker_ctx.exp[0] = new DDProfExporter();
-    ctx.worker_ctx.exp[1] = new DDProfExporter();
-    ctx.worker_ctx.pprof[0] = new DDProfPProf();
-    ctx.worker_ctx.pprof[1] = new DDProfPProf();
+    ctx.worker_ctx.exp = new DDProfExporter();
+    ctx.worker_ctx.pprof = new DDProfPProf();
 
-    DDRES_CHECK_FWD(ddprof_exporter_init(ctx.exp_input, ctx.worker_ctx.exp[0]));
-    DDRES_CHECK_FWD(ddprof_exporter_init(ctx.exp_input, ctx.worker_ctx.exp[1]));
+    DDRES_CHECK_FWD(ddprof_exporter_init(ctx.exp_input, ctx.worker_ctx.exp));
     // warning : depends on unwind init
     DDRES_CHECK_FWD(
-        ddprof_exporter_new(ctx.worker_ctx.user_tags, ctx.worker_ctx.exp[0]));
-    DDRES_CHECK_FWD(
-        ddprof_exporter_new(ctx.worker_ctx.user_tags, ctx.worker_ctx.exp[1]));
-
-    DDRES_CHECK_FWD(pprof_create_profile(ctx.worker_ctx.pprof[0], ctx));
-    DDRES_CHECK_FWD(pprof_create_profile(ctx.worker_ctx.pprof[1], ctx));
+        ddprof_exporter_new(ctx.worker_ctx.user_tags, ctx.worker_ctx.exp));
+    ctx.worker_ctx.export_queue = new ExportQueue<ExportJob>(
+        ctx.params.export_queue_depth,
+        [exporter = ctx.worker_ctx.exp](ExportJob &job) {
+          DDRes const res = ddprof_exporter_send(job, exporter);
+          if (IsDDResFatal(res)) {
+            LG_NFO("Failed to export from worker");
+          }
+          return res;
+        });
+
+    DDRES_CHECK_FWD(pprof_create_profile(ctx.worker_ctx.pprof, ctx));
+    DDRES_CHECK_FWD(create_unwinding_pool(ctx));
+    init_symbol_cache(ctx);
     DDRES_CHECK_FWD(worker_init_stats(&ctx.worker_ctx));
   }
   CatchExcept2DDRes();
@@ -711,30 +1106,31 @@ DDRes ddprof_worker_free(DDProfContext &ctx) {
   try {
     // First, see if there are any outstanding requests and give them a token
     // amount of time to complete
-    if (ctx.worker_ctx.exp_tid) {
-      struct timespec waittime;
-      clock_gettime(CLOCK_REALTIME, &waittime);
+    if (ctx.worker_ctx.export_queue) {
       constexpr std::chrono::seconds k_export_thread_join_timeout{5};
-      waittime.tv_sec +=
-          std::chrono::seconds(k_export_thread_join_timeout).count();
-      if (pthread_timedjoin_np(ctx.worker_ctx.exp_tid, nullptr, &waittime)) {
-        pthread_cancel(ctx.worker_ctx.exp_tid);
+      if (!ctx.worker_ctx.export_queue->drain(k_export_thread_join_timeout)) {
+        LG_WRN("Dropping %zu pending profiles",
+               ctx.worker_ctx.export_queue->size());
       }
-      ctx.worker_ctx.exp_tid = 0;
+      // Stops the export thread (uploads have their own timeout)
+      delete ctx.worker_ctx.export_queue;
+      ctx.worker_ctx.export_queue = nullptr;
     }
 
+    // Stops the unwinding threads
+    delete ctx.worker_ctx.unwinding_pool;
+    ctx.worker_ctx.unwinding_pool = nullptr;
+
     DDRES_CHECK_FWD(worker_library_free(ctx));
-    for (int i = 0; i < 2; i++) {
-      if (ctx.worker_ctx.exp[i]) {
-        DDRES_CHECK_FWD(ddprof_exporter_free(ctx.worker_ctx.exp[i]));
-        delete ctx.worker_ctx.exp[i];
-        ctx.worker_ctx.exp[i] = nullptr;
-      }
-      if (ctx.worker_ctx.pprof[i]) {
-        DDRES_CHECK_FWD(pprof_free_profile(ctx.worker_ctx.pprof[i]));
-        delete ctx.worker_ctx.pprof[i];
-        ctx.worker_ctx.pprof[i] = nullptr;
-      }
+    if (ctx.worker_ctx.exp) {
+      DDRES_CHECK_FWD(ddprof_exporter_free(ctx.worker_ctx.exp));
+      delete ctx.worker_ctx.exp;
+      ctx.worker_ctx.exp = nullptr;
+    }
+    if (ctx.worker_ctx.pprof) {
+      DDRES_CHECK_FWD(pprof_free_profile(ctx.worker_ctx.pprof));
+      delete ctx.worker_ctx.pprof;
+      ctx.worker_ctx.pprof = nullptr;
     }
     delete ctx.worker_ctx.symbolizer;
   }
@@ -750,6 +1146,123 @@ struct perf_event_hdr_wpid : perf_event_header {
   uint32_t pid, tid;
 };
 
+namespace {
+// Returns the pid owning an event handled by the unwinding pool (0 if the
+// event is handled by the worker)
+pid_t unwinding_pool_pid(const perf_event_header *hdr,
+                         const PerfWatcher *watcher) {
+  switch (hdr->type) {
+  case PERF_RECORD_SAMPLE: {
+    perf_event_sample sample;
+    return watcher->sample_decoder(hdr, watcher->sample_type, sample)
+        ? sample.pid
+        : 0;
+  }
+  case PERF_RECORD_MMAP2:
+  case PERF_RECORD_COMM:
+  case PERF_RECORD_EXIT:
+  case PERF_RECORD_FORK:
+    return static_cast<const perf_event_hdr_wpid *>(hdr)->pid;
+  default:
+    return 0;
+  }
+}
+
+DDRes ddprof_shard_pr_sample(DDProfContext &ctx, WorkerShard &shard,
+                             perf_event_sample *sample, int watcher_pos) {
+  // Keep the same accounting as samples unwound by the worker
+  if (ctx.watchers[watcher_pos].config == PERF_COUNT_SW_TASK_CLOCK) {
+    ddprof_stats_add(STATS_TARGET_CPU_USAGE, sample->period, nullptr);
+  }
+
+  auto ticks0 = TscClock::cycles_now();
+  bool inconsistent_pid_state = false;
+  DDRes const res = ddprof_unwind_sample(ctx, &shard.us, sample, watcher_pos,
+                                         inconsistent_pid_state);
+  auto unwind_ticks = TscClock::cycles_now();
+  ddprof_stats_add(STATS_UNWIND_AVG_TIME, unwind_ticks - ticks0, nullptr);
+
+  const PerfWatcher *watcher = &ctx.watchers[watcher_pos];
+  if (!IsDDResFatal(res) &&
+      Any(EventAggregationMode::kSum & watcher->aggregation_mode)) {
+    uint64_t const sample_val = perf_value_from_sample(watcher, sample);
+    uint64_t timestamp = 0;
+    if (ctx.params.timeline && sample->time != 0) {
+      timestamp = sample->time + ctx.worker_ctx.perfclock_offset;
+    }
+    // Aggregated into the profile at the end of the cycle (or earlier if too
+    // many stacks are pending)
+    shard.stacks.add(watcher_pos, shard.us.output,
+                     {static_cast<int64_t>(sample_val), 1, timestamp});
+    if (shard.stacks.nb_stacks() + shard.stacks.nb_timed_samples() >=
+        k_max_accumulated_stacks) {
+      DDRES_CHECK_FWD(
+          aggregate_stacks(ctx, shard.stacks, shard.us, &shard.symbolizer));
+    }
+  }
+  // Stacks do not reference the state of the process
+  if (inconsistent_pid_state) {
+    unwind_pid_free(&shard.us, shard.us.pid);
+  }
+  ddprof_stats_add(STATS_AGGREGATION_AVG_TIME,
+                   TscClock::cycles_now() - unwind_ticks, nullptr);
+  return {};
+}
+} // namespace
+
+DDRes ddprof_worker_process_shard_event(WorkerShard &shard,
+                                        const perf_event_header *hdr,
+                                        int watcher_pos, DDProfContext &ctx) {
+  try {
+    UnwindState &us = shard.us;
+    switch (hdr->type) {
+    case PERF_RECORD_SAMPLE: {
+      const PerfWatcher &watcher = ctx.watchers[watcher_pos];
+      perf_event_sample sample;
+      if (watcher.sample_decoder(hdr, watcher.sample_type, sample)) {
+        DDRES_CHECK_FWD(
+            ddprof_shard_pr_sample(ctx, shard, &sample, watcher_pos));
+      }
+    } break;
+    case PERF_RECORD_MMAP2: {
+      const PerfWatcher *watcher = &ctx.watchers[watcher_pos];
+      ddprof_pr_mmap(us, reinterpret_cast<const perf_event_mmap2 *>(hdr),
+                     watcher_pos,
+                     perf_clock_time_point_from_timestamp(
+                         hdr_time(hdr, watcher->sample_type)));
+    } break;
+    case PERF_RECORD_COMM: {
+      const auto *comm = reinterpret_cast<const perf_event_comm *>(hdr);
+      if (is_exec(comm)) {
+        LG_DBG("<%d>(COMM)%d -> %s", watcher_pos, comm->pid, comm->comm);
+        unwind_pid_free(&us, comm->pid);
+      } else {
+        ddprof_pr_thread_rename(us, comm);
+      }
+    } break;
+    case PERF_RECORD_EXIT:
+      ddprof_pr_exit(us, reinterpret_cast<const perf_event_exit *>(hdr),
+                     watcher_pos);
+      break;
+    case PERF_RECORD_FORK: {
+      const auto *frk = reinterpret_cast<const perf_event_fork *>(hdr);
+      LG_DBG("<%d>(FORK)%d -> %d/%d", watcher_pos, frk->ppid, frk->pid,
+             frk->tid);
+      if (frk->ppid != frk->pid) {
+        unwind_pid_free(&us, frk->pid);
+        ddprof_pr_process_fork(us, frk);
+      } else {
+        ddprof_pr_thread_fork(us, frk);
+      }
+    } break;
+    default:
+      break;
+    }
+  }
+  CatchExcept2DDRes();
+  return {};
+}
+
 DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
                                   DDProfContext &ctx) {
   // global try catch to avoid leaking exceptions to main loop
@@ -765,20 +1278,28 @@ DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
       ctx.worker_ctx.last_processed_event_timestamp = timestamp;
     }
 
+    if (ctx.worker_ctx.unwinding_pool && wpid->pid) {
+      // Events of a process are handled by the thread owning the pid
+      pid_t const pid = unwinding_pool_pid(hdr, watcher);
+      if (pid) {
+        return ctx.worker_ctx.unwinding_pool->push(pid, hdr, watcher_pos);
+      }
+    }
+
     switch (hdr->type) {
     /* Cases where the target type has a PID */
     case PERF_RECORD_SAMPLE:
       if (wpid->pid) {
-        uint64_t const mask = watcher->sample_type;
-        perf_event_sample *sample = hdr2samp(hdr, mask);
-        if (sample) {
-          DDRES_CHECK_FWD(ddprof_pr_sample(ctx, sample, watcher_pos));
+        perf_event_sample sample;
+        if (watcher->sample_decoder(hdr, watcher->sample_type, sample)) {
+          DDRES_CHECK_FWD(ddprof_pr_sample(ctx, &sample, watcher_pos));
         }
       }
       break;
     case PERF_RECORD_MMAP2:
       if (wpid->pid) {
-        ddprof_pr_mmap(ctx, reinterpret_cast<const perf_event_mmap2 *>(hdr),
+        ddprof_pr_mmap(*ctx.worker_ctx.us,
+                       reinterpret_cast<const perf_event_mmap2 *>(hdr),
                        watcher_pos, timestamp);
       }
       break;
@@ -790,7 +1311,8 @@ DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
       break;
     case PERF_RECORD_EXIT:
       if (wpid->pid) {
-        ddprof_pr_exit(ctx, reinterpret_cast<const perf_event_exit *>(hdr),
+        ddprof_pr_exit(*ctx.worker_ctx.us,
+                       reinterpret_cast<const perf_event_exit *>(hdr),
                        watcher_pos);
       }
       break;
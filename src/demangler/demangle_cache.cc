@@ -0,0 +1,97 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "demangler/demangle_cache.hpp"
+
+#include "demangler/demangler.hpp"
+
+#include <functional>
+#include <string>
+
+namespace ddprof {
+
+DemangleCache &DemangleCache::global() {
+  static DemangleCache s_demangle_cache;
+  return s_demangle_cache;
+}
+
+std::string_view DemangleCache::demangle(const char *mangled) {
+  std::string_view const mangled_view{mangled};
+  uint64_t const hash = std::hash<std::string_view>{}(mangled_view);
+  std::lock_guard const lock{_mutex};
+  auto it = _entries.find(hash);
+  if (it != _entries.end()) {
+    ++_stats._nb_hits;
+    it->second.visited = true;
+    return it->second.demangled;
+  }
+  ++_stats._nb_misses;
+  std::string demangled = Demangler::non_microsoft_demangle(mangled);
+  _stats._bytes_saved += mangled_view.size();
+  auto name_it = _names.find(demangled);
+  if (name_it == _names.end()) {
+    _stats._bytes += demangled.size();
+    name_it = _names.emplace(std::move(demangled), 0).first;
+  } else {
+    _stats._bytes_saved += demangled.size();
+  }
+  ++name_it->second;
+  it = _entries
+           .emplace(hash, Entry{.demangled = name_it->first,
+                                .mangled_size =
+                                    static_cast<uint32_t>(mangled_view.size()),
+                                .visited = true})
+           .first;
+  return it->second.demangled;
+}
+
+void DemangleCache::release(const Entry &entry) {
+  _stats._bytes_saved -= entry.mangled_size;
+  auto it = _names.find(entry.demangled);
+  if (--it->second == 0) {
+    _stats._bytes -= it->first.size();
+    _names.erase(it);
+  } else {
+    _stats._bytes_saved -= it->first.size();
+  }
+}
+
+void DemangleCache::cycle() {
+  std::lock_guard const lock{_mutex};
+  if (_entries.size() > _max_entries) {
+    // Names that were not used during the cycle first, then any name
+    for (bool const evict_visited : {false, true}) {
+      for (auto it = _entries.begin();
+           it != _entries.end() && _entries.size() > _max_entries;) {
+        if (it->second.visited && !evict_visited) {
+          ++it;
+          continue;
+        }
+        release(it->second);
+        it = _entries.erase(it);
+        ++_stats._nb_evictions;
+      }
+    }
+  }
+  for (auto &[hash, entry] : _entries) {
+    entry.visited = false;
+  }
+  _cycle_stats = _stats;
+  _stats._nb_hits = 0;
+  _stats._nb_misses = 0;
+  _stats._nb_evictions = 0;
+}
+
+size_t DemangleCache::size() const {
+  std::lock_guard const lock{_mutex};
+  return _entries.size();
+}
+
+DemangleCache::Stats DemangleCache::cycle_stats() const {
+  std::lock_guard const lock{_mutex};
+  return _cycle_stats;
+}
+
+} // namespace ddprof
@@ -79,6 +79,14 @@ void DsoSymbolLookup::stats_display() const {
   LG_NTC("DSO_SYMB  | %10s | %lu", "SIZE", get_size());
 }
 
+void DsoSymbolLookup::remap(const TableRemap &symbol_remap) {
+  for (auto it = _map_dso_path.begin(); it != _map_dso_path.end();) {
+    remap_map_values(it->second, symbol_remap);
+    it = it->second.empty() ? _map_dso_path.erase(it) : std::next(it);
+  }
+  remap_map_values(_map_unhandled_dso, symbol_remap);
+}
+
 size_t DsoSymbolLookup::get_size() const {
   unsigned total_nb_elts = 0;
   std::for_each(_map_dso_path.begin(), _map_dso_path.end(),
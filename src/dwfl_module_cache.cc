@@ -0,0 +1,98 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "dwfl_module_cache.hpp"
+
+#include "ddprof_module_lib.hpp"
+#include "ddres.hpp"
+#include "logger.hpp"
+
+#include <unordered_set>
+
+namespace ddprof {
+
+const Segment *SharedModule::find_segment(Offset_t file_offset) const {
+  for (const Segment &segment : _load_segments) {
+    if (file_offset >= segment.offset &&
+        file_offset < segment.offset + segment.filesz) {
+      return &segment;
+    }
+  }
+  return nullptr;
+}
+
+DDRes SharedModule::get_elf(Elf **elf) const {
+  return _elf_handles->get(_file_info_id, _path, elf);
+}
+
+DDRes DwflModuleCache::get_or_insert(const FileInfoValue &file_info_value,
+                                     SharedModulePtr &module) {
+  const FileInfoId_t file_info_id = file_info_value.get_id();
+  auto it = _modules.find(file_info_id);
+  if (it != _modules.end()) {
+    ++_stats._nb_hits;
+    module = it->second;
+    return {};
+  }
+
+  Elf *elf = nullptr;
+  auto res = _elf_handles->get(file_info_id, file_info_value.get_path(), &elf);
+  if (!IsDDResOK(res)) {
+    return res;
+  }
+  auto new_module = std::make_shared<SharedModule>();
+  res = load_shared_module(elf, file_info_value.get_path(), *new_module);
+  if (!IsDDResOK(res)) {
+    _elf_handles->erase(file_info_id);
+    return res;
+  }
+  new_module->_file_info_id = file_info_id;
+  new_module->_elf_handles = _elf_handles.get();
+
+  if (!new_module->_build_id.empty()) {
+    auto &build_id_entry = _build_id_map[new_module->_build_id];
+    if (SharedModulePtr existing = build_id_entry.lock()) {
+      // Same binary through a different file (e.g. a container layer)
+      LG_DBG("[Mod] Reusing %s for %s (build-id: %s)",
+             existing->_path.c_str(), file_info_value.get_path().c_str(),
+             existing->_build_id.c_str());
+      ++_stats._nb_hits;
+      _elf_handles->erase(file_info_id);
+      module = _modules.emplace(file_info_id, std::move(existing))
+                   .first->second;
+      return {};
+    }
+    build_id_entry = new_module;
+  }
+  ++_stats._nb_loads;
+  module = _modules.emplace(file_info_id, std::move(new_module)).first->second;
+  return {};
+}
+
+size_t DwflModuleCache::remove_unused() {
+  // A file can be referenced by several entries of the cache
+  std::unordered_map<const SharedModule *, long> cache_refs;
+  for (const auto &[file_info_id, module] : _modules) {
+    ++cache_refs[module.get()];
+  }
+  std::unordered_set<const SharedModule *> unused;
+  for (const auto &[file_info_id, module] : _modules) {
+    if (module.use_count() == cache_refs[module.get()]) {
+      unused.insert(module.get());
+    }
+  }
+  std::erase_if(_modules, [this, &unused](const auto &el) {
+    if (!unused.contains(el.second.get())) {
+      return false;
+    }
+    _elf_handles->erase(el.first);
+    return true;
+  });
+  std::erase_if(_build_id_map,
+                [](const auto &el) { return el.second.expired(); });
+  return unused.size();
+}
+
+} // namespace ddprof
@@ -15,11 +15,36 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <utility>
 #include <vector>
 
 namespace ddprof {
 
+namespace {
+// Modules reported by ddprof carry the elf parsed by the module cache: hand it
+// over to dwfl instead of opening and parsing the file for every process.
+int find_elf_shared(Dwfl_Module *mod, void **userdata, const char *modname,
+                    Dwarf_Addr base, char **file_name, Elf **elfp) {
+  const auto *shared_module = static_cast<const SharedModule *>(*userdata);
+  if (!shared_module) {
+    return dwfl_linux_proc_find_elf(mod, userdata, modname, base, file_name,
+                                    elfp);
+  }
+  Elf *shared_elf = nullptr;
+  if (IsDDResNotOK(shared_module->get_elf(&shared_elf))) {
+    return -1;
+  }
+  // Takes a reference on the shared elf object (released by dwfl_end)
+  *elfp = elf_begin(-1, ELF_C_READ_MMAP, shared_elf);
+  if (*elfp) {
+    *file_name = strdup(shared_module->_path.c_str());
+  }
+  // dwfl does not own a file descriptor for this module
+  return -1;
+}
+} // namespace
+
 DwflWrapper::DwflWrapper() = default;
 
 DwflWrapper::~DwflWrapper() { dwfl_end(_dwfl); }
@@ -31,7 +56,7 @@ DDRes DwflWrapper::attach(pid_t pid, const UniqueElf &ref_elf,
   }
   // for split debug, we can fill the debuginfo_path
   static const Dwfl_Callbacks proc_callbacks = {
-      .find_elf = dwfl_linux_proc_find_elf,
+      .find_elf = find_elf_shared,
       .find_debuginfo = dwfl_standard_find_debuginfo,
       .section_address = nullptr,
       .debuginfo_path = nullptr,
@@ -68,20 +93,24 @@ DDProfMod *DwflWrapper::unsafe_get(FileInfoId_t file_info_id) {
 
 DDRes DwflWrapper::register_mod(ProcessAddress_t pc, const Dso &dso,
                                 const FileInfoValue &fileInfoValue,
+                                DwflModuleCache &module_cache,
                                 DDProfMod **mod) {
   if (!_attached) {
     DDRES_RETURN_WARN_LOG(DD_WHAT_DWFL_LIB_ERROR, "dwfl not attached to pid %d",
                           dso._pid);
   }
   DDProfMod new_mod;
-  DDRes res = report_module(_dwfl, pc, dso, fileInfoValue, new_mod);
+  DDRes res =
+      report_module(_dwfl, pc, dso, fileInfoValue, module_cache, new_mod);
   _inconsistent = new_mod._status == DDProfMod::kInconsistent;
 
   if (IsDDResNotOK(res)) {
     *mod = nullptr;
     return res;
   }
-  *mod = &_ddprof_mods.insert_or_assign(fileInfoValue.get_id(), new_mod)
+  _reported_modules.push_back(new_mod._shared_module);
+  *mod = &_ddprof_mods
+              .insert_or_assign(fileInfoValue.get_id(), std::move(new_mod))
               .first->second;
   return res;
 }
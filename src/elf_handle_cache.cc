@@ -0,0 +1,45 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "elf_handle_cache.hpp"
+
+#include "ddres.hpp"
+#include "logger.hpp"
+#include "unique_fd.hpp"
+
+#include <fcntl.h>
+#include <libelf.h>
+
+namespace ddprof {
+
+DDRes ElfHandleCache::get(FileInfoId_t file_info_id,
+                          const std::string &filepath, Elf **elf) {
+  if (UniqueElf *handle = _handles.find(file_info_id)) {
+    *elf = handle->get();
+    return {};
+  }
+
+  const UniqueFd fd_holder{::open(filepath.c_str(), O_RDONLY)};
+  if (!fd_holder) {
+    LG_WRN("[Mod] Couldn't open fd to module (%s)", filepath.c_str());
+    return ddres_warn(DD_WHAT_MODULE);
+  }
+  LG_DBG("[Mod] Success opening %s, ", filepath.c_str());
+
+  UniqueElf new_elf{elf_begin(fd_holder.get(), ELF_C_READ_MMAP, nullptr)};
+  if (!new_elf) {
+    LG_WRN("Invalid elf %s", filepath.c_str());
+    return ddres_error(DD_WHAT_INVALID_ELF);
+  }
+  // Read what could not be mapped and detach the elf from the file descriptor
+  if (elf_cntl(new_elf.get(), ELF_C_FDREAD) != 0) {
+    LG_WRN("Unable to read elf %s (%s)", filepath.c_str(), elf_errmsg(-1));
+    return ddres_error(DD_WHAT_INVALID_ELF);
+  }
+  *elf = _handles.emplace(file_info_id, std::move(new_elf)).get();
+  return {};
+}
+
+} // namespace ddprof
@@ -62,6 +62,20 @@ std::optional<EventAggregationMode> mode_from_str(const std::string &str) {
   return mode;
 }
 
+std::optional<EventConfUnwindMode> unwind_mode_from_str(const std::string &str) {
+  if (str == "dwarf") {
+    return EventConfUnwindMode::kDwarf;
+  }
+  if (str == "fp" || str == "callchain") {
+    return EventConfUnwindMode::kCallchain;
+  }
+  if (str == "hybrid") {
+    return EventConfUnwindMode::kHybrid;
+  }
+  fprintf(stderr, "Warning, unexpected unwind mode %s \n", str.c_str());
+  return {};
+}
+
 void conf_finalize(EventConf * conf, std::vector<EventConf> * configs) {
   // Generate label if needed
   // * if both, "<eventname>:<groupname>"
@@ -111,6 +125,8 @@ void conf_print(const EventConf *tp) {
   else if (tp->value_source == EventConfValueSource::kRaw)
     printf("  location: raw event (%lu with size %d bytes)\n", tp->raw_offset, tp->raw_size);
   printf("  stack_sample_size: %u\n", tp->stack_sample_size);
+  const char *unwind_modes[] = {"dwarf", "callchain", "hybrid"};
+  printf("  unwind mode: %s\n", unwind_modes[static_cast<unsigned>(tp->unwind_mode)]);
   if (tp->value_scale != 0)
     printf("  scaling factor: %f\n", tp->value_scale);
 
@@ -230,6 +246,16 @@ opt:
              g_accum_event_conf.mode = *mode;
              break;
            }
+         case EventConfField::kUnwindMode:
+           {
+             auto unwind_mode = unwind_mode_from_str(*$3);
+             if (!unwind_mode) {
+               delete $3;
+               VAL_ERROR();
+             }
+             g_accum_event_conf.unwind_mode = *unwind_mode;
+             break;
+           }
          default:
            delete $3;
            VAL_ERROR();
@@ -16,6 +16,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
@@ -60,10 +61,20 @@ DDRes create_pprof_file(ddog_Timespec start, const char *dbg_pprof_prefix,
 /// Write pprof to a valid file descriptor : allows to use pprof tools
 DDRes write_profile(const ddog_prof_EncodedProfile *encoded_profile, int fd) {
   const ddog_Vec_U8 *buffer = &encoded_profile->buffer;
-  if (write(fd, buffer->ptr, buffer->len) == 0) {
-    DDRES_RETURN_ERROR_LOG(DD_WHAT_EXPORTER,
-                           "Failed to write byte buffer to stdout! %s\n",
-                           strerror(errno));
+  const uint8_t *data = buffer->ptr;
+  size_t remaining = buffer->len;
+  while (remaining != 0) {
+    ssize_t const ret = write(fd, data, remaining);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_EXPORTER,
+                             "Failed to write byte buffer to file! %s\n",
+                             strerror(errno));
+    }
+    data += ret;
+    remaining -= ret;
   }
   return {};
 }
@@ -141,12 +152,13 @@ DDRes fill_stable_tags(const UserTags *user_tags,
   return {};
 }
 
-DDRes check_send_response_code(uint16_t send_response_code) {
+DDRes check_send_response_code(uint16_t send_response_code, bool &retryable) {
   constexpr int k_http_gateway_timeout = 504;
   constexpr int k_http_forbidden = 403;
   constexpr int k_http_not_found = 404;
   constexpr int k_http_ok = 200;
   constexpr int k_http_multiple_choices = 300;
+  constexpr int k_http_internal_server_error = 500;
 
   LG_DBG("[EXPORTER] HTTP Response code: %u", send_response_code);
   if (send_response_code >= k_http_ok &&
@@ -157,9 +169,10 @@ DDRes check_send_response_code(uint16_t send_response_code) {
     }
     return {};
   }
+  // Server errors are transient: the profile can be spooled and replayed
+  retryable = send_response_code >= k_http_internal_server_error;
   if (send_response_code == k_http_gateway_timeout) {
-    LG_WRN("[EXPORTER] Error 504 (Timeout) - Dropping profile");
-    // TODO - implement retry
+    LG_WRN("[EXPORTER] Error 504 (Timeout)");
     return {};
   }
   if (send_response_code == k_http_forbidden) {
@@ -252,6 +265,22 @@ DDRes ddprof_exporter_init(const ExporterInput &exporter_input,
   // Debug process : capture pprof to a folder
   exporter->_debug_pprof_prefix = exporter->_input.debug_pprof_prefix;
   exporter->_export = exporter->_input.do_export;
+
+  exporter->_spool.reset();
+  if (!exporter_input.spool_dir.empty()) {
+    constexpr uint64_t k_mebibyte = 1024 * 1024;
+    ExportSpoolLimits const limits{
+        .max_bytes = exporter_input.spool_max_mb * k_mebibyte,
+        .max_age = std::chrono::seconds{exporter_input.spool_max_age_s}};
+    exporter->_spool =
+        std::make_unique<ExportSpool>(exporter_input.spool_dir, limits);
+    if (IsDDResNotOK(exporter->_spool->init())) {
+      // Not worth stopping the profiler
+      LG_WRN("[EXPORTER] Unable to use spool directory %s",
+             exporter_input.spool_dir.c_str());
+      exporter->_spool.reset();
+    }
+  }
   return {};
 }
 
@@ -286,10 +315,15 @@ DDRes ddprof_exporter_new(const UserTags *user_tags, DDProfExporter *exporter) {
   return {};
 }
 
-DDRes ddprof_exporter_export(ddog_prof_Profile *profile,
-                             const Tags &additional_tags, uint32_t profile_seq,
-                             DDProfExporter *exporter) {
-  DDRes res = ddres_init();
+void ExportJob::EncodedProfileDeleter::operator()(
+    ddog_prof_EncodedProfile *encoded_profile) const {
+  ddog_prof_EncodedProfile_drop(encoded_profile);
+  delete encoded_profile;
+}
+
+DDRes ddprof_exporter_serialize(ddog_prof_Profile *profile,
+                                const Tags &additional_tags,
+                                uint32_t profile_seq, ExportJob &job) {
   ddog_prof_Profile_SerializeResult serialized_result =
       ddog_prof_Profile_serialize(profile, nullptr, nullptr, nullptr);
   if (serialized_result.tag != DDOG_PROF_PROFILE_SERIALIZE_RESULT_OK) {
@@ -297,78 +331,164 @@ DDRes ddprof_exporter_export(ddog_prof_Profile *profile,
     DDRES_RETURN_ERROR_LOG(DD_WHAT_EXPORTER, "Failed to serialize: %s",
                            serialized_result.err.message.ptr);
   }
+  job.encoded_profile.reset(new ddog_prof_EncodedProfile(serialized_result.ok));
+  job.additional_tags = additional_tags;
+  job.profile_seq = profile_seq;
+  return {};
+}
+
+DDRes ddprof_exporter_export(ddog_prof_Profile *profile,
+                             const Tags &additional_tags, uint32_t profile_seq,
+                             DDProfExporter *exporter) {
+  ExportJob job;
+  DDRES_CHECK_FWD(
+      ddprof_exporter_serialize(profile, additional_tags, profile_seq, job));
+  return ddprof_exporter_send(job, exporter);
+}
+
+namespace {
+// Spooled profiles are kept when the failure is transient (agent down)
+DDRes send_payload(ddog_ByteSlice payload, ddog_Timespec start,
+                   ddog_Timespec end, const Tags &additional_tags,
+                   uint32_t profile_seq, DDProfExporter *exporter,
+                   bool &retryable) {
+  DDRes res = ddres_init();
+  retryable = false;
+  ddog_Vec_Tag ffi_additional_tags = ddog_Vec_Tag_new();
+  defer { ddog_Vec_Tag_drop(ffi_additional_tags); };
+  DDRES_CHECK_FWD(
+      fill_cycle_tags(additional_tags, profile_seq, ffi_additional_tags););
+
+  LG_NTC("[EXPORTER] Export buffer of size %lu", payload.len);
+
+  // Backend has some logic based on the following naming
+  ddog_prof_Exporter_File files_[] = {{
+      .name = to_CharSlice("auto.pprof"),
+      .file = payload,
+  }};
+  ddog_prof_Exporter_Slice_File const files = {.ptr = files_,
+                                               .len = std::size(files_)};
+
+  ddog_prof_Exporter_Request_BuildResult res_request =
+      ddog_prof_Exporter_Request_build(exporter->_exporter, start, end,
+                                       ddog_prof_Exporter_Slice_File_empty(),
+                                       files, &ffi_additional_tags,
+                                       nullptr, // optional_endpoints_stats
+                                       nullptr, // internal_metadata_json
+                                       nullptr, // optional_info_json
+                                       k_timeout_ms);
+
+  if (res_request.tag == DDOG_PROF_EXPORTER_REQUEST_BUILD_RESULT_OK) {
+    ddog_prof_Exporter_Request *request = res_request.ok;
+
+    // dropping the request is not useful if we have a send
+    // however the send will replace the request by null when it takes
+    // ownership
+    defer { ddog_prof_Exporter_Request_drop(&request); };
+
+    ddog_prof_Exporter_SendResult result =
+        ddog_prof_Exporter_send(exporter->_exporter, &request, nullptr);
+
+    if (result.tag == DDOG_PROF_EXPORTER_SEND_RESULT_ERR) {
+      defer { ddog_Error_drop(&result.err); };
+      LG_WRN("Failure to establish connection, check url %s",
+             exporter->_url.c_str());
+      LG_WRN("Failure to send profiles (%.*s)", (int)result.err.message.len,
+             result.err.message.ptr);
+      retryable = true;
+      // Free error buffer (prefer this API to the free API)
+      if (exporter->_nb_consecutive_errors++ >=
+          k_max_nb_consecutive_errors_allowed) {
+        // this will shut down profiler
+        res = ddres_error(DD_WHAT_EXPORTER);
+      } else {
+        res = ddres_warn(DD_WHAT_EXPORTER);
+      }
+    } else {
+      // success establishing connection
+      exporter->_nb_consecutive_errors = 0;
+      res = check_send_response_code(result.http_response.code, retryable);
+    }
+  } else {
+    defer { ddog_Error_drop(&res_request.err); };
+    LG_ERR("[EXPORTER] Failure to build request: %s",
+           res_request.err.message.ptr);
+    res = ddres_error(DD_WHAT_EXPORTER);
+  }
+  return res;
+}
 
-  ddog_prof_EncodedProfile *encoded_profile = &serialized_result.ok;
-  defer { ddog_prof_EncodedProfile_drop(encoded_profile); };
+ddog_Timespec to_timespec(std::chrono::nanoseconds time) {
+  auto const seconds = std::chrono::floor<std::chrono::seconds>(time);
+  return {.seconds = seconds.count(),
+          .nanoseconds = static_cast<uint32_t>((time - seconds).count())};
+}
+
+std::chrono::nanoseconds from_timespec(ddog_Timespec time) {
+  return std::chrono::seconds{time.seconds} +
+      std::chrono::nanoseconds{time.nanoseconds};
+}
+
+// Send the oldest spooled profiles, as long as the agent accepts them
+void replay_spooled_profiles(DDProfExporter *exporter) {
+  ExportSpool &spool = *exporter->_spool;
+  std::vector<std::byte> payload;
+  Tags tags;
+  while (auto profile = spool.next_replay()) {
+    if (IsDDResNotOK(spool.load(*profile, payload, tags))) {
+      spool.remove(*profile);
+      continue;
+    }
+    LG_NTC("[EXPORTER] Replaying spooled profile #%u", profile->profile_seq);
+    bool retryable;
+    DDRes const res = send_payload(
+        {.ptr = reinterpret_cast<const uint8_t *>(payload.data()),
+         .len = payload.size()},
+        to_timespec(profile->start), to_timespec(profile->end), tags,
+        profile->profile_seq, exporter, retryable);
+    if (retryable) {
+      break;
+    }
+    // Sent or rejected for good
+    spool.remove(*profile);
+    if (IsDDResNotOK(res)) {
+      break;
+    }
+  }
+}
+} // namespace
+
+DDRes ddprof_exporter_send(const ExportJob &job, DDProfExporter *exporter) {
+  const ddog_prof_EncodedProfile *encoded_profile = job.encoded_profile.get();
 
   if (!exporter->_debug_pprof_prefix.empty()) {
     write_pprof_file(encoded_profile, exporter->_debug_pprof_prefix.c_str());
   }
 
-  ddog_Timespec const start = encoded_profile->start;
-  ddog_Timespec const end = encoded_profile->end;
-
-  if (exporter->_export) {
-    ddog_Vec_Tag ffi_additional_tags = ddog_Vec_Tag_new();
-    defer { ddog_Vec_Tag_drop(ffi_additional_tags); };
-    DDRES_CHECK_FWD(
-        fill_cycle_tags(additional_tags, profile_seq, ffi_additional_tags););
-
-    LG_NTC("[EXPORTER] Export buffer of size %lu", encoded_profile->buffer.len);
-
-    // Backend has some logic based on the following naming
-    ddog_prof_Exporter_File files_[] = {{
-        .name = to_CharSlice("auto.pprof"),
-        .file = ddog_Vec_U8_as_slice(&encoded_profile->buffer),
-    }};
-    ddog_prof_Exporter_Slice_File const files = {.ptr = files_,
-                                                 .len = std::size(files_)};
-
-    ddog_prof_Exporter_Request_BuildResult res_request =
-        ddog_prof_Exporter_Request_build(exporter->_exporter, start, end,
-                                         ddog_prof_Exporter_Slice_File_empty(),
-                                         files, &ffi_additional_tags,
-                                         nullptr, // optional_endpoints_stats
-                                         nullptr, // internal_metadata_json
-                                         nullptr, // optional_info_json
-                                         k_timeout_ms);
-
-    if (res_request.tag == DDOG_PROF_EXPORTER_REQUEST_BUILD_RESULT_OK) {
-      ddog_prof_Exporter_Request *request = res_request.ok;
-
-      // dropping the request is not useful if we have a send
-      // however the send will replace the request by null when it takes
-      // ownership
-      defer { ddog_prof_Exporter_Request_drop(&request); };
-
-      ddog_prof_Exporter_SendResult result =
-          ddog_prof_Exporter_send(exporter->_exporter, &request, nullptr);
-
-      if (result.tag == DDOG_PROF_EXPORTER_SEND_RESULT_ERR) {
-        defer { ddog_Error_drop(&result.err); };
-        LG_WRN("Failure to establish connection, check url %s",
-               exporter->_url.c_str());
-        LG_WRN("Failure to send profiles (%.*s)", (int)result.err.message.len,
-               result.err.message.ptr);
-        // Free error buffer (prefer this API to the free API)
-        if (exporter->_nb_consecutive_errors++ >=
-            k_max_nb_consecutive_errors_allowed) {
-          // this will shut down profiler
-          res = ddres_error(DD_WHAT_EXPORTER);
-        } else {
-          res = ddres_warn(DD_WHAT_EXPORTER);
-        }
-      } else {
-        // success establishing connection
-        exporter->_nb_consecutive_errors = 0;
-        res = check_send_response_code(result.http_response.code);
-      }
-    } else {
-      defer { ddog_Error_drop(&res_request.err); };
-      LG_ERR("[EXPORTER] Failure to build request: %s",
-             res_request.err.message.ptr);
-      res = ddres_error(DD_WHAT_EXPORTER);
+  if (!exporter->_export) {
+    return {};
+  }
+  bool retryable;
+  DDRes res = send_payload(ddog_Vec_U8_as_slice(&encoded_profile->buffer),
+                           encoded_profile->start, encoded_profile->end,
+                           job.additional_tags, job.profile_seq, exporter,
+                           retryable);
+  if (!exporter->_spool) {
+    return res;
+  }
+  if (retryable) {
+    SpooledProfile const profile{.start = from_timespec(encoded_profile->start),
+                                 .end = from_timespec(encoded_profile->end),
+                                 .profile_seq = job.profile_seq};
+    DDRes const spool_res = exporter->_spool->store(
+        profile, job.additional_tags,
+        [&](int fd) { return write_profile(encoded_profile, fd); });
+    if (IsDDResOK(spool_res) && IsDDResFatal(res)) {
+      // The agent is down: keep profiling while the spool has room
+      res = ddres_warn(DD_WHAT_EXPORTER);
     }
+  } else if (IsDDResOK(res)) {
+    replay_spooled_profiles(exporter);
   }
   return res;
 }
@@ -378,6 +498,7 @@ DDRes ddprof_exporter_free(DDProfExporter *exporter) {
     ddog_prof_Exporter_drop(exporter->_exporter);
   }
   exporter->_exporter = nullptr;
+  exporter->_spool.reset();
   return {};
 }
 
@@ -0,0 +1,253 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "exporter/export_spool.hpp"
+
+#include "ddres_helpers.hpp"
+#include "defer.hpp"
+#include "logger.hpp"
+
+#include <absl/strings/substitute.h>
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+constexpr std::string_view k_profile_suffix = ".pprof.lz4";
+constexpr std::string_view k_tags_suffix = ".tags";
+constexpr std::string_view k_tmp_suffix = ".tmp";
+constexpr mode_t k_read_write_user_only = 0600;
+
+// <start_ns>-<end_ns>-<seq>
+std::string spool_basename(const SpooledProfile &profile) {
+  return absl::Substitute("$0-$1-$2", profile.start.count(),
+                          profile.end.count(), profile.profile_seq);
+}
+
+std::optional<SpooledProfile> parse_basename(std::string_view basename) {
+  int64_t start_ns;
+  int64_t end_ns;
+  uint32_t profile_seq;
+  const char *const last = basename.data() + basename.size();
+  auto res = std::from_chars(basename.data(), last, start_ns);
+  if (res.ec != std::errc{} || res.ptr == last || *res.ptr != '-') {
+    return std::nullopt;
+  }
+  res = std::from_chars(res.ptr + 1, last, end_ns);
+  if (res.ec != std::errc{} || res.ptr == last || *res.ptr != '-') {
+    return std::nullopt;
+  }
+  res = std::from_chars(res.ptr + 1, last, profile_seq);
+  if (res.ec != std::errc{} || res.ptr != last) {
+    return std::nullopt;
+  }
+  return SpooledProfile{.start = std::chrono::nanoseconds{start_ns},
+                        .end = std::chrono::nanoseconds{end_ns},
+                        .profile_seq = profile_seq};
+}
+
+std::string tags_path(std::string_view profile_path) {
+  std::string path(
+      profile_path.substr(0, profile_path.size() - k_profile_suffix.size()));
+  path += k_tags_suffix;
+  return path;
+}
+
+// Write to a temporary file, sync it then atomically move it to its location
+DDRes write_file_atomically(const std::string &path,
+                            const ExportSpool::WriteFunc &write) {
+  std::string const tmp_path = path + std::string(k_tmp_suffix);
+  int const fd = open(tmp_path.c_str(),
+                      O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC,
+                      k_read_write_user_only);
+  DDRES_CHECK_ERRNO(fd, DD_WHAT_EXPORT_SPOOL, "Unable to create %s",
+                    tmp_path.c_str());
+  auto defer_unlink = make_defer([&] { unlink(tmp_path.c_str()); });
+  {
+    defer { close(fd); };
+    DDRES_CHECK_FWD(write(fd));
+    DDRES_CHECK_ERRNO(fsync(fd), DD_WHAT_EXPORT_SPOOL, "Unable to sync %s",
+                      tmp_path.c_str());
+  }
+  DDRES_CHECK_ERRNO(rename(tmp_path.c_str(), path.c_str()),
+                    DD_WHAT_EXPORT_SPOOL, "Unable to rename %s",
+                    tmp_path.c_str());
+  defer_unlink.release();
+  return {};
+}
+
+DDRes write_tags(int fd, const Tags &tags) {
+  std::string content;
+  for (const auto &[key, value] : tags) {
+    absl::SubstituteAndAppend(&content, "$0:$1\n", key, value);
+  }
+  if (write(fd, content.data(), content.size()) !=
+      static_cast<ssize_t>(content.size())) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_EXPORT_SPOOL, "Unable to write tags");
+  }
+  return {};
+}
+} // namespace
+
+ExportSpool::ExportSpool(std::string dir, const ExportSpoolLimits &limits)
+    : _dir(std::move(dir)), _limits(limits),
+      _replay_limiter(limits.max_replays_per_interval, limits.replay_interval) {
+}
+
+DDRes ExportSpool::init() {
+  std::error_code ec;
+  std::filesystem::create_directories(_dir, ec);
+  DDRES_CHECK_ERRORCODE(ec, DD_WHAT_EXPORT_SPOOL,
+                        "Unable to create spool directory %s", _dir.c_str());
+
+  std::vector<std::string> orphan_files;
+  std::vector<std::string> tags_files;
+  for (const auto &entry : std::filesystem::directory_iterator(_dir, ec)) {
+    std::string const path = entry.path().string();
+    std::string_view const filename =
+        std::string_view(path).substr(path.rfind('/') + 1);
+    if (filename.ends_with(k_tmp_suffix)) {
+      // Interrupted write
+      orphan_files.push_back(path);
+      continue;
+    }
+    if (filename.ends_with(k_tags_suffix)) {
+      tags_files.push_back(path);
+      continue;
+    }
+    if (!filename.ends_with(k_profile_suffix)) {
+      continue;
+    }
+    auto profile = parse_basename(
+        filename.substr(0, filename.size() - k_profile_suffix.size()));
+    if (!profile) {
+      continue;
+    }
+    profile->path = path;
+    profile->size = entry.file_size(ec);
+    _nb_bytes += profile->size;
+    _profiles.push_back(std::move(*profile));
+  }
+  DDRES_CHECK_ERRORCODE(ec, DD_WHAT_EXPORT_SPOOL,
+                        "Unable to list spool directory %s", _dir.c_str());
+  // Tags of profiles that were never committed (or were partially removed)
+  for (const auto &path : tags_files) {
+    if (std::none_of(_profiles.begin(), _profiles.end(),
+                     [&](const SpooledProfile &profile) {
+                       return tags_path(profile.path) == path;
+                     })) {
+      orphan_files.push_back(path);
+    }
+  }
+  for (const auto &path : orphan_files) {
+    unlink(path.c_str());
+  }
+  std::sort(_profiles.begin(), _profiles.end(),
+            [](const SpooledProfile &lhs, const SpooledProfile &rhs) {
+              return std::tie(lhs.start, lhs.profile_seq) <
+                  std::tie(rhs.start, rhs.profile_seq);
+            });
+  if (!_profiles.empty()) {
+    LG_NTC("[EXPORTER] Found %zu spooled profiles in %s", _profiles.size(),
+           _dir.c_str());
+  }
+  enforce_limits(std::chrono::system_clock::now());
+  return {};
+}
+
+DDRes ExportSpool::store(const SpooledProfile &profile, const Tags &tags,
+                         const WriteFunc &write) {
+  SpooledProfile spooled = profile;
+  spooled.path = _dir + '/' + spool_basename(profile);
+  spooled.path += k_profile_suffix;
+  // Tags first: the profile file commits the entry
+  DDRES_CHECK_FWD(write_file_atomically(
+      tags_path(spooled.path), [&](int fd) { return write_tags(fd, tags); }));
+  DDRes const res = write_file_atomically(spooled.path, write);
+  if (IsDDResNotOK(res)) {
+    unlink(tags_path(spooled.path).c_str());
+    return res;
+  }
+  struct stat st;
+  if (stat(spooled.path.c_str(), &st) == 0) {
+    spooled.size = st.st_size;
+  }
+  _nb_bytes += spooled.size;
+  LG_NTC("[EXPORTER] Spooled profile #%u to %s", spooled.profile_seq,
+         spooled.path.c_str());
+  _profiles.push_back(std::move(spooled));
+  enforce_limits(std::chrono::system_clock::now());
+  return {};
+}
+
+std::optional<SpooledProfile> ExportSpool::next_replay() {
+  enforce_limits(std::chrono::system_clock::now());
+  if (_profiles.empty() || !_replay_limiter.check()) {
+    return std::nullopt;
+  }
+  return _profiles.front();
+}
+
+DDRes ExportSpool::load(const SpooledProfile &profile,
+                        std::vector<std::byte> &payload, Tags &tags) const {
+  std::ifstream profile_file(profile.path, std::ios::binary);
+  DDRES_CHECK_BOOL(profile_file.good(), DD_WHAT_EXPORT_SPOOL,
+                   "Unable to open %s", profile.path.c_str());
+  payload.resize(profile.size);
+  profile_file.read(reinterpret_cast<char *>(payload.data()),
+                    static_cast<std::streamsize>(payload.size()));
+  bool const complete =
+      profile_file.gcount() == static_cast<std::streamsize>(payload.size());
+  DDRES_CHECK_BOOL(complete, DD_WHAT_EXPORT_SPOOL, "Unable to read %s",
+                   profile.path.c_str());
+
+  tags.clear();
+  std::ifstream tags_file(tags_path(profile.path));
+  std::string line;
+  while (std::getline(tags_file, line)) {
+    size_t const pos = line.find(':');
+    if (pos != std::string::npos) {
+      tags.emplace_back(line.substr(0, pos), line.substr(pos + 1));
+    }
+  }
+  return {};
+}
+
+void ExportSpool::remove(const SpooledProfile &profile) {
+  auto it = std::find_if(_profiles.begin(), _profiles.end(),
+                         [&](const SpooledProfile &spooled) {
+                           return spooled.path == profile.path;
+                         });
+  if (it == _profiles.end()) {
+    return;
+  }
+  // Profile first: a leftover tags file is ignored
+  unlink(it->path.c_str());
+  unlink(tags_path(it->path).c_str());
+  _nb_bytes -= it->size;
+  _profiles.erase(it);
+}
+
+void ExportSpool::enforce_limits(std::chrono::system_clock::time_point now) {
+  auto const oldest_end = now.time_since_epoch() - _limits.max_age;
+  while (!_profiles.empty() &&
+         (_nb_bytes > _limits.max_bytes ||
+          _profiles.front().end < oldest_end)) {
+    LG_NTC("[EXPORTER] Evicting spooled profile %s",
+           _profiles.front().path.c_str());
+    ++_nb_evicted;
+    SpooledProfile const oldest = _profiles.front();
+    remove(oldest);
+  }
+}
+
+} // namespace ddprof
@@ -0,0 +1,69 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "file_tail.hpp"
+
+#include "ddres.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+bool operator==(const timespec &lhs, const timespec &rhs) {
+  return lhs.tv_sec == rhs.tv_sec && lhs.tv_nsec == rhs.tv_nsec;
+}
+} // namespace
+
+DDRes FileTail::map(int fd, FileTailState &state) {
+  unmap();
+  struct stat st;
+  DDRES_CHECK_ERRNO(fstat(fd, &st), DD_WHAT_NO_JIT_FILE,
+                    "Unable to stat runtime symbol file");
+  auto const size = static_cast<uint64_t>(st.st_size);
+  bool const known_file = state.inode != 0;
+  bool const same_file = st.st_dev == state.dev && st.st_ino == state.inode;
+  _replaced = known_file &&
+      (!same_file || size < state.offset ||
+       (size == state.offset && !(st.st_mtim == state.mtime)));
+  if (!same_file || _replaced) {
+    state = {.dev = st.st_dev, .inode = st.st_ino, .offset = 0};
+  }
+  state.mtime = st.st_mtim;
+  if (size <= state.offset) {
+    return {};
+  }
+
+  // Offsets of mappings are page aligned
+  static const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  uint64_t const map_offset = state.offset - (state.offset % page_size);
+  _size = size - map_offset;
+  _skip = state.offset - map_offset;
+  _addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd,
+               static_cast<off_t>(map_offset));
+  if (_addr == MAP_FAILED) {
+    _addr = nullptr;
+    _size = 0;
+    _skip = 0;
+    DDRES_RETURN_WARN_LOG(DD_WHAT_NO_JIT_FILE,
+                          "Unable to map runtime symbol file");
+  }
+  // Parsed once, front to back
+  madvise(_addr, _size, MADV_SEQUENTIAL);
+  return {};
+}
+
+void FileTail::unmap() {
+  if (_addr) {
+    munmap(_addr, _size);
+  }
+  _addr = nullptr;
+  _size = 0;
+  _skip = 0;
+}
+
+} // namespace ddprof
@@ -0,0 +1,147 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "jit/jit_symbol_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+namespace ddprof {
+
+namespace {
+template <typename Interval> struct StartsAfter {
+  bool operator()(const Interval &lhs, const Interval &rhs) const {
+    return lhs.start > rhs.start;
+  }
+};
+
+// Parts of intervals that remain once an overlap was resolved, they are
+// merged back in start order
+template <typename Interval>
+using Leftovers = std::priority_queue<Interval, std::vector<Interval>,
+                                      StartsAfter<Interval>>;
+
+// Intervals are added in start order. Only the last one can overlap.
+template <typename Interval>
+void add_resolved(std::vector<Interval> &merged, Interval interval,
+                  Leftovers<Interval> &leftovers) {
+  while (!merged.empty() && merged.back().end > interval.start) {
+    Interval &last = merged.back();
+    if (last.generation > interval.generation) {
+      // The older interval keeps what is after the newer one
+      if (interval.end > last.end) {
+        interval.start = last.end;
+        leftovers.push(interval);
+      }
+      return;
+    }
+    if (last.end > interval.end) {
+      leftovers.push({.start = interval.end,
+                      .end = last.end,
+                      .symbol_idx = last.symbol_idx,
+                      .generation = last.generation});
+    }
+    last.end = interval.start;
+    if (last.start < last.end) {
+      break;
+    }
+    merged.pop_back();
+  }
+  merged.push_back(interval);
+}
+
+// Newer intervals (sorted by start, then generation) overwrite older ones
+template <typename Interval>
+std::vector<Interval> merge(const std::vector<Interval> &older,
+                            const std::vector<Interval> &newer) {
+  std::vector<Interval> merged;
+  merged.reserve(older.size() + newer.size());
+  Leftovers<Interval> leftovers;
+  // start < end, so no interval can start at the max address
+  constexpr auto k_none = std::numeric_limits<ProcessAddress_t>::max();
+  auto it_old = older.begin();
+  auto it_new = newer.begin();
+  while (true) {
+    ProcessAddress_t const old_start =
+        it_old != older.end() ? it_old->start : k_none;
+    ProcessAddress_t const new_start =
+        it_new != newer.end() ? it_new->start : k_none;
+    ProcessAddress_t const leftover_start =
+        leftovers.empty() ? k_none : leftovers.top().start;
+    if (old_start == k_none && new_start == k_none &&
+        leftover_start == k_none) {
+      break;
+    }
+    if (old_start <= new_start && old_start <= leftover_start) {
+      add_resolved(merged, *it_old++, leftovers);
+    } else if (new_start <= leftover_start) {
+      add_resolved(merged, *it_new++, leftovers);
+    } else {
+      Interval const leftover = leftovers.top();
+      leftovers.pop();
+      add_resolved(merged, leftover, leftovers);
+    }
+  }
+  // Intervals no longer overlap: all future insertions are newer
+  for (Interval &interval : merged) {
+    interval.generation = 0;
+  }
+  return merged;
+}
+} // namespace
+
+void JITSymbolIndex::insert(ProcessAddress_t start, Offset_t size,
+                            SymbolIdx_t symbol_idx) {
+  _pending.push_back({.start = start,
+                      .end = start + size,
+                      .symbol_idx = symbol_idx,
+                      .generation = ++_generation});
+}
+
+SymbolIdx_t JITSymbolIndex::find(ProcessAddress_t pc) {
+  if (!_pending.empty()) {
+    flush();
+  }
+  SymbolIdx_t const symbol_idx = find(_recent, pc);
+  return symbol_idx != -1 ? symbol_idx : find(_intervals, pc);
+}
+
+SymbolIdx_t JITSymbolIndex::find(const std::vector<Interval> &intervals,
+                                 ProcessAddress_t pc) {
+  auto it = std::upper_bound(intervals.begin(), intervals.end(), pc,
+                             [](ProcessAddress_t addr, const Interval &el) {
+                               return addr < el.start;
+                             });
+  if (it == intervals.begin()) {
+    return -1;
+  }
+  --it;
+  return pc < it->end ? it->symbol_idx : -1;
+}
+
+// Sorting the insertions is O(p.log(p)), merging them with the recent
+// intervals is linear. The main array is only copied once the recent
+// intervals represent a fraction of it.
+void JITSymbolIndex::flush() {
+  std::sort(_pending.begin(), _pending.end(),
+            [](const Interval &lhs, const Interval &rhs) {
+              return std::tie(lhs.start, lhs.generation) <
+                  std::tie(rhs.start, rhs.generation);
+            });
+  _recent = merge(_recent, _pending);
+  _pending.clear();
+  _generation = 0;
+  if (_recent.size() > k_min_merge_size + (_intervals.size() / k_merge_ratio)) {
+    for (Interval &interval : _recent) {
+      interval.generation = 1;
+    }
+    _intervals = merge(_intervals, _recent);
+    _recent.clear();
+  }
+}
+
+} // namespace ddprof
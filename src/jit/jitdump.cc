@@ -1,9 +1,11 @@
 #include "jit/jitdump.hpp"
 
+#include "file_tail.hpp"
 #include "logger.hpp"
+#include "unique_fd.hpp"
 
 #include <cstring>
-#include <fstream>
+#include <fcntl.h>
 #include <span>
 #include <vector>
 
@@ -26,10 +28,12 @@ template <std::integral T> T load(const char **data) {
 }
 } // namespace
 
-DDRes jit_read_header(std::ifstream &file_stream, JITHeader &header) {
-  if (!file_stream.read(reinterpret_cast<char *>(&header), sizeof(JITHeader))) {
+DDRes jit_read_header(std::span<const std::byte> data, JITHeader &header,
+                      uint64_t &header_size) {
+  if (data.size() < sizeof(JITHeader)) {
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "incomplete jit file");
   }
+  memcpy(&header, data.data(), sizeof(JITHeader));
 
   if (header.magic == k_header_magic) {
     // expected value (no need to swap data)
@@ -39,29 +43,26 @@ DDRes jit_read_header(std::ifstream &file_stream, JITHeader &header) {
   } else {
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Unknown jit format(%x)", header.magic);
   }
-  int64_t const remaining_size = header.total_size - sizeof(header);
-  if (remaining_size > 0) {
-    if (!file_stream.seekg(remaining_size)) {
-      DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "incomplete jit file");
-    }
-  } else if (remaining_size == 0) {
-    // this is the expected code path
-  } else { // afaik this should never happen
+  if (header.total_size < sizeof(header)) { // afaik this should never happen
+    DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "incomplete jit file");
+  }
+  if (header.total_size > data.size()) {
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "incomplete jit file");
   }
   if (header.version != k_jit_header_version) {
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Version not handled");
   }
+  header_size = header.total_size;
   return {};
 }
 
 // true if we should continue
-bool jit_read_prefix(std::ifstream &file_stream, JITRecordPrefix &prefix) {
-  if (!file_stream.read(reinterpret_cast<char *>(&prefix),
-                        sizeof(JITRecordPrefix))) {
+bool jit_read_prefix(std::span<const std::byte> data, JITRecordPrefix &prefix) {
+  if (data.size() < sizeof(JITRecordPrefix)) {
     // It is expected that we reach EOF here
     return false;
   }
+  memcpy(&prefix, data.data(), sizeof(JITRecordPrefix));
   if (prefix.id == JITRecordType::JIT_CODE_CLOSE) {
     return false;
   }
@@ -72,25 +73,18 @@ bool jit_read_prefix(std::ifstream &file_stream, JITRecordPrefix &prefix) {
   return true;
 }
 
-DDRes jit_read_code_load(std::ifstream &file_stream,
-                         JITRecordCodeLoad &code_load,
-                         std::vector<char> &buff) {
+// record holds the bytes that follow the prefix
+DDRes jit_read_code_load(std::span<const std::byte> record,
+                         JITRecordCodeLoad &code_load) {
 #ifdef DEBUG
   LG_DBG("----  Read code load  ----");
 #endif
   // we should at least have size for prefix / pid / tid / addr..
-  if ((code_load.prefix.total_size) <
-      (sizeof(JITRecordPrefix) + JITRecordCodeLoad::k_size_integers)) {
+  if (record.size() < JITRecordCodeLoad::k_size_integers) {
     // Unlikely unless the write was truncated
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Invalid code load structure");
   }
-  buff.resize(code_load.prefix.total_size - sizeof(JITRecordPrefix));
-  if (!file_stream.read(
-          buff.data(), code_load.prefix.total_size - sizeof(JITRecordPrefix))) {
-    // can happen if we are in the middle of a write
-    DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete code load structure");
-  }
-  const char *buf = buff.data();
+  const char *buf = reinterpret_cast<const char *>(record.data());
   code_load.pid = load<uint32_t>(&buf);
   code_load.tid = load<uint32_t>(&buf);
 
@@ -99,13 +93,13 @@ DDRes jit_read_code_load(std::ifstream &file_stream,
   code_load.code_size = load<uint64_t>(&buf);
   code_load.code_index = load<uint64_t>(&buf);
   // remaining = total - (everything we read)
-  int const remaining_size = code_load.prefix.total_size -
-      sizeof(JITRecordPrefix) - JITRecordCodeLoad::k_size_integers;
-  if (remaining_size < static_cast<int>(code_load.code_size)) {
+  uint64_t const remaining_size =
+      record.size() - JITRecordCodeLoad::k_size_integers;
+  if (remaining_size < code_load.code_size) {
     // inconsistency
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete code load structure");
   }
-  int const str_size = remaining_size - code_load.code_size;
+  uint64_t const str_size = remaining_size - code_load.code_size;
   if (str_size > 1) {
     code_load.func_name = std::string(buf, str_size - 1);
   }
@@ -117,29 +111,36 @@ DDRes jit_read_code_load(std::ifstream &file_stream,
   return {};
 }
 
-DDRes jit_read_debug_info(std::ifstream &file_stream,
-                          JITRecordDebugInfo &debug_info,
-                          std::vector<char> &buff) {
+DDRes jit_read_debug_info(std::span<const std::byte> record,
+                          JITRecordDebugInfo &debug_info) {
 #ifdef DEBUG
   LG_DBG("---- Read debug info ----");
 #endif
-  if (debug_info.prefix.total_size <
-      (sizeof(JITRecordPrefix) + JITRecordDebugInfo::k_size_integers)) {
+  if (record.size() < JITRecordDebugInfo::k_size_integers) {
     DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Invalid debug info size");
   }
-  buff.resize(debug_info.prefix.total_size - sizeof(JITRecordPrefix));
-  if (!file_stream.read(buff.data(), buff.size())) {
-    DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete debug info structure");
-  }
-  const char *buf = buff.data();
+  const char *buf = reinterpret_cast<const char *>(record.data());
+  const char *const end = buf + record.size();
   debug_info.code_addr = load<uint64_t>(&buf);
   debug_info.nr_entry = load<uint64_t>(&buf);
+  constexpr size_t k_entry_min_size = sizeof(uint64_t) + 2 * sizeof(int32_t);
+  if (debug_info.nr_entry > record.size() / k_entry_min_size) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Invalid debug info entry count");
+  }
   debug_info.entries.resize(debug_info.nr_entry);
 
   for (unsigned i = 0; i < debug_info.nr_entry; ++i) {
+    if (end - buf < static_cast<ptrdiff_t>(k_entry_min_size)) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete debug info structure");
+    }
     debug_info.entries[i].addr = load<uint64_t>(&buf);
     debug_info.entries[i].lineno = load<int32_t>(&buf);
     debug_info.entries[i].discrim = load<int32_t>(&buf);
+    // Names are null terminated within the record
+    size_t const name_size = strnlen(buf, end - buf);
+    if (name_size == static_cast<size_t>(end - buf)) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete debug info structure");
+    }
     // NOLINTNEXTLINE(readability-magic-numbers)
     if (static_cast<unsigned char>(*buf) == 0xff && *(buf + 1) == '\0') {
       if (i >= 1) {
@@ -148,8 +149,8 @@ DDRes jit_read_debug_info(std::ifstream &file_stream,
         LG_WRN("Invalid attempt to copy previous debug entry\n");
       }
     }
-    debug_info.entries[i].name = std::string(buf);
-    buf += debug_info.entries[i].name.size() + 1;
+    debug_info.entries[i].name = std::string(buf, name_size);
+    buf += name_size + 1;
 #ifdef DEBUG
     LG_DBG("Name:line = %s:%d / %lx / time=%lu",
            debug_info.entries[i].name.c_str(), debug_info.entries[i].lineno,
@@ -159,56 +160,83 @@ DDRes jit_read_debug_info(std::ifstream &file_stream,
   return {};
 }
 
-DDRes jit_read_records(std::ifstream &file_stream, JITDump &jit_dump) {
-  // a buffer to copy the data
-  std::vector<char> buff;
-  bool valid_entry = true;
-  do {
-    JITRecordPrefix prefix;
-    valid_entry = jit_read_prefix(file_stream, prefix);
-    if (valid_entry) {
-      switch (prefix.id) {
-      case JITRecordType::JIT_CODE_LOAD: {
-        JITRecordCodeLoad current;
-        current.prefix = prefix;
-        DDRES_CHECK_FWD_STRICT(jit_read_code_load(file_stream, current, buff));
-        jit_dump.code_load.push_back(std::move(current));
-        break;
-      }
-      case JITRecordType::JIT_CODE_DEBUG_INFO: {
-        JITRecordDebugInfo current;
-        current.prefix = prefix;
-        DDRES_CHECK_FWD_STRICT(jit_read_debug_info(file_stream, current, buff));
-        jit_dump.debug_info.push_back(std::move(current));
-        break;
-      }
-      default: {
-        // llvm seems to only emit the two above
-        DDRES_RETURN_ERROR_LOG(DD_WHAT_JIT, "jitdump record not handled");
-        break;
-      }
-      }
+// Parse complete records. parsed_size stops before an incomplete record, that
+// is expected when the writer is in the middle of a write.
+DDRes jit_read_records(std::span<const std::byte> data, JITDump &jit_dump,
+                       uint64_t &parsed_size) {
+  parsed_size = 0;
+  JITRecordPrefix prefix;
+  while (jit_read_prefix(data.subspan(parsed_size), prefix)) {
+    if (prefix.total_size < sizeof(JITRecordPrefix)) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Invalid record size");
     }
-  } while (valid_entry);
+    if (prefix.total_size > data.size() - parsed_size) {
+      // can happen if we are in the middle of a write
+      DDRES_RETURN_WARN_LOG(DD_WHAT_JIT, "Incomplete record");
+    }
+    auto const record = data.subspan(parsed_size + sizeof(JITRecordPrefix),
+                                      prefix.total_size -
+                                          sizeof(JITRecordPrefix));
+    switch (prefix.id) {
+    case JITRecordType::JIT_CODE_LOAD: {
+      JITRecordCodeLoad current;
+      current.prefix = prefix;
+      DDRES_CHECK_FWD_STRICT(jit_read_code_load(record, current));
+      jit_dump.code_load.push_back(std::move(current));
+      break;
+    }
+    case JITRecordType::JIT_CODE_DEBUG_INFO: {
+      JITRecordDebugInfo current;
+      current.prefix = prefix;
+      DDRES_CHECK_FWD_STRICT(jit_read_debug_info(record, current));
+      jit_dump.debug_info.push_back(std::move(current));
+      break;
+    }
+    default: {
+      // llvm seems to only emit the two above
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_JIT, "jitdump record not handled");
+      break;
+    }
+    }
+    parsed_size += prefix.total_size;
+  }
   return {};
 }
 
 DDRes jitdump_read(std::string_view file, JITDump &jit_dump) {
-  try {
-
-    std::ifstream file_stream(std::string{file}, std::ios::binary);
-    // We are not locking, assumption is that even if we fail to read a given
-    // section we can always retry later. The aim is not to slow down the app
-    if (!file_stream) {
-      // avoid logging as this can happen in standard path
-      return ddres_error(DD_WHAT_NO_JIT_FILE);
-    }
-    LG_DBG("JITDump starting parse of %s", file.data());
-    DDRES_CHECK_FWD_STRICT(jit_read_header(file_stream, jit_dump.header));
-    DDRES_CHECK_FWD_STRICT(jit_read_records(file_stream, jit_dump));
+  FileTailState state;
+  bool replaced;
+  return jitdump_read_tail(file, state, jit_dump, replaced);
+}
+
+DDRes jitdump_read_tail(std::string_view file, FileTailState &state,
+                        JITDump &jit_dump, bool &replaced) {
+  replaced = false;
+  // We are not locking, assumption is that even if we fail to read a given
+  // section we can always retry later. The aim is not to slow down the app
+  UniqueFd const fd{open(std::string{file}.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd) {
+    // avoid logging as this can happen in standard path
+    return ddres_error(DD_WHAT_NO_JIT_FILE);
   }
-  // incomplete files can trigger exceptions
-  CatchExcept2DDRes();
-  return {};
+  FileTail tail;
+  DDRES_CHECK_FWD_STRICT(tail.map(fd.get(), state));
+  replaced = tail.replaced();
+  std::span<const std::byte> data = tail.data();
+  if (data.empty()) {
+    return {};
+  }
+  LG_DBG("JITDump parse of %s (from offset %lu)", file.data(), state.offset);
+  if (state.offset == 0) {
+    uint64_t header_size;
+    DDRES_CHECK_FWD_STRICT(jit_read_header(data, jit_dump.header, header_size));
+    state.offset = header_size;
+    data = data.subspan(header_size);
+  }
+  uint64_t parsed_size = 0;
+  DDRes const res = jit_read_records(data, jit_dump, parsed_size);
+  // Incomplete records are parsed again once they are fully written
+  state.offset += parsed_size;
+  return res;
 }
 } // namespace ddprof
@@ -0,0 +1,75 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "kernel_symbol_lookup.hpp"
+
+#include "ddres.hpp"
+#include "logger.hpp"
+
+namespace ddprof {
+
+namespace {
+std::string module_path(std::string_view module) {
+  return module.empty() ? std::string{"[kernel.kallsyms]"}
+                        : "[" + std::string{module} + "]";
+}
+} // namespace
+
+SymbolIdx_t KernelSymbolLookup::get_or_insert(ProcessAddress_t addr,
+                                              SymbolTable &symbol_table,
+                                              MapInfoTable &mapinfo_table,
+                                              MapInfoIdx_t &map_info_idx) {
+  if (!_symbols) {
+    _symbols = std::make_unique<KernelSymbols>(_cache_dir, _path_to_proc,
+                                               _path_to_sys);
+    refresh();
+  }
+  auto const symbol = _symbols->find(addr);
+  if (!symbol) {
+    return k_symbol_idx_null;
+  }
+
+  auto const mapinfo_it = _mapinfo_map.find(symbol->module);
+  if (mapinfo_it != _mapinfo_map.end()) {
+    map_info_idx = mapinfo_it->second;
+  } else {
+    map_info_idx = mapinfo_table.size();
+    // Modules do not expose their build id
+    mapinfo_table.emplace_back(
+        0, 0, 0, module_path(symbol->module),
+        symbol->module.empty() ? _symbols->build_id() : BuildIdStr{});
+    _mapinfo_map.emplace(symbol->module, map_info_idx);
+  }
+
+  auto const symbol_it = _symbol_map.find(symbol->start);
+  if (symbol_it != _symbol_map.end()) {
+    return symbol_it->second;
+  }
+  SymbolIdx_t const symbol_idx = symbol_table.size();
+  symbol_table.emplace_back(std::string{symbol->name},
+                            std::string{symbol->name}, 0, std::string{});
+  _symbol_map.emplace(symbol->start, symbol_idx);
+  return symbol_idx;
+}
+
+void KernelSymbolLookup::cycle() {
+  if (_symbols && _symbols->available()) {
+    refresh();
+  }
+}
+
+void KernelSymbolLookup::refresh() {
+  DDRes const res = _symbols->refresh();
+  if (IsDDResNotOK(res)) {
+    LOG_ERROR_DETAILS(LG_NTC, res._what);
+  }
+  if (_symbols->modules_signature() != _modules_signature) {
+    // Addresses of the unloaded modules can be reused
+    _modules_signature = _symbols->modules_signature();
+    _symbol_map.clear();
+  }
+}
+
+} // namespace ddprof
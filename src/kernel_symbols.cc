@@ -0,0 +1,515 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "kernel_symbols.hpp"
+
+#include "build_id.hpp"
+#include "ddres_helpers.hpp"
+#include "defer.hpp"
+#include "hash_helper.hpp"
+#include "logger.hpp"
+#include "syscalls.hpp"
+#include "unique_fd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace ddprof {
+
+namespace {
+// Cache file layout (native endianness): CacheHeader, entries, names
+struct CacheHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t nb_entries;
+  uint32_t names_size;
+  uint64_t text_size;
+};
+constexpr std::array<char, 4> k_cache_magic = {'D', 'D', 'K', 'S'};
+constexpr uint32_t k_cache_version = 1;
+
+constexpr std::string_view k_text_symbol = "_text";
+constexpr std::string_view k_etext_symbol = "_etext";
+
+struct KallsymsLine {
+  ProcessAddress_t addr;
+  char type;
+  std::string_view name;
+  std::string_view module; // empty for the kernel
+};
+
+// <address> <type> <name>[\t[<module>]]
+bool parse_kallsyms_line(std::string_view line, KallsymsLine &parsed) {
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+    line.remove_suffix(1);
+  }
+  auto const [ptr, ec] = std::from_chars(
+      line.data(), line.data() + line.size(), parsed.addr, 16);
+  if (ec != std::errc{}) {
+    return false;
+  }
+  line.remove_prefix(ptr - line.data());
+  if (line.size() < 4 || line[0] != ' ' || line[2] != ' ') {
+    return false;
+  }
+  parsed.type = line[1];
+  line.remove_prefix(3);
+  parsed.module = {};
+  auto const tab = line.find('\t');
+  if (tab != std::string_view::npos) {
+    std::string_view module = line.substr(tab + 1);
+    if (module.size() > 2 && module.front() == '[' && module.back() == ']') {
+      parsed.module = module.substr(1, module.size() - 2);
+    }
+    line = line.substr(0, tab);
+  }
+  parsed.name = line;
+  return !parsed.name.empty();
+}
+
+bool is_text_symbol(char type) {
+  return type == 't' || type == 'T' || type == 'w' || type == 'W';
+}
+
+// Symbols of an image being parsed
+struct ImageSymbols {
+  std::vector<std::pair<ProcessAddress_t, uint32_t>> symbols;
+  std::string names;
+
+  void add(ProcessAddress_t addr, std::string_view name) {
+    symbols.emplace_back(addr, static_cast<uint32_t>(names.size()));
+    names += name;
+    names += '\0';
+  }
+};
+
+DDRes read_file(const std::string &path, std::string &content) {
+  UniqueFd const fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to open %s",
+                          path.c_str());
+  }
+  // procfs files do not report their size
+  constexpr size_t k_read_size = 64 * 1024;
+  content.clear();
+  while (true) {
+    size_t const pos = content.size();
+    content.resize(pos + k_read_size);
+    ssize_t const ret = read(fd.get(), content.data() + pos, k_read_size);
+    if (ret < 0 && errno == EINTR) {
+      content.resize(pos);
+      continue;
+    }
+    if (ret < 0) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to read %s",
+                            path.c_str());
+    }
+    content.resize(pos + ret);
+    if (ret == 0) {
+      return {};
+    }
+  }
+}
+
+template <typename Func> void for_each_line(std::string_view content, Func f) {
+  while (!content.empty()) {
+    auto const eol = content.find('\n');
+    f(content.substr(0, eol));
+    if (eol == std::string_view::npos) {
+      break;
+    }
+    content.remove_prefix(eol + 1);
+  }
+}
+
+// GNU build id from the ELF notes of the kernel image
+std::string read_build_id(const std::string &notes_path) {
+  std::string notes;
+  if (IsDDResNotOK(read_file(notes_path, notes))) {
+    return {};
+  }
+  auto align = [](size_t size) { return (size + 3) & ~size_t{3}; };
+  std::string_view data{notes};
+  Elf64_Nhdr nhdr;
+  while (data.size() >= sizeof(nhdr)) {
+    memcpy(&nhdr, data.data(), sizeof(nhdr));
+    data.remove_prefix(sizeof(nhdr));
+    size_t const name_size = align(nhdr.n_namesz);
+    size_t const desc_size = align(nhdr.n_descsz);
+    if (data.size() < name_size + desc_size) {
+      break;
+    }
+    if (nhdr.n_type == NT_GNU_BUILD_ID &&
+        nhdr.n_namesz == sizeof(ELF_NOTE_GNU) &&
+        memcmp(data.data(), ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0) {
+      return format_build_id(
+          {reinterpret_cast<const unsigned char *>(data.data() + name_size),
+           nhdr.n_descsz});
+    }
+    data.remove_prefix(name_size + desc_size);
+  }
+  return {};
+}
+} // namespace
+
+KernelSymbols::KernelSymbols(std::string cache_dir,
+                             std::string_view path_to_proc,
+                             std::string_view path_to_sys)
+    : _cache_dir(std::move(cache_dir)), _path_to_proc(path_to_proc),
+      _path_to_sys(path_to_sys) {}
+
+std::optional<KernelSymbol>
+KernelSymbols::Image::find(ProcessAddress_t addr) const {
+  if (addr < start || addr >= end) {
+    return std::nullopt;
+  }
+  auto const offset = static_cast<uint32_t>(addr - start);
+  auto const it = std::upper_bound(
+      entries.begin(), entries.end(), offset,
+      [](uint32_t value, const Entry &entry) { return value < entry.offset; });
+  if (it == entries.begin()) {
+    return std::nullopt;
+  }
+  const Entry &entry = *std::prev(it);
+  return KernelSymbol{
+      .name = std::string_view{names.data() + entry.name_offset},
+      .module = name,
+      .start = start + entry.offset};
+}
+
+std::optional<KernelSymbol> KernelSymbols::find(ProcessAddress_t addr) const {
+  if (auto symbol = _kernel.find(addr)) {
+    return symbol;
+  }
+  auto const it = std::upper_bound(
+      _modules.begin(), _modules.end(), addr,
+      [](ProcessAddress_t value, const Image &image) {
+        return value < image.start;
+      });
+  if (it == _modules.begin()) {
+    return std::nullopt;
+  }
+  return std::prev(it)->find(addr);
+}
+
+size_t KernelSymbols::size() const {
+  size_t count = _kernel.entries.size();
+  for (const Image &module : _modules) {
+    count += module.entries.size();
+  }
+  return count;
+}
+
+DDRes KernelSymbols::refresh() {
+  bool parse_kernel = false;
+  if (!_initialized) {
+    _initialized = true;
+    _build_id = read_build_id(_path_to_sys + "/kernel/notes");
+    ProcessAddress_t text = 0;
+    DDRES_CHECK_FWD(read_text_address(text));
+    if (!text) {
+      LG_NTC("Kernel addresses are hidden (kptr_restrict), kernel frames "
+             "will not be symbolized");
+      return {};
+    }
+    if (!cache_path().empty() && IsDDResNotOK(load_cache(text))) {
+      LG_DBG("Unable to load kernel symbols from %s", cache_path().c_str());
+    }
+    parse_kernel = !available();
+  } else if (!available()) {
+    return {};
+  }
+
+  std::vector<ModuleInfo> modules;
+  uint64_t signature = 0;
+  DDRES_CHECK_FWD(read_modules(modules, signature));
+  if (!parse_kernel && signature == _modules_signature) {
+    return {};
+  }
+  // Modules that are still loaded at the same address are kept
+  std::vector<Image> images;
+  std::vector<ModuleInfo> added;
+  for (ModuleInfo &module : modules) {
+    auto const it = std::ranges::find_if(_modules, [&](const Image &image) {
+      return image.name == module.name && image.start == module.start;
+    });
+    if (it != _modules.end()) {
+      images.push_back(std::move(*it));
+    } else {
+      added.push_back(std::move(module));
+    }
+  }
+  LG_DBG("Kernel modules changed (%zu kept, %zu new)", images.size(),
+         added.size());
+  if (parse_kernel || !added.empty()) {
+    DDRES_CHECK_FWD(parse_kallsyms(parse_kernel, added, images));
+  }
+  std::ranges::sort(images, {}, &Image::start);
+  _modules = std::move(images);
+  _modules_signature = signature;
+  if (parse_kernel && available() && !cache_path().empty() &&
+      IsDDResNotOK(write_cache())) {
+    LG_DBG("Unable to write kernel symbols to %s", cache_path().c_str());
+  }
+  return {};
+}
+
+DDRes KernelSymbols::read_modules(std::vector<ModuleInfo> &modules,
+                                  uint64_t &signature) const {
+  std::string content;
+  DDRES_CHECK_FWD(read_file(_path_to_proc + "/modules", content));
+  size_t seed = 0;
+  // <name> <size> <refcount> <dependencies> <state> <address> [taint]
+  for_each_line(content, [&](std::string_view line) {
+    std::array<std::string_view, 6> fields;
+    size_t nb_fields = 0;
+    while (nb_fields < fields.size() && !line.empty()) {
+      auto const sep = line.find(' ');
+      fields[nb_fields++] = line.substr(0, sep);
+      line.remove_prefix(sep == std::string_view::npos ? line.size() : sep + 1);
+    }
+    if (nb_fields < fields.size()) {
+      return;
+    }
+    ModuleInfo module{.name = std::string{fields[0]}, .start = 0, .size = 0};
+    std::string_view address = fields[5];
+    if (address.starts_with("0x")) {
+      address.remove_prefix(2);
+    }
+    std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(),
+                    module.size);
+    std::from_chars(address.data(), address.data() + address.size(),
+                    module.start, 16);
+    // The reference count changes without (un)loading modules
+    hash_combine(seed, fields[0]);
+    hash_combine(seed, module.start);
+    hash_combine(seed, module.size);
+    if (module.start && module.size) {
+      modules.push_back(std::move(module));
+    }
+  });
+  signature = seed;
+  return {};
+}
+
+DDRes KernelSymbols::read_text_address(ProcessAddress_t &text) const {
+  std::string const path = _path_to_proc + "/kallsyms";
+  UniqueFile const file{fopen(path.c_str(), "re"), fclose};
+  if (!file) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to open %s",
+                          path.c_str());
+  }
+  char *buf = nullptr;
+  defer { free(buf); };
+  size_t sz_buf = 0;
+  // Found in the first lines, after the per-CPU variables
+  KallsymsLine line;
+  while (-1 != getline(&buf, &sz_buf, file.get())) {
+    if (parse_kallsyms_line(buf, line) && line.name == k_text_symbol &&
+        line.module.empty()) {
+      text = line.addr;
+      return {};
+    }
+  }
+  text = 0;
+  return {};
+}
+
+DDRes KernelSymbols::parse_kallsyms(bool parse_kernel,
+                                    const std::vector<ModuleInfo> &added,
+                                    std::vector<Image> &images) {
+  std::string content;
+  DDRES_CHECK_FWD(read_file(_path_to_proc + "/kallsyms", content));
+  std::unordered_map<std::string_view, size_t> added_pos;
+  for (size_t i = 0; i < added.size(); ++i) {
+    added_pos.emplace(added[i].name, i);
+  }
+  ImageSymbols kernel_symbols;
+  std::vector<ImageSymbols> module_symbols(added.size());
+  ProcessAddress_t text = 0;
+  ProcessAddress_t etext = 0;
+  KallsymsLine line;
+  for_each_line(content, [&](std::string_view raw_line) {
+    // Only the lines of modules end with a bracket
+    if (!parse_kernel && !raw_line.ends_with(']')) {
+      return;
+    }
+    if (!parse_kallsyms_line(raw_line, line)) {
+      return;
+    }
+    if (line.module.empty()) {
+      if (!parse_kernel) {
+        return;
+      }
+      if (line.name == k_text_symbol) {
+        text = line.addr;
+      } else if (line.name == k_etext_symbol) {
+        etext = line.addr;
+      }
+      if (is_text_symbol(line.type)) {
+        kernel_symbols.add(line.addr, line.name);
+      }
+      return;
+    }
+    auto const it = added_pos.find(line.module);
+    if (it != added_pos.end() && is_text_symbol(line.type)) {
+      module_symbols[it->second].add(line.addr, line.name);
+    }
+  });
+
+  // Symbols out of the image (e.g. freed init sections) are dropped
+  auto make_image = [](std::string name, ProcessAddress_t start,
+                       ProcessAddress_t end, ImageSymbols &symbols) {
+    Image image;
+    image.name = std::move(name);
+    image.start = start;
+    image.end = end;
+    std::ranges::stable_sort(symbols.symbols, {},
+                             &std::pair<ProcessAddress_t, uint32_t>::first);
+    for (const auto &[addr, name_offset] : symbols.symbols) {
+      if (addr < start || addr >= end ||
+          (!image.entries.empty() &&
+           image.entries.back().offset == addr - start)) {
+        continue;
+      }
+      image.entries.push_back({.offset = static_cast<uint32_t>(addr - start),
+                               .name_offset = name_offset});
+    }
+    image.names = std::move(symbols.names);
+    return image;
+  };
+  if (parse_kernel && text) {
+    if (etext <= text) {
+      // Up to the last symbol
+      etext = text + 1;
+      for (const auto &symbol : kernel_symbols.symbols) {
+        etext = std::max(etext, symbol.first + 1);
+      }
+    }
+    _kernel = make_image({}, text, etext, kernel_symbols);
+    LG_NTC("Read %zu kernel symbols", _kernel.entries.size());
+  }
+  for (size_t i = 0; i < added.size(); ++i) {
+    images.push_back(make_image(added[i].name, added[i].start,
+                                added[i].start + added[i].size,
+                                module_symbols[i]));
+  }
+  return {};
+}
+
+std::string KernelSymbols::cache_path() const {
+  if (_cache_dir.empty() || _build_id.empty()) {
+    return {};
+  }
+  // Accounted for in the size of the symbol cache
+  return _cache_dir + "/kernel-" + _build_id + ".sym";
+}
+
+DDRes KernelSymbols::load_cache(ProcessAddress_t text) {
+  std::string const path = cache_path();
+  UniqueFd const fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd) {
+    // Not cached yet
+    return {};
+  }
+  std::string content;
+  DDRES_CHECK_FWD(read_file(path, content));
+  CacheHeader header;
+  if (content.size() < sizeof(header)) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Truncated file %s",
+                          path.c_str());
+  }
+  memcpy(&header, content.data(), sizeof(header));
+  size_t const entries_size = header.nb_entries * sizeof(Entry);
+  if (header.magic != k_cache_magic || header.version != k_cache_version ||
+      content.size() != sizeof(header) + entries_size + header.names_size) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Invalid file %s",
+                          path.c_str());
+  }
+  Image image;
+  image.start = text;
+  image.end = text + header.text_size;
+  image.entries.resize(header.nb_entries);
+  memcpy(image.entries.data(), content.data() + sizeof(header), entries_size);
+  image.names = content.substr(sizeof(header) + entries_size);
+  if (std::ranges::any_of(image.entries, [&](const Entry &entry) {
+        return entry.name_offset >= image.names.size();
+      })) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Invalid file %s",
+                          path.c_str());
+  }
+  _kernel = std::move(image);
+  _loaded_from_cache = true;
+  // Mark the file as recently used
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  LG_NTC("Loaded %zu kernel symbols from %s", _kernel.entries.size(),
+         path.c_str());
+  return {};
+}
+
+DDRes KernelSymbols::write_cache() const {
+  std::string const path = cache_path();
+  CacheHeader const header{
+      .magic = k_cache_magic,
+      .version = k_cache_version,
+      .nb_entries = static_cast<uint32_t>(_kernel.entries.size()),
+      .names_size = static_cast<uint32_t>(_kernel.names.size()),
+      .text_size = _kernel.end - _kernel.start};
+  std::string content;
+  content.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  content.append(reinterpret_cast<const char *>(_kernel.entries.data()),
+                 _kernel.entries.size() * sizeof(Entry));
+  content += _kernel.names;
+
+  std::error_code ec;
+  std::filesystem::create_directories(_cache_dir, ec);
+  DDRES_CHECK_ERRORCODE(ec, DD_WHAT_KERNEL_SYMBOLS, "Unable to create %s",
+                        _cache_dir.c_str());
+  // Written aside then renamed: other profilers (and unwinding threads) only
+  // see complete files
+  std::string const tmp_path = path + '.' + std::to_string(gettid());
+  {
+    constexpr mode_t k_read_write_user_only = 0600;
+    UniqueFd const fd{open(tmp_path.c_str(),
+                           O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                           k_read_write_user_only)};
+    if (!fd) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to open %s",
+                            tmp_path.c_str());
+    }
+    std::string_view buf{content};
+    while (!buf.empty()) {
+      ssize_t const ret = write(fd.get(), buf.data(), buf.size());
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret <= 0) {
+        unlink(tmp_path.c_str());
+        DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to write %s",
+                              tmp_path.c_str());
+      }
+      buf.remove_prefix(ret);
+    }
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    unlink(tmp_path.c_str());
+    DDRES_RETURN_WARN_LOG(DD_WHAT_KERNEL_SYMBOLS, "Unable to rename %s",
+                          tmp_path.c_str());
+  }
+  return {};
+}
+
+} // namespace ddprof
@@ -7,6 +7,8 @@
 
 #include "logger.hpp"
 
+#include <cassert>
+
 namespace ddprof {
 
 bool LiveAllocation::register_deallocation(uintptr_t address,
@@ -85,4 +87,31 @@ bool LiveAllocation::register_allocation(const UnwindOutput &uo,
   return true;
 }
 
+void LiveAllocation::remap(const TableRemap &symbol_remap,
+                           const TableRemap &mapinfo_remap) {
+  std::vector<PprofStacks::node_type> nodes;
+  for (auto &pid_map : _watcher_vector) {
+    for (auto &pid_vt : pid_map) {
+      PprofStacks &stacks = pid_vt.second._unique_stacks;
+      // Keys are modified through node handles: elements keep their address,
+      // so the pointers held in the address map remain valid
+      nodes.clear();
+      nodes.reserve(stacks.size());
+      while (!stacks.empty()) {
+        nodes.push_back(stacks.extract(stacks.begin()));
+      }
+      for (auto &node : nodes) {
+        for (FunLoc &loc : node.key().locs) {
+          [[maybe_unused]] const bool kept_symbol =
+              remap_index(symbol_remap, loc.symbol_idx);
+          [[maybe_unused]] const bool kept_mapinfo =
+              remap_index(mapinfo_remap, loc.map_info_idx);
+          assert(kept_symbol && kept_mapinfo);
+        }
+        stacks.insert(std::move(node));
+      }
+    }
+  }
+}
+
 } // namespace ddprof
@@ -0,0 +1,51 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "overload_controller.hpp"
+
+#include <algorithm>
+
+namespace ddprof {
+
+std::string_view overload_tier_name(OverloadTier tier) {
+  switch (tier) {
+  case OverloadTier::kNone:
+    return "none";
+  case OverloadTier::kNoSymbolization:
+    return "no_symbolization";
+  case OverloadTier::kTruncatedStack:
+    return "truncated_stack";
+  case OverloadTier::kCountOnly:
+    return "count_only";
+  }
+  return "unknown";
+}
+
+OverloadController::OverloadController(
+    std::span<const uint32_t> thresholds_pct)
+    : _thresholds_pct(thresholds_pct.begin(), thresholds_pct.end()) {
+  std::sort(_thresholds_pct.begin(), _thresholds_pct.end());
+  if (_thresholds_pct.size() > k_nb_overload_thresholds) {
+    _thresholds_pct.resize(k_nb_overload_thresholds);
+  }
+}
+
+OverloadTier OverloadController::update(uint64_t occupancy_pct) {
+  auto level = static_cast<size_t>(_tier);
+  // Escalate to the highest tier whose threshold is reached
+  while (level < _thresholds_pct.size() &&
+         occupancy_pct >= _thresholds_pct[level]) {
+    ++level;
+  }
+  // Step down one tier at a time, once the backlog has been absorbed
+  if (level == static_cast<size_t>(_tier) && level > 0 &&
+      occupancy_pct < _thresholds_pct[level - 1] / 2) {
+    --level;
+  }
+  _tier = static_cast<OverloadTier>(level);
+  return _tier;
+}
+
+} // namespace ddprof
@@ -95,7 +95,9 @@ perf_event_attr perf_config_from_watcher(const PerfWatcher *watcher,
   attr.sample_period = watcher->sample_period; // Equivalently, freq
   attr.freq = watcher->options.is_freq;
   attr.sample_type = watcher->sample_type;
-  attr.sample_stack_user = watcher->options.stack_sample_size;
+  if (watcher->sample_type & PERF_SAMPLE_STACK_USER) {
+    attr.sample_stack_user = watcher->options.stack_sample_size;
+  }
 
   // If use_kernel==off means we exclude_kernel
   attr.exclude_kernel =
@@ -116,6 +118,26 @@ perf_event_attr perf_config_from_watcher(const PerfWatcher *watcher,
   return attr;
 }
 
+PerfCallchain perf_callchain_split(std::span<const uint64_t> ips) {
+  PerfCallchain callchain;
+  size_t pos = 0;
+  while (pos < ips.size()) {
+    uint64_t const context = ips[pos++];
+    size_t const start = pos;
+    // Addresses of a context run until the next marker
+    while (pos < ips.size() && ips[pos] < PERF_CONTEXT_MAX) {
+      ++pos;
+    }
+    std::span<const uint64_t> const addrs = ips.subspan(start, pos - start);
+    if (context == PERF_CONTEXT_KERNEL) {
+      callchain.kernel = addrs;
+    } else if (context == PERF_CONTEXT_USER) {
+      callchain.user = addrs;
+    }
+  }
+  return callchain;
+}
+
 size_t perf_mmap_size(int buf_size_shift) {
   // size of buffers are constrained to a power of 2 + 1
   return ((1U << buf_size_shift) + 1) * get_page_size();
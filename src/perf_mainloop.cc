@@ -5,12 +5,16 @@
 
 #include "perf_mainloop.hpp"
 
+#include "adaptive_wakeup.hpp"
 #include "ddprof_context_lib.hpp"
+#include "ddprof_stats.hpp"
 #include "ddprof_worker.hpp"
 #include "ddres.hpp"
 #include "defer.hpp"
 #include "ipc.hpp"
 #include "logger.hpp"
+#include "loser_tree.hpp"
+#include "overload_controller.hpp"
 #include "perf.hpp"
 #include "persistent_worker_state.hpp"
 #include "pevent.hpp"
@@ -18,14 +22,17 @@
 #include "unique_fd.hpp"
 #include "unwind.h"
 #include "unwind_state.hpp"
+#include "unwinding_pool.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cassert>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
-#include <poll.h>
-#include <queue>
+#include <limits>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
@@ -155,18 +162,71 @@ ReplyMessage create_reply_message(const DDProfContext &ctx) {
   return reply;
 }
 
-void pollfd_setup(std::span<PEvent> pes, struct pollfd *pfd) {
-  // Setup poll() to watch perf_event file descriptors
+// Ring buffers to process after a wakeup, indexed like the pevents
+using RingSet = std::bitset<k_max_nb_perf_event_open>;
+
+DDRes epoll_setup(std::span<const PEvent> pes, UniqueFd &epoll_fd) {
+  // Setup epoll to watch perf_event file descriptors
+  epoll_fd.reset(epoll_create1(EPOLL_CLOEXEC));
+  if (!epoll_fd) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_POLLERROR, "epoll_create1 failed (%s)",
+                           strerror(errno));
+  }
   for (size_t i = 0; i < pes.size(); ++i) {
-    // NOTE: if fd is negative, it will be ignored
-    pfd[i].fd = pes[i].fd;
-    pfd[i].events = POLLIN;
+    if (pes[i].fd < 0) {
+      continue;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u32 = static_cast<uint32_t>(i);
+    DDRES_CHECK_ERRNO(
+        epoll_ctl(epoll_fd.get(), EPOLL_CTL_ADD, pes[i].fd, &event),
+        DD_WHAT_POLLERROR, "epoll_ctl failed");
   }
+  return {};
+}
+
+// Feed the writer positions of the ring buffers to the wakeup heuristic and
+// track the highest ring buffer occupancy of the cycle.
+// Ring buffers holding unread data are added to rings: perf only signals a
+// ring buffer once it reaches the wakeup watermark, a quiet ring buffer would
+// otherwise wait for the next timeout.
+// max_occupancy_pct is set to the occupancy of the fullest ring buffer.
+// Returns false if no data was written since the previous wakeup.
+bool observe_ring_buffers(std::span<const PEvent> pes, AdaptiveWakeup &wakeup,
+                          std::chrono::steady_clock::time_point now,
+                          RingSet &rings, uint64_t &max_occupancy_pct) {
+  bool new_data = false;
+  max_occupancy_pct = 0;
+  for (size_t i = 0; i < pes.size(); ++i) {
+    const RingBuffer &rb = pes[i].rb;
+    if (pes[i].fd < 0 || !rb.writer_pos) {
+      continue;
+    }
+    uint64_t const writer_pos =
+        __atomic_load_n(rb.writer_pos, __ATOMIC_ACQUIRE);
+    new_data |= wakeup.observe(i, writer_pos, rb.data_size, now);
+    uint64_t const used = writer_pos - *rb.reader_pos;
+    if (used != 0) {
+      rings.set(i);
+    }
+    if (rb.data_size) {
+      max_occupancy_pct =
+          std::max(max_occupancy_pct, used * 100 / rb.data_size);
+    }
+  }
+  long high_water = 0;
+  ddprof_stats_get(STATS_RING_BUFFER_OCCUPANCY_MAX, &high_water);
+  if (static_cast<long>(max_occupancy_pct) > high_water) {
+    ddprof_stats_set(STATS_RING_BUFFER_OCCUPANCY_MAX,
+                     static_cast<long>(max_occupancy_pct));
+  }
+  return new_data;
 }
 
 // EventWrapper holds a reference to a perf_event_header with its associated
 // timestamp.
-// It is used to order events in a std::priority_queue without copying events.
+// It is used to order events without copying them.
 // perf_event_header is not owned by EventWrapper, it points on ring buffer
 // memory, and must remain valid during the lifetime of EventWrapper.
 // Consequently, care must be taken to advance reader cursor position in ring
@@ -174,24 +234,72 @@ void pollfd_setup(std::span<PEvent> pes, struct pollfd *pfd) {
 struct EventWrapper {
   const perf_event_header *event;
   PerfClock::time_point timestamp;
-  int buffer_idx;
 
   friend bool operator>(const EventWrapper &lhs, const EventWrapper &rhs) {
     return lhs.timestamp > rhs.timestamp;
   }
 };
 
-using EventQueue = std::priority_queue<EventWrapper, std::vector<EventWrapper>,
-                                       std::greater<EventWrapper>>;
+// Events read from the ring buffers but not processed yet.
+// Each ring buffer has its own min-heap of pending events: a perf ring buffer
+// has at most one pending event (its events are already ordered), a MPSC ring
+// buffer can have several. The heads of the heaps are merged with a loser
+// tree, so that processing an event costs log2(nb ring buffers) comparisons
+// instead of a push and a pop in a heap holding the events of all rings.
+class OrderedEvents {
+public:
+  explicit OrderedEvents(size_t nb_rings)
+      : _pending(nb_rings), _tree(nb_rings, PerfClock::time_point::max()) {}
+
+  [[nodiscard]] bool empty() const { return _nb_pending == 0; }
+
+  // Next event to process, only valid if not empty
+  [[nodiscard]] int top_ring() const { return static_cast<int>(_tree.top()); }
+  [[nodiscard]] const EventWrapper &top() const {
+    return _pending[_tree.top()].front();
+  }
+
+  // Tree must be rebuilt once all the rings are read
+  void push(int ring_idx, const EventWrapper &evt) {
+    auto &heap = _pending[ring_idx];
+    heap.push_back(evt);
+    std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+    _tree.set_key(ring_idx, heap.front().timestamp);
+    ++_nb_pending;
+  }
+  void rebuild() { _tree.rebuild(); }
+
+  // Remove the top event, optionally replacing it with the next event of the
+  // same ring buffer
+  void replace_top(const EventWrapper *next) {
+    auto &heap = _pending[_tree.top()];
+    std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+    heap.pop_back();
+    --_nb_pending;
+    if (next) {
+      heap.push_back(*next);
+      std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+      ++_nb_pending;
+    }
+    _tree.replace_top(heap.empty() ? PerfClock::time_point::max()
+                                   : heap.front().timestamp);
+  }
+
+private:
+  std::vector<std::vector<EventWrapper>> _pending;
+  LoserTree<PerfClock::time_point> _tree;
+  size_t _nb_pending{0};
+};
 
 DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
                                           DDProfContext &ctx,
-                                          EventQueue &event_queue, bool drain) {
+                                          OrderedEvents &ordered_events,
+                                          bool drain) {
   // Reorder events from ring buffers before processing them.
   // Events in each perf ring buffer are already ordered by timestamp.
   // For MPSC ring buffers, there is no such guarantee.
-  // The strategy is to dequeue events from ring buffers and push them in a
-  // priority queue, ordered by timestamp. And then process this priority queue.
+  // The strategy is to dequeue events from ring buffers into per ring pending
+  // events, and to merge the pending events of all rings by timestamp.
   // When a ring buffer is empty, we cannot be sure that a new event with a
   // timestamp less than a previously enqueued event will not be added to the
   // ring buffer in the future.
@@ -199,29 +307,25 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
   // between the timestamp of an event and the time it appears in the ring
   // buffer, and we process events with timestamps up to (now -
   // kMaxSampleLatency).
-  // For MPSC ring buffers, we dequeue events and push them into the priority
-  // queue until we reach an event with a timestamp greater than (now -
+  // For MPSC ring buffers, we dequeue events and push them into the pending
+  // events until we reach an event with a timestamp greater than (now -
   // kMaxSampleLatency) or the ring buffer is empty. Note that when an event
   // with a timestamp greater than (now - kMaxSampleLatency) is dequeued, it is
-  // still pushed in the priority_queue.
+  // still pushed in the pending events.
   // For perf ring buffers, we ensure that at anytime at most one event from
-  // each ring buffer is in the priority queue. This ensures that events with
-  // identical timestamps in a ring buffer are processed in the same order as in
-  // the ring buffer (priority queue is not stable, therefore pushing events
-  // with identical timestamps might permute them) and this also makes advancing
-  // the reader cursor position in the ring buffer easier since know that only
-  // one event has been read, we can just bump the reader cursor to the last
-  // read position.
-  // When an event from a perf ring buffer is dequeued fron the priority queue,
-  // we advance the reader cursor position in the ring buffer to free the slot
-  // for the writer, and attempt to read the next event from the ring buffer if
-  // not empty.
-  // When an event from a MPSC ring buffer is dequeued from the priority queue,
-  // we try to advance the reader cursor position in the ring buffer to free the
-  // slot for the writer. Since events might be out of order for this ring
-  // buffer, advancing is done by marking processed events as discarded and
-  // bumping the reader position until empty or we reach the first non-discarded
-  // event.
+  // each ring buffer is pending. This ensures that events with identical
+  // timestamps in a ring buffer are processed in the same order as in the ring
+  // buffer and this also makes advancing the reader cursor position in the
+  // ring buffer easier since know that only one event has been read, we can
+  // just bump the reader cursor to the last read position.
+  // When a pending event from a perf ring buffer is processed, we advance the
+  // reader cursor position in the ring buffer to free the slot for the writer,
+  // and attempt to read the next event from the ring buffer if not empty.
+  // When a pending event from a MPSC ring buffer is processed, we try to
+  // advance the reader cursor position in the ring buffer to free the slot for
+  // the writer. Since events might be out of order for this ring buffer,
+  // advancing is done by marking processed events as discarded and bumping the
+  // reader position until empty or we reach the first non-discarded event.
 
   const std::chrono::microseconds kMaxSampleLatency{100};
 
@@ -235,18 +339,18 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
         drain ? PerfClock::time_point::max() : now - kMaxSampleLatency;
     int new_events = 0;
 
-    // Dequeue events from each ring buffer and push them in the priority queue
+    // Dequeue events from each ring buffer into the pending events
     for (int i = 0; i < static_cast<int>(pes.size()); ++i) {
       auto &rb = pes[i].rb;
 
       if (rb.type == RingBufferType::kPerfRingBuffer) {
-        // if perf ring buffer has already events in the priority queue, skip it
+        // if perf ring buffer has already a pending event, skip it
         if (!perf_rb_has_inflight_events(rb)) {
           const perf_event_header *event = perf_rb_read_event(rb);
           if (event) {
             auto timestamp = perf_clock_time_point_from_timestamp(
                 hdr_time(event, ctx.watchers[pes[i].watcher_pos].sample_type));
-            event_queue.push({event, timestamp, i});
+            ordered_events.push(i, {event, timestamp});
             ++new_events;
           }
         }
@@ -259,7 +363,7 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
 
           auto timestamp = perf_clock_time_point_from_timestamp(
               hdr_time(event, ctx.watchers[pes[i].watcher_pos].sample_type));
-          event_queue.push({event, timestamp, i});
+          ordered_events.push(i, {event, timestamp});
           ++new_events;
           if (timestamp > max_timestamp) {
             break;
@@ -267,14 +371,15 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
         }
       }
     }
+    ordered_events.rebuild();
 
-    while (!event_queue.empty()) {
-      const auto &evt = event_queue.top();
+    while (!ordered_events.empty()) {
+      const auto &evt = ordered_events.top();
       if (evt.timestamp > max_timestamp) {
         // the next event is too recent, stop processing
         return {};
       }
-      auto &pevent = pes[evt.buffer_idx];
+      auto &pevent = pes[ordered_events.top_ring()];
       auto res =
           ddprof_worker_process_event(evt.event, pevent.watcher_pos, ctx);
       if (!IsDDResOK(res)) {
@@ -288,16 +393,20 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
 
         const perf_event_header *new_event = perf_rb_read_event(rb);
         if (new_event) {
-          // enqueue next event from the same ring buffer
-          auto timestamp = perf_clock_time_point_from_timestamp(hdr_time(
-              new_event, ctx.watchers[pevent.watcher_pos].sample_type));
-          event_queue.push({new_event, timestamp, evt.buffer_idx});
+          // next event from the same ring buffer replaces the processed one
+          EventWrapper const next{
+              new_event,
+              perf_clock_time_point_from_timestamp(hdr_time(
+                  new_event, ctx.watchers[pevent.watcher_pos].sample_type))};
+          ordered_events.replace_top(&next);
+        } else {
+          ordered_events.replace_top(nullptr);
         }
       } else {
         // advance ring buffer if possible, this frees space for the writer end
         mpsc_rb_advance_if_possible(rb, evt.event);
+        ordered_events.replace_top(nullptr);
       }
-      event_queue.pop();
     }
 
     if (!new_events) {
@@ -311,8 +420,24 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
   return {};
 }
 
+// Events are at most 64KiB (size is a 16 bit field of perf_event_header)
+constexpr size_t k_max_event_size = std::numeric_limits<uint16_t>::max() + 1;
+
+// Copy an event out of a ring buffer, so that its slot can be released before
+// the event is processed (unwinding can be slow and would otherwise let the
+// ring buffer fill up)
+const perf_event_header *stage_event(const perf_event_header *hdr,
+                                     const PEvent &pevent,
+                                     const DDProfContext &ctx,
+                                     std::span<uint64_t> staging) {
+  auto *dst = reinterpret_cast<std::byte *>(staging.data());
+  hdr_compact_copy(hdr, ctx.watchers[pevent.watcher_pos].sample_type, dst);
+  return reinterpret_cast<const perf_event_header *>(dst);
+}
+
 inline DDRes
-worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
+worker_process_ring_buffers(std::span<PEvent> pes, const RingSet &rings,
+                            DDProfContext &ctx, std::span<uint64_t> staging,
                             std::chrono::steady_clock::time_point *now) {
   // While there are events to process, iterate through them
   // while limiting time spent in loop to at most k_sample_default_wakeup
@@ -322,7 +447,11 @@ worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
   bool events;
   do {
     events = false;
-    for (auto &pevent : pes) {
+    for (size_t i = 0; i < pes.size(); ++i) {
+      if (!rings.test(i)) {
+        continue;
+      }
+      auto &pevent = pes[i];
       auto &ring_buffer = pevent.rb;
       if (ring_buffer.type == RingBufferType::kPerfRingBuffer) {
         PerfRingBufferReader reader(&ring_buffer);
@@ -331,16 +460,20 @@ worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
         while (!buffer.empty()) {
           const auto *hdr =
               reinterpret_cast<const perf_event_header *>(buffer.data());
-          DDRes res = ddprof_worker_process_event(hdr, pevent.watcher_pos, ctx);
+          size_t const event_size = hdr->size;
+          const perf_event_header *staged =
+              stage_event(hdr, pevent, ctx, staging);
+          // free slot for the writer before processing the event
+          reader.advance(event_size);
+          buffer = remaining(buffer, event_size);
+
+          DDRes res =
+              ddprof_worker_process_event(staged, pevent.watcher_pos, ctx);
 
           // Check for processing error
           if (IsDDResNotOK(res)) {
             return res;
           }
-          // \fixme{nsavoire} free slot as soon as possible ?
-          // reader.advance(hdr->size);
-
-          buffer = remaining(buffer, hdr->size);
         }
       } else {
         MPSCRingBufferReader reader{&ring_buffer};
@@ -348,20 +481,23 @@ worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
              buffer = reader.read_sample()) {
           const auto *hdr =
               reinterpret_cast<const perf_event_header *>(buffer.data());
-          DDRes res = ddprof_worker_process_event(hdr, pevent.watcher_pos, ctx);
+          const perf_event_header *staged =
+              stage_event(hdr, pevent, ctx, staging);
+          // free slot for the writers before processing the event
+          reader.advance();
+
+          DDRes res =
+              ddprof_worker_process_event(staged, pevent.watcher_pos, ctx);
 
           // Check for processing error
           if (IsDDResNotOK(res)) {
             return res;
           }
-
-          // \fixme{nsavoire} free slot as soon as possible ?
-          // reader.advance();
         }
       }
 
-      // PerfRingBufferReader destructor takes care of advancing ring buffer
-      // read position
+      // Reader destructors take care of advancing ring buffer read position
+      // in case of early return
     }
     local_now = std::chrono::steady_clock::now();
   } while (events && (local_now - loop_start) < k_sample_default_wakeup);
@@ -373,11 +509,14 @@ worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
 DDRes worker_loop(DDProfContext &ctx, const WorkerAttr *attr,
                   PersistentWorkerState *persistent_worker_state) {
 
-  // Setup poll() to watch perf_event file descriptors
-  pollfd poll_fds[k_max_nb_perf_event_open];
   std::span const pevents{ctx.worker_ctx.pevent_hdr.pes,
                           ctx.worker_ctx.pevent_hdr.size};
-  pollfd_setup(pevents, poll_fds);
+  UniqueFd epoll_fd;
+  DDRES_CHECK_FWD(epoll_setup(pevents, epoll_fd));
+  epoll_event ready_events[k_max_nb_perf_event_open];
+  AdaptiveWakeup wakeup(pevents.size());
+  OverloadController overload_controller(ctx.params.overload_thresholds);
+  std::vector<uint64_t> staging(k_max_event_size / sizeof(uint64_t));
 
   // Perform user-provided initialization
   defer { attr->finish_fun(ctx); };
@@ -386,46 +525,74 @@ DDRes worker_loop(DDProfContext &ctx, const WorkerAttr *attr,
   if (ctx.params.pid > 0 && ctx.backpopulate_pid_upon_start &&
       persistent_worker_state->profile_seq == 0) {
     int nb_elems;
-    ctx.worker_ctx.us->dso_hdr.pid_backpopulate(ctx.params.pid, nb_elems);
+    UnwindState &us = ctx.worker_ctx.unwinding_pool
+        ? ctx.worker_ctx.unwinding_pool->shard_of(ctx.params.pid).us
+        : *ctx.worker_ctx.us;
+    us.dso_hdr.pid_backpopulate(ctx.params.pid, nb_elems);
   }
 
   WorkerServer const server =
       start_worker_server(ctx.socket_fd.get(), create_reply_message(ctx));
 
-  EventQueue event_queue;
+  OrderedEvents ordered_events(pevents.size());
+  std::chrono::milliseconds timeout{k_sample_default_wakeup};
   // Worker poll loop
   while (!g_termination_requested.load(std::memory_order::relaxed)) {
-    int const n =
-        poll(poll_fds, pevents.size(),
-             std::chrono::milliseconds{k_sample_default_wakeup}.count());
+    int const n = epoll_wait(epoll_fd.get(), ready_events,
+                             static_cast<int>(std::size(ready_events)),
+                             static_cast<int>(timeout.count()));
 
     // If there was an issue, return and let the caller check errno
     if (-1 == n && errno == EINTR) {
       continue;
     }
-    DDRES_CHECK_ERRNO(n, DD_WHAT_POLLERROR, "poll failed");
+    DDRES_CHECK_ERRNO(n, DD_WHAT_POLLERROR, "epoll_wait failed");
 
     bool stop = false;
-    for (size_t i = 0; i < pevents.size(); ++i) {
-      pollfd const &pfd = poll_fds[i];
-      if (pfd.revents & POLLHUP) {
+    RingSet rings;
+    for (int i = 0; i < n; ++i) {
+      uint32_t const idx = ready_events[i].data.u32;
+      if (ready_events[i].events & EPOLLHUP) {
         stop = true;
-      } else if (pfd.revents & POLLIN && pevents[i].custom_event) {
-        // for custom ring buffer, need to read from eventfd to flush POLLIN
+      } else if (ready_events[i].events & EPOLLIN &&
+                 pevents[idx].custom_event) {
+        // for custom ring buffer, need to read from eventfd to flush EPOLLIN
         // status
         uint64_t count;
-        DDRES_CHECK_ERRNO(read(pevents[i].fd, &count, sizeof(count)),
+        DDRES_CHECK_ERRNO(read(pevents[idx].fd, &count, sizeof(count)),
                           DD_WHAT_PERFRB, "Failed to read from evenfd");
       }
+      rings.set(idx);
+    }
+
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    // Perf ring buffers below the kernel wakeup watermark are not signaled:
+    // they are processed on timeouts and before exports
+    if (n == 0 || stop || now > ctx.worker_ctx.send_time) {
+      rings.set();
     }
+    ddprof_stats_add(STATS_WORKER_WAKEUPS, 1, nullptr);
+    uint64_t occupancy_pct = 0;
+    if (!observe_ring_buffers(pevents, wakeup, now, rings, occupancy_pct)) {
+      ddprof_stats_add(STATS_WORKER_IDLE_WAKEUPS, 1, nullptr);
+    }
+    // Shed unwinding work while the backlog is high
+    std::atomic_ref(ctx.worker_ctx.overload_tier)
+        .store(overload_controller.update(occupancy_pct),
+               std::memory_order_relaxed);
 
-    std::chrono::steady_clock::time_point now;
     if (ctx.params.reorder_events) {
-      DDRES_CHECK_FWD(
-          worker_process_ring_buffers_ordered(pevents, ctx, event_queue, stop));
+      DDRES_CHECK_FWD(worker_process_ring_buffers_ordered(
+          pevents, ctx, ordered_events, stop));
       now = std::chrono::steady_clock::now();
     } else {
-      DDRES_CHECK_FWD(worker_process_ring_buffers(pevents, ctx, &now));
+      DDRES_CHECK_FWD(worker_process_ring_buffers(pevents, rings, ctx, staging,
+                                                  &now));
+    }
+    if (ctx.worker_ctx.unwinding_pool) {
+      // Hand the events that were read over to the unwinding threads
+      DDRES_CHECK_FWD(ctx.worker_ctx.unwinding_pool->flush());
     }
 
     DDRES_CHECK_FWD(ddprof_worker_maybe_export(ctx, now));
@@ -438,6 +605,18 @@ DDRes worker_loop(DDProfContext &ctx, const WorkerAttr *attr,
     if (stop) {
       break;
     }
+
+    timeout = wakeup.timeout();
+    if (!ordered_events.empty()) {
+      // Queued events are waiting for the maximum sample latency to elapse
+      timeout = AdaptiveWakeup::k_min_timeout;
+    }
+    // Do not sleep past the next export
+    timeout = std::min(
+        timeout,
+        std::max(std::chrono::ceil<std::chrono::milliseconds>(
+                     ctx.worker_ctx.send_time - now),
+                 std::chrono::milliseconds{1}));
   }
 
   // export current samples before exiting
@@ -8,9 +8,12 @@
 #include "logger.hpp"
 #include "mpscringbuffer.hpp"
 
+#include <array>
 #include <bit>
 #include <cstdlib>
 #include <cstring>
+#include <type_traits>
+#include <utility>
 
 namespace ddprof {
 
@@ -121,6 +124,7 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
   if (PERF_SAMPLE_CPU & mask) {
     (reinterpret_cast<flipper *>(buf))->half[0] = sample->cpu;
     (reinterpret_cast<flipper *>(buf))->half[1] = sample->res;
+    buf++;
     SZ_CHECK;
   }
   if (PERF_SAMPLE_PERIOD & mask) {
@@ -145,7 +149,7 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
     if (sz >= sz_hdr) {
       return false;
     }
-    memcpy(buf, sample->ips, sample->nr);
+    memcpy(buf, sample->ips, sizeof(uint64_t) * sample->nr);
     buf += sample->nr;
   }
   if (PERF_SAMPLE_RAW & mask) {
@@ -167,7 +171,7 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
     if (sz >= sz_hdr) {
       return false;
     }
-    memcpy(buf, sample->regs, k_perf_register_count);
+    memcpy(buf, sample->regs, sizeof(uint64_t) * k_perf_register_count);
     buf += k_perf_register_count;
   }
   if (PERF_SAMPLE_STACK_USER & mask) {
@@ -195,8 +199,12 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
   return true;
 }
 
-perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
-  static perf_event_sample sample = {};
+namespace {
+// Mask is either a runtime value or a std::integral_constant: for the latter,
+// the tests of the fields are resolved at compile time.
+template <typename Mask>
+bool decode_sample(const perf_event_header *hdr, Mask mask,
+                   perf_event_sample &sample) {
   sample.header = *hdr;
 
   const auto *buf =
@@ -257,7 +265,7 @@ perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
     // ddprof only has register definitions for 64-bit processors.  Reject
     // everything else for now.
     if (sample.abi != PERF_SAMPLE_REGS_ABI_64) {
-      return nullptr;
+      return false;
     }
     sample.regs = buf;
     buf += k_perf_register_count;
@@ -295,7 +303,53 @@ perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
   // analysis and checkers happy.
   (void)buf;
 
-  return &sample;
+  return true;
+}
+
+template <uint64_t Mask>
+bool hdr2samp_specialized(const perf_event_header *hdr, uint64_t /*mask*/,
+                          perf_event_sample &sample) {
+  return decode_sample(hdr, std::integral_constant<uint64_t, Mask>{}, sample);
+}
+
+// Sample types of the watchers: the default of EVENT_CONFIG_TABLE and the
+// fields added by the options of the watchers
+constexpr auto k_specialized_sample_types = std::to_array<uint64_t>({
+    k_default_sample_type,
+    k_default_sample_type | PERF_SAMPLE_ADDR,      // allocations
+    k_default_sample_type | PERF_SAMPLE_RAW,       // raw values
+    k_default_sample_type | PERF_SAMPLE_CALLCHAIN, // hybrid unwinding
+    (k_default_sample_type & ~PERF_SAMPLE_STACK_USER) |
+        PERF_SAMPLE_CALLCHAIN, // callchain unwinding
+});
+
+template <size_t... Idx>
+constexpr auto make_specialized_decoders(std::index_sequence<Idx...>) {
+  return std::array<SampleDecoder, sizeof...(Idx)>{
+      &hdr2samp_specialized<k_specialized_sample_types[Idx]>...};
+}
+
+constexpr auto k_specialized_decoders = make_specialized_decoders(
+    std::make_index_sequence<k_specialized_sample_types.size()>{});
+} // namespace
+
+bool hdr2samp(const perf_event_header *hdr, uint64_t mask,
+              perf_event_sample &sample) {
+  return decode_sample(hdr, mask, sample);
+}
+
+SampleDecoder sample_decoder_from_mask(uint64_t mask) {
+  for (size_t i = 0; i < k_specialized_sample_types.size(); ++i) {
+    if (k_specialized_sample_types[i] == mask) {
+      return k_specialized_decoders[i];
+    }
+  }
+  return hdr2samp;
+}
+
+perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
+  static perf_event_sample sample = {};
+  return hdr2samp(hdr, mask, sample) ? &sample : nullptr;
 }
 
 uint64_t hdr_time(const perf_event_header *hdr, uint64_t mask) {
@@ -342,4 +396,34 @@ uint64_t hdr_time(const perf_event_header *hdr, uint64_t mask) {
   return 0;
 }
 
+size_t hdr_compact_copy(const perf_event_header *hdr, uint64_t mask,
+                        std::byte *dst) {
+  perf_event_sample sample;
+  if (hdr->type != PERF_RECORD_SAMPLE || !(mask & PERF_SAMPLE_STACK_USER) ||
+      !hdr2samp(hdr, mask, sample) || !sample.data_stack ||
+      sample.size_stack == 0) {
+    memcpy(dst, hdr, hdr->size);
+    return hdr->size;
+  }
+  // Keep everything up to the stack data, the captured part of the stack
+  // (8-byte aligned), then dyn_size
+  const auto *src = reinterpret_cast<const std::byte *>(hdr);
+  size_t const stack_offset =
+      reinterpret_cast<const std::byte *>(sample.data_stack) - src;
+  uint64_t const captured_size =
+      (sample.size_stack + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+  memcpy(dst, src, stack_offset);
+  memcpy(dst + stack_offset - sizeof(uint64_t), &captured_size,
+         sizeof(captured_size));
+  memcpy(dst + stack_offset, sample.data_stack, sample.size_stack);
+  memset(dst + stack_offset + sample.size_stack, 0,
+         captured_size - sample.size_stack);
+  memcpy(dst + stack_offset + captured_size, &sample.dyn_size_stack,
+         sizeof(uint64_t));
+  size_t const size = stack_offset + captured_size + sizeof(uint64_t);
+  reinterpret_cast<perf_event_header *>(dst)->size =
+      static_cast<uint16_t>(size);
+  return size;
+}
+
 } // namespace ddprof
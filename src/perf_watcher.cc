@@ -13,11 +13,7 @@
 
 namespace ddprof {
 
-#define BASE_STYPES                                                            \
-  (PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER | PERF_SAMPLE_TID |          \
-   PERF_SAMPLE_TIME | PERF_SAMPLE_PERIOD)
-
-uint64_t perf_event_default_sample_type() { return BASE_STYPES; }
+uint64_t perf_event_default_sample_type() { return k_default_sample_type; }
 
 #define X_STR(a, b, c, d, e) std::array{b, d},
 const char *sample_type_name_from_idx(int idx, EventAggregationModePos pos) {
@@ -62,7 +58,7 @@ bool watcher_has_countable_sample_type(const PerfWatcher *watcher) {
 // NOLINTBEGIN(bugprone-macro-parentheses)
 #define X_EVENTS(a, b, c, d, e, f, g)                                          \
   {                                                                            \
-      .sample_type = BASE_STYPES,                                              \
+      .sample_type = k_default_sample_type,                                    \
       .config = (d),                                                           \
       .value_scale = 0,                                                        \
       .desc = (b),                                                             \
@@ -125,7 +121,7 @@ const PerfWatcher *ewatcher_from_str(const char *str) {
 
 const PerfWatcher *tracepoint_default_watcher() {
   static const PerfWatcher tracepoint_template = {
-      .sample_type = BASE_STYPES,
+      .sample_type = k_default_sample_type,
       .config = 0,
       .value_scale = 1.0,
       .desc = "Tracepoint",
@@ -239,7 +235,8 @@ std::string_view watcher_help_text() {
 "- `n|arg_num|argno`: Argument number to retrieve a value associated with this event.\n"
 "- `p|period|per`: Period of the event.\n"
 "- `r|register|regno`: Register to retrieve the value associated with this event.\n"
-"- `st|stack_sample_size|stcksz : Same as the stack_sample_size input option for this event."
+"- `st|stack_sample_size|stcksz : Same as the stack_sample_size input option for this event.\n"
+"- `u|unwind|unwind_mode`: How stacks are captured: `dwarf` (default), `fp` (kernel callchain, requires frame pointers) or `hybrid` (`fp`, with `dwarf` for processes with truncated callchains).\n"
 "- `o|raw_offset|rawoff`: Raw offset to retrieve the value associated with this event.\n"
 "- `z|raw_size|rawsz`: Raw size associated to raw offset.\n\n"
 "Disclaimer:\n"
@@ -5,17 +5,20 @@
 
 #include "pevent_lib.hpp"
 
+#include "cpu_budget.hpp"
 #include "ddprof_cmdline.hpp"
 #include "ddres.hpp"
 #include "defer.hpp"
 #include "lib/allocation_event.hpp"
 #include "perf.hpp"
 #include "ringbuffer_utils.hpp"
+#include "stack_usage.hpp"
 #include "sys_utils.hpp"
 #include "syscalls.hpp"
 #include "tracepoint_config.hpp"
 #include "user_override.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstddef>
@@ -71,7 +74,8 @@ void pevent_set_info(int fd, int attr_idx, PEvent &pevent,
 
 DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
                             pid_t pid, PerfClockSource perf_clock_source,
-                            PEventHdr *pevent_hdr, size_t &pevent_idx) {
+                            uint32_t ring_stack_size, PEventHdr *pevent_hdr,
+                            size_t &pevent_idx) {
   // register cpu 0 and find a working config
   PEvent *pes = pevent_hdr->pes;
   std::vector<perf_event_attr> perf_event_data =
@@ -86,7 +90,7 @@ DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
       // Copy the successful config
       pevent_hdr->attrs[pevent_hdr->nb_attrs] = attr;
       pevent_set_info(fd, pevent_hdr->nb_attrs, pes[pevent_idx],
-                      watcher->options.stack_sample_size);
+                      ring_stack_size);
       ++pevent_hdr->nb_attrs;
       assert(pevent_hdr->nb_attrs <= kMaxTypeWatcher);
       break;
@@ -108,16 +112,58 @@ DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
   return {};
 }
 
+// Open disabled copies of the event capturing the other stack sample sizes.
+// The worker enables the size matching the stack usage.
+DDRes pevent_open_stack_tiers(const PerfWatcher *watcher, int watcher_idx,
+                              perf_event_attr attr, std::span<pid_t> pids,
+                              int cpu_idx, PEvent &pevent) {
+  uint32_t const nominal_size = watcher->options.stack_sample_size;
+  attr.enable_on_exec = 0;
+  uint32_t prev_size = 0;
+  for (uint32_t const size : stack_size_tiers(nominal_size)) {
+    if (size == nominal_size || size == prev_size) {
+      continue;
+    }
+    prev_size = size;
+    attr.sample_stack_user = size;
+    // Registered before opening so that fds are closed on failures
+    PEventStackTier &tier =
+        pevent.stack_tiers.emplace_back(PEventStackTier{size, {}});
+    for (auto tid : pids) {
+      int const fd =
+          perf_event_open(&attr, tid, cpu_idx, -1, PERF_FLAG_FD_CLOEXEC);
+      if (fd != -1) {
+        tier.fds.push_back(fd);
+      } else if (tid == pids[0]) {
+        DDRES_RETURN_ERROR_LOG(
+            DD_WHAT_PERFOPEN,
+            "Error calling perfopen on watcher %d.%d (%s) with a stack sample "
+            "size of %u",
+            watcher_idx, cpu_idx, strerror(errno), size);
+      } else {
+        // Ignore failure, thread may have exited
+        LG_WRN("Error calling perf_event_open on watcher %d.%d (%s) for tid %d",
+               watcher_idx, cpu_idx, strerror(errno), tid);
+      }
+    }
+  }
+  return {};
+}
+
 DDRes pevent_open_all_cpus(const PerfWatcher *watcher, int watcher_idx,
                            std::span<pid_t> pids, int num_cpu,
-                           PerfClockSource perf_clock_source,
+                           PerfClockSource perf_clock_source, bool stack_tiers,
                            PEventHdr *pevent_hdr) {
   PEvent *pes = pevent_hdr->pes;
 
+  // Ring buffers are sized for the largest stacks they can receive
+  uint32_t const ring_stack_size = stack_tiers
+      ? stack_size_tiers(watcher->options.stack_sample_size).back()
+      : watcher->options.stack_sample_size;
   size_t template_pevent_idx = -1;
-  DDRES_CHECK_FWD(pevent_register_cpu_0(watcher, watcher_idx, pids[0],
-                                        perf_clock_source, pevent_hdr,
-                                        template_pevent_idx));
+  DDRES_CHECK_FWD(pevent_register_cpu_0(
+      watcher, watcher_idx, pids[0], perf_clock_source, ring_stack_size,
+      pevent_hdr, template_pevent_idx));
   int const template_attr_idx = pes[template_pevent_idx].attr_idx;
   perf_event_attr *attr = &pevent_hdr->attrs[template_attr_idx];
 
@@ -136,7 +182,7 @@ DDRes pevent_open_all_cpus(const PerfWatcher *watcher, int watcher_idx,
                                watcher_idx, cpu_idx, strerror(errno));
       }
       pevent_set_info(fd, pes[template_pevent_idx].attr_idx, pes[pevent_idx],
-                      watcher->options.stack_sample_size);
+                      ring_stack_size);
       pevent = &pes[pevent_idx];
     } else {
       pevent = &pes[template_pevent_idx];
@@ -155,6 +201,19 @@ DDRes pevent_open_all_cpus(const PerfWatcher *watcher, int watcher_idx,
         pevent->sub_fds.push_back(fd);
       }
     }
+    if (stack_tiers) {
+      DDRES_CHECK_FWD(pevent_open_stack_tiers(watcher, watcher_idx, *attr,
+                                              pids, cpu_idx, *pevent));
+    }
+  }
+  return {};
+}
+
+DDRes pevent_ioctl_fds(std::span<const int> fds, unsigned long request,
+                       size_t pevent_idx) {
+  for (int const fd : fds) {
+    DDRES_CHECK_INT(ioctl(fd, request), DD_WHAT_IOCTL,
+                    "Error ioctl fd=%d (idx#%zu)", fd, pevent_idx);
   }
   return {};
 }
@@ -192,8 +251,9 @@ DDRes pevent_open(DDProfContext &ctx, std::span<pid_t> pids, int num_cpu,
        ++watcher_idx) {
     PerfWatcher *watcher = &ctx.watchers[watcher_idx];
     if (watcher->type < kDDPROF_TYPE_CUSTOM) {
-      DDRES_CHECK_FWD(pevent_open_all_cpus(watcher, watcher_idx, pids, num_cpu,
-                                           ctx.perf_clock_source, pevent_hdr));
+      DDRES_CHECK_FWD(pevent_open_all_cpus(
+          watcher, watcher_idx, pids, num_cpu, ctx.perf_clock_source,
+          pevent_has_stack_tiers(ctx, *watcher), pevent_hdr));
     } else {
       // custom event, eg.allocation profiling
       size_t pevent_idx = 0;
@@ -286,6 +346,17 @@ DDRes pevent_enable(PEventHdr *pevent_hdr) {
         DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_ENABLE), DD_WHAT_IOCTL,
                         "Error ioctl fd=%d (idx#%zu)", fd, i);
       }
+      // Other stack sizes stay disabled until the worker selects them
+      for (const auto &tier : pevent_hdr->pes[i].stack_tiers) {
+        for (auto fd : tier.fds) {
+          DDRES_CHECK_INT(
+              ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, pevent_hdr->pes[i].fd),
+              DD_WHAT_IOCTL,
+              "Error ioctl PERF_EVENT_IOC_SET_OUTPUT fd=%d output_fd=%d "
+              "(idx#%zu)",
+              fd, pevent_hdr->pes[i].fd, i);
+        }
+      }
 
       DDRES_CHECK_INT(ioctl(pevent_hdr->pes[i].fd, PERF_EVENT_IOC_ENABLE),
                       DD_WHAT_IOCTL, "Error ioctl fd=%d (idx#%zu)",
@@ -295,6 +366,89 @@ DDRes pevent_enable(PEventHdr *pevent_hdr) {
   return {};
 }
 
+DDRes pevent_set_period_scale(PEventHdr *pevent_hdr,
+                              std::span<const PerfWatcher> watchers,
+                              uint32_t scale_pct) {
+  for (size_t i = 0; i < pevent_hdr->size; ++i) {
+    const PEvent &pevent = pevent_hdr->pes[i];
+    if (pevent.custom_event || pevent.fd == -1) {
+      continue;
+    }
+    const PerfWatcher &watcher = watchers[pevent.watcher_pos];
+    if (watcher.value_source != EventConfValueSource::kSample) {
+      // Skipping samples would bias values that are not the sample period
+      continue;
+    }
+    // The kernel interprets the value as a frequency for frequency events
+    uint64_t value = watcher.options.is_freq
+        ? watcher.sample_frequency * k_nominal_period_scale_pct / scale_pct
+        : watcher.sample_period * scale_pct / k_nominal_period_scale_pct;
+    value = std::max<uint64_t>(value, 1);
+    for (auto fd : pevent.sub_fds) {
+      DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_PERIOD, &value), DD_WHAT_IOCTL,
+                      "Error ioctl PERF_EVENT_IOC_PERIOD fd=%d (idx#%zu)", fd,
+                      i);
+    }
+    for (const auto &tier : pevent.stack_tiers) {
+      for (auto fd : tier.fds) {
+        DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_PERIOD, &value),
+                        DD_WHAT_IOCTL,
+                        "Error ioctl PERF_EVENT_IOC_PERIOD fd=%d (idx#%zu)", fd,
+                        i);
+      }
+    }
+    DDRES_CHECK_INT(ioctl(pevent.fd, PERF_EVENT_IOC_PERIOD, &value),
+                    DD_WHAT_IOCTL,
+                    "Error ioctl PERF_EVENT_IOC_PERIOD fd=%d (idx#%zu)",
+                    pevent.fd, i);
+  }
+  return {};
+}
+
+bool pevent_has_stack_tiers(const DDProfContext &ctx,
+                            const PerfWatcher &watcher) {
+  return ctx.params.adaptive_stack_sample_size &&
+      watcher.type < kDDPROF_TYPE_CUSTOM &&
+      (watcher.sample_type & PERF_SAMPLE_STACK_USER);
+}
+
+DDRes pevent_set_stack_sample_size(PEventHdr *pevent_hdr,
+                                   const PerfWatcher &watcher, int watcher_pos,
+                                   uint32_t stack_sample_size) {
+  bool const nominal_size =
+      stack_sample_size == watcher.options.stack_sample_size;
+  for (size_t i = 0; i < pevent_hdr->size; ++i) {
+    const PEvent &pevent = pevent_hdr->pes[i];
+    if (pevent.watcher_pos != watcher_pos || pevent.stack_tiers.empty()) {
+      continue;
+    }
+    // Enable the new size before disabling the others not to miss samples
+    if (nominal_size) {
+      DDRES_CHECK_FWD(pevent_ioctl_fds({&pevent.fd, 1}, PERF_EVENT_IOC_ENABLE,
+                                       i));
+      DDRES_CHECK_FWD(
+          pevent_ioctl_fds(pevent.sub_fds, PERF_EVENT_IOC_ENABLE, i));
+    }
+    for (const auto &tier : pevent.stack_tiers) {
+      if (tier.stack_sample_size == stack_sample_size) {
+        DDRES_CHECK_FWD(pevent_ioctl_fds(tier.fds, PERF_EVENT_IOC_ENABLE, i));
+      }
+    }
+    if (!nominal_size) {
+      DDRES_CHECK_FWD(pevent_ioctl_fds({&pevent.fd, 1}, PERF_EVENT_IOC_DISABLE,
+                                       i));
+      DDRES_CHECK_FWD(
+          pevent_ioctl_fds(pevent.sub_fds, PERF_EVENT_IOC_DISABLE, i));
+    }
+    for (const auto &tier : pevent.stack_tiers) {
+      if (tier.stack_sample_size != stack_sample_size) {
+        DDRES_CHECK_FWD(pevent_ioctl_fds(tier.fds, PERF_EVENT_IOC_DISABLE, i));
+      }
+    }
+  }
+  return {};
+}
+
 DDRes pevent_munmap_event(PEvent *event) {
   if (event->rb.base) {
     if (perfdisown(event->rb.base, event->ring_buffer_size) != 0) {
@@ -338,6 +492,16 @@ DDRes pevent_close_event(PEvent *event) {
             sub_fd, event->watcher_pos, strerror(errno));
       }
     }
+    for (const auto &tier : event->stack_tiers) {
+      for (auto tier_fd : tier.fds) {
+        if (close(tier_fd) == -1) {
+          DDRES_RETURN_ERROR_LOG(
+              DD_WHAT_PERFOPEN,
+              "Error when closing tier fd=%d (watcher #%d) (%s)", tier_fd,
+              event->watcher_pos, strerror(errno));
+        }
+      }
+    }
   }
   if (event->custom_event && event->mapfd != -1) {
     if (close(event->mapfd) == -1) {
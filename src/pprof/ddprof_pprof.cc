@@ -11,6 +11,7 @@
 #include "ddprof_defs.hpp"
 #include "ddres.hpp"
 #include "defer.hpp"
+#include "overload_controller.hpp"
 #include "pevent_lib.hpp"
 #include "symbol_hdr.hpp"
 #include "symbolizer.hpp"
@@ -31,6 +32,8 @@ namespace ddprof {
 
 namespace {
 constexpr size_t k_max_pprof_labels{8};
+// Bound the pid label strings kept across cycles
+constexpr size_t k_max_cached_pid_strs{16384};
 
 constexpr int k_max_value_types =
     DDPROF_PWT_LENGTH * static_cast<int>(kNbEventAggregationModes);
@@ -245,6 +248,7 @@ size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
   constexpr std::string_view k_thread_id_label = "thread id"sv;
   constexpr std::string_view k_thread_name_label = "thread_name"sv;
   constexpr std::string_view k_tracepoint_label = "tracepoint_type"sv;
+  constexpr std::string_view k_overload_tier_label = "overload_tier"sv;
   size_t labels_num = 0;
   if (!uw_output.container_id.empty()) {
     labels[labels_num].key = to_CharSlice(k_container_id_label);
@@ -286,6 +290,12 @@ size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
     labels[labels_num].str = to_CharSlice(uw_output.thread_name);
     ++labels_num;
   }
+  if (uw_output.overload_tier != OverloadTier::kNone) {
+    labels[labels_num].key = to_CharSlice(k_overload_tier_label);
+    labels[labels_num].str =
+        to_CharSlice(overload_tier_name(uw_output.overload_tier));
+    ++labels_num;
+  }
   DDPROF_DCHECK_FATAL(labels_num <= labels.size(),
                       "pprof_aggregate - label buffer exceeded");
   return labels_num;
@@ -309,7 +319,8 @@ DDRes process_symbolization(
     const FileInfoVector &file_infos, Symbolizer *symbolizer,
     DDProfPProf *pprof,
     std::array<ddog_prof_Location, kMaxStackDepth> &locations_buff,
-    Symbolizer::BlazeResultsWrapper &session_results, unsigned &write_index) {
+    Symbolizer::BlazeResultsWrapper &session_results, unsigned &write_index,
+    bool skip_symbolization) {
   unsigned index = 0;
 
   const ddprof::SymbolTable &symbol_table = symbol_hdr._symbol_table;
@@ -340,8 +351,10 @@ DDRes process_symbolization(
 
     const FileInfoId_t file_id = locs[index].file_info_id;
     const std::string &current_file_path = file_infos[file_id].get_path();
-    std::vector<uintptr_t> elf_addresses;
-    std::vector<uintptr_t> process_addresses;
+    std::pmr::vector<uintptr_t> elf_addresses(&pprof->_arena);
+    std::pmr::vector<uintptr_t> process_addresses(&pprof->_arena);
+    elf_addresses.reserve(locs.size() - index);
+    process_addresses.reserve(locs.size() - index);
 
     // Collect all consecutive locations for the same file
     const unsigned start_index = index;
@@ -358,7 +371,7 @@ DDRes process_symbolization(
         elf_addresses, process_addresses, file_id, current_file_path,
         mapinfo_table[locs[start_index].map_info_idx],
         std::span<ddog_prof_Location>{locations_buff}, write_index,
-        session_results);
+        session_results, skip_symbolization);
     if (IsDDResNotOK(res)) {
       if (IsDDResFatal(res)) {
         DDRES_RETURN_ERROR_LOG(DD_WHAT_SYMBOLIZER, "Failed to symbolize pprof");
@@ -530,12 +543,17 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
   std::span locs{uw_output->locs};
   locs = adjust_locations(watcher, locs);
 
+  // Temporaries of the previous sample are no longer referenced
+  pprof->_arena.rewind();
   // Blaze results should remain alive until we aggregate the pprof data
-  Symbolizer::BlazeResultsWrapper session_results;
+  Symbolizer::BlazeResultsWrapper session_results(&pprof->_arena);
   unsigned write_index = 0;
-  DDRES_CHECK_FWD(process_symbolization(locs, symbol_hdr, file_infos,
-                                        symbolizer, pprof, locations_buff,
-                                        session_results, write_index));
+  // Under overload, only report addresses
+  bool const skip_symbolization =
+      uw_output->overload_tier >= OverloadTier::kNoSymbolization;
+  DDRES_CHECK_FWD(process_symbolization(
+      locs, symbol_hdr, file_infos, symbolizer, pprof, locations_buff,
+      session_results, write_index, skip_symbolization));
   std::array<ddog_prof_Label, k_max_pprof_labels> labels{};
   // Create the labels for the sample.  Two samples are the same only when
   // their locations _and_ all labels are identical, so we admit a very limited
@@ -564,6 +582,25 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
   return {};
 }
 
+void pprof_prepare_symbolization(const UnwindOutput *uw_output,
+                                 const PerfWatcher *watcher,
+                                 Symbolizer *symbolizer) {
+  if (uw_output->overload_tier >= OverloadTier::kNoSymbolization) {
+    return;
+  }
+  std::span locs{uw_output->locs};
+  locs = adjust_locations(watcher, locs);
+  // Same frames as process_symbolization (the last one is the binary frame)
+  for (size_t i = 0; i + 1 < locs.size(); ++i) {
+    const FunLoc &loc = locs[i];
+    if (loc.symbol_idx == k_symbol_idx_null &&
+        loc.file_info_id > k_file_info_error) {
+      symbolizer->add_to_batch(loc.file_info_id, loc.elf_addr,
+                               loc.map_info_idx);
+    }
+  }
+}
+
 DDRes pprof_reset(DDProfPProf *pprof) {
   auto res = ddog_prof_Profile_reset(&pprof->_profile, nullptr);
   if (res.tag != DDOG_PROF_PROFILE_RESULT_OK) {
@@ -572,7 +609,10 @@ DDRes pprof_reset(DDProfPProf *pprof) {
     DDRES_RETURN_ERROR_LOG(DD_WHAT_PPROF, "Unable to reset profile: %*s",
                            static_cast<int>(msg.len), msg.ptr);
   }
-  pprof->_pid_str.clear();
+  pprof->_arena.release();
+  if (pprof->_pid_str.size() > k_max_cached_pid_strs) {
+    pprof->_pid_str.clear();
+  }
   return {};
 }
 } // namespace ddprof
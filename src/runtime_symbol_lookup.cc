@@ -13,10 +13,12 @@
 
 #include <absl/strings/substitute.h>
 #include <algorithm>
+#include <charconv>
 #include <cstdio>
 #include <cstring>
-#include <iostream>
+#include <fcntl.h>
 #include <limits>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -26,7 +28,7 @@ namespace ddprof {
 // 00007F78F52300D8 78 stub<2> AllocateTemporaryEntryPoints<PRECODE_STUB>
 // 00007F78F5230150 18 stub<3> AllocateTemporaryEntryPoints<PRECODE_STUB>
 
-UniqueFile
+UniqueFd
 RuntimeSymbolLookup::perfmaps_open(int pid, const char *path_to_perfmap = "") {
   char buf[PATH_MAX];
   auto n = snprintf(buf, std::size(buf), "%s/proc/%d/root%s/perf-%d.map",
@@ -35,21 +37,20 @@ RuntimeSymbolLookup::perfmaps_open(int pid, const char *path_to_perfmap = "") {
       std::size(buf)) { // unable to snprintf everything
     return nullptr;
   }
-  UniqueFile perfmap_file{fopen(buf, "r")};
-  if (perfmap_file) {
-    return perfmap_file;
+  UniqueFd perfmap_fd{open(buf, O_RDONLY | O_CLOEXEC)};
+  if (perfmap_fd) {
+    return perfmap_fd;
   }
   // attempt in local namespace
   snprintf(buf, std::size(buf), "%s/perf-%d.map", path_to_perfmap, pid);
   LG_DBG("Open perf-map %s", buf);
-  return UniqueFile{fopen(buf, "r")};
+  return UniqueFd{open(buf, O_RDONLY | O_CLOEXEC)};
 }
 
-bool RuntimeSymbolLookup::insert_or_replace(std::string_view symbol,
-                                            ProcessAddress_t address,
-                                            Offset_t code_size,
-                                            SymbolMap &symbol_map,
-                                            SymbolTable &symbol_table) {
+bool RuntimeSymbolLookup::insert(std::string_view symbol,
+                                 ProcessAddress_t address, Offset_t code_size,
+                                 JITSymbolIndex &index,
+                                 SymbolTable &symbol_table) {
   if (should_skip_symbol(symbol)) {
     return false;
   }
@@ -65,43 +66,82 @@ bool RuntimeSymbolLookup::insert_or_replace(std::string_view symbol,
     return false;
   }
 
-  SymbolMap::FindRes const find_res = symbol_map.find_closest(address);
-  if (!find_res.second) {
-    symbol_map.emplace_hint(
-        find_res.first, address,
-        SymbolSpan(address + code_size - 1, symbol_table.size()));
-    symbol_table.emplace_back(std::string(symbol), std::string(symbol), 0,
-                              "jit");
-  } else {
-    // todo managing range erase (we can overall with other syms)
-    SymbolIdx_t const existing = find_res.first->second.get_symbol_idx();
-#ifdef DEBUG
-    LG_DBG("Existyng sym -- %s (%lx-%lx)",
-           symbol_table[existing]._demangled_name.c_str(),
-           find_res.first->first, find_res.first->second.get_end());
-    LG_DBG("New sym -- %s (%lx-%lx)", code_load.func_name.c_str(),
-           code_load.code_addr, code_load.code_size + code_load.code_addr);
-#endif
-    if (symbol_table[existing]._demangled_name == symbol) {
-      find_res.first->second.set_end(address + code_size - 1);
+  auto it = _name_ids.find(symbol);
+  if (it == _name_ids.end()) {
+    SymbolIdx_t name_id = static_cast<SymbolIdx_t>(_names.size());
+    if (!_free_name_ids.empty()) {
+      name_id = _free_name_ids.back();
+      _free_name_ids.pop_back();
     } else {
-      // remove current element (as start can be different)
-      symbol_map.erase(find_res.first);
-      symbol_map.emplace(address,
-                         SymbolSpan(address + code_size - 1, existing));
-      symbol_table[existing]._demangled_name = symbol;
-      symbol_table[existing]._symname = symbol;
+      _names.emplace_back();
     }
+    it = _name_ids.emplace(symbol, name_id).first;
+    _names[name_id] = {.name = &it->first, .symbol_idx = -1};
   }
-
+  symbol_of(it->second, symbol_table);
+  // Overwrites the regions that were previously emitted at this address
+  index.insert(address, code_size, it->second);
   return true;
 }
+
+SymbolIdx_t RuntimeSymbolLookup::symbol_of(SymbolIdx_t name_id,
+                                           SymbolTable &symbol_table) {
+  if (name_id == -1) {
+    return -1;
+  }
+  JITName &jit_name = _names[name_id];
+  if (jit_name.symbol_idx == -1) {
+    jit_name.symbol_idx = static_cast<SymbolIdx_t>(symbol_table.size());
+    symbol_table.emplace_back(*jit_name.name, *jit_name.name, 0, "jit");
+  }
+  return jit_name.symbol_idx;
+}
 namespace {
 bool is_absolute_path(std::string_view path) { return path.front() == '/'; }
+
+std::string_view skip_blanks(std::string_view str) {
+  size_t const pos = str.find_first_not_of(" \t");
+  return pos == std::string_view::npos ? std::string_view{} : str.substr(pos);
+}
+
+// Parse an hexadecimal token, returns the remaining string
+std::optional<std::string_view> parse_hex(std::string_view str,
+                                          uint64_t &value) {
+  str = skip_blanks(str);
+  if (str.starts_with("0x")) {
+    str.remove_prefix(2);
+  }
+  constexpr int hexadecimal_base = 16;
+  auto const res = std::from_chars(str.data(), str.data() + str.size(), value,
+                                   hexadecimal_base);
+  if (res.ec != std::errc{} ||
+      (res.ptr != str.data() + str.size() && *res.ptr != ' ' &&
+       *res.ptr != '\t')) {
+    return std::nullopt;
+  }
+  return str.substr(res.ptr - str.data());
+}
+
+// <start address> <size> <symbol name>
+bool parse_perfmap_line(std::string_view line, ProcessAddress_t &address,
+                        Offset_t &code_size, std::string_view &symbol) {
+  auto remaining = parse_hex(line, address);
+  if (remaining) {
+    remaining = parse_hex(*remaining, code_size);
+  }
+  if (!remaining) {
+    return false;
+  }
+  // Avoid considering any symbols beyond 300 chars
+  constexpr size_t k_max_symbol_size = 300;
+  symbol = skip_blanks(*remaining);
+  symbol = symbol.substr(0, std::min(symbol.find('\t'), k_max_symbol_size));
+  return !symbol.empty();
+}
 } // namespace
 
 DDRes RuntimeSymbolLookup::fill_from_jitdump(std::string_view jitdump_path,
-                                             pid_t pid, SymbolMap &symbol_map,
+                                             pid_t pid, SymbolInfo &symbol_info,
                                              SymbolTable &symbol_table) {
   const std::string path = is_absolute_path(jitdump_path)
       ? absl::Substitute("$0/proc/$1/root$2", _path_to_proc, pid,
@@ -110,10 +150,13 @@ DDRes RuntimeSymbolLookup::fill_from_jitdump(std::string_view jitdump_path,
       absl::Substitute("$0/proc/$1/cwd/$2", _path_to_proc, pid, jitdump_path);
 
   JITDump jitdump;
-  DDRes res = jitdump_read(path, jitdump);
+  bool replaced;
+  DDRes res =
+      jitdump_read_tail(path, symbol_info._jitdump_tail, jitdump, replaced);
   if (IsDDResNotOK(res) && res._what == DD_WHAT_NO_JIT_FILE) {
     // retry with different path
-    res = jitdump_read(jitdump_path, jitdump);
+    res = jitdump_read_tail(jitdump_path, symbol_info._jitdump_tail, jitdump,
+                            replaced);
     if (IsDDResFatal(res)) {
       if (res._what == DD_WHAT_NO_JIT_FILE) {
         LG_WRN("Unable to read jitdump file at %.*s",
@@ -124,9 +167,14 @@ DDRes RuntimeSymbolLookup::fill_from_jitdump(std::string_view jitdump_path,
     }
   }
 
+  if (replaced) {
+    // Symbols of the perf-map are also dropped
+    symbol_info._index.clear();
+    symbol_info._perfmap_tail.offset = 0;
+  }
   for (const JITRecordCodeLoad &code_load : jitdump.code_load) {
-    insert_or_replace(code_load.func_name, code_load.code_addr,
-                      code_load.code_size, symbol_map, symbol_table);
+    insert(code_load.func_name, code_load.code_addr, code_load.code_size,
+           symbol_info._index, symbol_table);
   }
   // todo we can add file and inlined functions with debug info
   return {};
@@ -139,7 +187,7 @@ bool RuntimeSymbolLookup::should_skip_symbol(std::string_view symbol) {
   });
 }
 
-DDRes RuntimeSymbolLookup::fill_from_perfmap(int pid, SymbolMap &symbol_map,
+DDRes RuntimeSymbolLookup::fill_from_perfmap(int pid, SymbolInfo &symbol_info,
                                              SymbolTable &symbol_table) {
   auto pmf{perfmaps_open(pid, "/tmp")};
   if (!pmf) {
@@ -147,28 +195,37 @@ DDRes RuntimeSymbolLookup::fill_from_perfmap(int pid, SymbolMap &symbol_map,
     return ddres_error(DD_WHAT_NO_JIT_FILE);
   }
 
-  LG_DBG("Loading runtime symbols from (PID%d)", pid);
-  char *line = nullptr;
-  size_t sz_buf = 0;
-  char buffer[PATH_MAX];
-  while (-1 != getline(&line, &sz_buf, pmf.get())) {
-    constexpr size_t k_uint64_hex_rep_size = 2 * sizeof(uint64_t) + 1;
-    char address_buff[k_uint64_hex_rep_size]; // max size of 16 (as it should be
-                                              // hexa for uint64)
-    char size_buff[k_uint64_hex_rep_size];
-    // Avoid considering any symbols beyond 300 chars
-    if (3 !=
-        sscanf(line, "%16s %8s %300[^\t\n]", address_buff, size_buff, buffer)) {
-      continue;
+  FileTailState &state = symbol_info._perfmap_tail;
+  FileTail tail;
+  DDRES_CHECK_FWD(tail.map(pmf.get(), state));
+  if (tail.replaced()) {
+    // Symbols of the jitdump are also dropped
+    symbol_info._index.clear();
+    symbol_info._jitdump_tail.offset = 0;
+  }
+  std::string_view data(reinterpret_cast<const char *>(tail.data().data()),
+                        tail.data().size());
+  // The last line can be in the middle of a write
+  size_t const end = data.rfind('\n');
+  if (end == std::string_view::npos) {
+    return {};
+  }
+  data = data.substr(0, end + 1);
+  LG_DBG("Loading runtime symbols from (PID%d) at offset %lu", pid,
+         state.offset);
+  state.offset += data.size();
+
+  while (!data.empty()) {
+    size_t const eol = data.find('\n');
+    std::string_view const line = data.substr(0, eol);
+    data.remove_prefix(eol + 1);
+    ProcessAddress_t address;
+    Offset_t code_size;
+    std::string_view symbol;
+    if (parse_perfmap_line(line, address, code_size, symbol)) {
+      insert(symbol, address, code_size, symbol_info._index, symbol_table);
     }
-    constexpr int hexadecimal_base = 16;
-    ProcessAddress_t const address =
-        std::strtoul(address_buff, nullptr, hexadecimal_base);
-    Offset_t const code_size =
-        std::strtoul(size_buff, nullptr, hexadecimal_base);
-    insert_or_replace(buffer, address, code_size, symbol_map, symbol_table);
-  }
-  free(line);
+  }
   return {};
 }
 
@@ -177,41 +234,60 @@ RuntimeSymbolLookup::get_or_insert_jitdump(pid_t pid, ProcessAddress_t pc,
                                            SymbolTable &symbol_table,
                                            std::string_view jitdump_path) {
   SymbolInfo &symbol_info = _pid_map[pid];
-  SymbolMap::FindRes find_res = symbol_info._map.find_closest(pc);
-  if (!find_res.second && !has_lookup_failure(symbol_info, jitdump_path)) {
+  SymbolIdx_t name_id = symbol_info._index.find(pc);
+  if (name_id == -1 && !has_lookup_failure(symbol_info, jitdump_path)) {
     // refresh as we expect there to be new symbols
     ++_stats._nb_jit_reads;
-    if (IsDDResFatal(fill_from_jitdump(jitdump_path, pid, symbol_info._map,
-                                       symbol_table))) {
+    if (IsDDResFatal(
+            fill_from_jitdump(jitdump_path, pid, symbol_info, symbol_table))) {
       // Some warnings can be expected with incomplete files
       flag_lookup_failure(symbol_info, jitdump_path);
       return -1;
     }
-    find_res = symbol_info._map.find_closest(pc);
+    name_id = symbol_info._index.find(pc);
   }
   // Avoid bouncing when we are failing lookups.
   // !This could have a negative impact on symbolisation. To be studied
-  if (!find_res.second) {
+  if (name_id == -1) {
     flag_lookup_failure(symbol_info, jitdump_path);
   }
-  return find_res.second ? find_res.first->second.get_symbol_idx() : -1;
+  return symbol_of(name_id, symbol_table);
 }
 
 SymbolIdx_t RuntimeSymbolLookup::get_or_insert(pid_t pid, ProcessAddress_t pc,
                                                SymbolTable &symbol_table) {
   SymbolInfo &symbol_info = _pid_map[pid];
-  SymbolMap::FindRes find_res = symbol_info._map.find_closest(pc);
+  SymbolIdx_t name_id = symbol_info._index.find(pc);
 
   // Only check the file if we did not get failures in this cycle (for this pid)
-  if (!find_res.second && !has_lookup_failure(symbol_info, "perfmap")) {
+  if (name_id == -1 && !has_lookup_failure(symbol_info, "perfmap")) {
     ++_stats._nb_jit_reads;
-    fill_from_perfmap(pid, symbol_info._map, symbol_table);
-    find_res = symbol_info._map.find_closest(pc);
+    fill_from_perfmap(pid, symbol_info, symbol_table);
+    name_id = symbol_info._index.find(pc);
   }
-  if (!find_res.second) {
+  if (name_id == -1) {
     flag_lookup_failure(symbol_info, "perfmap");
   }
-  return find_res.second ? find_res.first->second.get_symbol_idx() : -1;
+  return symbol_of(name_id, symbol_table);
+}
+
+void RuntimeSymbolLookup::remap(const TableRemap &symbol_remap) {
+  std::vector<bool> referenced(_names.size());
+  for (auto &el : _pid_map) {
+    el.second._index.for_each_symbol(
+        [&referenced](SymbolIdx_t name_id) { referenced[name_id] = true; });
+  }
+  for (size_t name_id = 0; name_id < _names.size(); ++name_id) {
+    JITName &jit_name = _names[name_id];
+    // Removed symbols are set to -1
+    remap_index(symbol_remap, jit_name.symbol_idx);
+    if (jit_name.name && !referenced[name_id] && jit_name.symbol_idx == -1) {
+      // No code region uses this name anymore
+      _name_ids.erase(_name_ids.find(*jit_name.name));
+      jit_name = {};
+      _free_name_ids.push_back(static_cast<SymbolIdx_t>(name_id));
+    }
+  }
 }
 
 } // namespace ddprof
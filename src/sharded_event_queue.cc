@@ -0,0 +1,167 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "sharded_event_queue.hpp"
+
+#include "ddres.hpp"
+
+#include <cstring>
+
+namespace ddprof {
+
+namespace {
+
+// Events are stored back to back, each one preceded by this header
+struct RecordHeader {
+  int32_t watcher_pos;
+  uint32_t size; // size of the event, including padding
+};
+
+constexpr size_t k_record_alignment = alignof(uint64_t);
+
+constexpr size_t align_record(size_t size) {
+  return (size + k_record_alignment - 1) & ~(k_record_alignment - 1);
+}
+
+} // namespace
+
+ShardedEventQueue::ShardedEventQueue(unsigned nb_shards, Handler handler,
+                                     size_t max_pending_bytes)
+    : _handler(std::move(handler)), _max_pending_bytes(max_pending_bytes) {
+  _shards.reserve(nb_shards);
+  for (unsigned i = 0; i < nb_shards; ++i) {
+    _shards.push_back(std::make_unique<Shard>());
+  }
+  for (unsigned i = 0; i < nb_shards; ++i) {
+    Shard &shard = *_shards[i];
+    shard.thread = std::thread([this, &shard, i] { run(shard, i); });
+  }
+}
+
+ShardedEventQueue::~ShardedEventQueue() {
+  for (auto &shard : _shards) {
+    {
+      const std::lock_guard lock{shard->mutex};
+      shard->stop = true;
+    }
+    shard->events_cv.notify_one();
+  }
+  for (auto &shard : _shards) {
+    shard->thread.join();
+  }
+}
+
+DDRes ShardedEventQueue::push(pid_t pid, const perf_event_header *hdr,
+                              int watcher_pos) {
+  Shard &shard = *_shards[shard_of(pid)];
+  const size_t event_size = align_record(hdr->size);
+  std::vector<std::byte> &staging = shard.staging;
+  const size_t offset = staging.size();
+  staging.resize(offset + sizeof(RecordHeader) + event_size);
+  const RecordHeader record{watcher_pos, static_cast<uint32_t>(event_size)};
+  memcpy(staging.data() + offset, &record, sizeof(record));
+  memcpy(staging.data() + offset + sizeof(record), hdr, hdr->size);
+  if (staging.size() >= k_flush_bytes) {
+    return flush(shard);
+  }
+  return {};
+}
+
+DDRes ShardedEventQueue::flush() {
+  DDRes res{};
+  for (auto &shard : _shards) {
+    DDRes const shard_res = flush(*shard);
+    if (IsDDResOK(res)) {
+      res = shard_res;
+    }
+  }
+  return res;
+}
+
+DDRes ShardedEventQueue::flush(Shard &shard) {
+  std::unique_lock lock{shard.mutex};
+  if (!IsDDResOK(shard.error)) {
+    // events of a failing shard are dropped
+    shard.staging.clear();
+    return shard.error;
+  }
+  if (shard.staging.empty()) {
+    return {};
+  }
+  shard.progress_cv.wait(lock, [&] {
+    return shard.pending.size() < _max_pending_bytes;
+  });
+  if (shard.pending.empty()) {
+    // recycle the buffer that was released by the thread
+    shard.pending.swap(shard.staging);
+  } else {
+    shard.pending.insert(shard.pending.end(), shard.staging.begin(),
+                         shard.staging.end());
+    shard.staging.clear();
+  }
+  lock.unlock();
+  shard.events_cv.notify_one();
+  return {};
+}
+
+DDRes ShardedEventQueue::drain() {
+  DDRes res = flush();
+  for (auto &shard : _shards) {
+    std::unique_lock lock{shard->mutex};
+    shard->progress_cv.wait(
+        lock, [&] { return shard->pending.empty() && !shard->busy; });
+    if (IsDDResOK(res)) {
+      res = shard->error;
+    }
+  }
+  return res;
+}
+
+void ShardedEventQueue::run(Shard &shard, unsigned shard_idx) {
+  std::vector<std::byte> batch;
+  std::unique_lock lock{shard.mutex};
+  while (true) {
+    shard.events_cv.wait(lock,
+                         [&] { return shard.stop || !shard.pending.empty(); });
+    if (shard.pending.empty()) {
+      // stop was requested and everything was handled
+      break;
+    }
+    batch.clear();
+    batch.swap(shard.pending);
+    shard.busy = true;
+    lock.unlock();
+    shard.progress_cv.notify_all();
+
+    DDRes const res = handle_batch(shard_idx, batch);
+
+    lock.lock();
+    shard.busy = false;
+    if (!IsDDResOK(res) && IsDDResOK(shard.error)) {
+      shard.error = res;
+    }
+    shard.progress_cv.notify_all();
+  }
+}
+
+DDRes ShardedEventQueue::handle_batch(unsigned shard_idx,
+                                      const std::vector<std::byte> &batch) {
+  size_t offset = 0;
+  while (offset < batch.size()) {
+    RecordHeader record;
+    memcpy(&record, batch.data() + offset, sizeof(record));
+    offset += sizeof(record);
+    const auto *hdr =
+        reinterpret_cast<const perf_event_header *>(batch.data() + offset);
+    DDRes const res = _handler(shard_idx, hdr, record.watcher_pos);
+    if (!IsDDResOK(res)) {
+      return res;
+    }
+    offset += record.size;
+  }
+  return {};
+}
+
+} // namespace ddprof
@@ -0,0 +1,49 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_accumulator.hpp"
+
+namespace ddprof {
+
+void StackAccumulator::add(int watcher_pos, const UnwindOutput &output,
+                           const DDProfValuePack &pack) {
+  if (static_cast<size_t>(watcher_pos) >= _stack_maps.size()) {
+    _stack_maps.resize(watcher_pos + 1);
+  }
+  StackMap &stack_map = _stack_maps[watcher_pos];
+  auto it = stack_map.find(output);
+  if (it == stack_map.end()) {
+    UnwindOutput copy = output;
+    copy.container_id = intern(output.container_id);
+    copy.exe_name = intern(output.exe_name);
+    copy.thread_name = intern(output.thread_name);
+    it = stack_map.emplace(std::move(copy), _stacks.size()).first;
+    _stacks.push_back({&it->first, watcher_pos, {0, 0, 0}});
+  }
+  if (pack.timestamp == 0) {
+    DDProfValuePack &total = _stacks[it->second]._total;
+    total.value += pack.value;
+    total.count += pack.count;
+  } else {
+    _timed_samples.push_back({it->second, pack});
+  }
+}
+
+void StackAccumulator::clear() {
+  _stack_maps.clear();
+  _stacks.clear();
+  _timed_samples.clear();
+  _strings.clear();
+}
+
+std::string_view StackAccumulator::intern(std::string_view str) {
+  auto it = _strings.find(str);
+  if (it == _strings.end()) {
+    it = _strings.emplace(str).first;
+  }
+  return *it;
+}
+
+} // namespace ddprof
@@ -5,6 +5,8 @@
 #include "stack_helper.hpp"
 #include "unwind_state.hpp"
 
+#include <algorithm>
+
 namespace ddprof {
 // read a word from the given stack
 bool memory_read(ProcessAddress_t addr, ElfWord_t *result, int regno,
@@ -152,6 +154,7 @@ bool memory_read(ProcessAddress_t addr, ElfWord_t *result, int regno,
     return false;
   }
   *result = *reinterpret_cast<const ElfWord_t *>(us->stack + stack_idx);
+  us->max_stack_read = std::max(us->max_stack_read, addr);
   return true;
 }
 
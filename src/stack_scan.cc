@@ -0,0 +1,152 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_scan.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+// Generic vectors: lowered to the SIMD instructions of the target
+using WordVec = uint64_t __attribute__((vector_size(32)));
+constexpr size_t k_words_per_vec = sizeof(WordVec) / sizeof(uint64_t);
+
+bool in_ranges(uint64_t word, std::span<const CodeRange> ranges) {
+  auto const it = std::upper_bound(
+      ranges.begin(), ranges.end(), word,
+      [](uint64_t value, const CodeRange &range) {
+        return value < range.start;
+      });
+  return it != ranges.begin() && word < std::prev(it)->end;
+}
+
+#if defined(__x86_64__)
+// Size of a "call r/m64" instruction (ff /2) from its ModRM and SIB bytes, 0
+// if it is not one
+size_t indirect_call_size(uint8_t modrm, uint8_t sib) {
+  constexpr uint8_t k_call_opcode_ext = 2;
+  if (((modrm >> 3) & 7) != k_call_opcode_ext) {
+    return 0;
+  }
+  uint8_t const mod = modrm >> 6;
+  uint8_t const rm = modrm & 7;
+  constexpr uint8_t k_rm_sib = 4;
+  constexpr uint8_t k_rm_disp32 = 5;
+  switch (mod) {
+  case 0:
+    if (rm == k_rm_sib) {
+      // No base register: a 32-bit displacement follows
+      return (sib & 7) == k_rm_disp32 ? 7 : 3;
+    }
+    return rm == k_rm_disp32 ? 6 : 2;
+  case 1:
+    return rm == k_rm_sib ? 4 : 3;
+  case 2:
+    return rm == k_rm_sib ? 7 : 6;
+  default:
+    return 2;
+  }
+}
+#endif
+} // namespace
+
+void find_code_addresses(std::span<const uint64_t> words,
+                         std::span<const CodeRange> ranges,
+                         std::vector<uint32_t> &positions) {
+  if (ranges.empty()) {
+    return;
+  }
+  uint64_t const low = ranges.front().start;
+  uint64_t const high = ranges.back().end;
+  size_t pos = 0;
+  for (; pos + k_words_per_vec <= words.size(); pos += k_words_per_vec) {
+    WordVec vec;
+    memcpy(&vec, words.data() + pos, sizeof(vec));
+    auto const in_bounds = (vec >= low) & (vec < high);
+    bool any = false;
+    for (size_t i = 0; i < k_words_per_vec; ++i) {
+      any |= in_bounds[i] != 0;
+    }
+    if (!any) {
+      continue;
+    }
+    for (size_t i = 0; i < k_words_per_vec; ++i) {
+      if (in_bounds[i] && in_ranges(vec[i], ranges)) {
+        positions.push_back(pos + i);
+      }
+    }
+  }
+  for (; pos < words.size(); ++pos) {
+    if (words[pos] >= low && words[pos] < high &&
+        in_ranges(words[pos], ranges)) {
+      positions.push_back(pos);
+    }
+  }
+}
+
+bool ends_with_call(std::span<const std::byte> code) {
+#if defined(__x86_64__)
+  auto byte_at = [&](size_t from_end) {
+    return static_cast<uint8_t>(code[code.size() - from_end]);
+  };
+  // call rel32
+  constexpr uint8_t k_call_rel32 = 0xe8;
+  constexpr size_t k_call_rel32_size = 5;
+  if (code.size() >= k_call_rel32_size &&
+      byte_at(k_call_rel32_size) == k_call_rel32) {
+    return true;
+  }
+  // call r/m64, possibly with prefixes
+  constexpr uint8_t k_call_indirect = 0xff;
+  for (size_t size = 2; size <= std::min(code.size(), k_max_call_size);
+       ++size) {
+    if (byte_at(size) == k_call_indirect &&
+        indirect_call_size(byte_at(size - 1),
+                           size >= 3 ? byte_at(size - 2) : 0) == size) {
+      return true;
+    }
+  }
+  return false;
+#elif defined(__aarch64__)
+  uint32_t insn;
+  if (code.size() < sizeof(insn)) {
+    return false;
+  }
+  memcpy(&insn, code.data() + code.size() - sizeof(insn), sizeof(insn));
+  // bl <label>
+  constexpr uint32_t k_bl_mask = 0xfc000000;
+  constexpr uint32_t k_bl = 0x94000000;
+  // blr <register>
+  constexpr uint32_t k_blr_mask = 0xfffffc1f;
+  constexpr uint32_t k_blr = 0xd63f0000;
+  return (insn & k_bl_mask) == k_bl || (insn & k_blr_mask) == k_blr;
+#else
+  return false;
+#endif
+}
+
+bool CodeReader::read_before(FileInfoId_t file_info_id,
+                             const std::string &path, Offset_t offset,
+                             std::span<std::byte> code) {
+  if (offset < code.size()) {
+    return false;
+  }
+  UniqueFd *fd = _files.find(file_info_id);
+  if (!fd) {
+    fd = &_files.emplace(file_info_id,
+                         open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  }
+  if (!*fd) {
+    return false;
+  }
+  return pread(fd->get(), code.data(), code.size(), offset - code.size()) ==
+      static_cast<ssize_t>(code.size());
+}
+
+} // namespace ddprof
@@ -0,0 +1,37 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_usage.hpp"
+
+namespace ddprof {
+
+uint32_t stack_tier_from_usage(const StackSizeTiers &tiers,
+                               std::span<const ProcessStackUsage> usages,
+                               uint32_t current_size) {
+  std::array<uint64_t, k_nb_stack_tiers> tier_samples{};
+  uint64_t nb_samples = 0;
+  for (const ProcessStackUsage &usage : usages) {
+    // Stacks bigger than the largest tier are truncated in any case
+    auto const it = std::ranges::lower_bound(tiers, usage.stack_bytes);
+    size_t const tier_idx = it != tiers.end() ? it - tiers.begin()
+                                              : k_nb_stack_tiers - 1;
+    tier_samples[tier_idx] += usage.nb_samples;
+    nb_samples += usage.nb_samples;
+  }
+  if (nb_samples == 0) {
+    return current_size;
+  }
+  uint64_t const target = (nb_samples * k_stack_usage_pct + 99) / 100;
+  uint64_t cumulated = 0;
+  for (size_t i = 0; i < k_nb_stack_tiers; ++i) {
+    cumulated += tier_samples[i];
+    if (cumulated >= target) {
+      return tiers[i];
+    }
+  }
+  return tiers.back();
+}
+
+} // namespace ddprof
@@ -0,0 +1,341 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "symbol_cache.hpp"
+
+#include "ddres_helpers.hpp"
+#include "logger.hpp"
+#include "unique_fd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace ddprof {
+
+namespace {
+// File layout (native endianness):
+//   FileHeader
+//   records: RecordHeader, then nb_frames x (FrameHeader, name, file)
+struct FileHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+};
+constexpr FileHeader k_file_header{.magic = {'D', 'D', 'S', 'C'},
+                                   .version = 1};
+
+struct RecordHeader {
+  uint64_t addr;
+  uint32_t nb_frames;
+  uint32_t size; // bytes of the frames
+};
+
+struct FrameHeader {
+  uint32_t line;
+  uint32_t name_size;
+  uint32_t file_size;
+};
+
+template <typename T> bool read_pod(std::span<const std::byte> &data, T &val) {
+  if (data.size() < sizeof(T)) {
+    return false;
+  }
+  memcpy(&val, data.data(), sizeof(T));
+  data = data.subspan(sizeof(T));
+  return true;
+}
+
+bool read_string(std::span<const std::byte> &data, uint32_t size,
+                 std::string_view &str) {
+  if (data.size() < size) {
+    return false;
+  }
+  str = {reinterpret_cast<const char *>(data.data()), size};
+  data = data.subspan(size);
+  return true;
+}
+
+template <typename T> void append_pod(std::string &buf, const T &val) {
+  buf.append(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+bool is_hex_string(std::string_view str) {
+  return std::ranges::all_of(
+      str, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+}
+
+DDRes write_all(int fd, std::string_view buf) {
+  while (!buf.empty()) {
+    ssize_t const ret = write(fd, buf.data(), buf.size());
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      DDRES_RETURN_WARN_LOG(DD_WHAT_SYMBOL_CACHE,
+                            "Unable to write symbol cache file");
+    }
+    buf.remove_prefix(ret);
+  }
+  return {};
+}
+} // namespace
+
+SymbolCacheFile::~SymbolCacheFile() {
+  if (_addr) {
+    munmap(_addr, _mapped_size);
+  }
+}
+
+DDRes SymbolCacheFile::load() {
+  UniqueFd const fd{open(_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd) {
+    // Not cached yet
+    return {};
+  }
+  struct stat st;
+  DDRES_CHECK_ERRNO(fstat(fd.get(), &st), DD_WHAT_SYMBOL_CACHE,
+                    "Unable to stat %s", _path.c_str());
+  if (static_cast<size_t>(st.st_size) <= sizeof(FileHeader)) {
+    return {};
+  }
+  void *addr =
+      mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+  if (addr == MAP_FAILED) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_SYMBOL_CACHE, "Unable to map %s",
+                          _path.c_str());
+  }
+  _addr = addr;
+  _mapped_size = st.st_size;
+  _valid_size = sizeof(FileHeader);
+
+  std::span<const std::byte> data{static_cast<const std::byte *>(_addr),
+                                  _mapped_size};
+  FileHeader header;
+  read_pod(data, header);
+  if (header.magic != k_file_header.magic ||
+      header.version != k_file_header.version) {
+    LG_NTC("Discarding symbol cache file %s (unknown format)", _path.c_str());
+    unlink(_path.c_str());
+    return {};
+  }
+
+  std::vector<CachedFrame> frames;
+  RecordHeader record_header;
+  while (read_pod(data, record_header)) {
+    if (record_header.size > data.size()) {
+      // Interrupted write
+      break;
+    }
+    std::span<const std::byte> record = data.first(record_header.size);
+    data = data.subspan(record_header.size);
+    _valid_size = _mapped_size - data.size();
+    frames.clear();
+    FrameHeader frame_header;
+    for (uint32_t i = 0; i < record_header.nb_frames; ++i) {
+      CachedFrame frame;
+      if (!read_pod(record, frame_header) ||
+          !read_string(record, frame_header.name_size, frame.name) ||
+          !read_string(record, frame_header.file_size, frame.file)) {
+        break;
+      }
+      frame.line = frame_header.line;
+      frames.push_back(frame);
+    }
+    if (frames.size() == record_header.nb_frames && !frames.empty()) {
+      index(record_header.addr, frames);
+    }
+  }
+  LG_DBG("Loaded %zu symbols from %s", _entries.size(), _path.c_str());
+  return {};
+}
+
+std::span<const CachedFrame> SymbolCacheFile::find(ElfAddress_t addr) const {
+  auto const it = _entries.find(addr);
+  if (it == _entries.end()) {
+    return {};
+  }
+  return std::span{_frames}.subspan(it->second.first_frame,
+                                    it->second.nb_frames);
+}
+
+void SymbolCacheFile::index(ElfAddress_t addr,
+                            std::span<const CachedFrame> frames) {
+  auto const [it, inserted] = _entries.try_emplace(
+      addr,
+      Entry{.first_frame = static_cast<uint32_t>(_frames.size()),
+            .nb_frames = static_cast<uint32_t>(frames.size())});
+  if (inserted) {
+    _frames.insert(_frames.end(), frames.begin(), frames.end());
+  }
+}
+
+void SymbolCacheFile::add(ElfAddress_t addr,
+                          std::span<const CachedFrame> frames) {
+  if (frames.empty() || _entries.contains(addr)) {
+    return;
+  }
+  auto intern = [this](std::string_view str) -> std::string_view {
+    auto it = _strings.find(str);
+    if (it == _strings.end()) {
+      it = _strings.emplace(str).first;
+    }
+    return *it;
+  };
+  std::vector<CachedFrame> interned;
+  interned.reserve(frames.size());
+  std::string record;
+  for (const CachedFrame &frame : frames) {
+    interned.push_back({.name = intern(frame.name),
+                        .file = intern(frame.file),
+                        .line = frame.line});
+    FrameHeader const frame_header{
+        .line = frame.line,
+        .name_size = static_cast<uint32_t>(frame.name.size()),
+        .file_size = static_cast<uint32_t>(frame.file.size())};
+    append_pod(record, frame_header);
+    record += frame.name;
+    record += frame.file;
+  }
+  index(addr, interned);
+  append_pod(_pending,
+             RecordHeader{.addr = addr,
+                          .nb_frames = static_cast<uint32_t>(frames.size()),
+                          .size = static_cast<uint32_t>(record.size())});
+  _pending += record;
+}
+
+DDRes SymbolCacheFile::flush() {
+  if (_pending.empty()) {
+    // Only mark the file as recently used
+    utimensat(AT_FDCWD, _path.c_str(), nullptr, 0);
+    return {};
+  }
+  std::string const pending = std::move(_pending);
+  _pending.clear();
+  constexpr mode_t k_read_write_user_only = 0600;
+  UniqueFd const fd{open(_path.c_str(),
+                         O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                         k_read_write_user_only)};
+  if (!fd) {
+    DDRES_RETURN_WARN_LOG(DD_WHAT_SYMBOL_CACHE, "Unable to open %s",
+                          _path.c_str());
+  }
+  // Several profilers can share the directory (lock released on close)
+  DDRES_CHECK_ERRNO(flock(fd.get(), LOCK_EX), DD_WHAT_SYMBOL_CACHE,
+                    "Unable to lock %s", _path.c_str());
+  struct stat st;
+  DDRES_CHECK_ERRNO(fstat(fd.get(), &st), DD_WHAT_SYMBOL_CACHE,
+                    "Unable to stat %s", _path.c_str());
+  if (static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    // New file (or interrupted creation)
+    DDRES_CHECK_ERRNO(ftruncate(fd.get(), 0), DD_WHAT_SYMBOL_CACHE,
+                      "Unable to truncate %s", _path.c_str());
+    DDRES_CHECK_FWD(write_all(
+        fd.get(), {reinterpret_cast<const char *>(&k_file_header),
+                   sizeof(k_file_header)}));
+  } else if (static_cast<size_t>(st.st_size) == _mapped_size &&
+             _valid_size < _mapped_size) {
+    // Drop the interrupted record we found when loading the file, if nothing
+    // was appended since
+    DDRES_CHECK_ERRNO(ftruncate(fd.get(), _valid_size), DD_WHAT_SYMBOL_CACHE,
+                      "Unable to truncate %s", _path.c_str());
+  }
+  return write_all(fd.get(), pending);
+}
+
+SymbolCache::SymbolCache(std::string dir, uint64_t max_bytes,
+                         bool inlined_functions)
+    : _dir(std::move(dir)), _max_bytes(max_bytes),
+      _suffix(inlined_functions ? ".inlined.sym" : ".sym") {}
+
+DDRes SymbolCache::init() {
+  std::error_code ec;
+  std::filesystem::create_directories(_dir, ec);
+  DDRES_CHECK_ERRORCODE(ec, DD_WHAT_SYMBOL_CACHE,
+                        "Unable to create symbol cache directory %s",
+                        _dir.c_str());
+  return {};
+}
+
+SymbolCacheFile *SymbolCache::get(std::string_view build_id) {
+  // Build ids are used as file names
+  if (build_id.empty() || !is_hex_string(build_id)) {
+    return nullptr;
+  }
+  std::string const key{build_id};
+  if (auto *file = _files.find(key)) {
+    file->visited = true;
+    return file;
+  }
+  auto &file = _files.emplace(key, _dir + '/' + key + std::string(_suffix));
+  if (IsDDResNotOK(file.load())) {
+    // Results are still added and written
+    LG_DBG("Unable to load symbol cache for %s", key.c_str());
+  }
+  return &file;
+}
+
+void SymbolCache::cycle() {
+  _cycle_stats = std::exchange(_stats, {});
+  _files.for_each([](const std::string &, SymbolCacheFile &file) {
+    if (file.visited) {
+      file.flush();
+    }
+  });
+  _files.erase_if([](const std::string &, SymbolCacheFile &file) {
+    return !file.visited;
+  });
+  _files.for_each(
+      [](const std::string &, SymbolCacheFile &file) { file.visited = false; });
+  _files.shrink(k_max_files);
+
+  // Least recently used files first
+  struct CacheFile {
+    std::filesystem::file_time_type last_use;
+    uint64_t size;
+    std::filesystem::path path;
+  };
+  std::vector<CacheFile> cache_files;
+  uint64_t total_size = 0;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(_dir, ec)) {
+    if (!entry.path().string().ends_with(".sym")) {
+      continue;
+    }
+    std::error_code time_ec;
+    std::error_code size_ec;
+    CacheFile cache_file{.last_use = entry.last_write_time(time_ec),
+                         .size = entry.file_size(size_ec),
+                         .path = entry.path()};
+    if (time_ec || size_ec) {
+      continue;
+    }
+    total_size += cache_file.size;
+    cache_files.push_back(std::move(cache_file));
+  }
+  if (total_size <= _max_bytes) {
+    return;
+  }
+  std::ranges::sort(cache_files, {}, &CacheFile::last_use);
+  for (const CacheFile &cache_file : cache_files) {
+    if (total_size <= _max_bytes) {
+      break;
+    }
+    // Mapped files remain valid
+    if (std::filesystem::remove(cache_file.path, ec)) {
+      total_size -= cache_file.size;
+    }
+  }
+}
+
+} // namespace ddprof
@@ -0,0 +1,59 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "symbol_hdr.hpp"
+
+namespace ddprof {
+
+namespace {
+// Avoid remapping all caches for a handful of elements
+constexpr size_t k_min_reclaimable_elements = 1024;
+// Minimum fraction of the table (1 / k_min_reclaimable_ratio) to reclaim
+constexpr size_t k_min_reclaimable_ratio = 4;
+
+bool worth_compacting(const EpochTracker &tracker, size_t table_size,
+                      uint32_t max_age) {
+  const size_t nb_stale = tracker.count_stale(table_size, max_age);
+  return nb_stale >= k_min_reclaimable_elements &&
+      nb_stale * k_min_reclaimable_ratio >= table_size;
+}
+} // namespace
+
+bool SymbolHdr::compact(uint32_t max_age, TableRemap &symbol_remap,
+                        TableRemap &mapinfo_remap) {
+  symbol_remap.clear();
+  mapinfo_remap.clear();
+  const bool compact_symbols =
+      worth_compacting(_symbol_epochs, _symbol_table.size(), max_age);
+  const bool compact_mapinfos =
+      worth_compacting(_mapinfo_epochs, _mapinfo_table.size(), max_age);
+  if (!compact_symbols && !compact_mapinfos) {
+    return false;
+  }
+
+  if (compact_symbols) {
+    const size_t previous_size = _symbol_table.size();
+    symbol_remap = compact_table(_symbol_table, _symbol_epochs, max_age);
+    _base_frame_symbol_lookup.remap(symbol_remap);
+    _common_symbol_lookup.remap(symbol_remap);
+    _dso_symbol_lookup.remap(symbol_remap);
+    _runtime_symbol_lookup.remap(symbol_remap);
+    _kernel_symbol_lookup.remap(symbol_remap);
+    LG_NTC("[SYMBOLS] Compacted symbol table (%lu -> %lu)", previous_size,
+           _symbol_table.size());
+  }
+  if (compact_mapinfos) {
+    const size_t previous_size = _mapinfo_table.size();
+    mapinfo_remap = compact_table(_mapinfo_table, _mapinfo_epochs, max_age);
+    _common_mapinfo_lookup.remap(mapinfo_remap);
+    _mapinfo_lookup.remap(mapinfo_remap);
+    _kernel_symbol_lookup.remap_mapinfo(mapinfo_remap);
+    LG_NTC("[SYMBOLS] Compacted mapinfo table (%lu -> %lu)", previous_size,
+           _mapinfo_table.size());
+  }
+  return true;
+}
+
+} // namespace ddprof
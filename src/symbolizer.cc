@@ -7,10 +7,12 @@
 
 #include "ddog_profiling_utils.hpp" // for write_location_blaze
 #include "ddres.hpp"
-#include "demangler/demangler.hpp"
+#include "defer.hpp"
 #include "logger.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <tuple>
 
 namespace ddprof {
 inline void write_location_no_sym(ElfAddress_t ip, const MapInfo &mapinfo,
@@ -21,35 +23,268 @@ inline void write_location_no_sym(ElfAddress_t ip, const MapInfo &mapinfo,
   ffi_location->address = ip;
 }
 
+namespace {
+// Same order as the locations: inlined functions first
+void to_cached_frames(const blaze_sym &sym, DemangleCache &demangle_cache,
+                      std::vector<CachedFrame> &frames) {
+  auto add_frame = [&](const char *name,
+                       const blaze_symbolize_code_info &info) {
+    frames.push_back(
+        {.name = name ? demangle_cache.demangle(name) : std::string_view{},
+         .file = info.file ? std::string_view{info.file} : std::string_view{},
+         .line = info.line});
+  };
+  for (unsigned i = 0; i < sym.inlined_cnt; ++i) {
+    add_frame(sym.inlined[i].name, sym.inlined[i].code_info);
+  }
+  add_frame(sym.name, sym.code_info);
+}
+} // namespace
+
+DDRes Symbolizer::init_symbol_cache(std::string dir, uint64_t max_bytes) {
+  auto symbol_cache = std::make_unique<SymbolCache>(std::move(dir), max_bytes,
+                                                    inlined_functions);
+  DDRES_CHECK_FWD(symbol_cache->init());
+  _symbol_cache = std::move(symbol_cache);
+  return {};
+}
+
 int Symbolizer::remove_unvisited() {
   // Remove all unvisited blaze_symbolizer instances from the map
-  const auto count = std::erase_if(_symbolizer_map, [](const auto &item) {
-    auto const &[key, blaze_symbolizer_wrapper] = item;
-    return !blaze_symbolizer_wrapper.visited;
-  });
+  const auto count = _symbolizer_map.erase_if(
+      [](FileInfoId_t, const BlazeSymbolizerWrapper &blaze_symbolizer_wrapper) {
+        return !blaze_symbolizer_wrapper.visited;
+      });
+  _symbolizer_map.shrink(k_max_symbolizers);
+  if (_symbol_cache) {
+    _symbol_cache->cycle();
+  }
   return count;
 }
 
 void Symbolizer::reset_unvisited_flag() {
   // Reset visited flag for the remaining entries
-  for (auto &item : _symbolizer_map) {
-    item.second.visited = false;
-  }
+  _symbolizer_map.for_each(
+      [](FileInfoId_t, BlazeSymbolizerWrapper &blaze_symbolizer_wrapper) {
+        blaze_symbolizer_wrapper.visited = false;
+      });
 }
 
 Symbolizer::BlazeSymbolizerWrapper &
 Symbolizer::get_symbolizer(FileInfoId_t file_id, const std::string &elf_src) {
-  if (auto it = _symbolizer_map.find(file_id); it != _symbolizer_map.end()) {
-    return it->second;
+  if (auto *symbolizer_wrapper = _symbolizer_map.find(file_id)) {
+    symbolizer_wrapper->visited = true;
+    return *symbolizer_wrapper;
   }
-  auto [it, inserted] = _symbolizer_map.emplace(
-      file_id, BlazeSymbolizerWrapper(elf_src, inlined_functions));
-  DDPROF_DCHECK_FATAL(inserted, "Unable to insert symbolizer object");
-  auto &symbolizer_wrapper = it->second;
+  auto &symbolizer_wrapper =
+      _symbolizer_map.emplace(file_id, elf_src, inlined_functions);
   symbolizer_wrapper.visited = true;
   return symbolizer_wrapper;
 }
 
+const blaze_result *
+Symbolizer::symbolize_elf(BlazeSymbolizerWrapper &symbolizer_wrapper,
+                          std::span<const ElfAddress_t> elf_addrs) {
+  blaze_symbolize_src_elf src_elf{
+      .type_size = sizeof(blaze_symbolize_src_elf),
+      .path = symbolizer_wrapper.elf_src.c_str(),
+      .debug_syms = symbolizer_wrapper.use_debug,
+      .reserved = {},
+  };
+
+  // Symbolize the addresses
+  const auto *blaze_res = blaze_symbolize_elf_virt_offsets(
+      symbolizer_wrapper.symbolizer.get(), &src_elf, elf_addrs.data(),
+      elf_addrs.size());
+  if (!blaze_res && symbolizer_wrapper.use_debug) {
+    // Symbolization failed, retry without using debug symbols
+    // blazesym curently does not support compressed debug sections:
+    // cf. https://github.com/libbpf/blazesym/issues/581
+    LG_NTC("Unable to symbolize with debug symbols, retrying for %s (%s)",
+           symbolizer_wrapper.elf_src.c_str(), blaze_err_str(blaze_err_last()));
+    symbolizer_wrapper.use_debug = false;
+    src_elf.debug_syms = false;
+    blaze_res = blaze_symbolize_elf_virt_offsets(
+        symbolizer_wrapper.symbolizer.get(), &src_elf, elf_addrs.data(),
+        elf_addrs.size());
+  }
+  if (blaze_res) {
+    DDPROF_DCHECK_FATAL(blaze_res->cnt == elf_addrs.size(),
+                        "Symbolizer: Mismatch between size of returned "
+                        "symbols and size of given elf addresses");
+  }
+  return blaze_res;
+}
+
+void Symbolizer::update_cache(SymbolCacheFile &cache,
+                              std::span<const ElfAddress_t> elf_addrs,
+                              FileInfoId_t file_id, const std::string &elf_src,
+                              std::pmr::memory_resource *resource,
+                              bool count_stats) {
+  std::pmr::vector<ElfAddress_t> missing_addrs(resource);
+  for (ElfAddress_t const addr : elf_addrs) {
+    if (cache.find(addr).empty()) {
+      missing_addrs.push_back(addr);
+    }
+  }
+  if (count_stats) {
+    SymbolCache::Stats &stats = _symbol_cache->stats();
+    stats._nb_hits += elf_addrs.size() - missing_addrs.size();
+    stats._nb_misses += missing_addrs.size();
+  }
+  if (missing_addrs.empty()) {
+    return;
+  }
+  // Only now is the file opened
+  auto &symbolizer_wrapper = get_symbolizer(file_id, elf_src);
+  const blaze_result *blaze_res =
+      symbolize_elf(symbolizer_wrapper, missing_addrs);
+  if (!blaze_res) {
+    return;
+  }
+  // Strings are copied by the cache
+  defer { blaze_result_free(blaze_res); };
+  std::vector<CachedFrame> frames;
+  for (size_t i = 0; i < blaze_res->cnt && i < missing_addrs.size(); ++i) {
+    frames.clear();
+    to_cached_frames(blaze_res->syms[i], _demangle_cache, frames);
+    cache.add(missing_addrs[i], frames);
+  }
+}
+
+DDRes Symbolizer::symbolize_cached(SymbolCacheFile &cache,
+                                   std::span<ElfAddress_t> elf_addrs,
+                                   std::span<ProcessAddress_t> process_addrs,
+                                   FileInfoId_t file_id,
+                                   const std::string &elf_src,
+                                   const MapInfo &map_info,
+                                   std::span<ddog_prof_Location> locations,
+                                   unsigned &write_index,
+                                   BlazeResultsWrapper &results) {
+  // Addresses of a batch were counted when it was symbolized
+  update_cache(cache, elf_addrs, file_id, elf_src,
+               results.blaze_results.get_allocator().resource(), !_in_batch);
+  for (size_t i = 0; i < elf_addrs.size(); ++i) {
+    ProcessAddress_t const addr =
+        _reported_addr_format == k_elf ? elf_addrs[i] : process_addrs[i];
+    std::span<const CachedFrame> const frames = cache.find(elf_addrs[i]);
+    if (frames.empty()) {
+      // Symbolization failed
+      if (write_index >= locations.size()) {
+        return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
+      }
+      write_location_no_sym(addr, map_info, &locations[write_index++]);
+      continue;
+    }
+    for (const CachedFrame &frame : frames) {
+      if (write_index >= locations.size()) {
+        return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
+      }
+      write_location(addr, frame.name,
+                     frame.file.empty() ? std::string_view{map_info._sopath}
+                                        : frame.file,
+                     frame.line, map_info, &locations[write_index++]);
+    }
+  }
+  return {};
+}
+
+// One call per file instead of one per stack and file: the setup of a call
+// (finding the file, parsing its symbols on first use) dominates when stacks
+// only have a couple of frames in each file.
+DDRes Symbolizer::symbolize_batch(const FileInfoVector &file_infos,
+                                  const MapInfoTable &mapinfo_table) {
+  _in_batch = true;
+  if (_disable_symbolization || _batch_addrs.empty()) {
+    return {};
+  }
+  std::sort(_batch_addrs.begin(), _batch_addrs.end(),
+            [](const BatchAddress &lhs, const BatchAddress &rhs) {
+              return std::tie(lhs.file_id, lhs.elf_addr) <
+                  std::tie(rhs.file_id, rhs.elf_addr);
+            });
+  _batch_addrs.erase(
+      std::unique(_batch_addrs.begin(), _batch_addrs.end(),
+                  [](const BatchAddress &lhs, const BatchAddress &rhs) {
+                    return lhs.file_id == rhs.file_id &&
+                        lhs.elf_addr == rhs.elf_addr;
+                  }),
+      _batch_addrs.end());
+  _batch_elf_addrs.reserve(_batch_addrs.size());
+  for (auto it = _batch_addrs.begin(); it != _batch_addrs.end();) {
+    FileInfoId_t const file_id = it->file_id;
+    const MapInfo &map_info = mapinfo_table[it->map_info_idx];
+    size_t const first_addr = _batch_elf_addrs.size();
+    for (; it != _batch_addrs.end() && it->file_id == file_id; ++it) {
+      _batch_elf_addrs.push_back(it->elf_addr);
+    }
+    std::span<const ElfAddress_t> const elf_addrs{
+        _batch_elf_addrs.data() + first_addr,
+        _batch_elf_addrs.size() - first_addr};
+    const std::string &elf_src = file_infos[file_id].get_path();
+    if (elf_src.empty()) {
+      continue;
+    }
+    if (SymbolCacheFile *cache =
+            _symbol_cache ? _symbol_cache->get(map_info._build_id) : nullptr) {
+      // Results are then read from the cache
+      update_cache(*cache, elf_addrs, file_id, elf_src,
+                   std::pmr::get_default_resource(), true);
+      continue;
+    }
+    auto &symbolizer_wrapper = get_symbolizer(file_id, elf_src);
+    const blaze_result *blaze_res =
+        symbolize_elf(symbolizer_wrapper, elf_addrs);
+    if (blaze_res) {
+      _batch_results.blaze_results.push_back(blaze_res);
+    }
+    _batch.emplace(file_id, FileBatch{.first_addr = first_addr,
+                                      .nb_addrs = elf_addrs.size(),
+                                      .blaze_res = blaze_res});
+  }
+  return {};
+}
+
+void Symbolizer::end_batch() {
+  _in_batch = false;
+  _batch_addrs.clear();
+  _batch_elf_addrs.clear();
+  _batch.clear();
+  for (const auto *result : _batch_results.blaze_results) {
+    blaze_result_free(result);
+  }
+  _batch_results.blaze_results.clear();
+}
+
+DDRes Symbolizer::symbolize_batched(const FileBatch &file_batch,
+                                    std::span<ElfAddress_t> elf_addrs,
+                                    std::span<ProcessAddress_t> process_addrs,
+                                    const MapInfo &map_info,
+                                    std::span<ddog_prof_Location> locations,
+                                    unsigned &write_index) {
+  std::span<const ElfAddress_t> const batch_addrs{
+      _batch_elf_addrs.data() + file_batch.first_addr, file_batch.nb_addrs};
+  for (size_t i = 0; i < elf_addrs.size(); ++i) {
+    ProcessAddress_t const addr =
+        _reported_addr_format == k_elf ? elf_addrs[i] : process_addrs[i];
+    auto const it = std::lower_bound(batch_addrs.begin(), batch_addrs.end(),
+                                     elf_addrs[i]);
+    if (!file_batch.blaze_res || it == batch_addrs.end() ||
+        *it != elf_addrs[i]) {
+      if (write_index >= locations.size()) {
+        return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
+      }
+      write_location_no_sym(addr, map_info, &locations[write_index++]);
+      continue;
+    }
+    DDRES_CHECK_FWD(write_location_blaze(
+        addr, _demangle_cache, map_info,
+        file_batch.blaze_res->syms[it - batch_addrs.begin()], write_index,
+        locations));
+  }
+  return {};
+}
+
 DDRes Symbolizer::symbolize_pprof(std::span<ElfAddress_t> elf_addrs,
                                   std::span<ProcessAddress_t> process_addrs,
                                   FileInfoId_t file_id,
@@ -57,53 +292,35 @@ DDRes Symbolizer::symbolize_pprof(std::span<ElfAddress_t> elf_addrs,
                                   const MapInfo &map_info,
                                   std::span<ddog_prof_Location> locations,
                                   unsigned &write_index,
-                                  BlazeResultsWrapper &results) {
+                                  BlazeResultsWrapper &results,
+                                  bool skip_symbolization) {
   if (elf_addrs.size() != process_addrs.size() || elf_addrs.empty() ||
       elf_src.empty()) {
     LG_WRN("Error in provided addresses when symbolizing pprofs");
     return ddres_warn(DD_WHAT_PPROF); // or some other error handling
   }
 
-  if (!_disable_symbolization) {
-    auto &symbolizer_wrapper = get_symbolizer(file_id, elf_src);
-
-    blaze_symbolize_src_elf src_elf{
-        .type_size = sizeof(blaze_symbolize_src_elf),
-        .path = symbolizer_wrapper.elf_src.c_str(),
-        .debug_syms = symbolizer_wrapper.use_debug,
-        .reserved = {},
-    };
-
-    // Symbolize the addresses
-    const auto *blaze_res = blaze_symbolize_elf_virt_offsets(
-        symbolizer_wrapper.symbolizer.get(), &src_elf, elf_addrs.data(),
-        elf_addrs.size());
-    if (!blaze_res && symbolizer_wrapper.use_debug) {
-      // Symbolization failed, retry without using debug symbols
-      // blazesym curently does not support compressed debug sections:
-      // cf. https://github.com/libbpf/blazesym/issues/581
-      LG_NTC("Unable to symbolize with debug symbols, retrying for %s (%s)",
-             elf_src.c_str(), blaze_err_str(blaze_err_last()));
-      symbolizer_wrapper.use_debug = false;
-      src_elf.debug_syms = false;
-      blaze_res = blaze_symbolize_elf_virt_offsets(
-          symbolizer_wrapper.symbolizer.get(), &src_elf, elf_addrs.data(),
-          elf_addrs.size());
+  if (!_disable_symbolization && !skip_symbolization) {
+    if (auto it = _batch.find(file_id); it != _batch.end()) {
+      return symbolize_batched(it->second, elf_addrs, process_addrs, map_info,
+                               locations, write_index);
+    }
+    if (SymbolCacheFile *cache =
+            _symbol_cache ? _symbol_cache->get(map_info._build_id) : nullptr) {
+      return symbolize_cached(*cache, elf_addrs, process_addrs, file_id,
+                              elf_src, map_info, locations, write_index,
+                              results);
     }
+    auto &symbolizer_wrapper = get_symbolizer(file_id, elf_src);
+    const auto *blaze_res = symbolize_elf(symbolizer_wrapper, elf_addrs);
     if (blaze_res) {
-      DDPROF_DCHECK_FATAL(blaze_res->cnt == elf_addrs.size(),
-                          "Symbolizer: Mismatch between size of returned "
-                          "symbols and size of given elf addresses");
       results.blaze_results.push_back(blaze_res);
-      // Demangling cache based on stability of unordered map
-      // This will be moved to the backend
       for (size_t i = 0; i < blaze_res->cnt && i < elf_addrs.size(); ++i) {
         const blaze_sym *cur_sym = blaze_res->syms + i;
         // Update the location
         DDRES_CHECK_FWD(write_location_blaze(
             _reported_addr_format == k_elf ? elf_addrs[i] : process_addrs[i],
-            symbolizer_wrapper.demangled_names, map_info, *cur_sym, write_index,
-            locations));
+            _demangle_cache, map_info, *cur_sym, write_index, locations));
       }
       return {};
     }
@@ -111,7 +328,7 @@ DDRes Symbolizer::symbolize_pprof(std::span<ElfAddress_t> elf_addrs,
 
   // Handle the case of no blaze result
   // This can happen when file descriptors are exhausted
-  // OR symbolization is disabled
+  // OR symbolization is disabled / skipped
   for (auto el : (_reported_addr_format == k_elf) ? elf_addrs : process_addrs) {
     write_location_no_sym(el, map_info, &locations[write_index++]);
   }
@@ -10,6 +10,7 @@
 #include "dso_hdr.hpp"
 #include "dwfl_wrapper.hpp"
 #include "logger.hpp"
+#include "perf.hpp"
 #include "signal_helper.hpp"
 #include "symbol_hdr.hpp"
 #include "unwind_dwfl.hpp"
@@ -19,6 +20,7 @@
 
 #include <algorithm>
 #include <array>
+#include <span>
 
 namespace ddprof {
 
@@ -47,7 +49,68 @@ void add_exe_name(UnwindState *us) {
 }
 
 void add_thread_name(Process &process, UnwindState *us) {
-  us->output.thread_name = process.get_or_insert_thread_name(us->output.tid);
+  us->output.thread_name =
+      us->process_hdr.get_thread_name(process, us->output.tid);
+}
+
+// Without kernel symbols (hidden addresses), kernel frames are skipped
+void add_kernel_frames(UnwindState *us, std::span<const uint64_t> ips) {
+  SymbolHdr &symbol_hdr = us->symbol_hdr;
+  for (uint64_t const ip : ips) {
+    if (is_max_stack_depth_reached(*us)) {
+      return;
+    }
+    MapInfoIdx_t map_idx = k_mapinfo_idx_null;
+    SymbolIdx_t const symbol_idx =
+        symbol_hdr._kernel_symbol_lookup.get_or_insert(
+            ip, symbol_hdr._symbol_table, symbol_hdr._mapinfo_table, map_idx);
+    if (symbol_idx != k_symbol_idx_null) {
+      add_frame(symbol_idx, k_file_info_undef, map_idx, ip, ip, us);
+    }
+  }
+}
+
+// Frame pointer chains break in code built without frame pointers: the chain
+// then stops early or on an address that is not code.
+bool is_callchain_truncated(UnwindState *us,
+                            std::span<const uint64_t> user_ips) {
+  constexpr size_t k_min_callchain_depth = 2;
+  if (user_ips.size() < k_min_callchain_depth) {
+    return true;
+  }
+  DsoHdr::DsoFindRes const find_res =
+      us->dso_hdr.dso_find_closest(us->pid, user_ips.back());
+  return !find_res.second || !find_res.first->second.is_executable();
+}
+
+DDRes unwind_stack_copy(Process &process, bool avoid_new_attach,
+                        UnwindState *us) {
+  us->dwarf_unwound = true;
+  return unwind_dwfl(process, avoid_new_attach, us);
+}
+
+DDRes unwind_stack(Process &process, bool avoid_new_attach, UnwindState *us) {
+  if (us->unwind_mode == EventConfUnwindMode::kDwarf) {
+    return unwind_stack_copy(process, avoid_new_attach, us);
+  }
+  PerfCallchain const callchain = perf_callchain_split(us->callchain);
+  add_kernel_frames(us, callchain.kernel);
+  bool const hybrid = us->unwind_mode == EventConfUnwindMode::kHybrid;
+  if (hybrid && process.callchain_truncated()) {
+    return unwind_stack_copy(process, avoid_new_attach, us);
+  }
+  ddprof_stats_add(STATS_UNWIND_CALLCHAIN_SAMPLES, 1, nullptr);
+  size_t const nb_kernel_frames = us->output.locs.size();
+  DDRes res = unwind_callchain(process, avoid_new_attach, callchain.user, us);
+  if (hybrid && IsDDResOK(res) && is_callchain_truncated(us, callchain.user)) {
+    // Following samples of the process are unwound with DWARF
+    LG_DBG("(PID%d) Truncated callchain, unwinding with DWARF", us->pid);
+    process.set_callchain_truncated();
+    ddprof_stats_add(STATS_UNWIND_CALLCHAIN_FALLBACKS, 1, nullptr);
+    us->output.locs.resize(nb_kernel_frames);
+    res = unwind_stack_copy(process, avoid_new_attach, us);
+  }
+  return res;
 }
 } // namespace
 
@@ -60,6 +123,10 @@ void unwind_init_sample(UnwindState *us, const uint64_t *sample_regs,
   memcpy(&us->initial_regs.regs[0], sample_regs,
          k_nb_registers_to_unwind * sizeof(uint64_t));
   us->current_ip = us->initial_regs.regs[REGNAME(PC)];
+  us->max_stack_read = 0;
+  us->dwarf_unwound = false;
+  us->callchain = {};
+  us->unwind_mode = EventConfUnwindMode::kDwarf;
   us->pid = sample_pid;
   us->stack_sz = sample_size_stack;
   us->stack = sample_data_stack;
@@ -68,19 +135,21 @@ void unwind_init_sample(UnwindState *us, const uint64_t *sample_regs,
 DDRes unwindstate_unwind(UnwindState *us) {
   DDRes res = ddres_init();
   Process &process = us->process_hdr.get(us->pid);
+  process.increment_counter();
   bool avoid_new_attach = false;
-  if (us->maximum_pids != k_unlimited_max_profiled_pids &&
-      us->process_hdr.process_count() >
-          static_cast<unsigned>(us->maximum_pids)) {
+  if (us->pid != 0 && us->maximum_pids != k_unlimited_max_profiled_pids) {
     // we limit number of pids heavily as we can not guarantee unwinding
     // does not open new files
-    // There is currently no priority in the processes that we should unwind
-    // So there could be a situation where we are stuck with PIDs that are not
-    // interesting.
-    avoid_new_attach = true;
+    // Processes with the most samples are prioritized
+    pid_t evicted_pid = -1;
+    avoid_new_attach = !us->process_hdr.admit(
+        process, static_cast<unsigned>(us->maximum_pids), evicted_pid);
+    if (evicted_pid != -1) {
+      unwind_pid_evict(us, evicted_pid);
+    }
   }
   if (us->pid != 0) { // we can not unwind pid 0
-    res = unwind_dwfl(process, avoid_new_attach, us);
+    res = unwind_stack(process, avoid_new_attach, us);
   }
   if (IsDDResNotOK(res)) {
     if (res._what == DD_WHAT_UW_MAX_PIDS) {
@@ -105,6 +174,12 @@ DDRes unwindstate_unwind(UnwindState *us) {
   return res;
 }
 
+void unwind_pid_evict(UnwindState *us, pid_t pid) {
+  // process state (sample counts) is kept to allow a later admission
+  us->dso_hdr.pid_free(pid);
+  us->symbol_hdr.clear(pid);
+}
+
 void unwind_pid_free(UnwindState *us, pid_t pid) {
   us->dso_hdr.pid_free(pid);
   us->symbol_hdr.clear(pid);
@@ -115,6 +190,10 @@ void unwind_cycle(UnwindState *us) {
   us->symbol_hdr.display_stats();
   us->symbol_hdr.cycle();
   us->process_hdr.display_stats();
+  us->process_hdr.cycle();
+  us->module_cache.remove_unused();
+  us->module_cache.reset_stats();
+  us->code_reader.clear();
   us->dso_hdr.stats().reset();
   unwind_metrics_reset();
 }
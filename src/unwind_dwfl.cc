@@ -11,12 +11,16 @@
 #include "dwfl_thread_callbacks.hpp"
 #include "logger.hpp"
 #include "runtime_symbol_lookup.hpp"
+#include "stack_scan.hpp"
 #include "symbol_hdr.hpp"
 #include "unique_fd.hpp"
 #include "unwind_helper.hpp"
 #include "unwind_state.hpp"
 
+#include <array>
 #include <fcntl.h>
+#include <span>
+#include <vector>
 
 namespace ddprof {
 
@@ -63,6 +67,12 @@ bool is_infinite_loop(UnwindState *us) {
 DDRes add_runtime_symbol_frame(UnwindState *us, const Dso &dso, ElfAddress_t pc,
                                std::string_view jitdump_path);
 
+// Register the module of pc and add its frame. Without dwfl_frame (frames
+// found by scanning the stack or by the kernel), pc is a return address
+// unless is_activation is set.
+DDRes add_pc_frame(UnwindState *us, ProcessAddress_t pc,
+                   Dwfl_Frame *dwfl_frame, bool is_activation = false);
+
 // returns an OK status if we should continue unwinding
 DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
   if (is_max_stack_depth_reached(*us)) {
@@ -79,6 +89,11 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
     add_error_frame(nullptr, us, pc, SymbolErrors::unwind_failure);
     return {}; // invalid pc : do not add frame
   }
+  return add_pc_frame(us, pc, dwfl_frame);
+}
+
+DDRes add_pc_frame(UnwindState *us, ProcessAddress_t pc,
+                   Dwfl_Frame *dwfl_frame, bool is_activation) {
   us->current_ip = pc;
   DsoHdr &dsoHdr = us->dso_hdr;
   DsoHdr::PidMapping &pid_mapping = dsoHdr.get_pid_mapping(us->pid);
@@ -131,7 +146,8 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
     // ensure unwinding backend has access to this module (and check
     // consistency)
     auto res = us->_dwfl_wrapper->register_mod(pc, find_res.first->second,
-                                               file_info_value, &ddprof_mod);
+                                               file_info_value,
+                                               us->module_cache, &ddprof_mod);
     if (IsDDResOK(res)) {
       break;
     }
@@ -157,9 +173,7 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
   // This means we need access to the module information.
   // Now that we have loaded the module, we can check if we are an activation
   // frame
-  bool is_activation = false;
-
-  if (!dwfl_frame_pc(dwfl_frame, &pc, &is_activation)) {
+  if (dwfl_frame && !dwfl_frame_pc(dwfl_frame, &pc, &is_activation)) {
     LG_DBG("Failure to compute frame PC: %s (depth#%lu)", dwfl_errmsg(-1),
            us->output.locs.size());
     add_error_frame(nullptr, us, pc, SymbolErrors::unwind_failure);
@@ -245,6 +259,72 @@ DDRes add_runtime_symbol_frame(UnwindState *us, const Dso &dso, ElfAddress_t pc,
   return add_frame(symbol_idx, k_file_info_undef, map_idx, pc,
                    pc - dso.start() + dso.offset(), us);
 }
+
+// Callers of the frame where unwinding stopped, guessed from the return
+// addresses left on the copied stack above the slots that were read.
+// Only values that point to file backed code right after a call instruction
+// are kept. Dead stack slots can still hold stale return addresses: the
+// recovered frames follow a [stack scan] frame.
+void scan_stack(UnwindState *us) {
+  if (is_max_stack_depth_reached(*us)) {
+    return;
+  }
+  const DsoHdr::PidMapping &pid_mapping = us->dso_hdr.get_pid_mapping(us->pid);
+  std::vector<CodeRange> ranges;
+  for (const auto &[start, dso] : pid_mapping._map) {
+    if (dso._type == DsoType::kStandard && dso.is_executable()) {
+      ranges.push_back({.start = dso.start(), .end = dso.end() + 1});
+    }
+  }
+  uint64_t const sp = us->initial_regs.regs[REGNAME(SP)];
+  ProcessAddress_t scan_start =
+      us->max_stack_read ? us->max_stack_read + sizeof(ElfWord_t) : sp;
+  // Return addresses are stored in aligned slots
+  scan_start = (scan_start + sizeof(ElfWord_t) - 1) & ~(sizeof(ElfWord_t) - 1);
+  if (scan_start < sp || scan_start >= sp + us->stack_sz) {
+    return;
+  }
+  uint64_t const stack_idx = scan_start - sp;
+  std::span<const uint64_t> const words{
+      reinterpret_cast<const uint64_t *>(us->stack + stack_idx),
+      (us->stack_sz - stack_idx) / sizeof(uint64_t)};
+  std::vector<uint32_t> positions;
+  find_code_addresses(words, ranges, positions);
+
+  bool scanned = false;
+  for (uint32_t const pos : positions) {
+    if (is_max_stack_depth_reached(*us)) {
+      break;
+    }
+    ProcessAddress_t const return_addr = words[pos];
+    DsoHdr::DsoFindRes const find_res =
+        DsoHdr::dso_find_closest(pid_mapping._map, return_addr);
+    if (!find_res.second) {
+      continue;
+    }
+    const Dso &dso = find_res.first->second;
+    FileInfoId_t const file_info_id = us->dso_hdr.get_or_insert_file_info(dso);
+    if (file_info_id <= k_file_info_error) {
+      continue;
+    }
+    std::array<std::byte, k_max_call_size> code;
+    if (!us->code_reader.read_before(
+            file_info_id,
+            us->dso_hdr.get_file_info_value(file_info_id).get_path(),
+            return_addr - dso.start() + dso.offset(), code) ||
+        !ends_with_call(code)) {
+      continue;
+    }
+    if (!scanned) {
+      add_common_frame(us, SymbolErrors::stack_scan);
+      scanned = true;
+    }
+    if (IsDDResNotOK(add_pc_frame(us, return_addr, nullptr))) {
+      break;
+    }
+    ddprof_stats_add(STATS_UNWIND_SCANNED_FRAMES, 1, nullptr);
+  }
+}
 } // namespace
 
 DDRes unwind_init_dwfl(Process &process, bool avoid_new_attach,
@@ -271,10 +351,37 @@ DDRes unwind_dwfl(Process &process, bool avoid_new_attach, UnwindState *us) {
   if (dwfl_getthread_frames(us->_dwfl_wrapper->_dwfl, us->pid, frame_cb, us) !=
       0) {
     trace_unwinding_end(us);
+    if (us->stack_scan) {
+      scan_stack(us);
+    }
   }
   res = !us->output.locs.empty() ? ddres_init()
                                  : ddres_warn(DD_WHAT_DWFL_LIB_ERROR);
   return res;
 }
 
+DDRes unwind_callchain(Process &process, bool avoid_new_attach,
+                       std::span<const uint64_t> ips, UnwindState *us) {
+  // Modules are registered to compute the ELF addresses of the frames
+  DDRes res = unwind_init_dwfl(process, avoid_new_attach, us);
+  if (!IsDDResOK(res)) {
+    LOG_ERROR_DETAILS(LG_DBG, res._what);
+    return res;
+  }
+  for (size_t i = 0; i < ips.size(); ++i) {
+    if (is_max_stack_depth_reached(*us)) {
+      add_common_frame(us, SymbolErrors::truncated_stack);
+      ddprof_stats_add(STATS_UNWIND_TRUNCATED_OUTPUT, 1, nullptr);
+      break;
+    }
+    ddprof_stats_add(STATS_UNWIND_FRAMES, 1, nullptr);
+    // The first address is the PC of the sample, the others return addresses
+    if (IsDDResNotOK(add_pc_frame(us, ips[i], nullptr, i == 0))) {
+      break;
+    }
+  }
+  return !us->output.locs.empty() ? ddres_init()
+                                  : ddres_warn(DD_WHAT_DWFL_LIB_ERROR);
+}
+
 } // namespace ddprof
@@ -22,7 +22,7 @@ void add_frame_without_mapping(UnwindState *us, SymbolIdx_t symbol_idx) {
 
 bool is_max_stack_depth_reached(const UnwindState &us) {
   // +2 to keep room for common base frame
-  return us.output.locs.size() + 2 >= kMaxStackDepth;
+  return us.output.locs.size() + 2 >= us.max_stack_depth;
 }
 
 DDRes add_frame(SymbolIdx_t symbol_idx, FileInfoId_t file_info_id,
@@ -39,6 +39,7 @@ DDRes add_frame(SymbolIdx_t symbol_idx, FileInfoId_t file_info_id,
         CommonMapInfoLookup::MappingErrors::empty,
         us->symbol_hdr._mapinfo_table);
   }
+  us->symbol_hdr.mark_used(symbol_idx, map_idx);
   output->locs.emplace_back(FunLoc{.ip = pc,
                                    .elf_addr = elf_addr,
                                    .file_info_id = file_info_id,
@@ -0,0 +1,143 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "adaptive_wakeup.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+
+// Simulation of the worker loop against per-CPU perf ring buffers, in steps of
+// one millisecond.
+// The kernel signals a ring buffer once it is half full (default wakeup
+// watermark). Once awake, the worker reads the ring buffers holding data at
+// a fixed throughput, then goes back to sleep.
+constexpr int k_nb_rings = 8;
+constexpr uint64_t k_event_size = 8192;
+constexpr uint64_t k_ring_events = 128; // 1 MiB ring buffers
+constexpr double k_worker_events_per_ms = 40;
+constexpr int64_t k_simulated_ms = 120'000;
+constexpr std::chrono::milliseconds k_fixed_timeout{100};
+
+enum class Load { kIdle, kSteady, kBursty };
+constexpr std::array k_load_names{"idle", "steady", "bursty"};
+
+// Events written per millisecond in a ring buffer
+double write_rate(Load load, int ring, int64_t time_ms) {
+  switch (load) {
+  case Load::kIdle:
+    return 0.001; // one sample per second
+  case Load::kSteady:
+    return 0.1 * (1 + ring);
+  case Load::kBursty:
+    // 2 seconds of heavy activity every 10 seconds, on half of the CPUs
+    return (time_ms % 10'000) < 2'000 && ring % 2 == 0 ? 8.0 : 0.01;
+  }
+  return 0;
+}
+
+struct Ring {
+  double pending_writes{};
+  uint64_t used{};
+  uint64_t writer_pos{};
+};
+
+struct LoopStats {
+  uint64_t wakeups{};
+  uint64_t idle_wakeups{};
+  uint64_t lost_events{};
+  uint64_t written_events{};
+};
+
+template <bool Adaptive> LoopStats simulate(Load load) {
+  std::array<Ring, k_nb_rings> rings{};
+  AdaptiveWakeup wakeup(k_nb_rings);
+  LoopStats stats;
+  auto const start = AdaptiveWakeup::Clock::time_point{};
+  int64_t next_wakeup_ms = k_fixed_timeout.count();
+  bool busy = false;
+  std::array<uint64_t, k_nb_rings> observed_pos{};
+  for (int64_t t = 0; t < k_simulated_ms; ++t) {
+    bool signaled = false;
+    for (int i = 0; i < k_nb_rings; ++i) {
+      Ring &ring = rings[i];
+      ring.pending_writes += write_rate(load, i, t);
+      for (; ring.pending_writes >= 1; ring.pending_writes -= 1) {
+        ++stats.written_events;
+        if (ring.used == k_ring_events) {
+          ++stats.lost_events;
+          continue;
+        }
+        ++ring.used;
+        ring.writer_pos += k_event_size;
+      }
+      signaled |= ring.used >= k_ring_events / 2;
+    }
+    if (!busy && (signaled || t >= next_wakeup_ms)) {
+      ++stats.wakeups;
+      bool new_data = false;
+      for (int i = 0; i < k_nb_rings; ++i) {
+        new_data |= rings[i].writer_pos != observed_pos[i];
+        observed_pos[i] = rings[i].writer_pos;
+        if constexpr (Adaptive) {
+          wakeup.observe(i, rings[i].writer_pos, k_ring_events * k_event_size,
+                         start + std::chrono::milliseconds{t});
+        }
+      }
+      stats.idle_wakeups += new_data ? 0 : 1;
+      busy = true;
+    }
+    if (busy) {
+      auto budget = static_cast<uint64_t>(k_worker_events_per_ms);
+      for (Ring &ring : rings) {
+        uint64_t const nb_read = std::min(budget, ring.used);
+        ring.used -= nb_read;
+        budget -= nb_read;
+      }
+      if (budget != 0) {
+        busy = false;
+        next_wakeup_ms = t + (Adaptive ? wakeup.timeout() : k_fixed_timeout)
+                                 .count();
+      }
+    }
+  }
+  return stats;
+}
+
+template <bool Adaptive> void BM_WorkerWakeups(benchmark::State &state) {
+  auto const load = static_cast<Load>(state.range(0));
+  state.SetLabel(k_load_names[state.range(0)]);
+  LoopStats stats;
+  for (auto _ : state) {
+    stats = simulate<Adaptive>(load);
+    benchmark::DoNotOptimize(stats);
+  }
+  double const simulated_s = static_cast<double>(k_simulated_ms) / 1000;
+  state.counters["wakeups/s"] =
+      static_cast<double>(stats.wakeups) / simulated_s;
+  state.counters["idle_wakeups/s"] =
+      static_cast<double>(stats.idle_wakeups) / simulated_s;
+  state.counters["lost_pct"] = stats.written_events
+      ? 100.0 * static_cast<double>(stats.lost_events) /
+          static_cast<double>(stats.written_events)
+      : 0;
+}
+
+} // namespace
+
+// Worker loop polling every k_sample_default_wakeup
+BENCHMARK(BM_WorkerWakeups<false>)->DenseRange(0, 2);
+// Worker loop with the timeout of AdaptiveWakeup
+BENCHMARK(BM_WorkerWakeups<true>)->DenseRange(0, 2);
+
+} // namespace ddprof
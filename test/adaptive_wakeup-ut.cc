@@ -0,0 +1,52 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "adaptive_wakeup.hpp"
+
+#include <gtest/gtest.h>
+
+namespace ddprof {
+
+using namespace std::chrono_literals;
+
+TEST(AdaptiveWakeup, idle_rings_sleep_longer) {
+  AdaptiveWakeup wakeup(2);
+  EXPECT_EQ(wakeup.timeout(), AdaptiveWakeup::k_max_timeout);
+
+  auto now = AdaptiveWakeup::Clock::now();
+  for (int i = 0; i < 10; ++i) {
+    wakeup.observe(0, 0, 1024 * 1024, now);
+    wakeup.observe(1, 4096, 1024 * 1024, now);
+    now += 100ms;
+  }
+  EXPECT_EQ(wakeup.timeout(), AdaptiveWakeup::k_max_timeout);
+}
+
+TEST(AdaptiveWakeup, busy_rings_wake_up_earlier) {
+  constexpr size_t k_ring_size = 1024 * 1024;
+  AdaptiveWakeup wakeup(2);
+  auto now = AdaptiveWakeup::Clock::now();
+  wakeup.observe(0, 0, k_ring_size, now);
+  wakeup.observe(1, 0, k_ring_size, now);
+  now += 100ms;
+  // 1 KiB/ms: a quarter of the ring fills up in 256 ms
+  wakeup.observe(0, 100 * 1024, k_ring_size, now);
+  wakeup.observe(1, 0, k_ring_size, now);
+  EXPECT_EQ(wakeup.timeout(), 256ms);
+
+  // bursts are taken into account immediately
+  now += 10ms;
+  wakeup.observe(0, 100 * 1024 + 10 * 64 * 1024, k_ring_size, now);
+  EXPECT_EQ(wakeup.timeout(), AdaptiveWakeup::k_min_timeout);
+
+  // and decay when the activity stops
+  for (int i = 0; i < 20; ++i) {
+    now += 100ms;
+    wakeup.observe(0, 100 * 1024 + 10 * 64 * 1024, k_ring_size, now);
+  }
+  EXPECT_EQ(wakeup.timeout(), AdaptiveWakeup::k_max_timeout);
+}
+
+} // namespace ddprof
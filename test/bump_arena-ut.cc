@@ -0,0 +1,42 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "bump_arena.hpp"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+
+namespace ddprof {
+
+TEST(BumpArena, rewind_reuses_memory) {
+  BumpArena arena(256);
+  std::pmr::vector<uint64_t> values(&arena);
+  values.reserve(8);
+  auto *first = values.data();
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % alignof(uint64_t), 0);
+  arena.rewind();
+  std::pmr::vector<uint64_t> other(&arena);
+  other.reserve(8);
+  EXPECT_EQ(other.data(), first);
+  EXPECT_EQ(arena.nb_chunks(), 1);
+}
+
+TEST(BumpArena, grow_and_release) {
+  BumpArena arena(64);
+  void *small = arena.allocate(48, 8);
+  // Does not fit in the first chunk, nor in a default sized one
+  void *large = arena.allocate(1024, 64);
+  EXPECT_NE(small, large);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(large) % 64, 0);
+  EXPECT_EQ(arena.nb_chunks(), 2);
+  arena.rewind();
+  // Chunks are kept until release
+  EXPECT_NE(arena.allocate(1024, 8), nullptr);
+  EXPECT_EQ(arena.nb_chunks(), 2);
+  arena.release();
+  EXPECT_EQ(arena.nb_chunks(), 1);
+}
+
+} // namespace ddprof
@@ -0,0 +1,30 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "cpu_budget.hpp"
+
+#include <gtest/gtest.h>
+
+namespace ddprof {
+
+TEST(CpuBudget, disabled) {
+  EXPECT_EQ(cpu_budget_period_scale(400, 1000, 0), k_nominal_period_scale_pct);
+}
+
+TEST(CpuBudget, adjust) {
+  // 20% budget, using 40%: double the period
+  uint32_t scale = cpu_budget_period_scale(100, 400, 20);
+  EXPECT_EQ(scale, 200);
+  // within [3/4 budget, budget]: keep the period
+  EXPECT_EQ(cpu_budget_period_scale(scale, 170, 20), 200);
+  // well below the budget: sample faster again
+  scale = cpu_budget_period_scale(scale, 50, 20);
+  EXPECT_EQ(scale, k_nominal_period_scale_pct);
+  // bounded slowdown
+  EXPECT_EQ(cpu_budget_period_scale(scale, 1000000, 1),
+            k_max_period_scale_pct);
+}
+
+} // namespace ddprof
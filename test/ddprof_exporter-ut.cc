@@ -5,15 +5,27 @@
 
 #include "exporter/ddprof_exporter.hpp"
 
+#include "defer.hpp"
+#include "exporter/export_queue.hpp"
 #include "loghandle.hpp"
 #include "pevent_lib_mocks.hpp"
 #include "pprof/ddprof_pprof.hpp"
 #include "tags.hpp"
 #include "unwind_output_mock.hpp"
 
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <stdexcept>
 #include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
 #include <utility>
 
 #include "symbol_hdr.hpp"
@@ -188,6 +200,206 @@ TEST(DDProfExporter, simple) {
   EXPECT_TRUE(IsDDResOK(res));
 }
 
+namespace {
+// Stand-in for the agent: answers requests with a 200 (or a 503 when it is
+// unavailable), after a delay
+class LocalHttpServer {
+public:
+  explicit LocalHttpServer(std::chrono::milliseconds latency = {})
+      : _latency(latency) {
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (_fd == -1 ||
+        bind(_fd, reinterpret_cast<sockaddr *>(&addr), addr_len) != 0 ||
+        listen(_fd, 16) != 0 ||
+        getsockname(_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) !=
+            0) {
+      throw std::runtime_error("Unable to start http server");
+    }
+    _port = ntohs(addr.sin_port);
+    _thread = std::thread([this] { run(); });
+  }
+  ~LocalHttpServer() {
+    _stop = true;
+    _thread.join();
+    close(_fd);
+  }
+  LocalHttpServer(const LocalHttpServer &) = delete;
+  LocalHttpServer &operator=(const LocalHttpServer &) = delete;
+
+  [[nodiscard]] std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(_port);
+  }
+  // Number of accepted requests
+  [[nodiscard]] int nb_requests() const { return _nb_requests; }
+  void set_available(bool available) { _available = available; }
+
+private:
+  void run() {
+    constexpr int k_poll_timeout_ms = 10;
+    constexpr std::string_view k_ok = "HTTP/1.1 200 OK\r\n"
+                                      "Content-Length: 0\r\n"
+                                      "Connection: close\r\n\r\n";
+    constexpr std::string_view k_unavailable =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+    while (!_stop) {
+      pollfd pfd{.fd = _fd, .events = POLLIN, .revents = 0};
+      if (poll(&pfd, 1, k_poll_timeout_ms) <= 0) {
+        continue;
+      }
+      int const client = accept(_fd, nullptr, nullptr);
+      if (client == -1) {
+        continue;
+      }
+      read_request(client);
+      std::this_thread::sleep_for(_latency);
+      bool const available = _available;
+      std::string_view const response = available ? k_ok : k_unavailable;
+      if (write(client, response.data(), response.size()) > 0 && available) {
+        ++_nb_requests;
+      }
+      close(client);
+    }
+  }
+
+  // Consume headers and body (content-length or chunked)
+  static void read_request(int client) {
+    constexpr std::string_view k_content_length = "content-length: ";
+    std::string request;
+    char buf[4096];
+    size_t expected_size = std::string::npos;
+    while (request.size() < expected_size) {
+      ssize_t const nb_read = read(client, buf, sizeof(buf));
+      if (nb_read <= 0) {
+        return;
+      }
+      request.append(buf, nb_read);
+      size_t const header_end = request.find("\r\n\r\n");
+      if (header_end == std::string::npos) {
+        continue;
+      }
+      std::string headers = request.substr(0, header_end);
+      std::transform(headers.begin(), headers.end(), headers.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      size_t const length_pos = headers.find(k_content_length);
+      if (length_pos != std::string::npos) {
+        expected_size = header_end + 4 +
+            std::stoul(headers.substr(length_pos + k_content_length.size()));
+      } else if (request.ends_with("0\r\n\r\n")) {
+        return;
+      }
+    }
+  }
+
+  int _fd{-1};
+  uint16_t _port{};
+  std::chrono::milliseconds _latency;
+  std::atomic<bool> _stop{false};
+  std::atomic<bool> _available{true};
+  std::atomic<int> _nb_requests{0};
+  std::thread _thread;
+};
+} // namespace
+
+TEST(DDProfExporter, slow_backend) {
+  LogHandle handle;
+  constexpr std::chrono::milliseconds k_latency{200};
+  LocalHttpServer server(k_latency);
+  std::string const url = server.url();
+
+  ExporterInput exporter_input;
+  std::pair<std::string, std::string> host_port{"127.0.0.1", "0"};
+  fill_mock_exporter_input(exporter_input, host_port, false);
+  exporter_input.url = url;
+  DDProfExporter exporter;
+  ASSERT_TRUE(IsDDResOK(ddprof_exporter_init(exporter_input, &exporter)));
+  exporter._debug_pprof_prefix = {};
+  UserTags user_tags({}, 4);
+  ASSERT_TRUE(IsDDResOK(ddprof_exporter_new(&user_tags, &exporter)));
+
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+  ctx.watchers.push_back(*ewatcher_from_str("sCPU"));
+  ASSERT_TRUE(IsDDResOK(pprof_create_profile(&pprof, ctx)));
+
+  constexpr int k_nb_profiles = 4;
+  {
+    ExportQueue<ExportJob> queue(2, [&exporter](ExportJob &job) {
+      return ddprof_exporter_send(job, &exporter);
+    });
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < k_nb_profiles; ++i) {
+      ExportJob job;
+      ASSERT_TRUE(IsDDResOK(ddprof_exporter_serialize(
+          &pprof._profile, pprof._tags, static_cast<uint32_t>(i), job)));
+      queue.push(std::move(job));
+    }
+    // Producer is never blocked by the backend
+    EXPECT_LT(std::chrono::steady_clock::now() - start, k_latency);
+    ASSERT_TRUE(queue.drain(std::chrono::seconds{10}));
+    EXPECT_GE(queue.nb_dropped(), 1);
+    EXPECT_EQ(queue.nb_sent() + queue.nb_dropped(), k_nb_profiles);
+    EXPECT_EQ(queue.nb_failed(), 0);
+    EXPECT_EQ(server.nb_requests(), queue.nb_sent());
+  }
+
+  EXPECT_TRUE(IsDDResOK(ddprof_exporter_free(&exporter)));
+  EXPECT_TRUE(IsDDResOK(pprof_free_profile(&pprof)));
+}
+
+TEST(DDProfExporter, spool_replay) {
+  LogHandle handle;
+  LocalHttpServer server;
+  std::string const url = server.url();
+  std::string spool_dir = (std::filesystem::temp_directory_path() /
+                           "ddprof_exporter-ut.XXXXXX")
+                              .string();
+  ASSERT_NE(mkdtemp(spool_dir.data()), nullptr);
+  defer { std::filesystem::remove_all(spool_dir); };
+
+  ExporterInput exporter_input;
+  std::pair<std::string, std::string> host_port{"127.0.0.1", "0"};
+  fill_mock_exporter_input(exporter_input, host_port, false);
+  exporter_input.url = url;
+  exporter_input.spool_dir = spool_dir;
+  DDProfExporter exporter;
+  ASSERT_TRUE(IsDDResOK(ddprof_exporter_init(exporter_input, &exporter)));
+  ASSERT_TRUE(exporter._spool);
+  exporter._debug_pprof_prefix = {};
+  UserTags user_tags({}, 4);
+  ASSERT_TRUE(IsDDResOK(ddprof_exporter_new(&user_tags, &exporter)));
+
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+  ctx.watchers.push_back(*ewatcher_from_str("sCPU"));
+  ASSERT_TRUE(IsDDResOK(pprof_create_profile(&pprof, ctx)));
+
+  // Agent is down: profiles are kept on disk
+  server.set_available(false);
+  constexpr uint32_t k_nb_spooled = 3;
+  for (uint32_t seq = 0; seq < k_nb_spooled; ++seq) {
+    EXPECT_FALSE(IsDDResFatal(
+        ddprof_exporter_export(&pprof._profile, pprof._tags, seq, &exporter)));
+  }
+  EXPECT_EQ(exporter._spool->size(), k_nb_spooled);
+  EXPECT_EQ(server.nb_requests(), 0);
+
+  // Agent is back: the new profile is sent, then the spooled ones
+  server.set_available(true);
+  EXPECT_TRUE(IsDDResOK(ddprof_exporter_export(&pprof._profile, pprof._tags,
+                                               k_nb_spooled, &exporter)));
+  EXPECT_EQ(exporter._spool->size(), 0);
+  EXPECT_EQ(server.nb_requests(), k_nb_spooled + 1);
+
+  EXPECT_TRUE(IsDDResOK(ddprof_exporter_free(&exporter)));
+  EXPECT_TRUE(IsDDResOK(pprof_free_profile(&pprof)));
+}
+
 } // namespace ddprof
 
 // todo very long url
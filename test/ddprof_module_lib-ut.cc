@@ -4,6 +4,7 @@
 // Datadog, Inc.
 
 #include "ddprof_module_lib.hpp"
+#include "ddres.hpp"
 
 #include <gtest/gtest.h>
 
@@ -33,4 +34,41 @@ TEST(ddprof_module_lib, find_build_id) {
               "ljHvxz7xDEEo-TQ3z9Op");
   }
 }
+
+TEST(ddprof_module_lib, load_shared_module) {
+  elf_version(EV_CURRENT);
+  ElfHandleCache elf_handles;
+  Elf *elf = nullptr;
+  auto res = elf_handles.get(2, UNIT_TEST_DATA "/gnu_exe", &elf);
+  ASSERT_TRUE(IsDDResOK(res));
+  SharedModule module;
+  res = load_shared_module(elf, UNIT_TEST_DATA "/gnu_exe", module);
+  ASSERT_TRUE(IsDDResOK(res));
+  EXPECT_EQ(module._build_id, "463bf6f201611ff6bda58b492c39760bdf91c64c");
+  ASSERT_FALSE(module._load_segments.empty());
+  EXPECT_LT(module._load_start, module._load_end);
+  const Segment &first_segment = module._load_segments.front();
+  EXPECT_EQ(module.find_segment(first_segment.offset), &first_segment);
+}
+
+TEST(ddprof_module_lib, elf_handle_cache) {
+  elf_version(EV_CURRENT);
+  ElfHandleCache elf_handles(1);
+  Elf *elf = nullptr;
+  ASSERT_TRUE(IsDDResOK(elf_handles.get(2, UNIT_TEST_DATA "/gnu_exe", &elf)));
+  Elf *same_elf = nullptr;
+  ASSERT_TRUE(
+      IsDDResOK(elf_handles.get(2, UNIT_TEST_DATA "/gnu_exe", &same_elf)));
+  EXPECT_EQ(elf, same_elf);
+  // Only one file can be kept open
+  ASSERT_TRUE(IsDDResOK(
+      elf_handles.get(3, UNIT_TEST_DATA "/gnu_exe_without_sections", &elf)));
+  EXPECT_EQ(elf_handles.size(), 1);
+  EXPECT_EQ(elf_handles.stats()._nb_hits, 1);
+  EXPECT_EQ(elf_handles.stats()._nb_evictions, 1);
+  // The file is reopened on demand
+  ASSERT_TRUE(IsDDResOK(elf_handles.get(2, UNIT_TEST_DATA "/gnu_exe", &elf)));
+  EXPECT_EQ(elf_kind(elf), ELF_K_ELF);
+  EXPECT_FALSE(IsDDResOK(elf_handles.get(4, "/not/a/file", &elf)));
+}
 } // namespace ddprof
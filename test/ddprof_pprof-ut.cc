@@ -6,20 +6,45 @@
 #include "pprof/ddprof_pprof.hpp"
 
 #include "ddog_profiling_utils.hpp"
+#include "ddprof_base.hpp"
 #include "ddprof_cmdline.hpp"
 #include "ddprof_cmdline_watcher.hpp"
 #include "loghandle.hpp"
 #include "pevent_lib_mocks.hpp"
 #include "symbol_hdr.hpp"
+#include "symbolizer.hpp"
 #include "unwind_output_mock.hpp"
 
+#include <atomic>
 #include <cstdlib>
 #include <fcntl.h>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <link.h>
 #include <string>
 #include <time.h>
 #include <unistd.h>
 
+namespace {
+// Count the C++ allocations of the tests that enable the counter
+std::atomic<bool> g_count_allocations{false};
+std::atomic<size_t> g_nb_allocations{0};
+} // namespace
+
+void *operator new(size_t size) {
+  if (g_count_allocations.load(std::memory_order_relaxed)) {
+    ++g_nb_allocations;
+  }
+  void *ptr = malloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
 namespace ddprof {
 TEST(DDProfPProf, init_profiles) {
   DDProfPProf pprof;
@@ -84,6 +109,53 @@ TEST(DDProfPProf, aggregate) {
   EXPECT_TRUE(IsDDResOK(res));
 }
 
+TEST(DDProfPProf, no_allocation_per_sample) {
+  LogHandle handle;
+  SymbolHdr symbol_hdr;
+  UnwindOutput mock_output;
+  fill_unwind_symbols(symbol_hdr._symbol_table, symbol_hdr._mapinfo_table,
+                      mock_output);
+  // All frames but the binary one need symbolization
+  FileInfoVector file_infos;
+  file_infos.emplace_back(FileInfo{}, k_file_info_error);
+  file_infos.emplace_back(FileInfo{"/app/bar.0.so", 0, 0}, 1);
+  for (size_t i = 0; i < mock_output.locs.size() - 1; ++i) {
+    mock_output.locs[i].symbol_idx = k_symbol_idx_null;
+    mock_output.locs[i].file_info_id = 1;
+  }
+  mock_output.locs.back().file_info_id = k_file_info_error;
+  mock_output.pid = 1234;
+  mock_output.tid = 1235;
+
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+  ASSERT_TRUE(watchers_from_str("sCPU", ctx.watchers));
+  ASSERT_TRUE(IsDDResOK(pprof_create_profile(&pprof, ctx)));
+  Symbolizer symbolizer(false, true);
+  auto aggregate = [&]() {
+    return pprof_aggregate(&mock_output, symbol_hdr, {1000, 1, 0},
+                           &ctx.watchers[0], file_infos, false, kSumPos,
+                           &symbolizer, &pprof);
+  };
+  // First sample warms up the label strings and the arena
+  ASSERT_TRUE(IsDDResOK(aggregate()));
+
+  constexpr int k_nb_samples = 100;
+  g_nb_allocations = 0;
+  g_count_allocations = true;
+  for (int i = 0; i < k_nb_samples; ++i) {
+    ASSERT_TRUE(IsDDResOK(aggregate()));
+  }
+  g_count_allocations = false;
+  EXPECT_EQ(g_nb_allocations.load(), 0);
+  EXPECT_EQ(pprof._arena.nb_chunks(), 1);
+
+  // Label strings outlive the cycle
+  ASSERT_TRUE(IsDDResOK(pprof_reset(&pprof)));
+  EXPECT_EQ(pprof._pid_str.size(), 2);
+  ASSERT_TRUE(IsDDResOK(pprof_free_profile(&pprof)));
+}
+
 TEST(DDProfPProf, just_live) {
   LogHandle handle;
   SymbolHdr symbol_hdr;
@@ -123,4 +195,67 @@ TEST(DDProfPProf, just_live) {
   EXPECT_TRUE(IsDDResOK(res));
 }
 
+namespace {
+DDPROF_NOINLINE int batch_test_function(int val) { return (val * 3) + 1; }
+
+// Address in the ELF file of this binary
+ElfAddress_t elf_address(const void *addr) {
+  uintptr_t bias = 0;
+  dl_iterate_phdr(
+      [](dl_phdr_info *info, size_t, void *data) {
+        // The main program comes first
+        *static_cast<uintptr_t *>(data) = info->dlpi_addr;
+        return 1;
+      },
+      &bias);
+  return reinterpret_cast<uintptr_t>(addr) - bias;
+}
+} // namespace
+
+TEST(DDProfPProf, batched_symbolization) {
+  LogHandle handle;
+  FileInfoVector file_infos;
+  file_infos.emplace_back(FileInfo{}, k_file_info_error);
+  file_infos.emplace_back(
+      FileInfo{std::filesystem::read_symlink("/proc/self/exe"), 0, 0}, 1);
+  MapInfoTable mapinfo_table;
+  mapinfo_table.emplace_back(0, 0, 0, std::string{"ddprof_pprof-ut"},
+                             BuildIdStr{});
+  ElfAddress_t const func_addr =
+      elf_address(reinterpret_cast<const void *>(&batch_test_function));
+  std::vector<ElfAddress_t> stack{func_addr + 1, func_addr};
+
+  Symbolizer symbolizer;
+  auto symbolize = [&]() {
+    std::array<ddog_prof_Location, 8> locations{};
+    Symbolizer::BlazeResultsWrapper results;
+    unsigned write_index = 0;
+    EXPECT_TRUE(IsDDResOK(symbolizer.symbolize_pprof(
+        stack, stack, 1, file_infos[1].get_path(), mapinfo_table[0],
+        locations, write_index, results)));
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < write_index; ++i) {
+      names.emplace_back(locations[i].function.name.ptr,
+                         locations[i].function.name.len);
+    }
+    return names;
+  };
+  std::vector<std::string> const names = symbolize();
+  ASSERT_EQ(names.size(), stack.size());
+  EXPECT_NE(names[0].find("batch_test_function"), std::string::npos);
+  EXPECT_EQ(names[1], names[0]);
+
+  // Addresses are deduplicated, results are the same
+  for (int i = 0; i < 3; ++i) {
+    for (ElfAddress_t const addr : stack) {
+      symbolizer.add_to_batch(1, addr, 0);
+    }
+  }
+  ASSERT_TRUE(IsDDResOK(
+      symbolizer.symbolize_batch(file_infos, mapinfo_table)));
+  EXPECT_EQ(symbolize(), names);
+  symbolizer.end_batch();
+  EXPECT_EQ(symbolize(), names);
+}
+
 } // namespace ddprof
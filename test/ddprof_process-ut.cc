@@ -70,13 +70,14 @@ TEST(DDProfProcess, simple_tid) {
   pthread_t test_thread;
   int ret = pthread_create(&test_thread, nullptr, thread_function, nullptr);
   ASSERT_EQ(ret, 0) << "Failed to create pthread";
+  // Wait for the thread to be named (names are read at once)
+  while (!s_tid.load())
+    sched_yield();
+  ASSERT_NE(s_tid.load(), 0) << "Thread TID should be set";
   ProcessHdr process_hdr{};
   Process &p = process_hdr.get(getpid());
   std::string_view s = p.get_or_insert_thread_name(gettid());
   LG_DBG("Main thread name is %s", s.data());
-  while (!s_tid.load())
-    sched_yield();
-  ASSERT_NE(s_tid.load(), 0) << "Thread TID should be set";
   std::string_view s2 = p.get_or_insert_thread_name(s_tid.load());
   LG_DBG("New thread name is %s", s2.data());
   EXPECT_EQ(s2, "TestThread");
@@ -84,4 +85,95 @@ TEST(DDProfProcess, simple_tid) {
   pthread_join(test_thread, nullptr);
 }
 
+TEST(DDProfProcess, thread_name_events) {
+  LogHandle handle;
+  ProcessHdr process_hdr{};
+  const pid_t mypid = getpid();
+  EXPECT_EQ(process_hdr.find(mypid), nullptr);
+  Process &p = process_hdr.get(mypid);
+  EXPECT_EQ(process_hdr.find(mypid), &p);
+  // Existing threads are read from /proc
+  EXPECT_FALSE(p.get_or_insert_thread_name(gettid()).empty());
+
+  // A thread is created (tid does not exist in /proc)
+  constexpr pid_t k_new_tid = 1430928460;
+  p.set_thread_name(gettid(), "main_thread");
+  p.inherit_thread_name(gettid(), k_new_tid);
+  EXPECT_EQ(p.get_or_insert_thread_name(k_new_tid), "main_thread");
+  // and renamed
+  p.set_thread_name(k_new_tid, "worker");
+  EXPECT_EQ(p.get_or_insert_thread_name(k_new_tid), "worker");
+  p.erase_thread_name(k_new_tid);
+  // no /proc lookup for unknown threads as thread events are received
+  EXPECT_TRUE(p.get_or_insert_thread_name(k_new_tid + 1).empty());
+}
+
+TEST(DDProfProcess, thread_names_proc_root) {
+  LogHandle handle;
+  ProcessHdr process_hdr(UNIT_TEST_DATA);
+  Process &p = process_hdr.get(2);
+  EXPECT_EQ(process_hdr.get_thread_name(p, 2), "test_main");
+  EXPECT_EQ(process_hdr.get_thread_name(p, 3), "test_worker");
+  EXPECT_TRUE(process_hdr.get_thread_name(p, 4).empty());
+}
+
+TEST(DDProfProcess, thread_name_after_exit) {
+  LogHandle handle;
+  ProcessHdr process_hdr{};
+  Process &p = process_hdr.get(getpid());
+  constexpr pid_t k_new_tid = 1430928460;
+  p.set_thread_name(k_new_tid, "short_lived");
+  p.erase_thread_name(k_new_tid);
+  // A sample of another CPU is processed after the exit of the thread
+  EXPECT_EQ(p.get_or_insert_thread_name(k_new_tid), "short_lived");
+  process_hdr.cycle();
+  EXPECT_TRUE(p.get_or_insert_thread_name(k_new_tid).empty());
+
+  // The tid is reused by a new thread before the end of the cycle
+  p.set_thread_name(gettid(), "main_thread");
+  p.erase_thread_name(k_new_tid);
+  p.inherit_thread_name(gettid(), k_new_tid);
+  process_hdr.cycle();
+  EXPECT_EQ(p.get_or_insert_thread_name(k_new_tid), "main_thread");
+}
+
+TEST(DDProfProcess, admission) {
+  LogHandle handle;
+  ProcessHdr process_hdr{};
+  constexpr unsigned k_max_pids = 2;
+  pid_t evicted_pid = -1;
+  auto add_samples = [&](pid_t pid, int nb_samples) {
+    Process &p = process_hdr.get(pid);
+    for (int i = 0; i < nb_samples; ++i) {
+      p.increment_counter();
+    }
+    return process_hdr.admit(p, k_max_pids, evicted_pid);
+  };
+  EXPECT_TRUE(add_samples(10, 100));
+  EXPECT_TRUE(add_samples(11, 5));
+  // limit is reached and running processes are protected for one cycle
+  EXPECT_FALSE(add_samples(12, 1000));
+  EXPECT_EQ(evicted_pid, -1);
+  process_hdr.cycle();
+  // samples of previous cycles have less weight
+  EXPECT_EQ(process_hdr.get(12).sample_score(), 500);
+  process_hdr.clear(12);
+
+  // not enough samples to be considered
+  EXPECT_FALSE(add_samples(12, 5));
+  EXPECT_EQ(evicted_pid, -1);
+  // pid 11 is replaced by the hottest new process
+  EXPECT_TRUE(add_samples(12, 200));
+  EXPECT_EQ(evicted_pid, 11);
+  EXPECT_FALSE(process_hdr.get(11).admitted());
+  EXPECT_EQ(process_hdr.admitted_count(), k_max_pids);
+  EXPECT_EQ(process_hdr.nb_evictions(), 1);
+
+  // pid 11 does not come back unless it is significantly hotter
+  EXPECT_FALSE(add_samples(11, 10));
+  process_hdr.clear(10);
+  EXPECT_EQ(process_hdr.admitted_count(), 1);
+  EXPECT_TRUE(add_samples(11, 1));
+}
+
 } // namespace ddprof
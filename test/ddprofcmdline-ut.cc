@@ -347,4 +347,28 @@ TEST(CmdLineTst, MultipleEvents) {
   ASSERT_TRUE(watchers_from_str(str, watchers));
   ASSERT_EQ(watchers.size(), 2);
 }
+
+TEST(CmdLineTst, UnwindModes) {
+  PerfWatcher watcher = {};
+  ASSERT_TRUE(watcher_from_str("sCPU unwind=fp", &watcher));
+  EXPECT_EQ(watcher.options.unwind_mode, EventConfUnwindMode::kCallchain);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_STACK_USER);
+
+  watcher = {};
+  ASSERT_TRUE(watcher_from_str("sCPU unwind=hybrid", &watcher));
+  EXPECT_EQ(watcher.options.unwind_mode, EventConfUnwindMode::kHybrid);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_STACK_USER);
+
+  watcher = {};
+  ASSERT_TRUE(watcher_from_str("sCPU", &watcher));
+  EXPECT_EQ(watcher.options.unwind_mode, EventConfUnwindMode::kDwarf);
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+
+  // Allocations are not sampled by the kernel
+  watcher = {};
+  EXPECT_FALSE(watcher_from_str("sALLOC unwind=fp", &watcher));
+  EXPECT_FALSE(watcher_from_str("sCPU unwind=apples", &watcher));
+}
 } // namespace ddprof
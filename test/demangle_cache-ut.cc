@@ -0,0 +1,80 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "demangler/demangle_cache.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+namespace ddprof {
+
+TEST(DemangleCache, demangle) {
+  DemangleCache cache;
+  std::string_view const name = cache.demangle("_Z3fooi");
+  EXPECT_EQ(name, "foo(int)");
+  EXPECT_EQ(cache.demangle("_Z3fooi").data(), name.data());
+  EXPECT_EQ(cache.demangle("_ZN4main4main17he714a2e23ed7db23E"), "main::main");
+  EXPECT_EQ(cache.demangle("not_mangled"), "not_mangled");
+  EXPECT_EQ(cache.size(), 3);
+
+  cache.cycle();
+  DemangleCache::Stats const stats = cache.cycle_stats();
+  EXPECT_EQ(stats._nb_hits, 1);
+  EXPECT_EQ(stats._nb_misses, 3);
+  EXPECT_EQ(stats._bytes,
+            std::string_view{"foo(int)main::mainnot_mangled"}.size());
+  // Mangled names are not kept
+  EXPECT_EQ(stats._bytes_saved,
+            std::string_view{"_Z3fooi"
+                             "_ZN4main4main17he714a2e23ed7db23E"
+                             "not_mangled"}
+                .size());
+}
+
+TEST(DemangleCache, shared_names) {
+  DemangleCache cache;
+  // Rust symbols of different builds only differ by their hash
+  std::string_view const name =
+      cache.demangle("_ZN4main4main17he714a2e23ed7db23E");
+  EXPECT_EQ(cache.demangle("_ZN4main4main17h0123456789abcdefE").data(),
+            name.data());
+  EXPECT_EQ(cache.size(), 2);
+  cache.cycle();
+  DemangleCache::Stats const stats = cache.cycle_stats();
+  EXPECT_EQ(stats._nb_misses, 2);
+  EXPECT_EQ(stats._bytes, name.size());
+  EXPECT_EQ(stats._bytes_saved,
+            (2 * std::string_view{"_ZN4main4main17he714a2e23ed7db23E"}.size()) +
+                name.size());
+}
+
+TEST(DemangleCache, bounded) {
+  DemangleCache cache(2);
+  cache.demangle("_Z3fooi");
+  cache.demangle("_Z3bari");
+  cache.demangle("_Z3bazi");
+  // Only bounded when cycling
+  EXPECT_EQ(cache.size(), 3);
+  cache.cycle();
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.cycle_stats()._nb_evictions, 1);
+
+  // Names used during the cycle are kept
+  cache.demangle("_Z3fooi");
+  cache.demangle("_Z3bari");
+  cache.demangle("_Z3bazi");
+  cache.demangle("_Z3quxi");
+  cache.demangle("_Z3quxi");
+  cache.cycle();
+  EXPECT_EQ(cache.size(), 2);
+  DemangleCache::Stats const stats = cache.cycle_stats();
+  EXPECT_EQ(stats._nb_hits, 3);
+  EXPECT_EQ(stats._nb_misses, 2);
+  EXPECT_EQ(stats._nb_evictions, 2);
+  EXPECT_EQ(stats._bytes, 2 * std::string_view{"foo(int)"}.size());
+  EXPECT_EQ(stats._bytes_saved, 2 * std::string_view{"_Z3fooi"}.size());
+}
+
+} // namespace ddprof
@@ -62,6 +62,7 @@ TEST(DwflModule, inconsistency_test) {
   // Check that we found the DSO matching this IP
   ASSERT_TRUE(find_res.second);
   {
+    DwflModuleCache module_cache;
     DwflWrapper dwfl_wrapper;
     dwfl_wrapper.attach(my_pid, unique_elf, nullptr);
     // retrieve the map associated to pid
@@ -79,7 +80,8 @@ TEST(DwflModule, inconsistency_test) {
           dso_hdr.get_file_info_value(file_info_id);
       DDProfMod *ddprof_mod = nullptr;
       auto res = dwfl_wrapper.register_mod(dso._start, it->second,
-                                           file_info_value, &ddprof_mod);
+                                           file_info_value, module_cache,
+                                           &ddprof_mod);
 
       ASSERT_TRUE(IsDDResOK(res));
       ASSERT_TRUE(ddprof_mod->_mod);
@@ -123,6 +125,8 @@ TEST(DwflModule, short_lived) {
   // Load DSOs from our unit test
   ElfAddress_t ip = _THIS_IP_;
   DsoHdr dso_hdr;
+  // Shared across processes
+  DwflModuleCache module_cache;
 
   pid_t child_pid = fork();
   if (child_pid == 0) {
@@ -153,7 +157,8 @@ TEST(DwflModule, short_lived) {
           dso_hdr.get_file_info_value(file_info_id);
       DDProfMod *ddprof_mod = nullptr;
       auto res = dwfl_wrapper.register_mod(dso._start, it->second,
-                                           file_info_value, &ddprof_mod);
+                                           file_info_value, module_cache,
+                                           &ddprof_mod);
       ASSERT_TRUE(IsDDResOK(res));
       ASSERT_TRUE(ddprof_mod->_mod);
     }
@@ -190,11 +195,48 @@ TEST(DwflModule, short_lived) {
           dso_hdr.get_file_info_value(file_info_id);
       DDProfMod *ddprof_mod = nullptr;
       auto res = dwfl_wrapper.register_mod(dso._start, it->second,
-                                           file_info_value, &ddprof_mod);
+                                           file_info_value, module_cache,
+                                           &ddprof_mod);
       ASSERT_TRUE(IsDDResOK(res));
       ASSERT_TRUE(ddprof_mod->_mod);
     }
   }
+  // Elf files were parsed for the first pid only
+  EXPECT_GT(module_cache.stats()._nb_hits, 0);
+  EXPECT_GT(module_cache.size(), 0);
+  // No process is referencing the files anymore
+  EXPECT_GT(module_cache.remove_unused(), 0);
+  EXPECT_EQ(module_cache.size(), 0);
+}
+
+TEST(DwflModule, replaced_module) {
+  LogHandle handle;
+  pid_t my_pid = getpid();
+  ElfAddress_t ip = _THIS_IP_;
+  DsoHdr dso_hdr;
+  DsoHdr::DsoFindRes find_res = dso_hdr.dso_find_or_backpopulate(my_pid, ip);
+  ASSERT_TRUE(find_res.second);
+  UniqueElf unique_elf = create_elf_from_self();
+  DwflModuleCache module_cache;
+  {
+    DwflWrapper dwfl_wrapper;
+    dwfl_wrapper.attach(my_pid, unique_elf, nullptr);
+    const Dso &dso = find_res.first->second;
+    FileInfoId_t file_info_id = dso_hdr.get_or_insert_file_info(dso);
+    ASSERT_TRUE(file_info_id > k_file_info_error);
+    DDProfMod *ddprof_mod = nullptr;
+    auto res = dwfl_wrapper.register_mod(
+        dso._start, dso, dso_hdr.get_file_info_value(file_info_id),
+        module_cache, &ddprof_mod);
+    ASSERT_TRUE(IsDDResOK(res));
+    Dwfl_Module *mod = ddprof_mod->_mod;
+    // The module stays reported once ddprof forgets about it
+    dwfl_wrapper._ddprof_mods.clear();
+    EXPECT_EQ(module_cache.remove_unused(), 0);
+    Dwarf_Addr bias = 0;
+    EXPECT_TRUE(dwfl_module_getelf(mod, &bias));
+  }
+  EXPECT_GT(module_cache.remove_unused(), 0);
 }
 
 } // namespace ddprof
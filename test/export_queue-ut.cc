@@ -0,0 +1,70 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "exporter/export_queue.hpp"
+
+#include <gtest/gtest.h>
+#include <latch>
+#include <vector>
+
+namespace ddprof {
+
+TEST(ExportQueue, send_in_order) {
+  std::vector<int> sent;
+  ExportQueue<int> queue(4, [&](int &job) {
+    sent.push_back(job);
+    return DDRes{};
+  });
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  ASSERT_TRUE(queue.drain(std::chrono::seconds{5}));
+  EXPECT_EQ(sent, (std::vector<int>{0, 1, 2}));
+  EXPECT_EQ(queue.nb_sent(), 3);
+  EXPECT_FALSE(queue.error());
+}
+
+TEST(ExportQueue, drop_oldest) {
+  std::latch sending{1};
+  std::latch release{1};
+  std::vector<int> sent;
+  ExportQueue<int> queue(2, [&](int &job) {
+    if (job == 0) {
+      // Simulate a slow upload
+      sending.count_down();
+      release.wait();
+    }
+    sent.push_back(job);
+    return DDRes{};
+  });
+  EXPECT_TRUE(queue.push(0));
+  sending.wait();
+  // The export thread is stuck: pushes do not wait for it
+  EXPECT_TRUE(queue.push(1));
+  EXPECT_TRUE(queue.push(2));
+  EXPECT_FALSE(queue.push(3));
+  EXPECT_EQ(queue.size(), 2);
+  EXPECT_FALSE(queue.drain(std::chrono::milliseconds{10}));
+  release.count_down();
+  ASSERT_TRUE(queue.drain(std::chrono::seconds{5}));
+  EXPECT_EQ(sent, (std::vector<int>{0, 2, 3}));
+  EXPECT_EQ(queue.nb_dropped(), 1);
+}
+
+TEST(ExportQueue, errors) {
+  ExportQueue<int> queue(2, [](int &job) {
+    return job == 0 ? ddres_warn(DD_WHAT_EXPORTER)
+                    : ddres_error(DD_WHAT_EXPORTER);
+  });
+  queue.push(0);
+  ASSERT_TRUE(queue.drain(std::chrono::seconds{5}));
+  EXPECT_FALSE(queue.error());
+  queue.push(1);
+  ASSERT_TRUE(queue.drain(std::chrono::seconds{5}));
+  EXPECT_TRUE(queue.error());
+  EXPECT_EQ(queue.nb_failed(), 2);
+}
+
+} // namespace ddprof
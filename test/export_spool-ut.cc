@@ -0,0 +1,165 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "exporter/export_spool.hpp"
+
+#include "ddres.hpp"
+#include "loghandle.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string_view>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+struct SpoolDir {
+  SpoolDir() {
+    std::string tmpl = (std::filesystem::temp_directory_path() /
+                        "export_spool-ut.XXXXXX")
+                           .string();
+    path = mkdtemp(tmpl.data());
+  }
+  ~SpoolDir() { std::filesystem::remove_all(path); }
+  std::string path;
+};
+
+SpooledProfile make_profile(uint32_t seq,
+                            std::chrono::system_clock::time_point end =
+                                std::chrono::system_clock::now()) {
+  auto const end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end.time_since_epoch());
+  return {.start = end_ns - std::chrono::seconds{60},
+          .end = end_ns,
+          .profile_seq = seq};
+}
+
+DDRes store(ExportSpool &spool, const SpooledProfile &profile,
+            std::string_view payload, const Tags &tags = {}) {
+  return spool.store(profile, tags, [&](int fd) {
+    EXPECT_EQ(write(fd, payload.data(), payload.size()),
+              static_cast<ssize_t>(payload.size()));
+    return DDRes{};
+  });
+}
+
+std::string load_payload(const ExportSpool &spool,
+                         const SpooledProfile &profile, Tags &tags) {
+  std::vector<std::byte> payload;
+  EXPECT_TRUE(IsDDResOK(spool.load(profile, payload, tags)));
+  return {reinterpret_cast<const char *>(payload.data()), payload.size()};
+}
+
+constexpr ExportSpoolLimits k_unlimited_replays{
+    .max_replays_per_interval = 1000};
+} // namespace
+
+TEST(ExportSpool, replay_oldest_first) {
+  LogHandle handle;
+  SpoolDir dir;
+  ExportSpool spool(dir.path, k_unlimited_replays);
+  ASSERT_TRUE(IsDDResOK(spool.init()));
+  Tags const tags{{"service", "my:service"}, {"env", "prod"}};
+  ASSERT_TRUE(IsDDResOK(store(spool, make_profile(1), "first", tags)));
+  ASSERT_TRUE(IsDDResOK(store(spool, make_profile(2), "second")));
+  EXPECT_EQ(spool.size(), 2);
+  EXPECT_EQ(spool.nb_bytes(), 11);
+
+  auto profile = spool.next_replay();
+  ASSERT_TRUE(profile);
+  EXPECT_EQ(profile->profile_seq, 1);
+  Tags loaded_tags;
+  EXPECT_EQ(load_payload(spool, *profile, loaded_tags), "first");
+  EXPECT_EQ(loaded_tags, tags);
+  spool.remove(*profile);
+
+  profile = spool.next_replay();
+  ASSERT_TRUE(profile);
+  EXPECT_EQ(load_payload(spool, *profile, loaded_tags), "second");
+  EXPECT_TRUE(loaded_tags.empty());
+  spool.remove(*profile);
+  EXPECT_FALSE(spool.next_replay());
+  EXPECT_TRUE(std::filesystem::is_empty(dir.path));
+}
+
+TEST(ExportSpool, recovery) {
+  LogHandle handle;
+  SpoolDir dir;
+  {
+    ExportSpool spool(dir.path, k_unlimited_replays);
+    ASSERT_TRUE(IsDDResOK(spool.init()));
+    auto const now = std::chrono::system_clock::now();
+    ASSERT_TRUE(IsDDResOK(store(spool, make_profile(2, now), "second")));
+    ASSERT_TRUE(IsDDResOK(store(spool, make_profile(1, now), "first")));
+    // Write interrupted by a crash
+    EXPECT_FALSE(IsDDResOK(spool.store(make_profile(3), {}, [](int) {
+      return ddres_error(DD_WHAT_UNITTEST);
+    })));
+  }
+  std::ofstream(dir.path + "/4-4-4.pprof.lz4.tmp") << "partial";
+  std::ofstream(dir.path + "/5-5-5.tags") << "orphan:tags";
+
+  ExportSpool spool(dir.path, k_unlimited_replays);
+  ASSERT_TRUE(IsDDResOK(spool.init()));
+  ASSERT_EQ(spool.size(), 2);
+  auto profile = spool.next_replay();
+  ASSERT_TRUE(profile);
+  EXPECT_EQ(profile->profile_seq, 1);
+  // Only the two profiles and their tags remain
+  auto const nb_files = std::distance(
+      std::filesystem::directory_iterator(dir.path), {});
+  EXPECT_EQ(nb_files, 4);
+}
+
+TEST(ExportSpool, limits) {
+  LogHandle handle;
+  SpoolDir dir;
+  ExportSpoolLimits limits = k_unlimited_replays;
+  limits.max_bytes = 10;
+  limits.max_age = std::chrono::minutes{10};
+  ExportSpool spool(dir.path, limits);
+  ASSERT_TRUE(IsDDResOK(spool.init()));
+
+  // Too old to be kept
+  auto const now = std::chrono::system_clock::now();
+  ASSERT_TRUE(IsDDResOK(
+      store(spool, make_profile(0, now - std::chrono::hours{1}), "old")));
+  EXPECT_EQ(spool.size(), 0);
+  EXPECT_EQ(spool.nb_evicted(), 1);
+
+  // Size: oldest profiles are evicted
+  for (uint32_t seq = 1; seq <= 4; ++seq) {
+    ASSERT_TRUE(IsDDResOK(store(spool, make_profile(seq), "1234")));
+  }
+  EXPECT_EQ(spool.size(), 2);
+  EXPECT_EQ(spool.nb_bytes(), 8);
+  EXPECT_EQ(spool.next_replay()->profile_seq, 3);
+
+  spool.enforce_limits(now + std::chrono::hours{1});
+  EXPECT_EQ(spool.size(), 0);
+}
+
+TEST(ExportSpool, replay_rate) {
+  LogHandle handle;
+  SpoolDir dir;
+  ExportSpoolLimits const limits{.max_replays_per_interval = 2,
+                                 .replay_interval = std::chrono::hours{1}};
+  ExportSpool spool(dir.path, limits);
+  ASSERT_TRUE(IsDDResOK(spool.init()));
+  for (uint32_t seq = 0; seq < 3; ++seq) {
+    ASSERT_TRUE(IsDDResOK(store(spool, make_profile(seq), "data")));
+  }
+  for (int i = 0; i < 2; ++i) {
+    auto profile = spool.next_replay();
+    ASSERT_TRUE(profile);
+    spool.remove(*profile);
+  }
+  EXPECT_FALSE(spool.next_replay());
+  EXPECT_EQ(spool.size(), 1);
+}
+
+} // namespace ddprof
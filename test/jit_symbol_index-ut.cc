@@ -0,0 +1,107 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "jit/jit_symbol_index.hpp"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace ddprof {
+
+TEST(JITSymbolIndex, lookup) {
+  JITSymbolIndex index;
+  EXPECT_EQ(index.find(0x1000), -1);
+  index.insert(0x2000, 0x100, 2);
+  index.insert(0x1000, 0x100, 1);
+  EXPECT_EQ(index.find(0x0fff), -1);
+  EXPECT_EQ(index.find(0x1000), 1);
+  EXPECT_EQ(index.find(0x10ff), 1);
+  EXPECT_EQ(index.find(0x1100), -1);
+  EXPECT_EQ(index.find(0x2050), 2);
+  EXPECT_EQ(index.find(0x2100), -1);
+  EXPECT_EQ(index.size(), 2);
+}
+
+TEST(JITSymbolIndex, newer_overwrites) {
+  JITSymbolIndex index;
+  index.insert(0x1000, 0x1000, 1);
+  EXPECT_EQ(index.find(0x1000), 1);
+  // Region reused in the middle: the older symbol is split
+  index.insert(0x1400, 0x200, 2);
+  EXPECT_EQ(index.find(0x13ff), 1);
+  EXPECT_EQ(index.find(0x1400), 2);
+  EXPECT_EQ(index.find(0x15ff), 2);
+  EXPECT_EQ(index.find(0x1600), 1);
+  EXPECT_EQ(index.size(), 3);
+
+  // Overlaps within the same batch of insertions: last one wins
+  index.insert(0x1000, 0x800, 3);
+  index.insert(0x1100, 0x100, 4);
+  index.insert(0x1000, 0x80, 5);
+  EXPECT_EQ(index.find(0x1000), 5);
+  EXPECT_EQ(index.find(0x1080), 3);
+  EXPECT_EQ(index.find(0x1150), 4);
+  EXPECT_EQ(index.find(0x1500), 3);
+  EXPECT_EQ(index.find(0x1800), 1);
+  EXPECT_EQ(index.find(0x1fff), 1);
+  EXPECT_EQ(index.find(0x2000), -1);
+
+  // Fully covered
+  index.insert(0x0, 0x10000, 6);
+  EXPECT_EQ(index.find(0x1150), 6);
+  EXPECT_EQ(index.size(), 1);
+}
+
+TEST(JITSymbolIndex, older_in_same_batch) {
+  JITSymbolIndex index;
+  // The newer interval starts first, the older one only keeps its tail
+  index.insert(0x1100, 0x200, 1);
+  index.insert(0x1000, 0x200, 2);
+  EXPECT_EQ(index.find(0x1000), 2);
+  EXPECT_EQ(index.find(0x11ff), 2);
+  EXPECT_EQ(index.find(0x1200), 1);
+  EXPECT_EQ(index.find(0x12ff), 1);
+  EXPECT_EQ(index.find(0x1300), -1);
+}
+
+TEST(JITSymbolIndex, many_refreshes) {
+  JITSymbolIndex index;
+  constexpr int k_nb_symbols = 5000; // above k_min_merge_size
+  constexpr Offset_t k_size = 0x10;
+  // Symbols are looked up as they are added, as done with perf-maps
+  for (int i = 0; i < k_nb_symbols; ++i) {
+    index.insert(0x1000 + (i * k_size), k_size, i);
+    ASSERT_EQ(index.find(0x1000 + (i * k_size)), i);
+  }
+  EXPECT_EQ(index.size(), k_nb_symbols);
+  // Overwrite every other symbol
+  for (int i = 0; i < k_nb_symbols; i += 2) {
+    index.insert(0x1000 + (i * k_size), k_size, k_nb_symbols + i);
+    EXPECT_EQ(index.find(0x1000 + (i * k_size) + 1), k_nb_symbols + i);
+  }
+  for (int i = 0; i < k_nb_symbols; ++i) {
+    ASSERT_EQ(index.find(0x1000 + (i * k_size) + k_size - 1),
+              i % 2 ? i : k_nb_symbols + i);
+  }
+}
+
+TEST(JITSymbolIndex, for_each_symbol) {
+  JITSymbolIndex index;
+  index.insert(0x1000, 0x100, 0);
+  index.insert(0x2000, 0x100, 1);
+  EXPECT_EQ(index.find(0x1000), 0);
+  // Overwritten by a newer region, still pending
+  index.insert(0x2000, 0x100, 2);
+  std::vector<SymbolIdx_t> symbols;
+  index.for_each_symbol(
+      [&symbols](SymbolIdx_t symbol_idx) { symbols.push_back(symbol_idx); });
+  std::ranges::sort(symbols);
+  EXPECT_EQ(symbols, (std::vector<SymbolIdx_t>{0, 1, 2}));
+  index.clear();
+  EXPECT_EQ(index.find(0x1000), -1);
+}
+
+} // namespace ddprof
@@ -3,6 +3,10 @@
 #include "jit/jitdump.hpp"
 #include "loghandle.hpp"
 
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
 namespace ddprof {
 
 TEST(JITTest, SimpleRead) {
@@ -30,4 +34,57 @@ TEST(JITTest, DotnetJITDump) {
   EXPECT_EQ(jit_dump.debug_info.size(), 0);
 }
 
+TEST(JITTest, IncrementalRead) {
+  LogHandle handle;
+  std::string const jit_path =
+      std::string(UNIT_TEST_DATA) + "/" + std::string("jit-simple-julia.dump");
+  std::ifstream input(jit_path, std::ios::binary);
+  std::string const content((std::istreambuf_iterator<char>(input)),
+                            std::istreambuf_iterator<char>());
+  std::string tmp_path =
+      (std::filesystem::temp_directory_path() / "jitdump-ut.XXXXXX").string();
+  int const fd = mkstemp(tmp_path.data());
+  ASSERT_NE(fd, -1);
+  close(fd);
+
+  FileTailState state;
+  JITDump jit_dump;
+  bool replaced;
+  // Writer is in the middle of a record
+  size_t const partial_size = content.size() / 2;
+  std::ofstream(tmp_path, std::ios::binary)
+      << content.substr(0, partial_size);
+  DDRes res = jitdump_read_tail(tmp_path, state, jit_dump, replaced);
+  EXPECT_FALSE(IsDDResFatal(res));
+  EXPECT_FALSE(replaced);
+  EXPECT_LT(state.offset, partial_size);
+  size_t const first_code_loads = jit_dump.code_load.size();
+  EXPECT_GT(first_code_loads, 0);
+
+  std::ofstream(tmp_path, std::ios::binary | std::ios::app)
+      << content.substr(partial_size);
+  JITDump appended;
+  res = jitdump_read_tail(tmp_path, state, appended, replaced);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_FALSE(replaced);
+  EXPECT_EQ(state.offset, content.size());
+  EXPECT_EQ(first_code_loads + appended.code_load.size(), 13);
+  EXPECT_EQ(jit_dump.debug_info.size() + appended.debug_info.size(), 8);
+
+  // Nothing new
+  JITDump unchanged;
+  res = jitdump_read_tail(tmp_path, state, unchanged, replaced);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_TRUE(unchanged.code_load.empty());
+
+  // Truncated then written again: parsed from the start
+  std::ofstream(tmp_path, std::ios::binary | std::ios::trunc)
+      << content.substr(0, partial_size);
+  JITDump rewritten;
+  res = jitdump_read_tail(tmp_path, state, rewritten, replaced);
+  EXPECT_TRUE(replaced);
+  EXPECT_EQ(rewritten.code_load.size(), first_code_loads);
+  std::filesystem::remove(tmp_path);
+}
+
 } // namespace ddprof
@@ -0,0 +1,141 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "kernel_symbol_lookup.hpp"
+
+#include "loghandle.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+// Fake procfs and sysfs
+struct KernelDir {
+  KernelDir() {
+    std::string tmpl = (std::filesystem::temp_directory_path() /
+                        "kernel_symbol_lookup-ut.XXXXXX")
+                           .string();
+    path = mkdtemp(tmpl.data());
+    std::filesystem::create_directories(proc());
+    std::filesystem::create_directories(sys() + "/kernel");
+  }
+  ~KernelDir() { std::filesystem::remove_all(path); }
+
+  [[nodiscard]] std::string proc() const { return path + "/proc"; }
+  [[nodiscard]] std::string sys() const { return path + "/sys"; }
+
+  void write(const std::string &file, std::string_view content) const {
+    std::ofstream out(path + file, std::ios::binary | std::ios::trunc);
+    out << content;
+  }
+
+  std::string path;
+};
+} // namespace
+
+TEST(KernelSymbolLookup, get_or_insert) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", "ffffffff81000000 T _text\n"
+                              "ffffffff81001000 T schedule\n"
+                              "ffffffff81002000 T do_syscall_64\n"
+                              "ffffffff81004000 T _etext\n"
+                              "ffffffffc0001000 T mod_func\t[mod_a]\n");
+  dir.write("/proc/modules", "mod_a 4096 0 - Live 0xffffffffc0001000\n");
+  KernelSymbolLookup lookup(dir.proc(), dir.sys());
+  SymbolTable symbol_table;
+  MapInfoTable mapinfo_table;
+  MapInfoIdx_t map_idx = k_mapinfo_idx_null;
+
+  SymbolIdx_t const schedule_idx = lookup.get_or_insert(
+      0xffffffff81001010, symbol_table, mapinfo_table, map_idx);
+  ASSERT_NE(schedule_idx, k_symbol_idx_null);
+  EXPECT_EQ(symbol_table[schedule_idx]._demangled_name, "schedule");
+  ASSERT_NE(map_idx, k_mapinfo_idx_null);
+  EXPECT_EQ(mapinfo_table[map_idx]._sopath, "[kernel.kallsyms]");
+
+  // Same symbol, same mapping
+  MapInfoIdx_t other_map_idx = k_mapinfo_idx_null;
+  EXPECT_EQ(lookup.get_or_insert(0xffffffff81001020, symbol_table,
+                                 mapinfo_table, other_map_idx),
+            schedule_idx);
+  EXPECT_EQ(other_map_idx, map_idx);
+  EXPECT_EQ(symbol_table.size(), 1);
+
+  SymbolIdx_t const mod_idx = lookup.get_or_insert(
+      0xffffffffc0001010, symbol_table, mapinfo_table, other_map_idx);
+  ASSERT_NE(mod_idx, k_symbol_idx_null);
+  EXPECT_EQ(symbol_table[mod_idx]._symname, "mod_func");
+  EXPECT_EQ(mapinfo_table[other_map_idx]._sopath, "[mod_a]");
+  EXPECT_EQ(mapinfo_table.size(), 2);
+
+  EXPECT_EQ(lookup.get_or_insert(0xffffffff80000000, symbol_table,
+                                 mapinfo_table, other_map_idx),
+            k_symbol_idx_null);
+
+  // Compaction removed the kernel symbol
+  TableRemap const symbol_remap = {k_table_idx_removed, 0};
+  lookup.remap(symbol_remap);
+  symbol_table.erase(symbol_table.begin());
+  EXPECT_EQ(lookup.get_or_insert(0xffffffffc0001010, symbol_table,
+                                 mapinfo_table, other_map_idx),
+            0);
+  EXPECT_EQ(lookup.get_or_insert(0xffffffff81001010, symbol_table,
+                                 mapinfo_table, other_map_idx),
+            1);
+}
+
+TEST(KernelSymbolLookup, module_change) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", "ffffffff81000000 T _text\n"
+                              "ffffffff81004000 T _etext\n"
+                              "ffffffffc0001000 T mod_a_func\t[mod_a]\n");
+  dir.write("/proc/modules", "mod_a 4096 0 - Live 0xffffffffc0001000\n");
+  KernelSymbolLookup lookup(dir.proc(), dir.sys());
+  SymbolTable symbol_table;
+  MapInfoTable mapinfo_table;
+  MapInfoIdx_t map_idx = k_mapinfo_idx_null;
+  SymbolIdx_t const mod_a_idx = lookup.get_or_insert(
+      0xffffffffc0001010, symbol_table, mapinfo_table, map_idx);
+  ASSERT_NE(mod_a_idx, k_symbol_idx_null);
+
+  // Another module loaded at the same address
+  dir.write("/proc/kallsyms", "ffffffff81000000 T _text\n"
+                              "ffffffffc0001000 T mod_b_func\t[mod_b]\n");
+  dir.write("/proc/modules", "mod_b 4096 0 - Live 0xffffffffc0001000\n");
+  lookup.cycle();
+  SymbolIdx_t const mod_b_idx = lookup.get_or_insert(
+      0xffffffffc0001010, symbol_table, mapinfo_table, map_idx);
+  ASSERT_NE(mod_b_idx, k_symbol_idx_null);
+  EXPECT_NE(mod_b_idx, mod_a_idx);
+  EXPECT_EQ(symbol_table[mod_b_idx]._symname, "mod_b_func");
+  EXPECT_EQ(mapinfo_table[map_idx]._sopath, "[mod_b]");
+}
+
+TEST(KernelSymbolLookup, hidden_addresses) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", "0000000000000000 T _text\n"
+                              "0000000000000000 T schedule\n");
+  dir.write("/proc/modules", "");
+  KernelSymbolLookup lookup(dir.proc(), dir.sys());
+  SymbolTable symbol_table;
+  MapInfoTable mapinfo_table;
+  MapInfoIdx_t map_idx = k_mapinfo_idx_null;
+  EXPECT_EQ(lookup.get_or_insert(0xffffffff81001010, symbol_table,
+                                 mapinfo_table, map_idx),
+            k_symbol_idx_null);
+  lookup.cycle();
+  EXPECT_TRUE(symbol_table.empty());
+  EXPECT_TRUE(mapinfo_table.empty());
+}
+
+} // namespace ddprof
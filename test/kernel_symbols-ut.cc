@@ -0,0 +1,193 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "kernel_symbols.hpp"
+
+#include "ddres.hpp"
+#include "loghandle.hpp"
+
+#include <array>
+#include <cstring>
+#include <elf.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+constexpr std::string_view k_kernel_lines =
+    "0000000000000000 A fixed_percpu_data\n"
+    "ffffffff81000000 T _text\n"
+    "ffffffff81000000 T startup_64\n"
+    "ffffffff81001000 t do_one_initcall\n"
+    "ffffffff81002000 T schedule\n"
+    "ffffffff81002000 T __schedule_alias\n"
+    "ffffffff81003000 D some_data\n"
+    "ffffffff81004000 T _etext\n"
+    "ffffffff82000000 d data_symbol\n";
+
+// Fake procfs and sysfs
+struct KernelDir {
+  KernelDir() {
+    std::string tmpl = (std::filesystem::temp_directory_path() /
+                        "kernel_symbols-ut.XXXXXX")
+                           .string();
+    path = mkdtemp(tmpl.data());
+    std::filesystem::create_directories(proc());
+    std::filesystem::create_directories(sys() + "/kernel");
+    write("/sys/kernel/notes", build_id_notes());
+  }
+  ~KernelDir() { std::filesystem::remove_all(path); }
+
+  [[nodiscard]] std::string proc() const { return path + "/proc"; }
+  [[nodiscard]] std::string sys() const { return path + "/sys"; }
+  [[nodiscard]] std::string cache() const { return path + "/cache"; }
+
+  void write(const std::string &file, std::string_view content) const {
+    std::ofstream out(path + file, std::ios::binary | std::ios::trunc);
+    out << content;
+  }
+
+  static std::string build_id_notes() {
+    std::array<unsigned char, 4> const build_id = {0xab, 0xcd, 0x01, 0x23};
+    Elf64_Nhdr const nhdr{.n_namesz = sizeof(ELF_NOTE_GNU),
+                          .n_descsz = build_id.size(),
+                          .n_type = NT_GNU_BUILD_ID};
+    std::string notes(reinterpret_cast<const char *>(&nhdr), sizeof(nhdr));
+    notes.append(ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU));
+    notes.append(reinterpret_cast<const char *>(build_id.data()),
+                 build_id.size());
+    return notes;
+  }
+
+  std::string path;
+};
+} // namespace
+
+TEST(KernelSymbols, find) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", std::string{k_kernel_lines} +
+                                  "ffffffffc0001000 t mod_init\t[mod_a]\n"
+                                  "ffffffffc0001100 T mod_func\t[mod_a]\n"
+                                  "ffffffffc0101000 t bpf_prog\t[bpf]\n");
+  dir.write("/proc/modules",
+            "mod_a 8192 1 - Live 0xffffffffc0001000\n");
+  KernelSymbols symbols({}, dir.proc(), dir.sys());
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  ASSERT_TRUE(symbols.available());
+  EXPECT_EQ(symbols.build_id(), "abcd0123");
+  EXPECT_EQ(symbols.nb_modules(), 1);
+  // Aliases are only counted once, data symbols are skipped
+  EXPECT_EQ(symbols.size(), 5);
+
+  auto symbol = symbols.find(0xffffffff81002010);
+  ASSERT_TRUE(symbol);
+  EXPECT_EQ(symbol->name, "schedule");
+  EXPECT_TRUE(symbol->module.empty());
+  EXPECT_EQ(symbol->start, 0xffffffff81002000);
+  EXPECT_EQ(symbols.find(0xffffffff81001fff)->name, "do_one_initcall");
+  EXPECT_FALSE(symbols.find(0xffffffff81004000));
+  EXPECT_FALSE(symbols.find(0xffffffff80000000));
+
+  symbol = symbols.find(0xffffffffc0001180);
+  ASSERT_TRUE(symbol);
+  EXPECT_EQ(symbol->name, "mod_func");
+  EXPECT_EQ(symbol->module, "mod_a");
+  // Out of the module
+  EXPECT_FALSE(symbols.find(0xffffffffc0101000));
+}
+
+TEST(KernelSymbols, hidden_addresses) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", "0000000000000000 T _text\n"
+                              "0000000000000000 T schedule\n"
+                              "0000000000000000 t mod_func\t[mod_a]\n");
+  dir.write("/proc/modules", "mod_a 8192 1 - Live 0x0000000000000000\n");
+  KernelSymbols symbols(dir.cache(), dir.proc(), dir.sys());
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  EXPECT_FALSE(symbols.available());
+  EXPECT_EQ(symbols.size(), 0);
+  EXPECT_FALSE(symbols.find(0));
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  EXPECT_FALSE(std::filesystem::exists(dir.cache()));
+}
+
+TEST(KernelSymbols, module_refresh) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", std::string{k_kernel_lines} +
+                                  "ffffffffc0001000 T mod_a_func\t[mod_a]\n"
+                                  "ffffffffc0003000 T mod_b_func\t[mod_b]\n");
+  dir.write("/proc/modules", "mod_a 4096 1 - Live 0xffffffffc0001000\n"
+                             "mod_b 4096 0 - Live 0xffffffffc0003000\n");
+  KernelSymbols symbols({}, dir.proc(), dir.sys());
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  uint64_t const signature = symbols.modules_signature();
+  EXPECT_EQ(symbols.find(0xffffffffc0003010)->name, "mod_b_func");
+
+  // Reference counts are not relevant
+  dir.write("/proc/modules", "mod_a 4096 2 - Live 0xffffffffc0001000\n"
+                             "mod_b 4096 0 - Live 0xffffffffc0003000\n");
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  EXPECT_EQ(symbols.modules_signature(), signature);
+
+  // mod_b is unloaded and mod_c loaded. Known symbols are not parsed again:
+  // the kernel symbols that are no longer listed remain.
+  dir.write("/proc/kallsyms", "ffffffff81000000 T _text\n"
+                              "ffffffffc0001000 T mod_a_renamed\t[mod_a]\n"
+                              "ffffffffc0005000 T mod_c_func\t[mod_c]\n");
+  dir.write("/proc/modules", "mod_a 4096 1 - Live 0xffffffffc0001000\n"
+                             "mod_c 4096 0 - Live 0xffffffffc0005000\n");
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  EXPECT_NE(symbols.modules_signature(), signature);
+  EXPECT_EQ(symbols.nb_modules(), 2);
+  EXPECT_EQ(symbols.find(0xffffffff81002000)->name, "schedule");
+  EXPECT_EQ(symbols.find(0xffffffffc0001000)->name, "mod_a_func");
+  EXPECT_FALSE(symbols.find(0xffffffffc0003010));
+  auto const symbol = symbols.find(0xffffffffc0005010);
+  ASSERT_TRUE(symbol);
+  EXPECT_EQ(symbol->name, "mod_c_func");
+  EXPECT_EQ(symbol->module, "mod_c");
+}
+
+TEST(KernelSymbols, disk_cache) {
+  LogHandle handle;
+  KernelDir const dir;
+  dir.write("/proc/kallsyms", k_kernel_lines);
+  dir.write("/proc/modules", "");
+  {
+    KernelSymbols symbols(dir.cache(), dir.proc(), dir.sys());
+    ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+    EXPECT_FALSE(symbols.loaded_from_cache());
+  }
+  EXPECT_TRUE(std::filesystem::exists(dir.cache() + "/kernel-abcd0123.sym"));
+
+  // Another boot: kernel symbols moved, only _text is read
+  dir.write("/proc/kallsyms", "ffffffff91000000 T _text\n");
+  KernelSymbols symbols(dir.cache(), dir.proc(), dir.sys());
+  ASSERT_TRUE(IsDDResOK(symbols.refresh()));
+  EXPECT_TRUE(symbols.loaded_from_cache());
+  EXPECT_EQ(symbols.size(), 3);
+  auto const symbol = symbols.find(0xffffffff91002010);
+  ASSERT_TRUE(symbol);
+  EXPECT_EQ(symbol->name, "schedule");
+  EXPECT_EQ(symbol->start, 0xffffffff91002000);
+  EXPECT_FALSE(symbols.find(0xffffffff91004000));
+
+  // Another kernel
+  dir.write("/sys/kernel/notes", "");
+  dir.write("/proc/kallsyms", k_kernel_lines);
+  KernelSymbols other_kernel(dir.cache(), dir.proc(), dir.sys());
+  ASSERT_TRUE(IsDDResOK(other_kernel.refresh()));
+  EXPECT_FALSE(other_kernel.loaded_from_cache());
+  EXPECT_TRUE(other_kernel.build_id().empty());
+}
+
+} // namespace ddprof
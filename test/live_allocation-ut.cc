@@ -135,4 +135,33 @@ TEST(LiveAllocationTest, stats) {
   EXPECT_EQ(live_alloc.get_nb_unmatched_deallocations(), 0);
 }
 
+TEST(LiveAllocationTest, remap) {
+  LogHandle handle;
+  UnwindOutput uo;
+  uo.pid = 12;
+  uo.tid = 12;
+  uo.locs.push_back({.ip = 0x1234, .symbol_idx = 4, .map_info_idx = 1});
+  uo.locs.push_back({.ip = 0x4321, .symbol_idx = 2, .map_info_idx = 0});
+
+  LiveAllocation live_alloc;
+  const uintptr_t addr = 0x10;
+  live_alloc.register_allocation(uo, addr, 10, 0, uo.pid);
+  // symbols 0, 1 and 3 were reclaimed
+  const TableRemap symbol_remap{k_table_idx_removed, k_table_idx_removed, 0,
+                                k_table_idx_removed, 1};
+  live_alloc.remap(symbol_remap, {});
+
+  auto &pid_stacks = live_alloc._watcher_vector[0][uo.pid];
+  ASSERT_EQ(pid_stacks._unique_stacks.size(), 1);
+  const UnwindOutput &remapped = pid_stacks._unique_stacks.begin()->first;
+  EXPECT_EQ(remapped.locs[0].symbol_idx, 1);
+  EXPECT_EQ(remapped.locs[0].map_info_idx, 1);
+  EXPECT_EQ(remapped.locs[1].symbol_idx, 0);
+
+  // address map still points to the stack
+  live_alloc.register_deallocation(addr, 0, uo.pid);
+  EXPECT_EQ(pid_stacks._address_map.size(), 0);
+  EXPECT_EQ(pid_stacks._unique_stacks.size(), 0);
+}
+
 } // namespace ddprof
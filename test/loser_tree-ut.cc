@@ -0,0 +1,79 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "loser_tree.hpp"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+
+namespace ddprof {
+
+namespace {
+constexpr int k_no_key = std::numeric_limits<int>::max();
+
+// Merge sorted sequences, returning the (value, source) pairs in merge order
+std::vector<std::pair<int, size_t>>
+merge(const std::vector<std::vector<int>> &sources) {
+  LoserTree<int> tree(sources.size(), k_no_key);
+  std::vector<size_t> positions(sources.size());
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (!sources[i].empty()) {
+      tree.set_key(i, sources[i][0]);
+    }
+  }
+  tree.rebuild();
+
+  std::vector<std::pair<int, size_t>> merged;
+  while (tree.top_key() != k_no_key) {
+    size_t const source = tree.top();
+    merged.emplace_back(tree.top_key(), source);
+    size_t const pos = ++positions[source];
+    tree.replace_top(pos < sources[source].size() ? sources[source][pos]
+                                                  : k_no_key);
+  }
+  return merged;
+}
+} // namespace
+
+TEST(LoserTree, single_source) {
+  auto merged = merge({{1, 2, 3}});
+  ASSERT_EQ(merged.size(), 3);
+  EXPECT_EQ(merged[2].first, 3);
+}
+
+TEST(LoserTree, ties_are_broken_by_source) {
+  auto merged = merge({{1, 5}, {1, 2}, {}, {1}});
+  std::vector<std::pair<int, size_t>> const expected{
+      {1, 0}, {1, 1}, {1, 3}, {2, 1}, {5, 0}};
+  EXPECT_EQ(merged, expected);
+}
+
+TEST(LoserTree, random_merge) {
+  std::mt19937 gen(42);
+  for (size_t nb_sources : {2, 3, 7, 16, 33}) {
+    std::vector<std::vector<int>> sources(nb_sources);
+    std::vector<int> all;
+    for (auto &source : sources) {
+      std::uniform_int_distribution<int> size_dist(0, 50);
+      std::uniform_int_distribution<int> value_dist(0, 1000);
+      source.resize(size_dist(gen));
+      for (int &value : source) {
+        value = value_dist(gen);
+      }
+      std::sort(source.begin(), source.end());
+      all.insert(all.end(), source.begin(), source.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto merged = merge(sources);
+    ASSERT_EQ(merged.size(), all.size());
+    for (size_t i = 0; i < all.size(); ++i) {
+      EXPECT_EQ(merged[i].first, all[i]);
+    }
+  }
+}
+
+} // namespace ddprof
@@ -0,0 +1,57 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "lru_cache.hpp"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+namespace ddprof {
+
+TEST(LRUCache, least_recently_used_is_evicted) {
+  LRUCache<int, std::string> cache(2);
+  cache.emplace(1, "one");
+  cache.emplace(2, "two");
+  // 1 becomes the most recently used
+  ASSERT_NE(cache.find(1), nullptr);
+  cache.emplace(3, "three");
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.find(2), nullptr);
+  ASSERT_NE(cache.find(1), nullptr);
+  EXPECT_EQ(*cache.find(3), "three");
+  EXPECT_EQ(cache.stats()._nb_evictions, 1);
+  EXPECT_EQ(cache.stats()._nb_hits, 3);
+  EXPECT_EQ(cache.stats()._nb_misses, 1);
+  cache.reset_stats();
+  EXPECT_EQ(cache.stats()._nb_hits, 0);
+}
+
+TEST(LRUCache, move_only_values) {
+  LRUCache<int, std::unique_ptr<int>> cache;
+  for (int i = 0; i < 10; ++i) {
+    cache.emplace(i, std::make_unique<int>(i));
+  }
+  // Replacing an element does not evict anything
+  cache.emplace(4, std::make_unique<int>(42));
+  EXPECT_EQ(**cache.find(4), 42);
+  EXPECT_EQ(cache.erase_if([](int key, const auto &) { return key % 2; }), 5);
+  EXPECT_EQ(cache.size(), 5);
+  // 4 was used last, then the insertion order is kept
+  EXPECT_EQ(cache.shrink(2), 3);
+  ASSERT_NE(cache.find(4), nullptr);
+  ASSERT_NE(cache.find(8), nullptr);
+  EXPECT_EQ(cache.find(0), nullptr);
+  int count = 0;
+  cache.for_each([&count](int, std::unique_ptr<int> &value) {
+    ASSERT_TRUE(value);
+    ++count;
+  });
+  EXPECT_EQ(count, 2);
+  EXPECT_TRUE(cache.erase(4));
+  EXPECT_FALSE(cache.erase(4));
+}
+
+} // namespace ddprof
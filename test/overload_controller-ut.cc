@@ -0,0 +1,37 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "overload_controller.hpp"
+
+#include <gtest/gtest.h>
+
+namespace ddprof {
+
+TEST(OverloadController, disabled) {
+  OverloadController controller({});
+  EXPECT_EQ(controller.update(100), OverloadTier::kNone);
+}
+
+TEST(OverloadController, tiers) {
+  std::vector<uint32_t> const thresholds{90, 50, 70};
+  OverloadController controller(thresholds);
+  EXPECT_EQ(controller.update(10), OverloadTier::kNone);
+  EXPECT_EQ(controller.update(55), OverloadTier::kNoSymbolization);
+  // escalate directly to the matching tier
+  EXPECT_EQ(controller.update(95), OverloadTier::kCountOnly);
+  // hysteresis: stay until the occupancy drops below half of the threshold
+  EXPECT_EQ(controller.update(80), OverloadTier::kCountOnly);
+  EXPECT_EQ(controller.update(44), OverloadTier::kTruncatedStack);
+  EXPECT_EQ(controller.update(34), OverloadTier::kNoSymbolization);
+  EXPECT_EQ(controller.update(30), OverloadTier::kNoSymbolization);
+  EXPECT_EQ(controller.update(24), OverloadTier::kNone);
+  EXPECT_EQ(controller.tier(), OverloadTier::kNone);
+}
+
+TEST(OverloadController, names) {
+  EXPECT_EQ(overload_tier_name(OverloadTier::kCountOnly), "count_only");
+}
+
+} // namespace ddprof
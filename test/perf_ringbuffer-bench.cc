@@ -0,0 +1,116 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "perf_ringbuffer.hpp"
+#include "perf_watcher.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+
+constexpr auto k_bench_sample_types = std::to_array<uint64_t>(
+    {k_default_sample_type, k_default_sample_type | PERF_SAMPLE_CALLCHAIN,
+     (k_default_sample_type & ~PERF_SAMPLE_STACK_USER) |
+         PERF_SAMPLE_CALLCHAIN});
+constexpr int k_nb_samples = 1024;
+constexpr size_t k_max_stack_size = 8192;
+
+// Synthetic perf samples serialized back to back with samp2hdr, with the
+// layout of the events of a ring buffer
+class SyntheticSamples {
+public:
+  explicit SyntheticSamples(uint64_t mask) {
+    std::vector<char> stack(k_max_stack_size);
+    for (size_t i = 0; i < stack.size(); ++i) {
+      stack[i] = static_cast<char>(i);
+    }
+    std::array<uint64_t, k_perf_register_count> regs{};
+    std::array<uint64_t, 33> ips{PERF_CONTEXT_USER};
+    for (size_t i = 1; i < ips.size(); ++i) {
+      ips[i] = 0x400000 + (i * 0x100);
+    }
+    for (int i = 0; i < k_nb_samples; ++i) {
+      perf_event_sample sample{};
+      sample.header.type = PERF_RECORD_SAMPLE;
+      sample.pid = 1000 + (i % 16);
+      sample.tid = sample.pid;
+      sample.time = i;
+      sample.period = 1000;
+      sample.nr = 2 + (i % (ips.size() - 2));
+      sample.ips = ips.data();
+      sample.abi = PERF_SAMPLE_REGS_ABI_64;
+      sample.regs = regs.data();
+      // Stacks of various depths
+      sample.size_stack = 512 * (1 + (i % (k_max_stack_size / 512)));
+      sample.data_stack = stack.data();
+      sample.dyn_size_stack = sample.size_stack;
+
+      std::vector<std::byte> event(sizeof(perf_event_header) +
+                                   sizeof(uint64_t) * (64 + ips.size()) +
+                                   regs.size() * sizeof(uint64_t) +
+                                   k_max_stack_size);
+      auto *hdr = reinterpret_cast<perf_event_header *>(event.data());
+      if (!samp2hdr(hdr, &sample, event.size(), mask)) {
+        exit(1);
+      }
+      _data.insert(_data.end(), event.begin(), event.begin() + hdr->size);
+    }
+  }
+
+  [[nodiscard]] const std::vector<std::byte> &data() const { return _data; }
+
+private:
+  std::vector<std::byte> _data;
+};
+
+template <typename Decode>
+void decode_ring(benchmark::State &state, Decode &&decode) {
+  uint64_t const mask = k_bench_sample_types[state.range(0)];
+  SyntheticSamples const samples(mask);
+  perf_event_sample sample;
+  for (auto _ : state) {
+    size_t pos = 0;
+    while (pos < samples.data().size()) {
+      const auto *hdr =
+          reinterpret_cast<const perf_event_header *>(&samples.data()[pos]);
+      benchmark::DoNotOptimize(decode(hdr, mask, sample));
+      benchmark::DoNotOptimize(sample);
+      pos += hdr->size;
+    }
+  }
+  state.counters["samples/s"] =
+      benchmark::Counter(static_cast<double>(state.iterations() * k_nb_samples),
+                         benchmark::Counter::kIsRate);
+}
+
+} // namespace
+
+// Decoding with the tests of all the fields of the sample type
+static void BM_Hdr2Samp(benchmark::State &state) {
+  decode_ring(state,
+              [](const perf_event_header *hdr, uint64_t mask,
+                 perf_event_sample &sample) {
+                return hdr2samp(hdr, mask, sample);
+              });
+}
+
+// Decoding with the decoder of the watchers
+static void BM_SampleDecoder(benchmark::State &state) {
+  SampleDecoder const decoder =
+      sample_decoder_from_mask(k_bench_sample_types[state.range(0)]);
+  decode_ring(state, decoder);
+}
+
+BENCHMARK(BM_Hdr2Samp)->DenseRange(0, k_bench_sample_types.size() - 1);
+BENCHMARK(BM_SampleDecoder)->DenseRange(0, k_bench_sample_types.size() - 1);
+
+} // namespace ddprof
@@ -7,7 +7,9 @@
 #include "perf_watcher.hpp" // for default sample type used in ddprof
 
 #include <gtest/gtest.h>
+#include <span>
 #include <stdio.h>
+#include <vector>
 
 namespace ddprof {
 
@@ -110,4 +112,137 @@ TEST(PerfRingbufferTest, SampleSymmetryx86) {
   ASSERT_TRUE(sample_eq(&sample, sample_new));
 }
 
+TEST(PerfRingbufferTest, CompactCopy) {
+  uint64_t const mask = perf_event_default_sample_type();
+  char stack[4096];
+  for (uint64_t i = 0; i < std::size(stack); i++) {
+    stack[i] = i & 255;
+  }
+  uint64_t regs[k_perf_register_count] = {};
+  for (size_t i = 0; i < k_perf_register_count; ++i) {
+    regs[i] = 1ull << i;
+  }
+  perf_event_sample sample = {};
+  sample.header.type = PERF_RECORD_SAMPLE;
+  sample.pid = 12;
+  sample.tid = 13;
+  sample.time = 14;
+  sample.period = 15;
+  sample.abi = PERF_SAMPLE_REGS_ABI_64;
+  sample.regs = regs;
+  sample.size_stack = std::size(stack);
+  sample.data_stack = stack;
+  // only the beginning of the stack was captured
+  sample.dyn_size_stack = 101;
+
+  alignas(uint64_t) std::byte event[2 * 4096] = {};
+  auto *hdr = reinterpret_cast<perf_event_header *>(event);
+  ASSERT_TRUE(samp2hdr(hdr, &sample, sizeof(event), mask));
+
+  alignas(uint64_t) std::byte copy[2 * 4096];
+  size_t const size = hdr_compact_copy(hdr, mask, copy);
+  const auto *copy_hdr = reinterpret_cast<const perf_event_header *>(copy);
+  EXPECT_EQ(copy_hdr->size, size);
+  EXPECT_LT(size, hdr->size - 3900);
+  EXPECT_EQ(size % sizeof(uint64_t), 0);
+
+  perf_event_sample copy_sample;
+  ASSERT_TRUE(hdr2samp(copy_hdr, mask, copy_sample));
+  EXPECT_EQ(copy_sample.pid, 12);
+  EXPECT_EQ(copy_sample.tid, 13);
+  EXPECT_EQ(copy_sample.time, 14);
+  EXPECT_EQ(copy_sample.period, 15);
+  EXPECT_EQ(copy_sample.size_stack, 101);
+  EXPECT_EQ(copy_sample.dyn_size_stack, 101);
+  EXPECT_EQ(memcmp(copy_sample.data_stack, stack, 101), 0);
+  EXPECT_EQ(memcmp(copy_sample.regs, regs, sizeof(regs)), 0);
+  EXPECT_EQ(hdr_time(copy_hdr, mask), 14);
+
+  // other events are copied as is
+  perf_event_header lost{PERF_RECORD_LOST, 0, sizeof(perf_event_header)};
+  EXPECT_EQ(hdr_compact_copy(&lost, mask, copy), sizeof(lost));
+}
+
+TEST(PerfRingbufferTest, SampleDecoders) {
+  char stack[512];
+  for (uint64_t i = 0; i < std::size(stack); i++) {
+    stack[i] = i & 255;
+  }
+  char raw[16] = {0};
+  uint64_t regs[k_perf_register_count] = {};
+  for (size_t i = 0; i < k_perf_register_count; ++i) {
+    regs[i] = 1ull << i;
+  }
+  uint64_t const ips[] = {PERF_CONTEXT_USER, 0x401000, 0x402000};
+  perf_event_sample sample = {};
+  sample.header.type = PERF_RECORD_SAMPLE;
+  sample.ip = 11;
+  sample.pid = 12;
+  sample.tid = 13;
+  sample.time = 14;
+  sample.addr = 15;
+  sample.period = 16;
+  sample.nr = std::size(ips);
+  sample.ips = ips;
+  sample.size_raw = sizeof(raw);
+  sample.data_raw = raw;
+  sample.abi = PERF_SAMPLE_REGS_ABI_64;
+  sample.regs = regs;
+  sample.size_stack = std::size(stack);
+  sample.data_stack = stack;
+  sample.dyn_size_stack = std::size(stack);
+
+  uint64_t const callchain_mask =
+      (k_default_sample_type & ~PERF_SAMPLE_STACK_USER) | PERF_SAMPLE_CALLCHAIN;
+  for (uint64_t const mask :
+       {k_default_sample_type, k_default_sample_type | PERF_SAMPLE_ADDR,
+        k_default_sample_type | PERF_SAMPLE_RAW,
+        k_default_sample_type | PERF_SAMPLE_CALLCHAIN, callchain_mask,
+        k_default_sample_type | PERF_SAMPLE_IP}) {
+    alignas(uint64_t) std::byte event[2 * 4096] = {};
+    auto *hdr = reinterpret_cast<perf_event_header *>(event);
+    ASSERT_TRUE(samp2hdr(hdr, &sample, sizeof(event), mask));
+
+    SampleDecoder const decoder = sample_decoder_from_mask(mask);
+    perf_event_sample decoded = {};
+    ASSERT_TRUE(decoder(hdr, mask, decoded));
+    perf_event_sample expected = {};
+    ASSERT_TRUE(hdr2samp(hdr, mask, expected));
+    EXPECT_TRUE(sample_eq(&expected, &decoded));
+    EXPECT_EQ(decoded.nr, (mask & PERF_SAMPLE_CALLCHAIN) ? std::size(ips) : 0);
+    EXPECT_EQ(decoded.ips, expected.ips);
+  }
+
+  // Other sample types are decoded by hdr2samp
+  SampleDecoder const generic_decoder = hdr2samp;
+  EXPECT_NE(sample_decoder_from_mask(k_default_sample_type), generic_decoder);
+  EXPECT_NE(sample_decoder_from_mask(callchain_mask), generic_decoder);
+  EXPECT_EQ(sample_decoder_from_mask(k_default_sample_type | PERF_SAMPLE_IP),
+            generic_decoder);
+  // Watchers decode any sample type until they are specialized
+  EXPECT_EQ(PerfWatcher{}.sample_decoder, generic_decoder);
+}
+
+TEST(PerfCallchain, split) {
+  std::vector<uint64_t> const ips = {PERF_CONTEXT_KERNEL, 0xffffffff81000010,
+                                     0xffffffff81000020, PERF_CONTEXT_USER,
+                                     0x401000,           0x402000,
+                                     0x403000};
+  PerfCallchain callchain = perf_callchain_split(ips);
+  ASSERT_EQ(callchain.kernel.size(), 2);
+  EXPECT_EQ(callchain.kernel[1], 0xffffffff81000020);
+  ASSERT_EQ(callchain.user.size(), 3);
+  EXPECT_EQ(callchain.user[0], 0x401000);
+  EXPECT_EQ(callchain.user[2], 0x403000);
+
+  // Sample taken in user mode
+  callchain = perf_callchain_split(std::span{ips}.subspan(3));
+  EXPECT_TRUE(callchain.kernel.empty());
+  EXPECT_EQ(callchain.user.size(), 3);
+
+  callchain = perf_callchain_split({});
+  EXPECT_TRUE(callchain.kernel.empty());
+  EXPECT_TRUE(callchain.user.empty());
+}
+
 } // namespace ddprof
@@ -0,0 +1,108 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "runtime_symbol_lookup.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace ddprof {
+
+namespace {
+constexpr pid_t k_pid = 1234;
+constexpr uint64_t k_symbol_size = 0x40;
+constexpr int k_appended_lines = 100;
+
+// Fake /proc hierarchy holding a perf-map that keeps growing, as a JIT
+// would write it
+class GrowingPerfMap {
+public:
+  GrowingPerfMap() {
+    std::string tmpl = (std::filesystem::temp_directory_path() /
+                        "perfmap_tail-bench.XXXXXX")
+                           .string();
+    _proc_dir = mkdtemp(tmpl.data());
+    std::filesystem::path const tmp_dir =
+        std::filesystem::path(_proc_dir) / "proc" / std::to_string(k_pid) /
+        "root/tmp";
+    std::filesystem::create_directories(tmp_dir);
+    _file = fopen(
+        (tmp_dir / ("perf-" + std::to_string(k_pid) + ".map")).c_str(), "w");
+  }
+  ~GrowingPerfMap() {
+    fclose(_file);
+    std::filesystem::remove_all(_proc_dir);
+  }
+
+  GrowingPerfMap(const GrowingPerfMap &) = delete;
+  GrowingPerfMap &operator=(const GrowingPerfMap &) = delete;
+
+  // Managed symbol names are long, this keeps the line count realistic
+  void append(uint64_t nb_lines) {
+    for (uint64_t i = 0; i < nb_lines; ++i) {
+      fprintf(_file,
+              "%lx %lx instance void [System.Private.CoreLib] "
+              "System.Collections.Generic.Dictionary`2[System.__Canon,"
+              "System.Int32]::TryInsert_%lu(!0,!1,uint8)[Optimized]\n",
+              next_addr(), k_symbol_size, _nb_lines);
+      ++_nb_lines;
+    }
+    fflush(_file);
+  }
+
+  void append_bytes(uint64_t nb_bytes) {
+    while (static_cast<uint64_t>(ftell(_file)) < nb_bytes) {
+      append(k_appended_lines);
+    }
+  }
+
+  [[nodiscard]] ProcessAddress_t last_addr() const {
+    return k_base_addr + ((_nb_lines - 1) * k_symbol_size);
+  }
+  [[nodiscard]] const std::string &proc_dir() const { return _proc_dir; }
+
+private:
+  static constexpr ProcessAddress_t k_base_addr = 0x7f0000000000;
+  [[nodiscard]] ProcessAddress_t next_addr() const {
+    return k_base_addr + (_nb_lines * k_symbol_size);
+  }
+
+  std::string _proc_dir;
+  FILE *_file{nullptr};
+  uint64_t _nb_lines{0};
+};
+} // namespace
+
+// Cost of picking up a few new JIT symbols in a large perf-map
+static void BM_perfmap_refresh(benchmark::State &state) {
+  GrowingPerfMap perfmap;
+  perfmap.append_bytes(state.range(0) * 1024 * 1024);
+  RuntimeSymbolLookup runtime_symbol_lookup(perfmap.proc_dir());
+  SymbolTable symbol_table;
+  // Initial parse
+  runtime_symbol_lookup.get_or_insert(k_pid, perfmap.last_addr(),
+                                      symbol_table);
+  for (auto _ : state) {
+    state.PauseTiming();
+    perfmap.append(k_appended_lines);
+    runtime_symbol_lookup.cycle();
+    state.ResumeTiming();
+    // Unknown address: the appended lines are parsed
+    SymbolIdx_t const symbol_idx = runtime_symbol_lookup.get_or_insert(
+        k_pid, perfmap.last_addr(), symbol_table);
+    benchmark::DoNotOptimize(symbol_idx);
+  }
+}
+
+BENCHMARK(BM_perfmap_refresh)
+    ->Arg(64)
+    ->Arg(500)
+    ->Unit(benchmark::kMicrosecond)
+    ->Iterations(100);
+
+} // namespace ddprof
@@ -0,0 +1,79 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "ddprof_cmdline_watcher.hpp"
+#include "pprof/ddprof_pprof.hpp"
+#include "symbol_hdr.hpp"
+#include "symbolizer.hpp"
+#include "unwind_output_mock.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<size_t> g_nb_allocations{0};
+} // namespace
+
+void *operator new(size_t size) {
+  g_nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  void *ptr = malloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+namespace ddprof {
+
+// Aggregate samples whose frames need symbolization (symbolization itself is
+// disabled to focus on the cost of the pprof conversion)
+static void BM_PProfAggregate(benchmark::State &state) {
+  SymbolHdr symbol_hdr;
+  UnwindOutput output;
+  fill_unwind_symbols(symbol_hdr._symbol_table, symbol_hdr._mapinfo_table,
+                      output);
+  FileInfoVector file_infos;
+  file_infos.emplace_back(FileInfo{}, k_file_info_error);
+  file_infos.emplace_back(FileInfo{"/app/bar.0.so", 0, 0}, 1);
+  for (size_t i = 0; i < output.locs.size() - 1; ++i) {
+    output.locs[i].symbol_idx = k_symbol_idx_null;
+    output.locs[i].file_info_id = 1;
+  }
+  output.locs.back().file_info_id = k_file_info_error;
+
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+  watchers_from_str("sCPU", ctx.watchers);
+  pprof_create_profile(&pprof, ctx);
+  Symbolizer symbolizer(false, true);
+
+  constexpr int k_nb_tids = 64;
+  size_t nb_samples = 0;
+  size_t const allocations_before = g_nb_allocations.load();
+  for (auto _ : state) {
+    output.pid = 1000;
+    output.tid = 1000 + static_cast<int>(nb_samples % k_nb_tids);
+    DDRes const res =
+        pprof_aggregate(&output, symbol_hdr, {1000, 1, 0}, &ctx.watchers[0],
+                        file_infos, false, kSumPos, &symbolizer, &pprof);
+    benchmark::DoNotOptimize(res);
+    ++nb_samples;
+  }
+  state.counters["allocs/sample"] = benchmark::Counter(
+      static_cast<double>(g_nb_allocations.load() - allocations_before) /
+      static_cast<double>(nb_samples));
+  state.SetItemsProcessed(static_cast<int64_t>(nb_samples));
+  pprof_free_profile(&pprof);
+}
+
+BENCHMARK(BM_PProfAggregate);
+
+} // namespace ddprof
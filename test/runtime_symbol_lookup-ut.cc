@@ -9,6 +9,8 @@
 #include "runtime_symbol_lookup.hpp"
 #include "symbol_table.hpp"
 
+#include <filesystem>
+#include <fstream>
 #include <string>
 
 namespace ddprof {
@@ -185,4 +187,96 @@ TEST(runtime_symbol_lookup, jitdump_vs_perfmap) {
   }
 }
 
+TEST(runtime_symbol_lookup, perfmap_append_and_truncate) {
+  LogHandle handle;
+  std::string proc_dir =
+      (std::filesystem::temp_directory_path() / "runtime_symbol_lookup.XXXXXX")
+          .string();
+  ASSERT_NE(mkdtemp(proc_dir.data()), nullptr);
+  constexpr pid_t k_pid = 12;
+  std::filesystem::path const tmp_dir =
+      std::filesystem::path(proc_dir) / "proc/12/root/tmp";
+  std::filesystem::create_directories(tmp_dir);
+  std::string const perfmap_path = tmp_dir / "perf-12.map";
+
+  RuntimeSymbolLookup runtime_symbol_lookup(proc_dir);
+  SymbolTable symbol_table;
+  auto lookup = [&](ProcessAddress_t pc) -> std::string {
+    runtime_symbol_lookup.cycle(); // failed lookups are retried every cycle
+    SymbolIdx_t const symbol_idx =
+        runtime_symbol_lookup.get_or_insert(k_pid, pc, symbol_table);
+    return symbol_idx == -1 ? "" : symbol_table[symbol_idx]._symname;
+  };
+
+  {
+    std::ofstream perfmap(perfmap_path);
+    perfmap << "1000 10 first\n2000 10 second\n3000 10 thi";
+  }
+  EXPECT_EQ(lookup(0x1004), "first");
+  // The last line is not complete yet
+  EXPECT_EQ(lookup(0x3004), "");
+  {
+    std::ofstream perfmap(perfmap_path, std::ios::app);
+    perfmap << "rd\n4000 10 fourth\n";
+  }
+  EXPECT_EQ(lookup(0x3004), "third");
+  EXPECT_EQ(lookup(0x4004), "fourth");
+  EXPECT_EQ(runtime_symbol_lookup.get_stats()._symbol_count, 4);
+
+  // Rewritten from scratch: previous symbols are dropped
+  {
+    std::ofstream perfmap(perfmap_path, std::ios::trunc);
+    perfmap << "5000 10 fifth\n";
+  }
+  EXPECT_EQ(lookup(0x5004), "fifth");
+  EXPECT_EQ(lookup(0x1004), "");
+  EXPECT_EQ(runtime_symbol_lookup.get_stats()._symbol_count, 1);
+
+  std::filesystem::remove_all(proc_dir);
+}
+
+TEST(runtime_symbol_lookup, remap) {
+  LogHandle handle;
+  std::string proc_dir =
+      (std::filesystem::temp_directory_path() / "runtime_symbol_lookup.XXXXXX")
+          .string();
+  ASSERT_NE(mkdtemp(proc_dir.data()), nullptr);
+  std::filesystem::path const tmp_dir =
+      std::filesystem::path(proc_dir) / "proc/12/root/tmp";
+  std::filesystem::create_directories(tmp_dir);
+  {
+    std::ofstream perfmap(tmp_dir / "perf-12.map");
+    perfmap << "1000 10 first\n2000 10 second\n";
+  }
+
+  RuntimeSymbolLookup runtime_symbol_lookup(proc_dir);
+  SymbolTable symbol_table;
+  SymbolIdx_t const first_idx =
+      runtime_symbol_lookup.get_or_insert(12, 0x1004, symbol_table);
+  ASSERT_EQ(symbol_table[first_idx]._symname, "first");
+  EXPECT_EQ(runtime_symbol_lookup.get_stats()._nb_jit_reads, 1);
+
+  // "first" is compacted away, "second" moves to index 0
+  TableRemap const remap = first_idx == 0
+      ? TableRemap{k_table_idx_removed, 0}
+      : TableRemap{0, k_table_idx_removed};
+  symbol_table.erase(symbol_table.begin() + first_idx);
+  runtime_symbol_lookup.remap(remap);
+  EXPECT_EQ(symbol_table.size(), 1);
+  EXPECT_EQ(symbol_table[runtime_symbol_lookup.get_or_insert(12, 0x2004,
+                                                             symbol_table)]
+                ._symname,
+            "second");
+  // The symbol is added again without parsing the file
+  SymbolIdx_t const new_first_idx =
+      runtime_symbol_lookup.get_or_insert(12, 0x1004, symbol_table);
+  ASSERT_NE(new_first_idx, -1);
+  EXPECT_EQ(symbol_table[new_first_idx]._symname, "first");
+  EXPECT_EQ(symbol_table.size(), 2);
+  EXPECT_EQ(runtime_symbol_lookup.get_stats()._nb_jit_reads, 1);
+  EXPECT_EQ(runtime_symbol_lookup.get_stats()._symbol_count, 2);
+
+  std::filesystem::remove_all(proc_dir);
+}
+
 } // namespace ddprof
@@ -14,6 +14,7 @@
 #include "unwind.hpp"
 
 #include <algorithm>
+#include <array>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -52,6 +53,33 @@ void funcA() {
 
 TEST(getcontext, getcontext) { funcA(); }
 
+// Stack usage is only recorded for samples whose stack copy was unwound:
+// hybrid samples unwound from their callchain would record no usage and
+// shrink the stack copies of the watcher
+TEST(getcontext, hybrid_stack_usage) {
+  UnwindState state = create_unwind_state().value();
+  uint64_t regs[k_nb_registers_to_unwind];
+  size_t const stack_size = save_context(retrieve_stack_bounds(), regs, stack);
+  std::array<uint64_t, 3> const callchain{
+      PERF_CONTEXT_USER, reinterpret_cast<uint64_t>(&funcB) + 1,
+      reinterpret_cast<uint64_t>(&funcA) + 1};
+
+  unwind_init_sample(&state, regs, getpid(), stack_size,
+                     reinterpret_cast<char *>(stack));
+  state.unwind_mode = EventConfUnwindMode::kHybrid;
+  state.callchain = callchain;
+  unwindstate_unwind(&state);
+  EXPECT_FALSE(state.process_hdr.get(getpid()).callchain_truncated());
+  EXPECT_FALSE(state.dwarf_unwound);
+  EXPECT_EQ(state.max_stack_read, 0);
+
+  unwind_init_sample(&state, regs, getpid(), stack_size,
+                     reinterpret_cast<char *>(stack));
+  unwindstate_unwind(&state);
+  EXPECT_TRUE(state.dwarf_unwound);
+  EXPECT_GT(state.max_stack_read, 0);
+}
+
 #if defined(__x86_64__) && !defined(MUSL_LIBC)
 // The matrix of where it works well is slightly more complex
 // There are also differences depending on vdso (as this can be a kernel
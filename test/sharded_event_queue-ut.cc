@@ -0,0 +1,92 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "sharded_event_queue.hpp"
+
+#include "ddres.hpp"
+#include "loghandle.hpp"
+
+#include <gtest/gtest.h>
+#include <mutex>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+struct TestEvent {
+  perf_event_header header;
+  uint32_t pid;
+  uint32_t seq;
+};
+} // namespace
+
+TEST(ShardedEventQueue, events_are_sharded_by_pid) {
+  LogHandle handle;
+  constexpr unsigned k_nb_shards = 4;
+  constexpr int k_nb_pids = 16;
+  constexpr uint32_t k_nb_events_per_pid = 10000;
+
+  // only accessed by the thread of the shard owning the pid
+  std::vector<std::vector<uint32_t>> seqs(k_nb_pids);
+  std::vector<unsigned> owner(k_nb_pids, k_nb_shards);
+  std::mutex mutex;
+  bool owner_mismatch = false;
+  ShardedEventQueue queue(
+      k_nb_shards,
+      [&](unsigned shard_idx, const perf_event_header *hdr, int watcher_pos) {
+        const auto *event = reinterpret_cast<const TestEvent *>(hdr);
+        EXPECT_EQ(watcher_pos, 1);
+        seqs[event->pid].push_back(event->seq);
+        if (owner[event->pid] == k_nb_shards) {
+          owner[event->pid] = shard_idx;
+        } else if (owner[event->pid] != shard_idx) {
+          const std::lock_guard lock{mutex};
+          owner_mismatch = true;
+        }
+        return DDRes{};
+      });
+  ASSERT_EQ(queue.nb_shards(), k_nb_shards);
+
+  for (uint32_t seq = 0; seq < k_nb_events_per_pid; ++seq) {
+    for (int pid = 0; pid < k_nb_pids; ++pid) {
+      TestEvent event{{PERF_RECORD_SAMPLE, 0, sizeof(TestEvent)},
+                      static_cast<uint32_t>(pid),
+                      seq};
+      ASSERT_TRUE(IsDDResOK(queue.push(pid, &event.header, 1)));
+    }
+  }
+  ASSERT_TRUE(IsDDResOK(queue.drain()));
+
+  EXPECT_FALSE(owner_mismatch);
+  for (int pid = 0; pid < k_nb_pids; ++pid) {
+    EXPECT_EQ(owner[pid], queue.shard_of(pid));
+    ASSERT_EQ(seqs[pid].size(), k_nb_events_per_pid);
+    for (uint32_t seq = 0; seq < k_nb_events_per_pid; ++seq) {
+      EXPECT_EQ(seqs[pid][seq], seq);
+    }
+  }
+}
+
+TEST(ShardedEventQueue, errors_are_reported) {
+  LogHandle handle;
+  ShardedEventQueue queue(
+      2, [](unsigned, const perf_event_header *hdr, int) {
+        return hdr->misc ? ddres_error(DD_WHAT_UW_ERROR) : DDRes{};
+      });
+  perf_event_header event{PERF_RECORD_SAMPLE, 0, sizeof(perf_event_header)};
+  ASSERT_TRUE(IsDDResOK(queue.push(1, &event, 0)));
+  ASSERT_TRUE(IsDDResOK(queue.drain()));
+
+  event.misc = 1;
+  ASSERT_TRUE(IsDDResOK(queue.push(1, &event, 0)));
+  EXPECT_TRUE(IsDDResFatal(queue.drain()));
+  // the error sticks to the failing shard
+  event.misc = 0;
+  EXPECT_TRUE(IsDDResOK(queue.push(2, &event, 0)));
+  EXPECT_TRUE(IsDDResOK(queue.push(1, &event, 0)));
+  EXPECT_TRUE(IsDDResFatal(queue.flush()));
+}
+
+} // namespace ddprof
@@ -0,0 +1,94 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_accumulator.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+namespace ddprof {
+
+namespace {
+UnwindOutput make_output(int pid, ProcessAddress_t ip,
+                         std::string_view thread_name) {
+  UnwindOutput output;
+  output.clear();
+  output.pid = pid;
+  output.tid = pid;
+  output.thread_name = thread_name;
+  output.locs.push_back({ip, ip, 0, 1, 2});
+  return output;
+}
+
+struct FoldedSample {
+  int watcher_pos;
+  UnwindOutput output;
+  DDProfValuePack pack;
+};
+
+std::vector<FoldedSample> fold(const StackAccumulator &accumulator) {
+  std::vector<FoldedSample> samples;
+  DDRes const res = accumulator.for_each(
+      [&](int watcher_pos, const UnwindOutput &output,
+          const DDProfValuePack &pack) {
+        samples.push_back({watcher_pos, output, pack});
+        return DDRes{};
+      });
+  EXPECT_TRUE(IsDDResOK(res));
+  return samples;
+}
+} // namespace
+
+TEST(StackAccumulator, identical_stacks_are_summed) {
+  StackAccumulator accumulator;
+  accumulator.add(0, make_output(1, 0x1000, "main"), {10, 1, 0});
+  accumulator.add(0, make_output(1, 0x1000, "main"), {5, 1, 0});
+  // different watcher
+  accumulator.add(1, make_output(1, 0x1000, "main"), {7, 1, 0});
+  // different stack
+  accumulator.add(0, make_output(1, 0x2000, "main"), {3, 1, 0});
+  EXPECT_EQ(accumulator.nb_stacks(), 3);
+
+  std::vector<FoldedSample> samples = fold(accumulator);
+  ASSERT_EQ(samples.size(), 3);
+  EXPECT_EQ(samples[0].watcher_pos, 0);
+  EXPECT_EQ(samples[0].pack.value, 15);
+  EXPECT_EQ(samples[0].pack.count, 2);
+  EXPECT_EQ(samples[1].watcher_pos, 1);
+  EXPECT_EQ(samples[1].pack.value, 7);
+  EXPECT_EQ(samples[2].output.locs[0].ip, 0x2000);
+
+  accumulator.clear();
+  EXPECT_TRUE(accumulator.empty());
+  EXPECT_TRUE(fold(accumulator).empty());
+}
+
+TEST(StackAccumulator, timestamped_samples_are_kept) {
+  StackAccumulator accumulator;
+  accumulator.add(0, make_output(1, 0x1000, "main"), {10, 1, 100});
+  accumulator.add(0, make_output(1, 0x1000, "main"), {5, 1, 200});
+  EXPECT_EQ(accumulator.nb_stacks(), 1);
+  EXPECT_EQ(accumulator.nb_timed_samples(), 2);
+
+  std::vector<FoldedSample> samples = fold(accumulator);
+  ASSERT_EQ(samples.size(), 2);
+  EXPECT_EQ(samples[0].pack.timestamp, 100);
+  EXPECT_EQ(samples[1].pack.timestamp, 200);
+  EXPECT_EQ(samples[1].pack.value, 5);
+}
+
+TEST(StackAccumulator, labels_outlive_their_source) {
+  StackAccumulator accumulator;
+  {
+    std::string thread_name = "worker";
+    accumulator.add(0, make_output(1, 0x1000, thread_name), {1, 1, 0});
+    thread_name = "overwritten";
+  }
+  std::vector<FoldedSample> samples = fold(accumulator);
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].output.thread_name, "worker");
+}
+
+} // namespace ddprof
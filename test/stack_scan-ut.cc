@@ -0,0 +1,118 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_scan.hpp"
+
+#include "prng.hpp"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+std::vector<std::byte> to_code(std::initializer_list<int> bytes) {
+  std::vector<std::byte> code;
+  for (int const byte : bytes) {
+    code.push_back(static_cast<std::byte>(byte));
+  }
+  return code;
+}
+} // namespace
+
+TEST(StackScan, find_code_addresses) {
+  std::vector<CodeRange> const ranges = {{.start = 0x1000, .end = 0x2000},
+                                         {.start = 0x5000, .end = 0x5100},
+                                         {.start = 0x9000, .end = 0xa000}};
+  xoshiro256ss rng{7};
+  std::vector<uint64_t> words(1001);
+  for (uint64_t &word : words) {
+    // Mostly out of the ranges, as on a stack
+    word = (rng() % 8 == 0) ? rng() % 0xb000 : rng();
+  }
+  words[0] = 0x1000;
+  words[1] = 0x2000;
+  words[words.size() - 1] = 0x9fff;
+
+  std::vector<uint32_t> positions;
+  find_code_addresses(words, ranges, positions);
+  std::vector<uint32_t> expected;
+  for (uint32_t pos = 0; pos < words.size(); ++pos) {
+    for (const CodeRange &range : ranges) {
+      if (words[pos] >= range.start && words[pos] < range.end) {
+        expected.push_back(pos);
+      }
+    }
+  }
+  EXPECT_EQ(positions, expected);
+  EXPECT_EQ(positions.front(), 0);
+  EXPECT_EQ(positions.back(), words.size() - 1);
+
+  positions.clear();
+  find_code_addresses(words, {}, positions);
+  EXPECT_TRUE(positions.empty());
+}
+
+#if defined(__x86_64__)
+TEST(StackScan, ends_with_call) {
+  // call rel32
+  EXPECT_TRUE(ends_with_call(to_code({0x90, 0x90, 0xe8, 1, 2, 3, 4})));
+  // call *%rax
+  EXPECT_TRUE(ends_with_call(to_code({0x90, 0x90, 0x90, 0x90, 0x90, 0xff,
+                                      0xd0})));
+  // call *0x8(%rax)
+  EXPECT_TRUE(ends_with_call(to_code({0x90, 0x90, 0x90, 0x90, 0xff, 0x50,
+                                      0x08})));
+  // call *0x10(%rip)
+  EXPECT_TRUE(ends_with_call(to_code({0x90, 0xff, 0x15, 0x10, 0, 0, 0})));
+  // call *0x20(%rsp,%rbx,8)
+  EXPECT_TRUE(ends_with_call(to_code({0x90, 0x90, 0x90, 0xff, 0x54, 0xdc,
+                                      0x20})));
+  // jmp *%rax
+  EXPECT_FALSE(ends_with_call(to_code({0x90, 0x90, 0x90, 0x90, 0x90, 0xff,
+                                       0xe0})));
+  // ret
+  EXPECT_FALSE(ends_with_call(to_code({0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+                                       0xc3})));
+  EXPECT_FALSE(ends_with_call({}));
+}
+#elif defined(__aarch64__)
+TEST(StackScan, ends_with_call) {
+  // bl
+  EXPECT_TRUE(ends_with_call(to_code({0x10, 0x00, 0x00, 0x94})));
+  // blr x8
+  EXPECT_TRUE(ends_with_call(to_code({0x00, 0x01, 0x3f, 0xd6})));
+  // ret
+  EXPECT_FALSE(ends_with_call(to_code({0xc0, 0x03, 0x5f, 0xd6})));
+  EXPECT_FALSE(ends_with_call({}));
+}
+#endif
+
+TEST(StackScan, code_reader) {
+  std::string const path =
+      (std::filesystem::temp_directory_path() / "stack_scan-ut.bin").string();
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "0123456789";
+  }
+  CodeReader reader;
+  std::array<std::byte, 4> code;
+  ASSERT_TRUE(reader.read_before(1, path, 6, code));
+  EXPECT_EQ(code[0], std::byte{'2'});
+  EXPECT_EQ(code[3], std::byte{'5'});
+  // Kept open
+  std::filesystem::remove(path);
+  EXPECT_TRUE(reader.read_before(1, path, 4, code));
+  EXPECT_FALSE(reader.read_before(1, path, 3, code));
+  EXPECT_FALSE(reader.read_before(1, path, 12, code));
+  reader.clear();
+  EXPECT_FALSE(reader.read_before(1, path, 6, code));
+}
+
+} // namespace ddprof
@@ -0,0 +1,64 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_usage.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace ddprof {
+
+TEST(StackUsage, tiers) {
+  EXPECT_EQ(stack_size_tiers(32000), (StackSizeTiers{8000, 32000, 60000}));
+  // Sizes are kept 8 bytes aligned
+  EXPECT_EQ(stack_size_tiers(16008)[0], 4000);
+  EXPECT_EQ(stack_size_tiers(2048), (StackSizeTiers{2048, 2048, 60000}));
+  EXPECT_EQ(stack_size_tiers(65528), (StackSizeTiers{16376, 65528, 65528}));
+}
+
+TEST(StackUsage, histogram) {
+  StackUsageHistogram histogram;
+  EXPECT_EQ(histogram.count(), 0);
+  for (int i = 0; i < 95; ++i) {
+    histogram.add(3000);
+  }
+  for (int i = 0; i < 5; ++i) {
+    histogram.add(40000);
+  }
+  EXPECT_EQ(histogram.count(), 100);
+  EXPECT_EQ(histogram.percentile(95), 3072);
+  EXPECT_EQ(histogram.percentile(100), 40960);
+  // Bigger stacks land in the last bucket
+  histogram.add(1000000);
+  EXPECT_EQ(histogram.percentile(100), 65536);
+
+  histogram.decay();
+  EXPECT_EQ(histogram.count(), 49);
+  EXPECT_EQ(histogram.percentile(95), 3072);
+}
+
+TEST(StackUsage, tier_from_usage) {
+  StackSizeTiers const tiers = stack_size_tiers(32000);
+  // No samples: keep the current size
+  EXPECT_EQ(stack_tier_from_usage(tiers, {}, 60000), 60000);
+
+  // Shallow stacks
+  std::vector<ProcessStackUsage> usages{{4096, 1000}, {7168, 500}};
+  EXPECT_EQ(stack_tier_from_usage(tiers, usages, 32000), 8000);
+
+  // A process that does not fit the copy, but is rarely sampled
+  usages.push_back({8192, 10});
+  EXPECT_EQ(stack_tier_from_usage(tiers, usages, 8000), 8000);
+
+  // Deep recursion in a busy process
+  usages.push_back({40960, 1000});
+  EXPECT_EQ(stack_tier_from_usage(tiers, usages, 8000), 60000);
+
+  // Stacks bigger than the largest copy
+  std::vector<ProcessStackUsage> const deep{{65536, 10}};
+  EXPECT_EQ(stack_tier_from_usage(tiers, deep, 32000), 60000);
+}
+
+} // namespace ddprof
@@ -0,0 +1,162 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "symbol_cache.hpp"
+
+#include "ddres.hpp"
+#include "loghandle.hpp"
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+struct CacheDir {
+  CacheDir() {
+    std::string tmpl = (std::filesystem::temp_directory_path() /
+                        "symbol_cache-ut.XXXXXX")
+                           .string();
+    path = mkdtemp(tmpl.data());
+  }
+  ~CacheDir() { std::filesystem::remove_all(path); }
+  std::string path;
+};
+
+// The name of the inlined function is derived from the outer one
+struct Frames {
+  explicit Frames(std::string_view name)
+      : inlined_name(std::string(name) + "_inlined"),
+        frames{{.name = inlined_name, .file = "inlined.h", .line = 12},
+               {.name = name, .file = "", .line = 0}} {}
+  std::string inlined_name;
+  std::vector<CachedFrame> frames;
+};
+
+std::vector<CachedFrame> make_frames(std::string_view name) {
+  static std::deque<Frames> s_frames;
+  return s_frames.emplace_back(name).frames;
+}
+} // namespace
+
+TEST(SymbolCache, round_trip) {
+  LogHandle handle;
+  CacheDir const dir;
+  std::string const path = dir.path + "/abcd.sym";
+  {
+    SymbolCacheFile file(path);
+    ASSERT_TRUE(IsDDResOK(file.load()));
+    EXPECT_EQ(file.size(), 0);
+    std::string name = "foo";
+    file.add(0x1000, make_frames(name));
+    // Strings are copied
+    name = "bar";
+    file.add(0x2000, make_frames("bar"));
+    // Already known
+    file.add(0x2000, make_frames("baz"));
+    EXPECT_EQ(file.find(0x1000)[1].name, "foo");
+    ASSERT_TRUE(IsDDResOK(file.flush()));
+  }
+  SymbolCacheFile file(path);
+  ASSERT_TRUE(IsDDResOK(file.load()));
+  EXPECT_EQ(file.size(), 2);
+  EXPECT_TRUE(file.find(0x3000).empty());
+  auto const frames = file.find(0x2000);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].name, "bar_inlined");
+  EXPECT_EQ(frames[0].file, "inlined.h");
+  EXPECT_EQ(frames[0].line, 12);
+  EXPECT_EQ(frames[1].name, "bar");
+  EXPECT_TRUE(frames[1].file.empty());
+
+  // Appended after the existing records
+  file.add(0x3000, make_frames("qux"));
+  ASSERT_TRUE(IsDDResOK(file.flush()));
+  SymbolCacheFile reloaded(path);
+  ASSERT_TRUE(IsDDResOK(reloaded.load()));
+  EXPECT_EQ(reloaded.size(), 3);
+  EXPECT_EQ(reloaded.find(0x3000)[1].name, "qux");
+}
+
+TEST(SymbolCache, interrupted_write) {
+  LogHandle handle;
+  CacheDir const dir;
+  std::string const path = dir.path + "/abcd.sym";
+  {
+    SymbolCacheFile file(path);
+    file.add(0x1000, make_frames("foo"));
+    file.add(0x2000, make_frames("bar"));
+    ASSERT_TRUE(IsDDResOK(file.flush()));
+  }
+  // Cut the last record
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+  {
+    SymbolCacheFile file(path);
+    ASSERT_TRUE(IsDDResOK(file.load()));
+    EXPECT_EQ(file.size(), 1);
+    EXPECT_TRUE(file.find(0x2000).empty());
+    file.add(0x2000, make_frames("bar"));
+    ASSERT_TRUE(IsDDResOK(file.flush()));
+  }
+  SymbolCacheFile file(path);
+  ASSERT_TRUE(IsDDResOK(file.load()));
+  EXPECT_EQ(file.size(), 2);
+  EXPECT_EQ(file.find(0x2000)[1].name, "bar");
+}
+
+TEST(SymbolCache, build_ids) {
+  LogHandle handle;
+  CacheDir const dir;
+  SymbolCache cache(dir.path + "/cache", 1024 * 1024, false);
+  ASSERT_TRUE(IsDDResOK(cache.init()));
+  EXPECT_EQ(cache.get(""), nullptr);
+  EXPECT_EQ(cache.get("../abcd"), nullptr);
+  SymbolCacheFile *file = cache.get("abcd");
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(cache.get("abcd"), file);
+  file->add(0x1000, make_frames("foo"));
+  cache.stats()._nb_misses = 1;
+  cache.cycle();
+  EXPECT_TRUE(std::filesystem::exists(dir.path + "/cache/abcd.sym"));
+  // Reported after the cycle
+  EXPECT_EQ(cache.cycle_stats()._nb_misses, 1);
+  EXPECT_EQ(cache.stats()._nb_misses, 0);
+
+  // Inlined functions are cached separately
+  SymbolCache inlined_cache(dir.path + "/cache", 1024 * 1024, true);
+  ASSERT_TRUE(IsDDResOK(inlined_cache.init()));
+  EXPECT_EQ(inlined_cache.get("abcd")->size(), 0);
+  SymbolCache other_cache(dir.path + "/cache", 1024 * 1024, false);
+  EXPECT_EQ(other_cache.get("abcd")->size(), 1);
+}
+
+TEST(SymbolCache, size_limit) {
+  LogHandle handle;
+  CacheDir const dir;
+  SymbolCache cache(dir.path, 1024 * 1024, false);
+  ASSERT_TRUE(IsDDResOK(cache.init()));
+  cache.get("aa")->add(0x1000, make_frames("foo"));
+  cache.cycle();
+  // Older than the next file
+  auto const old_time =
+      std::filesystem::file_time_type::clock::now() - std::chrono::hours{1};
+  std::filesystem::last_write_time(dir.path + "/aa.sym", old_time);
+  uint64_t const file_size = std::filesystem::file_size(dir.path + "/aa.sym");
+
+  SymbolCache bounded_cache(dir.path, (2 * file_size) - 1, false);
+  bounded_cache.get("bb")->add(0x1000, make_frames("bar"));
+  bounded_cache.cycle();
+  EXPECT_FALSE(std::filesystem::exists(dir.path + "/aa.sym"));
+  EXPECT_TRUE(std::filesystem::exists(dir.path + "/bb.sym"));
+  EXPECT_EQ(bounded_cache.get("bb")->find(0x1000)[1].name, "bar");
+}
+
+} // namespace ddprof
@@ -0,0 +1,136 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "ddprof_file_info.hpp"
+#include "mapinfo_table.hpp"
+#include "prng.hpp"
+#include "symbolizer.hpp"
+
+#include <array>
+#include <datadog/profiling.h>
+#include <filesystem>
+#include <link.h>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+constexpr FileInfoId_t k_file_id = 1;
+constexpr size_t k_nb_stacks = 1000;
+constexpr size_t k_stack_depth = 16;
+constexpr size_t k_nb_distinct_frames = 2000;
+
+// Frames of a profiling cycle: stacks drawn from the text section of this
+// binary, with a few frames shared by most stacks (as main or start_thread
+// are)
+struct FrameCorpus {
+  FrameCorpus() {
+    file_infos.emplace_back(FileInfo{}, k_file_info_error);
+    file_infos.emplace_back(
+        FileInfo{std::filesystem::read_symlink("/proc/self/exe"), 0, 0},
+        k_file_id);
+    mapinfo_table.emplace_back(0, 0, 0, std::string{file_infos[1].get_path()},
+                               BuildIdStr{});
+
+    ElfW(Phdr) text{};
+    dl_iterate_phdr(
+        [](dl_phdr_info *info, size_t, void *data) {
+          // The main program comes first
+          for (int i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X)) {
+              *static_cast<ElfW(Phdr) *>(data) = phdr;
+              break;
+            }
+          }
+          return 1;
+        },
+        &text);
+    xoshiro256ss rng{42};
+    std::vector<ElfAddress_t> frames(k_nb_distinct_frames);
+    for (ElfAddress_t &frame : frames) {
+      frame = text.p_vaddr + (rng() % text.p_memsz);
+    }
+    for (size_t i = 0; i < k_nb_stacks; ++i) {
+      std::vector<ElfAddress_t> &stack = stacks.emplace_back();
+      for (size_t depth = 0; depth < k_stack_depth; ++depth) {
+        // Skewed towards the first frames
+        uint64_t const pos = rng() % k_nb_distinct_frames;
+        stack.push_back(
+            frames[(pos * (rng() % k_nb_distinct_frames)) /
+                   k_nb_distinct_frames]);
+      }
+    }
+  }
+
+  FileInfoVector file_infos;
+  MapInfoTable mapinfo_table;
+  std::vector<std::vector<ElfAddress_t>> stacks;
+};
+
+// Only the reported addresses differ between elf and process formats
+DDRes symbolize_stack(Symbolizer &symbolizer, const FrameCorpus &corpus,
+                      std::vector<ElfAddress_t> &stack,
+                      std::span<ddog_prof_Location> locations) {
+  Symbolizer::BlazeResultsWrapper results;
+  unsigned write_index = 0;
+  return symbolizer.symbolize_pprof(stack, stack, k_file_id,
+                                    corpus.file_infos[k_file_id].get_path(),
+                                    corpus.mapinfo_table[0], locations,
+                                    write_index, results);
+}
+
+void set_counters(benchmark::State &state, size_t nb_calls) {
+  size_t const nb_frames =
+      state.iterations() * k_nb_stacks * k_stack_depth;
+  state.counters["calls"] = benchmark::Counter(
+      static_cast<double>(nb_calls), benchmark::Counter::kIsRate);
+  state.counters["time/frame"] = benchmark::Counter(
+      static_cast<double>(nb_frames),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+} // namespace
+
+// One symbolizer call per stack (and file)
+static void BM_SymbolizePerStack(benchmark::State &state) {
+  FrameCorpus corpus;
+  Symbolizer symbolizer;
+  std::array<ddog_prof_Location, kMaxStackDepth> locations;
+  for (auto _ : state) {
+    for (auto &stack : corpus.stacks) {
+      DDRes const res = symbolize_stack(symbolizer, corpus, stack, locations);
+      benchmark::DoNotOptimize(res);
+    }
+  }
+  set_counters(state, state.iterations() * k_nb_stacks);
+}
+
+// One symbolizer call per file for all the stacks of the cycle
+static void BM_SymbolizeBatch(benchmark::State &state) {
+  FrameCorpus corpus;
+  Symbolizer symbolizer;
+  std::array<ddog_prof_Location, kMaxStackDepth> locations;
+  for (auto _ : state) {
+    for (const auto &stack : corpus.stacks) {
+      for (ElfAddress_t const addr : stack) {
+        symbolizer.add_to_batch(k_file_id, addr, 0);
+      }
+    }
+    symbolizer.symbolize_batch(corpus.file_infos, corpus.mapinfo_table);
+    for (auto &stack : corpus.stacks) {
+      DDRes const res = symbolize_stack(symbolizer, corpus, stack, locations);
+      benchmark::DoNotOptimize(res);
+    }
+    symbolizer.end_batch();
+  }
+  set_counters(state, state.iterations());
+}
+
+BENCHMARK(BM_SymbolizePerStack)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SymbolizeBatch)->Unit(benchmark::kMillisecond);
+
+} // namespace ddprof
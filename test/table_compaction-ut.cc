@@ -0,0 +1,72 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "table_compaction.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_map>
+
+namespace ddprof {
+
+TEST(TableCompaction, untouched_elements_are_reclaimed) {
+  std::vector<std::string> table{"a", "b", "c", "d"};
+  EpochTracker tracker;
+  constexpr uint32_t k_max_age = 2;
+  // elements are seen during the first cycle
+  tracker.cycle(table.size());
+  for (int i = 0; i < 3; ++i) {
+    // only "b" and "d" are used
+    tracker.touch(1);
+    tracker.touch(3);
+    tracker.cycle(table.size());
+  }
+  EXPECT_EQ(tracker.count_stale(table.size(), k_max_age), 2);
+  TableRemap remap = compact_table(table, tracker, k_max_age);
+  ASSERT_EQ(table.size(), 2);
+  EXPECT_EQ(table[0], "b");
+  EXPECT_EQ(table[1], "d");
+  ASSERT_EQ(remap.size(), 4);
+  EXPECT_EQ(remap[0], k_table_idx_removed);
+  EXPECT_EQ(remap[1], 0);
+  EXPECT_EQ(remap[2], k_table_idx_removed);
+  EXPECT_EQ(remap[3], 1);
+  // epochs follow the elements
+  EXPECT_EQ(tracker.count_stale(table.size(), k_max_age), 0);
+}
+
+TEST(TableCompaction, new_elements_are_kept) {
+  std::vector<int> table{1, 2};
+  EpochTracker tracker;
+  constexpr uint32_t k_max_age = 1;
+  for (int i = 0; i < 3; ++i) {
+    tracker.cycle(table.size());
+  }
+  // inserted during the last cycle, never referenced yet
+  table.push_back(3);
+  TableRemap remap = compact_table(table, tracker, k_max_age);
+  ASSERT_EQ(table.size(), 1);
+  EXPECT_EQ(table[0], 3);
+  EXPECT_EQ(remap[2], 0);
+}
+
+TEST(TableCompaction, remap_map_values) {
+  const TableRemap remap{k_table_idx_removed, 0, 1};
+  std::unordered_map<int, int32_t> map{{10, 0}, {11, 1}, {12, 2}, {13, -1}};
+  remap_map_values(map, remap);
+  EXPECT_EQ(map.size(), 3);
+  EXPECT_EQ(map.count(10), 0);
+  EXPECT_EQ(map[11], 0);
+  EXPECT_EQ(map[12], 1);
+  // null values are kept as is
+  EXPECT_EQ(map[13], -1);
+
+  // An empty remap leaves indexes untouched
+  int32_t idx = 2;
+  EXPECT_TRUE(remap_index({}, idx));
+  EXPECT_EQ(idx, 2);
+}
+
+} // namespace ddprof
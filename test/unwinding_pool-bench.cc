@@ -0,0 +1,183 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "ddprof_base.hpp"
+#include "loghandle.hpp"
+#include "perf_ringbuffer.hpp"
+#include "savecontext.hpp"
+#include "unwind.hpp"
+#include "unwinding_pool.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace ddprof {
+
+namespace {
+
+constexpr uint64_t k_sample_type =
+    PERF_SAMPLE_TID | PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+// Samples are replayed for several processes so that they are spread over the
+// threads of the pool
+constexpr int k_nb_processes = 16;
+constexpr int k_max_depth = 32;
+
+struct CapturedStack {
+  uint64_t regs[k_perf_register_count];
+  std::vector<std::byte> stack;
+};
+
+// Stacks captured in this process at increasing depths, serialized as perf
+// samples the way they are read from the ring buffers
+class CapturedSamples {
+public:
+  CapturedSamples() {
+    unwind_init();
+    std::vector<CapturedStack> stacks;
+    for (int depth = 1; depth <= k_max_depth; ++depth) {
+      capture(depth, stacks);
+    }
+    // Children share the mappings of the captured stacks
+    for (int i = 0; i < k_nb_processes; ++i) {
+      pid_t const pid = fork();
+      if (pid == 0) {
+        pause();
+        _exit(0);
+      }
+      if (pid == -1) {
+        exit(1);
+      }
+      _pids.push_back(pid);
+    }
+    for (const CapturedStack &stack : stacks) {
+      for (pid_t const pid : _pids) {
+        serialize(stack, pid);
+      }
+    }
+  }
+
+  ~CapturedSamples() {
+    for (pid_t const pid : _pids) {
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+    }
+  }
+
+  CapturedSamples(const CapturedSamples &) = delete;
+  CapturedSamples &operator=(const CapturedSamples &) = delete;
+
+  [[nodiscard]] const std::vector<std::vector<std::byte>> &events() const {
+    return _events;
+  }
+
+private:
+  DDPROF_NOINLINE static void capture(int depth,
+                                      std::vector<CapturedStack> &stacks) {
+    if (depth > 1) {
+      capture(depth - 1, stacks);
+      DDPROF_BLOCK_TAIL_CALL_OPTIMIZATION();
+      return;
+    }
+    static std::byte buffer[k_default_perf_stack_sample_size];
+    CapturedStack &stack = stacks.emplace_back();
+    size_t const stack_size =
+        save_context(retrieve_stack_bounds(), stack.regs, buffer);
+    stack.stack.assign(buffer, buffer + stack_size);
+  }
+
+  void serialize(const CapturedStack &stack, pid_t pid) {
+    perf_event_sample sample{};
+    sample.header.type = PERF_RECORD_SAMPLE;
+    sample.pid = pid;
+    sample.tid = pid;
+    sample.abi = PERF_SAMPLE_REGS_ABI_64;
+    sample.regs = stack.regs;
+    sample.size_stack = stack.stack.size();
+    sample.data_stack = reinterpret_cast<const char *>(stack.stack.data());
+    sample.dyn_size_stack = stack.stack.size();
+
+    std::vector<std::byte> event(sizeof(perf_event_sample) +
+                                 stack.stack.size() +
+                                 sizeof(uint64_t) * k_perf_register_count);
+    auto *hdr = reinterpret_cast<perf_event_header *>(event.data());
+    if (!samp2hdr(hdr, &sample, event.size(), k_sample_type)) {
+      exit(1);
+    }
+    event.resize(hdr->size);
+    _events.push_back(std::move(event));
+  }
+
+  std::vector<pid_t> _pids;
+  std::vector<std::vector<std::byte>> _events;
+};
+
+const CapturedSamples &captured_samples() {
+  static const CapturedSamples data;
+  return data;
+}
+
+DDRes unwind_event(WorkerShard &shard, const perf_event_header *hdr,
+                   int watcher_pos) {
+  perf_event_sample sample;
+  if (!hdr2samp(hdr, k_sample_type, sample)) {
+    return ddres_warn(DD_WHAT_PERFSAMP);
+  }
+  UnwindState &us = shard.us;
+  unwind_init_sample(&us, sample.regs, sample.pid, sample.size_stack,
+                     sample.data_stack);
+  us.output.pid = sample.pid;
+  us.output.tid = sample.tid;
+  unwindstate_unwind(&us);
+  shard.stacks.add(watcher_pos, us.output, {1, 1, 0});
+  return {};
+}
+
+} // namespace
+
+// Samples per second unwound by the pool, depending on the number of threads
+static void BM_UnwindingPool(benchmark::State &state) {
+  LogHandle const handle(LL_WARNING);
+  const CapturedSamples &data = captured_samples();
+  std::vector<std::unique_ptr<WorkerShard>> shards;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    shards.push_back(std::make_unique<WorkerShard>(
+        create_unwind_state(-1, k_unlimited_max_profiled_pids).value(), false,
+        false, Symbolizer::k_process));
+  }
+  UnwindingPool pool(std::move(shards), unwind_event);
+  for (auto _ : state) {
+    for (const auto &event : data.events()) {
+      const auto *hdr = reinterpret_cast<const perf_event_header *>(
+          event.data());
+      perf_event_sample sample;
+      hdr2samp(hdr, k_sample_type, sample);
+      if (!IsDDResOK(pool.push(sample.pid, hdr, 0))) {
+        state.SkipWithError("Unable to push event");
+        return;
+      }
+    }
+    if (!IsDDResOK(pool.drain())) {
+      state.SkipWithError("Unwinding failed");
+      return;
+    }
+  }
+  state.counters["samples/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * data.events().size()),
+      benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_UnwindingPool)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace ddprof